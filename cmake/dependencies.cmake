@@ -1,6 +1,12 @@
 find_package(asio REQUIRED)
 find_package(spdlog REQUIRED)
 find_package(doctest REQUIRED)
+if (ENABLE_PERMESSAGE_DEFLATE)
+  find_package(ZLIB REQUIRED)
+endif()
+if (ENABLE_TLS)
+  find_package(OpenSSL 3 REQUIRED)
+endif()
 
 include(FetchContent)
 
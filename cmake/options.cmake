@@ -1 +1,3 @@
 option(ENABLE_TESTS "Enable Unit tests" ON)
+option(ENABLE_PERMESSAGE_DEFLATE "Enable permessage-deflate for websockets" OFF)
+option(ENABLE_TLS "Enable HTTPS through OpenSSL" OFF)
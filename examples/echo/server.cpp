@@ -2,12 +2,15 @@
 #include <spdlog/spdlog.h>
 
 #include <asio/io_context.hpp>
+#include <chrono>
 #include <coro/async_generator.hpp>
 
 #include "coro/sync_wait.hpp"
 #include "http-server/enum.h"
 #include "http-server/http-server.h"
+#include "http-server/middleware.h"
 #include "http-server/route.h"
+#include "http-server/sync-route.h"
 using namespace std::chrono_literals;
 
 struct Handler : public hs::Handler {
@@ -32,12 +35,55 @@ struct Route : public hs::Route {
   }
 };
 
+// Answered without a handler coroutine.
+struct Health : public hs::SyncRoute {
+  hs::Method GetMethod() const override { return hs::Method::GET; }
+  std::string GetPath() const override { return "/health"; }
+  hs::SimpleResponse Respond(const hs::Request &) const override {
+    return {.headers = {{"Content-Type", "application/json"}},
+            .body = R"({"status":"up"})"};
+  }
+};
+
+// Where the time went so far, per route and phase, as folded stacks
+// (e.g. curl localhost:5555/traces | flamegraph.pl > traces.svg).
+struct Traces : public hs::SyncRoute {
+  Traces(const hs::HttpServer &server) : server(server) {}
+  hs::Method GetMethod() const override { return hs::Method::GET; }
+  std::string GetPath() const override { return "/traces"; }
+  hs::SimpleResponse Respond(const hs::Request &) const override {
+    return {.headers = {{"Content-Type", "text/plain"}},
+            .body = server.TraceBreakdown()};
+  }
+  const hs::HttpServer &server;
+};
+
+// Logs how long each request took, composed at compile time.
+struct Timing {
+  template <typename Next>
+  coro::async_generator<hs::Response> Handle(hs::Request req, Next next) {
+    auto start = std::chrono::steady_clock::now();
+    auto gen = next(req);
+    for (auto it = co_await gen.begin(); it != gen.end();) {
+      co_yield *it;
+      co_await ++it;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    spdlog::info("{} took {}us", req.Path(),
+                 std::chrono::duration_cast<std::chrono::microseconds>(elapsed)
+                     .count());
+  }
+};
+
 int main(int argc, char *argv[]) {
   asio::io_context io_context;
   // asio::signal_set signals(io_context, SIGINT, SIGTERM);
-  auto server =
-      std::make_shared<hs::HttpServer>(hs::Config("echo", "localhost", 5555));
-  server->AddRoute(std::make_shared<Route>());
+  hs::Config config("echo", "localhost", 5555);
+  config.tracing = true;
+  auto server = std::make_shared<hs::HttpServer>(config);
+  server->AddRoute(std::make_shared<Health>());
+  server->AddRoute(std::make_shared<Traces>(*server));
+  server->AddRoute(hs::WithMiddleware(std::make_shared<Route>(), Timing{}));
   std::jthread t([&]() { coro::sync_wait(server->ServeAsync(io_context)); });
   std::this_thread::sleep_for(1s);
   // signals.async_wait([&](auto, auto) { io_context.stop(); });
@@ -24,7 +24,9 @@ int main(int argc, char *argv[]) {
   asio::io_context io_context;
   auto server = std::make_shared<hs::HttpServer>(
       hs::Config("file-server", "localhost", 55555));
-  server->AddRoute(std::make_shared<hs::StaticRoute>("/", base_dir));
+  server->AddRoute(std::make_shared<hs::StaticRoute>(
+      "/", base_dir,
+      hs::StaticOptions{.index = true, .list_directories = true}));
   std::jthread t([&]() { coro::sync_wait(server->ServeAsync(io_context)); });
   std::this_thread::sleep_for(1s);
   io_context.run();
@@ -9,6 +9,7 @@
 
 #include "coro/sync_wait.hpp"
 #include "http-server/http-server.h"
+#include "http-server/offload.h"
 #include "http-server/route.h"
 using namespace std::literals::chrono_literals;
 
@@ -33,7 +34,7 @@ struct Handler : public hs::Handler {
           "\r\n--hs-bd\r\n");
       co_yield resp;
 
-      std::this_thread::sleep_for(1s);
+      co_await hs::sleep_for(1s);
     }
   }
 };
@@ -0,0 +1,39 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include <spdlog/common.h>
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "coro/sync_wait.hpp"
+#include "http-server/http-server.h"
+#include "http-server/proxy.h"
+using namespace std::literals::chrono_literals;
+
+// Forwards everything under /api to the upstreams given as arguments, e.g.
+//   proxy 127.0.0.1:8081 127.0.0.1:8082
+int main(int argc, char *argv[]) {
+  spdlog::set_level(spdlog::level::debug);
+  if (argc < 2) {
+    spdlog::error("No upstreams given");
+    exit(1);
+  }
+  hs::ProxyOptions options;
+  for (int i = 1; i < argc; ++i) options.upstreams.emplace_back(argv[i]);
+  options.health_check_path = "/health";
+  auto upstreams = std::make_shared<hs::Upstreams>(options);
+
+  asio::io_context io_context;
+  auto server =
+      std::make_shared<hs::HttpServer>(hs::Config("proxy", "localhost", 55555));
+  for (auto method : {hs::Method::GET, hs::Method::POST}) {
+    server->AddRoute(
+        std::make_shared<hs::ProxyRoute>(method, "/api", upstreams));
+  }
+  std::jthread t([&]() { coro::sync_wait(server->ServeAsync(io_context)); });
+  std::this_thread::sleep_for(1s);
+  io_context.run();
+  return 0;
+}
@@ -0,0 +1,65 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+// Measures the cost of a rate limit check with 1 to 2 * hardware_concurrency
+// threads checking at once, first all on one hot key, then each on its own
+// share of a million keys, more than the table holds.
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "http-server/internal/rate-limit.h"
+
+constexpr size_t kChecks = 1000000;
+constexpr size_t kKeys = 1000000;
+
+void Run(size_t threads, bool hot_key) {
+  hs::internal::RateLimiter limiter({.rate = 1000, .burst = 100});
+  std::vector<std::string> keys;
+  if (!hot_key) {
+    for (size_t i = 0; i < kKeys; ++i) {
+      keys.push_back(fmt::format("10.{}.{}.{}", i >> 16, (i >> 8) & 255,
+                                 i & 255));
+    }
+  }
+  std::atomic<size_t> allowed{0};
+  std::atomic<bool> go{false};
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t]() {
+      while (!go) std::this_thread::yield();
+      size_t count = 0;
+      for (size_t i = 0; i < kChecks; ++i) {
+        auto key = hot_key ? std::string_view("hot")
+                           : std::string_view(keys[(t * kChecks + i) % kKeys]);
+        count += limiter.Check(key).allowed;
+      }
+      allowed += count;
+    });
+  }
+  auto start = std::chrono::steady_clock::now();
+  go = true;
+  for (auto &worker : workers) worker.join();
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  // Each thread makes kChecks checks over elapsed.
+  spdlog::info("{:>8} key, {:>3} threads: {:6.1f} ns/check, {:6.1f}M checks/s, "
+               "{} allowed",
+               hot_key ? "hot" : "distinct", threads, elapsed.count() / kChecks,
+               threads * kChecks / elapsed.count() * 1e3, allowed.load());
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_threads = 2 * std::max(1u, std::thread::hardware_concurrency());
+  for (bool hot_key : {true, false}) {
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+      Run(threads, hot_key);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,44 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include <spdlog/spdlog.h>
+
+#include <asio/io_context.hpp>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include "coro/sync_wait.hpp"
+#include "http-server/http-server.h"
+#include "http-server/route.h"
+#include "http-server/sse.h"
+using namespace std::chrono_literals;
+
+struct Route : public hs::Route {
+  Route(hs::Broadcaster::Ptr broadcaster) : broadcaster(broadcaster) {}
+  hs::Method GetMethod() const override { return hs::Method::GET; }
+  std::string GetPath() const override { return "/events"; }
+  hs::Handler::Ptr GetHandler() const override {
+    return std::make_shared<hs::SseHandler>(broadcaster);
+  }
+  bool Unmetered() const override { return true; }
+  hs::Broadcaster::Ptr broadcaster;
+};
+
+int main(int argc, char *argv[]) {
+  asio::io_context io_context;
+  auto broadcaster = std::make_shared<hs::Broadcaster>(io_context);
+  auto server =
+      std::make_shared<hs::HttpServer>(hs::Config("sse", "localhost", 5555));
+  server->AddRoute(std::make_shared<Route>(broadcaster));
+  std::jthread t([&]() { coro::sync_wait(server->ServeAsync(io_context)); });
+  std::jthread ticker([&](std::stop_token stop) {
+    for (int tick = 0; !stop.stop_requested(); ++tick) {
+      broadcaster->Publish({.data = fmt::format("tick {}", tick),
+                            .event = "tick",
+                            .id = fmt::format("{}", tick)});
+      std::this_thread::sleep_for(1s);
+    }
+  });
+  std::this_thread::sleep_for(1s);
+  io_context.run();
+  return 0;
+}
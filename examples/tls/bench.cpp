@@ -0,0 +1,186 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+// Serves HTTPS on loopback with a throwaway self-signed certificate and
+// measures full and resumed handshakes per second, then the throughput of
+// one keep-alive connection.
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <asio/connect.hpp>
+#include <asio/io_context.hpp>
+#include <asio/ip/tcp.hpp>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "coro/sync_wait.hpp"
+#include "http-server/http-server.h"
+#include "http-server/sync-route.h"
+using namespace std::chrono_literals;
+using asio::ip::tcp;
+
+constexpr uint16_t kPort = 5556;
+constexpr int kHandshakes = 1000;
+constexpr int kRequests = 200;
+const std::string kPayload(1024 * 1024, 'x');
+
+struct Small : public hs::SyncRoute {
+  hs::Method GetMethod() const override { return hs::Method::GET; }
+  std::string GetPath() const override { return "/"; }
+  hs::SimpleResponse Respond(const hs::Request &) const override {
+    return {.body = "ok"};
+  }
+};
+struct Large : public hs::SyncRoute {
+  hs::Method GetMethod() const override { return hs::Method::GET; }
+  std::string GetPath() const override { return "/payload"; }
+  hs::SimpleResponse Respond(const hs::Request &) const override {
+    return {.body = std::string_view(kPayload)};
+  }
+};
+
+void WriteSelfSigned(const std::string &cert_path,
+                     const std::string &key_path) {
+  EVP_PKEY *key = EVP_EC_gen("P-256");
+  X509 *cert = X509_new();
+  X509_set_version(cert, 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+  X509_set_pubkey(cert, key);
+  auto name = X509_get_subject_name(cert);
+  X509_NAME_add_entry_by_txt(
+      name, "CN", MBSTRING_ASC,
+      reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0);
+  X509_set_issuer_name(cert, name);
+  X509_sign(cert, key, EVP_sha256());
+  FILE *file = std::fopen(cert_path.c_str(), "w");
+  PEM_write_X509(file, cert);
+  std::fclose(file);
+  file = std::fopen(key_path.c_str(), "w");
+  PEM_write_PrivateKey(file, key, nullptr, nullptr, 0, nullptr, nullptr);
+  std::fclose(file);
+  X509_free(cert);
+  EVP_PKEY_free(key);
+}
+
+// A blocking TLS client connection.
+class Client {
+ public:
+  Client(asio::io_context &io_context, SSL_CTX *ctx, SSL_SESSION *session)
+      : socket_(io_context), ssl_(SSL_new(ctx)) {
+    socket_.connect({asio::ip::make_address_v4("127.0.0.1"), kPort});
+    SSL_set_fd(ssl_, socket_.native_handle());
+    if (session) SSL_set_session(ssl_, session);
+    if (SSL_connect(ssl_) != 1) throw std::runtime_error("handshake failed");
+  }
+  ~Client() {
+    // Without close_notify OpenSSL won't resume the session.
+    SSL_shutdown(ssl_);
+    SSL_free(ssl_);
+  }
+  bool Resumed() const { return SSL_session_reused(ssl_) == 1; }
+
+  // Returns the size of the response body.
+  size_t Get(std::string_view path) {
+    auto request = fmt::format("GET {} HTTP/1.1\r\nHost: localhost\r\n\r\n",
+                               path);
+    SSL_write(ssl_, request.data(), request.size());
+    std::string response;
+    size_t end;
+    while ((end = response.find("\r\n\r\n")) == std::string::npos) {
+      Read(response);
+    }
+    auto header = response.find("Content-Length: ");
+    size_t length = std::stoul(response.substr(header + 16));
+    while (response.size() < end + 4 + length) Read(response);
+    return length;
+  }
+
+ private:
+  void Read(std::string &into) {
+    char buffer[64 * 1024];
+    int n = SSL_read(ssl_, buffer, sizeof(buffer));
+    if (n <= 0) throw std::runtime_error("connection closed");
+    into.append(buffer, n);
+  }
+
+  tcp::socket socket_;
+  SSL *ssl_;
+};
+
+SSL_SESSION *last_session = nullptr;
+
+int KeepSession(SSL *, SSL_SESSION *session) {
+  if (last_session) SSL_SESSION_free(last_session);
+  last_session = session;
+  return 1;
+}
+
+void Handshakes(asio::io_context &io_context, SSL_CTX *ctx, bool resume) {
+  int resumed = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kHandshakes; ++i) {
+    Client client(io_context, ctx, resume ? last_session : nullptr);
+    client.Get("/");
+    resumed += client.Resumed();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  spdlog::info("{} handshakes: {:.0f}/s ({} resumed)",
+               resume ? "resumed" : "full", kHandshakes / elapsed.count(),
+               resumed);
+}
+
+void Throughput(asio::io_context &io_context, SSL_CTX *ctx) {
+  Client client(io_context, ctx, nullptr);
+  size_t bytes = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kRequests; ++i) bytes += client.Get("/payload");
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  spdlog::info("throughput: {:.1f} MiB/s", bytes / elapsed.count() / (1 << 20));
+}
+
+int main(int argc, char *argv[]) {
+  auto dir = std::filesystem::temp_directory_path();
+  auto cert = (dir / "http-server-bench.crt").string();
+  auto key = (dir / "http-server-bench.key").string();
+  WriteSelfSigned(cert, key);
+
+  asio::io_context io_context;
+  hs::Config config("tls-bench", "localhost", kPort);
+  config.tls_certificate_chain = cert;
+  config.tls_private_key = key;
+  auto server = std::make_shared<hs::HttpServer>(config);
+  server->AddRoute(std::make_shared<Small>());
+  server->AddRoute(std::make_shared<Large>());
+  // Serving never returns; the process exits under it.
+  std::thread([&]() { coro::sync_wait(server->ServeAsync(io_context)); })
+      .detach();
+  std::this_thread::sleep_for(1s);
+  std::jthread io([&]() { io_context.run(); });
+
+  asio::io_context client_context;
+  SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+  SSL_CTX_set_session_cache_mode(
+      ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(ctx, KeepSession);
+  Handshakes(client_context, ctx, false);
+  Handshakes(client_context, ctx, true);
+  Throughput(client_context, ctx);
+  SSL_CTX_free(ctx);
+
+  io_context.stop();
+  std::filesystem::remove(cert);
+  std::filesystem::remove(key);
+  return 0;
+}
@@ -0,0 +1,35 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include <spdlog/spdlog.h>
+
+#include <asio/io_context.hpp>
+#include <coro/task.hpp>
+
+#include "coro/sync_wait.hpp"
+#include "http-server/http-server.h"
+#include "http-server/websocket.h"
+using namespace std::chrono_literals;
+
+struct Handler : public hs::WebSocketHandler {
+  coro::task<> Handle(const hs::Request req, hs::WebSocket ws) override {
+    spdlog::info("WebSocket opened on {}", req.Path());
+    auto messages = ws.Receive();
+    for (auto it = co_await messages.begin(); it != messages.end();
+         co_await ++it) {
+      auto message = *it;
+      co_await ws.Send(message.data, message.type);
+    }
+    spdlog::info("WebSocket closed");
+  }
+};
+WEBSOCKET_ROUTE(EchoRoute, "/ws", std::make_shared<Handler>);
+
+int main(int argc, char *argv[]) {
+  asio::io_context io_context;
+  auto server = std::make_shared<hs::HttpServer>(
+      hs::Config("websocket", "localhost", 5555));
+  server->AddRoute(std::make_shared<EchoRoute>());
+  std::jthread t([&]() { coro::sync_wait(server->ServeAsync(io_context)); });
+  std::this_thread::sleep_for(1s);
+  io_context.run();
+  return 0;
+}
@@ -0,0 +1,63 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_CACHE_H
+#define HTTP_SERVER_CACHE_H
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "http-server/route.h"
+namespace hs {
+
+namespace internal {
+class ResponseCacheImpl;
+}  // namespace internal
+
+struct CacheOptions {
+  std::chrono::seconds ttl{60};
+  // Bound on the bytes held by all entries; least recently used go first.
+  size_t max_bytes = 64 * 1024 * 1024;
+  // Larger responses are passed through without being cached.
+  size_t max_entry_bytes = 1024 * 1024;
+  // Request headers whose values are part of the cache key.
+  std::vector<std::string> vary;
+};
+
+// GET responses keyed by path, query and the vary headers.
+// Concurrent misses on one key run the handler once and share its response.
+class ResponseCache {
+ public:
+  typedef std::shared_ptr<ResponseCache> Ptr;
+
+  ResponseCache(CacheOptions options = {});
+  ~ResponseCache();
+  size_t Size() const;
+  size_t Bytes() const;
+  void Clear() const;
+
+ private:
+  friend class CachedRoute;
+  std::shared_ptr<internal::ResponseCacheImpl> pimpl_;
+};
+
+// Wraps route so its 200 responses are served from cache. Responses that
+// set cookies or Cache-Control no-store/private are never cached. Requests
+// with Authorization or Cookie, unless listed in vary, or with
+// Cache-Control no-store bypass the cache; no-cache ones skip the stored
+// response and store the fresh one.
+class CachedRoute : public Route {
+ public:
+  CachedRoute(Route::Ptr route, ResponseCache::Ptr cache);
+  Method GetMethod() const override;
+  std::string GetPath() const override;
+  Handler::Ptr GetHandler() const override;
+  size_t MaxConcurrency() const override;
+  bool Unmetered() const override;
+
+ private:
+  Route::Ptr route_;
+  ResponseCache::Ptr cache_;
+};
+}  // namespace hs
+#endif  // !#ifndef HTTP_SERVER_CACHE_H
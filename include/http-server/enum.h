@@ -3,6 +3,8 @@
 #define HTTP_SERVER_ENUM_H
 #include <fmt/core.h>
 #include <fmt/format.h>
+
+#include <string_view>
 namespace hs {
 
 enum class Method {
@@ -16,12 +18,21 @@ enum class Method {
   //  TRACE,
   //  CONNECT
 };
-enum Version { HTTP_1_0, HTTP_1_1 };
+enum Version { HTTP_1_0, HTTP_1_1, HTTP_2 };
 enum StatusCode {
+  SwitchingProtocols = 101,
   Ok = 200,
+  MovedPermanently = 301,
   BadRequest = 400,
   NotFound = 404,
-  InternalServerError = 500
+  PayloadTooLarge = 413,
+  UnsupportedMediaType = 415,
+  UpgradeRequired = 426,
+  TooManyRequests = 429,
+  InternalServerError = 500,
+  BadGateway = 502,
+  ServiceUnavailable = 503,
+  GatewayTimeout = 504
 };
 }  // namespace hs
 
@@ -47,15 +58,140 @@ struct formatter<hs::StatusCode> {
       -> decltype(ctx.out()) {
     if (presentation == 'd') return fmt::format_to(ctx.out(), "{}", (int)code);
     switch (code) {
+      case hs::SwitchingProtocols:
+        return fmt::format_to(ctx.out(), "SwitchingProtocols");
       case hs::Ok:
         return fmt::format_to(ctx.out(), "Ok");
+      case hs::MovedPermanently:
+        return fmt::format_to(ctx.out(), "MovedPermanently");
       case hs::BadRequest:
         return fmt::format_to(ctx.out(), "BadRequest");
       case hs::NotFound:
         return fmt::format_to(ctx.out(), "NotFound");
+      case hs::PayloadTooLarge:
+        return fmt::format_to(ctx.out(), "PayloadTooLarge");
+      case hs::UnsupportedMediaType:
+        return fmt::format_to(ctx.out(), "UnsupportedMediaType");
+      case hs::UpgradeRequired:
+        return fmt::format_to(ctx.out(), "UpgradeRequired");
+      case hs::TooManyRequests:
+        return fmt::format_to(ctx.out(), "TooManyRequests");
+      case hs::BadGateway:
+        return fmt::format_to(ctx.out(), "BadGateway");
+      case hs::ServiceUnavailable:
+        return fmt::format_to(ctx.out(), "ServiceUnavailable");
+      case hs::GatewayTimeout:
+        return fmt::format_to(ctx.out(), "GatewayTimeout");
       case hs::InternalServerError:
-      default:
         return fmt::format_to(ctx.out(), "InternalServerError");
+      default:
+        return fmt::format_to(ctx.out(), "{}", Reason(code));
+    }
+  }
+
+  // Reasons of the other standard codes, such as those a proxy relays, and
+  // of the class of nonstandard ones.
+  static constexpr std::string_view Reason(int code) {
+    switch (code) {
+      case 100:
+        return "Continue";
+      case 201:
+        return "Created";
+      case 202:
+        return "Accepted";
+      case 203:
+        return "NonAuthoritativeInformation";
+      case 204:
+        return "NoContent";
+      case 205:
+        return "ResetContent";
+      case 206:
+        return "PartialContent";
+      case 300:
+        return "MultipleChoices";
+      case 302:
+        return "Found";
+      case 303:
+        return "SeeOther";
+      case 304:
+        return "NotModified";
+      case 305:
+        return "UseProxy";
+      case 307:
+        return "TemporaryRedirect";
+      case 308:
+        return "PermanentRedirect";
+      case 401:
+        return "Unauthorized";
+      case 402:
+        return "PaymentRequired";
+      case 403:
+        return "Forbidden";
+      case 405:
+        return "MethodNotAllowed";
+      case 406:
+        return "NotAcceptable";
+      case 407:
+        return "ProxyAuthenticationRequired";
+      case 408:
+        return "RequestTimeout";
+      case 409:
+        return "Conflict";
+      case 410:
+        return "Gone";
+      case 411:
+        return "LengthRequired";
+      case 412:
+        return "PreconditionFailed";
+      case 414:
+        return "UriTooLong";
+      case 416:
+        return "RangeNotSatisfiable";
+      case 417:
+        return "ExpectationFailed";
+      case 421:
+        return "MisdirectedRequest";
+      case 422:
+        return "UnprocessableContent";
+      case 428:
+        return "PreconditionRequired";
+      case 431:
+        return "RequestHeaderFieldsTooLarge";
+      case 451:
+        return "UnavailableForLegalReasons";
+      case 501:
+        return "NotImplemented";
+      case 505:
+        return "HttpVersionNotSupported";
+    }
+    if (code >= 100 && code < 200) return "Informational";
+    if (code >= 200 && code < 300) return "Success";
+    if (code >= 300 && code < 400) return "Redirection";
+    if (code >= 400 && code < 500) return "ClientError";
+    return "ServerError";
+  }
+};
+template <>
+struct formatter<hs::Method> {
+  template <typename ParseContext>
+  constexpr auto parse(ParseContext &ctx) {
+    return ctx.begin();
+  };
+
+  template <typename FormatContext>
+  auto format(const hs::Method &m, FormatContext &ctx) -> decltype(ctx.out()) {
+    switch (m) {
+      case hs::Method::POST:
+        return fmt::format_to(ctx.out(), "POST");
+      case hs::Method::PUT:
+        return fmt::format_to(ctx.out(), "PUT");
+      case hs::Method::DELETE:
+        return fmt::format_to(ctx.out(), "DELETE");
+      case hs::Method::HEAD:
+        return fmt::format_to(ctx.out(), "HEAD");
+      case hs::Method::GET:
+      default:
+        return fmt::format_to(ctx.out(), "GET");
     }
   }
 };
@@ -71,6 +207,8 @@ struct formatter<hs::Version> {
     switch (v) {
       case hs::HTTP_1_0:
         return fmt::format_to(ctx.out(), "HTTP/1.0");
+      case hs::HTTP_2:
+        return fmt::format_to(ctx.out(), "HTTP/2");
       case hs::HTTP_1_1:
       default:
         return fmt::format_to(ctx.out(), "HTTP/1.1");
@@ -0,0 +1,80 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_FORM_H
+#define HTTP_SERVER_FORM_H
+#include <coro/async_generator.hpp>
+#include <coro/task.hpp>
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "http-server/request.h"
+namespace hs {
+
+// Bounds on what a form body may contain. Going over any of them fails the
+// request with 413.
+struct FormLimits {
+  size_t max_parts = 128;
+  // Header block of one multipart part.
+  size_t max_header_size = 8 * 1024;
+  // Body of one part; file parts included.
+  size_t max_part_size = 64 * 1024 * 1024;
+  // One urlencoded name=value pair, and a part ReadForm keeps in memory.
+  size_t max_field_size = 1024 * 1024;
+};
+
+// Headers of one multipart/form-data part. The views stay valid until the
+// next part begins.
+struct FormPart {
+  std::vector<std::pair<std::string_view, std::string_view>> headers;
+
+  // Case-insensitive lookup.
+  std::optional<std::string_view> Header(std::string_view name) const;
+  // From Content-Disposition.
+  std::string_view Name() const;
+  std::optional<std::string_view> Filename() const;
+  // Content-Type, text/plain when absent.
+  std::string_view ContentType() const;
+};
+
+// A piece of a part's body as it comes off the connection. Each part ends
+// with an empty chunk that has end set. data is valid until the next chunk
+// is requested.
+struct FormChunk {
+  const FormPart *part;
+  std::string_view data;
+  bool end;
+};
+
+// Parses a multipart/form-data body while it is read. Memory stays bounded
+// by the read size and limits.max_header_size, whatever the body's size.
+coro::async_generator<FormChunk> ParseMultipart(Request req,
+                                                FormLimits limits = {});
+
+// Parses an application/x-www-form-urlencoded body while it is read,
+// yielding decoded name/value pairs valid until the next one is requested.
+coro::async_generator<std::pair<std::string_view, std::string_view>>
+ParseUrlEncoded(Request req, FormLimits limits = {});
+
+struct FormField {
+  std::string name;
+  // The value of a plain field; empty for files.
+  std::string value;
+  // Set for file parts, which are written to path instead of memory.
+  std::optional<std::string> filename;
+  std::string content_type;
+  std::filesystem::path path;
+  size_t size = 0;
+};
+
+// Reads a multipart or urlencoded form. File parts are streamed into new
+// files under upload_dir, the writes going through the worker pool; other
+// fields are kept in memory. Removing the files is up to the caller.
+coro::task<std::vector<FormField>> ReadForm(Request req,
+                                            std::filesystem::path upload_dir,
+                                            FormLimits limits = {});
+}  // namespace hs
+#endif  // !#ifndef HTTP_SERVER_FORM_H
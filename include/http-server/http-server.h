@@ -5,6 +5,7 @@
 #include <fmt/core.h>
 
 #include <asio/io_context.hpp>
+#include <chrono>
 #include <coro/task.hpp>
 #include <cstdint>
 #include <functional>
@@ -13,9 +14,12 @@
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <vector>
 
 #include "http-server/enum.h"
+#include "http-server/middleware.h"
 #include "http-server/route.h"
+#include "http-server/trace.h"
 
 namespace hs {
 
@@ -23,10 +27,130 @@ namespace internal {
 class HttpServerImpl;
 }  // namespace internal
 
+// Settings for the listening socket and accepted connections. Zero keeps
+// the operating system's default. Options the platform lacks or refuses are
+// logged and skipped.
+struct SocketOptions {
+  bool tcp_nodelay = true;
+  // Linux: wake the acceptor only once a connection has data, waiting at
+  // most defer_accept (TCP_DEFER_ACCEPT).
+  std::chrono::seconds defer_accept{0};
+  // Pending TCP Fast Open connections to queue; zero turns it off.
+  int fast_open_queue = 0;
+  // Zero uses SOMAXCONN.
+  int backlog = 0;
+  int send_buffer_size = 0;
+  int receive_buffer_size = 0;
+  // Linux: busy poll the device queue this long before sleeping on a read
+  // (SO_BUSY_POLL); values above net.core.busy_read need CAP_NET_ADMIN.
+  std::chrono::microseconds busy_poll{0};
+  // An IPv6 listener also takes IPv4 connections.
+  bool dual_stack = true;
+  bool reuse_address = true;
+};
+
+// What a rate limit counts requests by.
+enum class RateLimitKey {
+  // The client's IP address; clients on a Unix socket share one count.
+  RemoteAddress,
+  // The value of header; requests without it aren't limited.
+  Header,
+  // The path parameter at path_param; routes without it aren't limited.
+  PathParam,
+};
+
+// Lets each key make rate requests per second with bursts of up to burst,
+// checked once a request has matched its route, before its handler runs.
+// Requests over the limit get 429 with RateLimit-Limit, RateLimit-Remaining,
+// RateLimit-Reset and Retry-After.
+struct RateLimit {
+  RateLimitKey key = RateLimitKey::RemoteAddress;
+  std::string header;
+  size_t path_param = 0;
+  double rate = 10;
+  size_t burst = 20;
+  // Paths, as the routes give them, that the limit applies to; empty for
+  // all routes.
+  std::vector<std::string> routes;
+  // Keys tracked at once, 16 bytes each, allocated up front. A key is
+  // forgotten once its burst has refilled; with the table full, new keys
+  // take the place of the keys closest to that.
+  size_t max_keys = 1 << 18;
+};
+
 struct Config {
   std::string program_name;
+  // Host name or address to listen on; empty or "*" listens on all
+  // interfaces, IPv6 and, with dual_stack, IPv4.
   std::string bind_address;
   uint16_t port;
+  // Listen on this Unix domain socket instead of bind_address and port.
+  std::string unix_socket_path;
+  SocketOptions socket_options;
+  // Threads serving connections. With zero everything runs on the
+  // io_context given to ServeAsync; otherwise that context only accepts and
+  // each connection is handed to one of io_threads threads, each running
+  // its own io_context.
+  size_t io_threads = 0;
+  // Linux: pin io thread i to io_cpus[i % size], or, with io_cpus empty, to
+  // the i-th CPU the process may use, taking one NUMA node's CPUs before
+  // the next. Pinned threads allocate their connections' buffers
+  // themselves, which keeps that memory on their node.
+  bool pin_io_threads = false;
+  std::vector<int> io_cpus;
+  // Linux: give each connection to the io thread pinned to the CPU its
+  // packets arrive on (SO_INCOMING_CPU), or else to one on the same NUMA
+  // node. Pair it with RSS or RPS spreading receive queues over those CPUs.
+  bool steer_connections = false;
+  // Accept HTTP/2 over cleartext, both with prior knowledge and through an
+  // HTTP/1.1 "Upgrade: h2c" request.
+  bool http2 = true;
+  uint32_t http2_max_concurrent_streams = 100;
+  uint32_t http2_initial_window_size = 65535;
+  // HTTP/2 request bodies are buffered whole before the handler runs; a
+  // larger one is answered with 413 and its stream reset.
+  size_t http2_max_body_size = 16 * 1024 * 1024;
+  // WebSocket connections are pinged every websocket_ping_interval (zero
+  // disables it) and dropped when no pong arrives within
+  // websocket_pong_timeout, which also bounds the closing handshake.
+  std::chrono::milliseconds websocket_ping_interval{30000};
+  std::chrono::milliseconds websocket_pong_timeout{10000};
+  size_t websocket_max_message_size = 16 * 1024 * 1024;
+  // Negotiate permessage-deflate, only available when built with
+  // ENABLE_PERMESSAGE_DEFLATE.
+  bool websocket_deflate = true;
+  // Admission control: requests over a limit get 503 with Retry-After
+  // without running their handler. max_in_flight caps requests across all
+  // routes, zero for no cap. With adaptive_concurrency the cap moves (AIMD):
+  // it grows while requests finish within adaptive_latency_target and
+  // shrinks, down to adaptive_min_limit, when they don't.
+  size_t max_in_flight = 0;
+  bool adaptive_concurrency = false;
+  std::chrono::milliseconds adaptive_latency_target{100};
+  size_t adaptive_min_limit = 8;
+  std::chrono::seconds retry_after{1};
+  // Checked in order; the first limit a request is over answers it.
+  std::vector<RateLimit> rate_limits;
+  // HTTPS, only available when built with ENABLE_TLS: set both PEM file
+  // paths to serve TLS on port. ALPN offers h2 (when http2 is on) and
+  // http/1.1. Reconnecting clients resume their session, skipping the full
+  // handshake, through session tickets or a server side cache of
+  // tls_session_cache_size sessions (zero turns the cache off). With
+  // tls_ktls, Linux kernels with the tls module encrypt records themselves
+  // after the handshake.
+  std::string tls_certificate_chain;
+  std::string tls_private_key;
+  bool tls_session_tickets = true;
+  size_t tls_session_cache_size = 20 * 1024;
+  std::chrono::seconds tls_session_timeout{7200};
+  bool tls_ktls = true;
+  // Time the phases of every HTTP/1.x request into a per-route breakdown
+  // (HttpServer::TraceBreakdown) and hand requests slower than
+  // trace_slow_threshold, or answered with a 5xx, to the exporter set with
+  // HttpServer::SetTraceExporter. Incoming W3C traceparent headers are
+  // continued.
+  bool tracing = false;
+  std::chrono::milliseconds trace_slow_threshold{100};
   Config(const std::string &program_name, const std::string &bind_address,
          uint16_t port);
 };
@@ -36,7 +160,23 @@ class HttpServer : public std::enable_shared_from_this<HttpServer> {
   typedef std::shared_ptr<HttpServer> Ptr;
 
   HttpServer(const Config &config);
+  // Routes can be changed while serving; requests already matched finish
+  // on the route they matched. AddRoute replaces the route with the same
+  // method and path.
   void AddRoute(const Route::Ptr &route);
+  bool RemoveRoute(Method method, const std::string &path);
+  // Atomically swaps in a table of exactly routes.
+  void ReplaceRoutes(const std::vector<Route::Ptr> &routes);
+  // Runs middleware around the handlers of all routes, outermost first.
+  // Register middleware before serving.
+  void Use(const Middleware::Ptr &middleware);
+  // Matches requests in table, e.g. a CompiledRoutes of routes known at
+  // build time, before the routes added above. Set it before serving.
+  void UseRouteTable(RouteTable::Ptr table);
+  void SetTraceExporter(TraceExporter::Ptr exporter);
+  // Time spent per route and phase so far, as folded stacks for flame
+  // graph tools.
+  std::string TraceBreakdown() const;
   coro::task<void> ServeAsync(asio::io_context &io_context);
   ~HttpServer();
 
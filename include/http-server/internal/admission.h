@@ -0,0 +1,67 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_INTERNAL_ADMISSION_H
+#define HTTP_SERVER_INTERNAL_ADMISSION_H
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "http-server/http-server.h"
+#include "http-server/internal/rate-limit.h"
+#include "http-server/internal/request-impl.h"
+#include "http-server/route.h"
+namespace hs::internal {
+
+// Decides whether a matched request may run its handler now. Admit hands out
+// a Permit that holds the request's slot until it is destroyed, and feeds
+// the request's latency to the adaptive limit. Rate limits are checked
+// first, through RateLimited.
+class AdmissionController {
+ public:
+  class Permit {
+   public:
+    Permit(AdmissionController *controller, const Route *route, bool metered);
+    Permit(Permit &&other);
+    Permit(const Permit &) = delete;
+    ~Permit();
+
+   private:
+    AdmissionController *controller_;
+    const Route *route_;
+    bool metered_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  AdmissionController(const Config &config);
+  std::optional<Permit> Admit(const Route &route);
+  // Headers of the 429 answering request when it is over one of the
+  // configured rate limits, nullopt when it may go on to Admit.
+  std::optional<Headers> RateLimited(const Route &route,
+                                     const RequestImpl &request);
+  // Adjusts the adaptive limit for one finished request.
+  void RecordLatency(std::chrono::steady_clock::duration latency);
+
+  size_t InFlight() const;
+  size_t Limit() const;
+
+ private:
+  void Release(const Route *route, bool metered);
+
+  const size_t max_in_flight_;
+  const bool adaptive_;
+  const std::chrono::steady_clock::duration latency_target_;
+  const double min_limit_;
+  const double max_limit_;
+
+  mutable std::mutex mutex_;
+  size_t in_flight_ = 0;
+  double limit_;
+  std::unordered_map<const Route *, size_t> route_in_flight_;
+  // Lock free, outside mutex_.
+  std::vector<std::unique_ptr<RateLimiter>> rate_limiters_;
+};
+}  // namespace hs::internal
+#endif  // !#ifndef HTTP_SERVER_INTERNAL_ADMISSION_H
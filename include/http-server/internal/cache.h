@@ -0,0 +1,88 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_INTERNAL_CACHE_H
+#define HTTP_SERVER_INTERNAL_CACHE_H
+#include <asio/any_io_executor.hpp>
+#include <chrono>
+#include <coro/single_consumer_event.hpp>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "http-server/cache.h"
+#include "http-server/request.h"
+#include "http-server/route.h"
+namespace hs::internal {
+
+struct CacheEntry {
+  typedef std::shared_ptr<const CacheEntry> Ptr;
+  StatusCode status;
+  Headers headers;
+  ResponseBody::Ptr body;
+  // Body and header bytes, counted against CacheOptions::max_bytes.
+  size_t bytes;
+  std::chrono::steady_clock::time_point expires;
+};
+
+CacheEntry::Ptr BuildCacheEntry(StatusCode status, Headers headers,
+                                std::string body,
+                                std::chrono::steady_clock::time_point expires);
+
+// How a request may use a shared cache (RFC 9111).
+enum class CacheUse {
+  Normal,
+  // Cache-Control: no-cache; a stored response isn't served, but the fresh
+  // one replaces it.
+  Refresh,
+  // Credentials not in the key, or Cache-Control: no-store; the request
+  // goes straight to the handler and its response isn't stored.
+  Bypass,
+};
+
+// Someone waiting for another request to fill the same key.
+struct CacheWaiter {
+  typedef std::shared_ptr<CacheWaiter> Ptr;
+  coro::single_consumer_event event;
+  std::optional<asio::any_io_executor> executor;
+};
+
+class ResponseCacheImpl {
+ public:
+  ResponseCacheImpl(CacheOptions options);
+  const CacheOptions &Options() const;
+  std::string Key(const Request &request) const;
+  CacheUse Use(const Request &request) const;
+
+  CacheEntry::Ptr Lookup(const std::string &key);
+  // Single flight: null when the caller should produce key's response and
+  // Complete it, otherwise a waiter woken once that is done.
+  CacheWaiter::Ptr Join(const std::string &key);
+  // Stores entry, which is null for uncacheable responses, and wakes the
+  // requests waiting on key.
+  void Complete(const std::string &key, CacheEntry::Ptr entry);
+
+  size_t Size() const;
+  size_t Bytes() const;
+  void Clear();
+
+ private:
+  struct Slot {
+    CacheEntry::Ptr entry;
+    std::list<std::string>::iterator lru;
+  };
+  void Erase(std::unordered_map<std::string, Slot>::iterator it);
+
+  const CacheOptions options_;
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, Slot> entries_;
+  // Most recently used first.
+  std::list<std::string> lru_;
+  size_t bytes_ = 0;
+  std::unordered_map<std::string, std::vector<CacheWaiter::Ptr>> in_flight_;
+};
+}  // namespace hs::internal
+#endif  // !#ifndef HTTP_SERVER_INTERNAL_CACHE_H
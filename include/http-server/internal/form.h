@@ -0,0 +1,59 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_INTERNAL_FORM_H
+#define HTTP_SERVER_INTERNAL_FORM_H
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "http-server/form.h"
+namespace hs::internal {
+
+// Value of parameter name in a header such as
+//   multipart/form-data; boundary="xyz"
+// with surrounding quotes removed.
+std::optional<std::string_view> HeaderParam(std::string_view header,
+                                            std::string_view name);
+
+// Incremental multipart/form-data parser. Input is fed in whatever pieces
+// it arrives in and Next hands out events one at a time; part data is
+// returned as views into the parser's buffer, so a part of any size passes
+// through a buffer of about one read.
+class MultipartParser {
+ public:
+  enum class Event { NeedMore, PartBegin, Data, PartEnd, Done };
+
+  MultipartParser(std::string_view boundary, const FormLimits &limits);
+  MultipartParser(const MultipartParser &) = delete;
+  MultipartParser &operator=(const MultipartParser &) = delete;
+
+  // Appends input. Views returned by Next are invalidated.
+  void Feed(std::string_view input);
+  // The next event from the buffered input. data is set for Data events.
+  // Throws hs::Exception on a malformed body or a limit being crossed.
+  Event Next(std::string_view &data);
+  // Headers of the current part, after PartBegin.
+  const FormPart &Part() const { return part_; }
+
+ private:
+  enum class State { Preamble, Delimiter, Headers, Body, Done };
+
+  // Offset of the next delimiter in input, npos if there is none.
+  size_t Find(std::string_view input) const;
+  void ParseHeaders(std::string_view block);
+
+  const FormLimits &limits_;
+  // "\r\n--" + boundary.
+  std::string delimiter_;
+  std::boyer_moore_horspool_searcher<std::string::const_iterator> searcher_;
+  std::string buffer_;
+  size_t pos_ = 0;
+  State state_ = State::Preamble;
+  size_t parts_ = 0;
+  size_t part_size_ = 0;
+  std::string header_block_;
+  FormPart part_;
+};
+}  // namespace hs::internal
+#endif  // !#ifndef HTTP_SERVER_INTERNAL_FORM_H
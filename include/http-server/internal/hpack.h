@@ -0,0 +1,56 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_INTERNAL_HPACK_H
+#define HTTP_SERVER_INTERNAL_HPACK_H
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "http-server/enum.h"
+namespace hs::internal {
+
+typedef std::pair<std::string, std::string> HeaderField;
+typedef std::vector<HeaderField> HeaderList;
+
+// Integer representation from RFC 7541 section 5.1. DecodeInteger consumes
+// the bytes it reads from in.
+bool DecodeInteger(std::string_view &in, uint8_t prefix_bits, uint64_t &value);
+void EncodeInteger(uint64_t value, uint8_t prefix_bits, uint8_t flags,
+                   std::string &out);
+bool HuffmanDecode(std::string_view in, std::string &out);
+
+// Decoder side of HPACK header compression. One instance per connection, the
+// dynamic table carries over between header blocks.
+class HpackDecoder {
+ public:
+  HpackDecoder(size_t max_table_size = 4096);
+  std::optional<HeaderList> Decode(std::string_view block);
+  size_t TableSize() const;
+
+ private:
+  bool Lookup(uint64_t index, HeaderField &field) const;
+  bool ReadString(std::string_view &in, std::string &out) const;
+  void Insert(HeaderField field);
+  void Evict(size_t max_size);
+
+  std::deque<HeaderField> dynamic_table_;
+  size_t table_size_ = 0;
+  size_t max_table_size_;
+  size_t settings_table_size_;
+};
+
+// Encoder side of HPACK. Fields are written as literals without indexing so
+// the peer's dynamic table never has to be tracked; names found in the static
+// table are referenced by index.
+class HpackEncoder {
+ public:
+  void EncodeStatus(StatusCode code, std::string &out) const;
+  void Encode(std::string_view name, std::string_view value,
+              std::string &out) const;
+};
+}  // namespace hs::internal
+#endif  // !#ifndef HTTP_SERVER_INTERNAL_HPACK_H
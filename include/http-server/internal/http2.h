@@ -0,0 +1,167 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_INTERNAL_HTTP2_H
+#define HTTP_SERVER_INTERNAL_HTTP2_H
+#include <asio/ip/tcp.hpp>
+#include <coro/single_consumer_event.hpp>
+#include <coro/task.hpp>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "http-server/http-server.h"
+#include "http-server/internal/admission.h"
+#include "http-server/internal/hpack.h"
+#include "http-server/internal/request-impl.h"
+#include "http-server/internal/route.h"
+#include "http-server/route.h"
+
+using asio::ip::tcp;
+namespace hs::internal {
+
+constexpr std::string_view kHttp2Preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+constexpr size_t kFrameHeaderSize = 9;
+
+enum class FrameType : uint8_t {
+  Data = 0x0,
+  Headers = 0x1,
+  Priority = 0x2,
+  RstStream = 0x3,
+  Settings = 0x4,
+  PushPromise = 0x5,
+  Ping = 0x6,
+  GoAway = 0x7,
+  WindowUpdate = 0x8,
+  Continuation = 0x9,
+};
+
+enum FrameFlag : uint8_t {
+  EndStreamFlag = 0x1,
+  AckFlag = 0x1,
+  EndHeadersFlag = 0x4,
+  PaddedFlag = 0x8,
+  PriorityFlag = 0x20,
+};
+
+enum class Http2Error : uint32_t {
+  NoError = 0x0,
+  ProtocolError = 0x1,
+  InternalError = 0x2,
+  FlowControlError = 0x3,
+  StreamClosed = 0x5,
+  FrameSizeError = 0x6,
+  RefusedStream = 0x7,
+  Cancel = 0x8,
+  CompressionError = 0x9,
+};
+
+enum class Http2Setting : uint16_t {
+  HeaderTableSize = 0x1,
+  EnablePush = 0x2,
+  MaxConcurrentStreams = 0x3,
+  InitialWindowSize = 0x4,
+  MaxFrameSize = 0x5,
+  MaxHeaderListSize = 0x6,
+};
+
+struct FrameHeader {
+  uint32_t length;
+  FrameType type;
+  uint8_t flags;
+  uint32_t stream_id;
+};
+FrameHeader ParseFrameHeader(std::string_view data);
+void AppendFrameHeader(const FrameHeader &header, std::string &out);
+
+struct Http2Stream {
+  typedef std::shared_ptr<Http2Stream> Ptr;
+  uint32_t id;
+  HeaderList headers;
+  std::string body;
+  // Set for the stream an h2c upgrade request turns into.
+  RequestImpl::Ptr request;
+  Handler::Ptr handler;
+  int64_t send_window;
+  // What the peer may still send on the stream.
+  int64_t recv_window;
+  bool end_stream = false;
+  bool reset = false;
+  std::unique_ptr<coro::single_consumer_event> window_event;
+};
+
+// One HTTP/2 connection. Frames are read in Serve; every request runs its
+// handler concurrently in its own stream, and frames from all streams are
+// queued and written to the socket in order.
+class Http2Connection : public std::enable_shared_from_this<Http2Connection> {
+ public:
+  typedef std::shared_ptr<Http2Connection> Ptr;
+
+  Http2Connection(Stream::Ptr socket, Router &router, const Config &config,
+                  AdmissionController &admission);
+  // preread holds bytes already read off the socket; upgrade is the
+  // HTTP/1.1 request that switched protocols, it is answered on stream 1.
+  coro::task<> Serve(std::string preread, RequestImpl::Ptr upgrade = nullptr);
+
+  void SendHeaders(const Http2Stream::Ptr &stream, StatusCode status,
+                   const Headers &headers, bool end_stream);
+  coro::task<> SendData(Http2Stream::Ptr stream, std::string_view data,
+                        bool end_stream);
+
+ private:
+  coro::task<bool> Fill(size_t size);
+  coro::task<std::optional<FrameHeader>> ReadFrame(std::string &payload);
+  bool HandleFrame(const FrameHeader &header, std::string_view payload);
+  bool HandleHeaders(const FrameHeader &header, std::string_view payload);
+  bool HandleHeaderBlock(uint32_t stream_id, bool end_stream);
+  bool HandleData(const FrameHeader &header, std::string_view payload);
+  bool ApplySettings(std::string_view payload);
+  bool HandleWindowUpdate(const FrameHeader &header, std::string_view payload);
+  void Dispatch(const Http2Stream::Ptr &stream);
+  coro::task<> RunStream(Ptr self, Http2Stream::Ptr stream);
+  RequestImpl::Ptr BuildRequest(Http2Stream &stream);
+
+  void WriteFrame(FrameType type, uint8_t flags, uint32_t stream_id,
+                  std::string_view payload);
+  void SendSettings();
+  void SendWindowUpdate(uint32_t stream_id, uint32_t increment);
+  // The window a new stream starts with for data from the peer.
+  int64_t RecvInitialWindow() const;
+  void ResetStream(const Http2Stream::Ptr &stream, Http2Error error);
+  void GoAway(Http2Error error);
+  void Close();
+  void WakeWriters();
+  coro::task<> Flush(Ptr self);
+
+  Stream::Ptr socket_;
+  Router &router_;
+  const Config &config_;
+  AdmissionController &admission_;
+  HpackDecoder decoder_;
+  HpackEncoder encoder_;
+  std::unordered_map<uint32_t, Http2Stream::Ptr> streams_;
+
+  std::string read_buffer_;
+  size_t read_pos_ = 0;
+  std::string outbox_;
+  bool writing_ = false;
+  bool closed_ = false;
+  bool goaway_received_ = false;
+
+  uint32_t last_stream_id_ = 0;
+  uint32_t continuation_stream_ = 0;
+  bool continuation_end_stream_ = false;
+  std::string header_block_;
+
+  int64_t connection_send_window_ = 65535;
+  int64_t peer_initial_window_ = 65535;
+  int64_t connection_recv_window_ = 65535;
+  // Whether the peer acknowledged our SETTINGS.
+  bool settings_acked_ = false;
+  uint32_t peer_max_frame_size_ = 16384;
+  size_t active_streams_ = 0;
+  std::unique_ptr<coro::single_consumer_event> idle_;
+};
+}  // namespace hs::internal
+#endif  // !#ifndef HTTP_SERVER_INTERNAL_HTTP2_H
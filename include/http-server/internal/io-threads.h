@@ -0,0 +1,68 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_INTERNAL_IO_THREADS_H
+#define HTTP_SERVER_INTERNAL_IO_THREADS_H
+#include <asio/executor_work_guard.hpp>
+#include <asio/io_context.hpp>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "http-server/http-server.h"
+#include "http-server/internal/stream.h"
+namespace hs::internal {
+
+// CPUs this process may run on, node by node.
+std::vector<int> AvailableCpus();
+// NUMA node cpu belongs to, 0 when unknown.
+int CpuNode(int cpu);
+// Pins the calling thread to cpu. Failures are logged.
+bool PinCurrentThread(int cpu);
+// CPU that processed the most recent packet of socket (SO_INCOMING_CPU),
+// on Linux that is the CPU of the receive queue the connection hashes to.
+std::optional<int> IncomingCpu(int socket);
+
+// Io threads running one io_context each, for Config::io_threads. Accepted
+// connections are moved onto one of them and stay there, so a connection's
+// handlers never run concurrently and its memory is touched by one core.
+class IoThreads {
+ public:
+  IoThreads(const Config &config);
+  ~IoThreads();
+  size_t Size() const;
+
+  // Moves an accepted socket onto the io thread that should serve it.
+  template <typename Socket>
+  Stream::socket_type Adopt(Socket &socket) {
+    Stream::socket_type::protocol_type protocol(
+        socket.local_endpoint().protocol());
+    auto &context = Pick(socket.native_handle());
+    return Stream::socket_type(context, protocol, socket.release());
+  }
+
+ private:
+  struct Thread {
+    // Only ever run by one thread. The hint lets asio queue work posted from
+    // that thread privately; its locks stay in place, since other threads
+    // hand connections over.
+    asio::io_context context{1};
+    asio::executor_work_guard<asio::io_context::executor_type> work{
+        context.get_executor()};
+    int cpu = -1;
+    int node = 0;
+    std::jthread thread;
+  };
+  asio::io_context &Pick(int socket);
+
+  std::vector<std::unique_ptr<Thread>> threads_;
+  bool steer_;
+  // Steering tables: the thread pinned to each CPU, and the threads of each
+  // NUMA node.
+  std::vector<std::optional<size_t>> by_cpu_;
+  std::vector<std::vector<size_t>> by_node_;
+  std::vector<int> node_of_cpu_;
+  size_t next_ = 0;
+};
+}  // namespace hs::internal
+#endif  // !#ifndef HTTP_SERVER_INTERNAL_IO_THREADS_H
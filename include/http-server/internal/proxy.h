@@ -0,0 +1,158 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_INTERNAL_PROXY_H
+#define HTTP_SERVER_INTERNAL_PROXY_H
+#include <asio/any_io_executor.hpp>
+#include <asio/buffer.hpp>
+#include <asio/error_code.hpp>
+#include <asio/execution_context.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/steady_timer.hpp>
+#include <atomic>
+#include <chrono>
+#include <coro/task.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "http-server/proxy.h"
+namespace hs::internal {
+
+// Status line and headers of an upstream response, with the framing of the
+// body that follows.
+struct ResponseHead {
+  int status = 0;
+  // Names as the upstream sent them.
+  std::vector<std::pair<std::string, std::string>> headers;
+  std::optional<size_t> content_length;
+  bool chunked = false;
+  // Whether the upstream keeps the connection open after the body.
+  bool keep_alive = false;
+};
+// Parses head, which ends with the empty line; nullopt when it is
+// malformed.
+std::optional<ResponseHead> ParseResponseHead(std::string_view head);
+
+// Incremental decoder of a chunked body, fed whatever input has arrived.
+class ChunkedDecoder {
+ public:
+  // Consumes a prefix of input and returns its length, zero when more input
+  // is needed. data is set to the body bytes in the prefix, if any. Throws
+  // hs::Exception on malformed framing.
+  size_t Decode(std::string_view input, std::string_view &data);
+  bool Done() const { return state_ == State::Done; }
+
+ private:
+  enum class State { Size, Data, DataEnd, Trailer, Done };
+  State state_ = State::Size;
+  size_t remaining_ = 0;
+};
+
+// A client connection to an upstream. Every operation is bounded by a
+// timeout, after which it fails with asio::error::timed_out.
+class UpstreamConnection {
+ public:
+  typedef std::unique_ptr<UpstreamConnection> Ptr;
+  typedef std::chrono::steady_clock Clock;
+
+  UpstreamConnection(asio::any_io_executor executor);
+  coro::task<asio::error_code> Connect(const std::string &host,
+                                       const std::string &port,
+                                       std::chrono::milliseconds timeout);
+  coro::task<asio::error_code> Write(std::string_view data,
+                                     std::chrono::milliseconds timeout);
+  coro::task<std::pair<asio::error_code, size_t>> ReadSome(
+      asio::mutable_buffer buffer, std::chrono::milliseconds timeout);
+
+  // When the connection was last put in the idle pool.
+  Clock::time_point idle_since;
+
+ private:
+  typedef std::function<void(asio::error_code, size_t)> Completion;
+  coro::task<std::pair<asio::error_code, size_t>> Timed(
+      std::chrono::milliseconds timeout,
+      std::function<void(Completion)> start);
+
+  asio::ip::tcp::socket socket_;
+  asio::ip::tcp::resolver resolver_;
+  asio::steady_timer timer_;
+};
+
+// Keep-alive upstream connections of one io_context, which owns it as a
+// service so the sockets go before the context does.
+class IdleConnections : public asio::execution_context::service {
+ public:
+  static asio::execution_context::id id;
+
+  IdleConnections(asio::execution_context &context);
+  // The pool of the io_context behind executor.
+  static IdleConnections &Of(const asio::any_io_executor &executor);
+
+  // The most recently used connection to upstream of group that has been
+  // idle less than idle_timeout, null when there is none.
+  UpstreamConnection::Ptr Take(uint64_t group, size_t upstream,
+                               std::chrono::seconds idle_timeout);
+  // Keeps connection for reuse, dropping the oldest one over max_idle.
+  void Put(uint64_t group, size_t upstream, UpstreamConnection::Ptr connection,
+           size_t max_idle);
+  size_t Size() const;
+
+ private:
+  void shutdown() override;
+
+  mutable std::mutex mutex_;
+  std::map<std::pair<uint64_t, size_t>, std::deque<UpstreamConnection::Ptr>>
+      idle_;
+};
+
+// Health and load of the upstreams of one Upstreams.
+class UpstreamGroup : public std::enable_shared_from_this<UpstreamGroup> {
+ public:
+  typedef std::chrono::steady_clock Clock;
+  struct Upstream {
+    std::string host;
+    std::string port;
+    std::atomic<size_t> outstanding{0};
+    std::atomic<bool> healthy{true};
+    // Clock ticks of the next health check, or with passive checks of when
+    // an unhealthy upstream is tried again.
+    std::atomic<Clock::rep> next_check{0};
+    std::atomic<bool> checking{false};
+  };
+
+  UpstreamGroup(ProxyOptions options);
+  const ProxyOptions &Options() const { return options_; }
+  // Tells apart the pooled connections of different groups.
+  uint64_t Id() const { return id_; }
+  size_t Size() const { return upstreams_.size(); }
+  Upstream &At(size_t index) { return upstreams_[index]; }
+  const Upstream &At(size_t index) const { return upstreams_[index]; }
+
+  // Chooses an upstream and counts a request to it as outstanding until
+  // Done, nullopt when none is healthy.
+  std::optional<size_t> Pick();
+  void Done(size_t index);
+  // Takes index out of rotation after failing to reach it.
+  void MarkDown(size_t index);
+  // Starts the health checks that are due on executor.
+  void CheckHealth(const asio::any_io_executor &executor);
+
+ private:
+  bool Available(Upstream &upstream, Clock::rep now);
+  coro::task<> Probe(size_t index, asio::any_io_executor executor);
+
+  const ProxyOptions options_;
+  const uint64_t id_;
+  std::vector<Upstream> upstreams_;
+  std::atomic<size_t> next_{0};
+};
+}  // namespace hs::internal
+#endif  // !#ifndef HTTP_SERVER_INTERNAL_PROXY_H
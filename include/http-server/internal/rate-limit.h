@@ -0,0 +1,78 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_INTERNAL_RATE_LIMIT_H
+#define HTTP_SERVER_INTERNAL_RATE_LIMIT_H
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "http-server/http-server.h"
+#include "http-server/internal/request-impl.h"
+#include "http-server/route.h"
+namespace hs::internal {
+
+// One RateLimit, enforced with GCRA (the generic cell rate algorithm): each
+// key keeps only its theoretical arrival time, the time its burst will have
+// refilled, and a request is allowed when moving that one interval on keeps
+// it within burst intervals of now.
+//
+// Keys live in a fixed table of cache line sized buckets, picked by the
+// key's hash, and are updated with compare-and-swap, so checks from any
+// number of threads take no lock. A key whose arrival time has passed is
+// as good as absent, and its slot is reused. Two keys with the same 64 bit
+// hash share a count, and a slot taken over while another thread updates
+// it may charge that request to the new key.
+class RateLimiter {
+ public:
+  typedef std::chrono::steady_clock Clock;
+  struct Decision {
+    bool allowed;
+    // Requests the key may still make at once.
+    size_t remaining;
+    // Until the burst has refilled.
+    Clock::duration reset;
+    // Until the next request is allowed, zero when one is.
+    Clock::duration retry_after;
+  };
+
+  RateLimiter(const RateLimit &options);
+  const RateLimit &Options() const { return options_; }
+  bool Applies(const Route &route) const;
+  // The key request is counted by, set in storage when it has to be built;
+  // nullopt when request has none.
+  std::optional<std::string_view> Key(const RequestImpl &request,
+                                      std::string &storage) const;
+  Decision Check(std::string_view key, Clock::time_point now = Clock::now());
+  // Keys whose burst hasn't refilled yet.
+  size_t Tracked(Clock::time_point now = Clock::now()) const;
+  // Headers of a 429 answering a request decision refused.
+  Headers RefusedHeaders(const Decision &decision) const;
+
+ private:
+  struct Slot {
+    // Hash of the key, zero when the slot was never used.
+    std::atomic<uint64_t> key{0};
+    // Theoretical arrival time, in nanoseconds since epoch_.
+    std::atomic<int64_t> tat{0};
+  };
+  struct alignas(64) Bucket {
+    std::array<Slot, 4> slots;
+  };
+  Slot &Find(uint64_t hash, int64_t now);
+
+  const RateLimit options_;
+  // Nanoseconds between requests at the sustained rate.
+  const int64_t interval_;
+  // How far ahead of now a key's arrival time may get.
+  const int64_t tolerance_;
+  const Clock::time_point epoch_;
+  const size_t bucket_mask_;
+  std::unique_ptr<Bucket[]> buckets_;
+};
+}  // namespace hs::internal
+#endif  // !#ifndef HTTP_SERVER_INTERNAL_RATE_LIMIT_H
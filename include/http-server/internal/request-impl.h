@@ -3,12 +3,18 @@
 #define HTTP_SERVER_REQUEST_IMPL_H
 #include <asio/ip/tcp.hpp>
 #include <coro/task.hpp>
+#include <deque>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
-#include <optional>
+#include <utility>
+#include <vector>
 
 #include "http-server/enum.h"
+#include "http-server/internal/stream.h"
+#include "http-server/internal/trace.h"
 using asio::ip::tcp;
 namespace hs::internal {
 struct RequestImpl {
@@ -16,14 +22,31 @@ struct RequestImpl {
   Method method;
   Version version;
   std::string path;
+  // Raw query string, without the '?'.
+  std::string query;
   std::unordered_map<std::string, std::string> headers;
-  std::unordered_map<std::string, std::string> query_params;
+  // Parsed from query on first use, see QueryParameters.
+  std::optional<std::vector<std::pair<std::string_view, std::string_view>>>
+      query_params;
+  // Decoded keys and values that query_params points into.
+  std::deque<std::string> decoded_query;
   std::vector<std::string> path_params;
-  std::shared_ptr<tcp::socket> socket;
+  Stream::Ptr socket;
   std::string body_part;
+  RequestTrace trace;
 };
+Method ParseMethod(std::string_view method);
+// The value of header name, matched exactly first and then in any case, as
+// field names are case-insensitive.
+const std::string *FindHeader(const RequestImpl &request,
+                              std::string_view name);
+// Reads and parses the request line and headers. A connection that opens with
+// the HTTP/2 client preface yields a request with version HTTP_2 whose
+// body_part holds every byte read from the socket, starting at the preface.
+// With trace, the request's trace gets the times its head was read and
+// parsed.
 coro::task<std::optional<RequestImpl::Ptr>> ParseRequestLine(
-    std::shared_ptr<tcp::socket> socket);
+    Stream::Ptr socket, bool trace = false);
 }  // namespace hs::internal
 
 #endif  // !#ifndef HTTP_SERVER_REQUEST_IMPL_H
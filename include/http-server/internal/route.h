@@ -1,10 +1,14 @@
 // Copyright 2023 Vinay Varma; Subject to the MIT License.
 #ifndef HTTP_SERVER_INTERNAL_ROUTE_H
 #define HTTP_SERVER_INTERNAL_ROUTE_H
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string_view>
 #include <vector>
 
 #include "http-server/internal/request-impl.h"
+#include "http-server/middleware.h"
 #include "http-server/route.h"
 namespace hs::internal {
 
@@ -18,17 +22,37 @@ struct Node {
   Node(std::string_view path);
   RouteMatch Match(const Method method, std::vector<std::string> params) const;
   RouteMatch Match(const Method method, std::string_view path) const;
+  // Adds route, replacing the one with the same method at path.
   void Add(const Route::Ptr &route, std::string_view path);
+  bool Remove(const Method method, std::string_view path);
 };
 
+// Routes may be changed while serving. Lookups read an immutable snapshot
+// of the tree; changes copy it, edit the copy and publish it atomically. A
+// replaced snapshot is freed once the lookups reading it return, and the
+// requests already matched keep their routes alive.
 class Router {
  public:
-  Router() noexcept;
+  Router();
   void AddRoute(const Route::Ptr &route);
-  RouteMatch Match(const RequestImpl::Ptr &request);
+  bool RemoveRoute(Method method, std::string_view path);
+  // Swaps in a table of exactly routes, e.g. after a config reload.
+  void ReplaceRoutes(const std::vector<Route::Ptr> &routes);
+  // Matches in the table, if one is set, before searching the tree.
+  RouteMatch Match(const RequestImpl::Ptr &request) const;
+  // Set it before serving.
+  void SetTable(RouteTable::Ptr table);
+  void Use(const Middleware::Ptr &middleware);
+  bool HasMiddleware() const;
+  // route's handler behind the middleware registered so far.
+  Handler::Ptr GetHandler(const Route &route) const;
 
  private:
-  Node root_;
+  std::atomic<std::shared_ptr<const Node>> root_;
+  // Serializes changes so none is lost to a concurrent copy.
+  std::mutex update_mutex_;
+  std::shared_ptr<const std::vector<Middleware::Ptr>> middlewares_;
+  RouteTable::Ptr table_;
 };
 }  // namespace hs::internal
 #endif
@@ -0,0 +1,23 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_INTERNAL_SOCKET_OPTIONS_H
+#define HTTP_SERVER_INTERNAL_SOCKET_OPTIONS_H
+#include <asio/io_context.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/local/stream_protocol.hpp>
+
+#include "http-server/http-server.h"
+namespace hs::internal {
+
+// Listening sockets, opened, configured, bound and listening.
+asio::ip::tcp::acceptor OpenTcpAcceptor(asio::io_context &io_context,
+                                        const Config &config);
+asio::local::stream_protocol::acceptor OpenUnixAcceptor(
+    asio::io_context &io_context, const Config &config);
+
+// Applies the per connection options to an accepted socket.
+void ConfigureConnection(asio::ip::tcp::socket &socket,
+                         const SocketOptions &options);
+void ConfigureConnection(asio::local::stream_protocol::socket &socket,
+                         const SocketOptions &options);
+}  // namespace hs::internal
+#endif  // !#ifndef HTTP_SERVER_INTERNAL_SOCKET_OPTIONS_H
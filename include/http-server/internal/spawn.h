@@ -0,0 +1,11 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_INTERNAL_SPAWN_H
+#define HTTP_SERVER_INTERNAL_SPAWN_H
+#include <coro/task.hpp>
+
+namespace hs::internal {
+// Starts task immediately and lets it run to completion without a parent to
+// await it. Exceptions escaping the task are logged and dropped.
+void Spawn(coro::task<> task);
+}  // namespace hs::internal
+#endif  // !#ifndef HTTP_SERVER_INTERNAL_SPAWN_H
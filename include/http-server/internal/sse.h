@@ -0,0 +1,69 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_INTERNAL_SSE_H
+#define HTTP_SERVER_INTERNAL_SSE_H
+#include <asio/any_io_executor.hpp>
+#include <asio/io_context.hpp>
+#include <atomic>
+#include <coro/single_consumer_event.hpp>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "http-server/route.h"
+#include "http-server/sse.h"
+namespace hs::internal {
+
+struct SseSubscriber {
+  typedef std::shared_ptr<SseSubscriber> Ptr;
+  // The io thread the subscriber's handler runs on, where it is woken.
+  std::optional<asio::any_io_executor> executor;
+  // Guards the fields below, which fan-out and the handler share.
+  std::mutex mutex;
+  std::deque<ResponseBody::Ptr> queue;
+  // Set while the subscriber waits for its queue to fill.
+  std::shared_ptr<coro::single_consumer_event> ready;
+  size_t dropped = 0;
+  bool closed = false;
+};
+
+// Fan-out runs on the io_context; Post and PostClose hop onto it. Handlers
+// subscribe from their connection's io thread, which with Config::io_threads
+// is another thread, so the subscriber set and each subscriber are locked
+// and a waiting subscriber is resumed on its own io thread.
+class BroadcasterImpl : public std::enable_shared_from_this<BroadcasterImpl> {
+ public:
+  typedef std::shared_ptr<BroadcasterImpl> Ptr;
+
+  BroadcasterImpl(asio::io_context &io_context, size_t queue_size,
+                  SlowConsumerPolicy policy);
+  void Post(ResponseBody::Ptr body);
+  void PostClose();
+
+  SseSubscriber::Ptr Subscribe();
+  void Unsubscribe(const SseSubscriber::Ptr &subscriber);
+  void Fanout(const ResponseBody::Ptr &body);
+  void CloseAll();
+  size_t SubscriberCount() const;
+
+ private:
+  typedef std::vector<std::pair<SseSubscriber::Ptr,
+                                std::shared_ptr<coro::single_consumer_event>>>
+      Wakeups;
+  void Wake(Wakeups &ready);
+
+  asio::io_context &io_context_;
+  size_t queue_size_;
+  SlowConsumerPolicy policy_;
+  // Guards subscribers_ and closed_.
+  std::mutex mutex_;
+  std::unordered_set<SseSubscriber::Ptr> subscribers_;
+  std::atomic<size_t> count_ = 0;
+  bool closed_ = false;
+};
+}  // namespace hs::internal
+#endif  // !#ifndef HTTP_SERVER_INTERNAL_SSE_H
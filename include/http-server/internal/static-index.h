@@ -0,0 +1,99 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_INTERNAL_STATIC_INDEX_H
+#define HTTP_SERVER_INTERNAL_STATIC_INDEX_H
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace hs::internal {
+
+// MIME type of filename, by its extension; text/plain when it is unknown.
+std::string_view ContentType(std::string_view filename);
+
+struct StaticFile {
+  bool directory = false;
+  uint64_t size = 0;
+  // Empty for directories.
+  std::string_view content_type;
+};
+
+// A directory's listing as an HTML page, or with json a JSON array of
+// {"name", "type", "size"} objects, sorted by name. Links are relative to
+// the directory.
+std::string RenderListing(
+    std::vector<std::pair<std::string, StaticFile>> entries, bool json);
+
+// Regular files and directories under a root directory, keyed by their path
+// relative to it, "a/b.css", with "" for the root. Lookups don't touch the
+// file system. On Linux a thread follows changes through inotify until the
+// index is destroyed.
+class StaticIndex {
+ public:
+  typedef std::shared_ptr<StaticIndex> Ptr;
+
+  StaticIndex(std::filesystem::path root);
+  ~StaticIndex();
+  StaticIndex(const StaticIndex &) = delete;
+
+  std::optional<StaticFile> Find(std::string_view path) const;
+  // Listing of directory path, rendered on first use and kept until the
+  // directory changes; null when path isn't a directory.
+  std::shared_ptr<const std::string> Listing(std::string_view path,
+                                             bool json);
+  size_t Size() const;
+
+ private:
+  struct Hash {
+    typedef void is_transparent;
+    size_t operator()(std::string_view s) const {
+      return std::hash<std::string_view>()(s);
+    }
+  };
+  struct Listings {
+    std::shared_ptr<const std::string> html;
+    std::shared_ptr<const std::string> json;
+  };
+  typedef std::vector<std::pair<std::string, StaticFile>> Scanned;
+
+  // Reads the tree under path, watching its directories, into scanned.
+  void Scan(const std::string &path, Scanned &scanned);
+  void Watch(const std::string &path);
+  // Under mutex_.
+  void Insert(Scanned scanned);
+  void Remove(const std::string &path);
+  // Watcher thread: reads path again after an event on it, or everything
+  // after events were lost.
+  void Refresh(const std::string &path);
+  void Rescan();
+  void Run();
+  // Applies the events in buffer; returns false when the queue overflowed.
+  bool Apply(const char *buffer, size_t size);
+
+  const std::filesystem::path root_;
+  mutable std::shared_mutex mutex_;
+  std::unordered_map<std::string, StaticFile, Hash, std::equal_to<>> files_;
+  // Names in each directory, sorted.
+  std::unordered_map<std::string, std::set<std::string>, Hash,
+                     std::equal_to<>>
+      children_;
+  std::unordered_map<std::string, Listings, Hash, std::equal_to<>> listings_;
+
+  // Used by the constructor and then only by the watcher thread.
+  int inotify_ = -1;
+  int stop_ = -1;
+  std::unordered_map<int, std::string> watches_;
+  std::thread watcher_;
+};
+}  // namespace hs::internal
+#endif  // !#ifndef HTTP_SERVER_INTERNAL_STATIC_INDEX_H
@@ -0,0 +1,210 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_INTERNAL_STREAM_H
+#define HTTP_SERVER_INTERNAL_STREAM_H
+#include <asio/buffer.hpp>
+#include <asio/error.hpp>
+#include <asio/error_code.hpp>
+#include <asio/generic/stream_protocol.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/post.hpp>
+#include <asio/socket_base.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#ifdef HS_TLS
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include <asio/ssl/error.hpp>
+#endif
+
+using asio::ip::tcp;
+namespace hs {
+struct Config;
+namespace internal {
+
+#ifdef HS_TLS
+// Server side TLS settings shared by all connections: certificates, ALPN,
+// session resumption and kernel TLS, built from Config.
+class TlsContext {
+ public:
+  typedef std::shared_ptr<TlsContext> Ptr;
+
+  TlsContext(const Config &config);
+  ~TlsContext();
+  SSL_CTX *Get() const;
+
+ private:
+  SSL_CTX *ctx_;
+  // Read by the ALPN callback.
+  bool http2_;
+};
+#else
+class TlsContext;
+#endif
+
+// A client connection over TCP or a Unix domain socket, in plain text or
+// TLS. It models asio's
+// AsyncReadStream and AsyncWriteStream, so composed operations such as
+// async_read_until and async_write work on both.
+//
+// TLS runs OpenSSL directly on the non-blocking socket rather than through
+// memory BIOs, waiting for readiness whenever OpenSSL wants I/O. That lets
+// OpenSSL hand record encryption to the kernel (kTLS) after the handshake.
+// One read and one write may be outstanding at a time.
+class Stream {
+ public:
+  typedef std::shared_ptr<Stream> Ptr;
+  typedef asio::generic::stream_protocol::socket socket_type;
+  typedef socket_type::executor_type executor_type;
+
+  Stream(socket_type socket);
+  ~Stream();
+
+  executor_type get_executor() { return socket_.get_executor(); }
+  socket_type &Socket() { return socket_; }
+  bool IsTls() const;
+
+  // Runs the server side TLS handshake; the stream is TLS from then on.
+  void AsyncHandshake(const std::shared_ptr<TlsContext> &context,
+                      std::function<void(asio::error_code)> handler);
+  // Protocol chosen through ALPN, empty when none was.
+  std::string_view Alpn() const;
+  bool KernelTls() const;
+
+  template <typename MutableBuffers, typename ReadHandler>
+  void async_read_some(const MutableBuffers &buffers, ReadHandler &&handler) {
+#ifdef HS_TLS
+    if (ssl_) {
+      auto buffer = FirstBuffer<asio::mutable_buffer>(buffers);
+      TlsOp<asio::mutable_buffer, std::decay_t<ReadHandler>>{
+          this, buffer, std::forward<ReadHandler>(handler)}
+          .Start();
+      return;
+    }
+#endif
+    socket_.async_read_some(buffers, std::forward<ReadHandler>(handler));
+  }
+
+  template <typename ConstBuffers, typename WriteHandler>
+  void async_write_some(const ConstBuffers &buffers, WriteHandler &&handler) {
+#ifdef HS_TLS
+    if (ssl_) {
+      auto buffer = Gather(buffers);
+      TlsOp<asio::const_buffer, std::decay_t<WriteHandler>>{
+          this, buffer, std::forward<WriteHandler>(handler)}
+          .Start();
+      return;
+    }
+#endif
+    socket_.async_write_some(buffers, std::forward<WriteHandler>(handler));
+  }
+
+  // Sends TLS close_notify, best effort, before shutting the socket down.
+  void shutdown(asio::socket_base::shutdown_type what,
+                asio::error_code &error);
+  void close();
+  void close(asio::error_code &error);
+
+ private:
+  socket_type socket_;
+#ifdef HS_TLS
+  // Partial reads are allowed, so only the first non-empty buffer of a
+  // sequence is read into.
+  template <typename Buffer, typename Buffers>
+  static Buffer FirstBuffer(const Buffers &buffers) {
+    for (auto it = asio::buffer_sequence_begin(buffers);
+         it != asio::buffer_sequence_end(buffers); ++it) {
+      Buffer buffer(*it);
+      if (buffer.size() > 0) return buffer;
+    }
+    return Buffer();
+  }
+  // Gathered writes, such as a head and a small body, are copied into one
+  // buffer up to a record's worth so they go out as one record and one
+  // syscall rather than one each. Larger ones are written a buffer at a time.
+  template <typename ConstBuffers>
+  asio::const_buffer Gather(const ConstBuffers &buffers) {
+    auto it = asio::buffer_sequence_begin(buffers);
+    auto end = asio::buffer_sequence_end(buffers);
+    while (it != end && asio::const_buffer(*it).size() == 0) ++it;
+    if (it == end) return asio::const_buffer();
+    asio::const_buffer first(*it);
+    if (first.size() >= kMaxRecord || std::next(it) == end) return first;
+    write_buffer_.clear();
+    for (; it != end && write_buffer_.size() < kMaxRecord; ++it) {
+      asio::const_buffer buffer(*it);
+      auto size = std::min(buffer.size(), kMaxRecord - write_buffer_.size());
+      write_buffer_.append(static_cast<const char *>(buffer.data()), size);
+    }
+    return asio::buffer(write_buffer_);
+  }
+
+  // Maps the outcome of an SSL call that did not succeed. Returns false
+  // when OpenSSL needs the socket to become readable (or writable, per
+  // want_write) before retrying.
+  bool Failed(int result, asio::error_code &error, bool &want_write);
+  void Handshake(std::function<void(asio::error_code)> handler);
+
+  // One SSL_read or SSL_write, retried on socket readiness.
+  template <typename Buffer, typename Handler>
+  struct TlsOp {
+    Stream *stream;
+    Buffer buffer;
+    Handler handler;
+
+    void Start() {
+      if (buffer.size() == 0) {
+        return asio::post(stream->get_executor(),
+                          [handler = std::move(handler)]() mutable {
+                            handler(asio::error_code(), 0);
+                          });
+      }
+      Attempt(true);
+    }
+    void operator()(asio::error_code error) {
+      if (error) return handler(error, 0);
+      Attempt(false);
+    }
+    void Attempt(bool initiating) {
+      size_t n = 0;
+      ERR_clear_error();
+      int result;
+      if constexpr (std::is_same_v<Buffer, asio::mutable_buffer>) {
+        result = SSL_read_ex(stream->ssl_, buffer.data(), buffer.size(), &n);
+      } else {
+        result = SSL_write_ex(stream->ssl_, buffer.data(), buffer.size(), &n);
+      }
+      asio::error_code error;
+      bool want_write = false;
+      if (result <= 0 && !stream->Failed(result, error, want_write)) {
+        stream->socket_.async_wait(want_write ? asio::socket_base::wait_write
+                                              : asio::socket_base::wait_read,
+                                   std::move(*this));
+        return;
+      }
+      if (!initiating) return handler(error, n);
+      // Handlers never run inside the initiating call.
+      asio::post(stream->get_executor(),
+                 [handler = std::move(handler), error, n]() mutable {
+                   handler(error, n);
+                 });
+    }
+  };
+
+  SSL *ssl_ = nullptr;
+  // Plaintext bytes a TLS record holds at most.
+  static constexpr size_t kMaxRecord = 16 * 1024;
+  // Gather's copy, unchanged while OpenSSL may retry the write.
+  std::string write_buffer_;
+#endif
+};
+}  // namespace internal
+}  // namespace hs
+#endif  // !#ifndef HTTP_SERVER_INTERNAL_STREAM_H
@@ -0,0 +1,14 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_INTERNAL_SYNC_ROUTE_H
+#define HTTP_SERVER_INTERNAL_SYNC_ROUTE_H
+#include <string>
+
+#include "http-server/enum.h"
+#include "http-server/sync-route.h"
+namespace hs::internal {
+
+// Status line and headers of response, up to and including the blank line.
+std::string SerializeHead(Version version, const SimpleResponse &response,
+                          bool keep_alive);
+}  // namespace hs::internal
+#endif  // !#ifndef HTTP_SERVER_INTERNAL_SYNC_ROUTE_H
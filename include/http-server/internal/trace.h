@@ -0,0 +1,103 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_INTERNAL_TRACE_H
+#define HTTP_SERVER_INTERNAL_TRACE_H
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "http-server/enum.h"
+#include "http-server/trace.h"
+namespace hs {
+struct Config;
+struct Route;
+namespace internal {
+struct RequestImpl;
+
+// Phase timings of one request. Mark charges the time since the previous
+// mark to a phase; it does nothing unless the trace was started.
+struct RequestTrace {
+  typedef std::chrono::steady_clock Clock;
+
+  bool enabled = false;
+  // When the request head was fully read, and when it was parsed.
+  Clock::time_point received;
+  Clock::time_point parsed;
+  Clock::time_point mark;
+  std::array<Clock::duration, kTracePhases> phases{};
+  StatusCode status = StatusCode::Ok;
+  // The matched route, null when none matched.
+  std::shared_ptr<Route> route;
+  std::string trace_id;
+  std::string span_id;
+  std::string parent_span_id;
+
+  void Mark(TracePhase phase) {
+    if (!enabled) return;
+    auto now = Clock::now();
+    phases[static_cast<size_t>(phase)] += now - mark;
+    mark = now;
+  }
+};
+
+struct TraceParent {
+  std::string trace_id;
+  std::string parent_id;
+  uint8_t flags;
+};
+// Parses a traceparent header, nullopt when it is malformed.
+std::optional<TraceParent> ParseTraceParent(std::string_view header);
+
+// Tail-sampling tracer. Every request's phases feed a per-route breakdown;
+// only requests slower than the threshold, or failing with a 5xx, are
+// exported as spans.
+class Tracer {
+ public:
+  Tracer(const Config &config);
+
+  void SetExporter(TraceExporter::Ptr exporter);
+  // Starts timing request. accepted and ready are given for a connection's
+  // first request: when it was accepted and when it was ready for requests,
+  // after any TLS handshake. Takes ids from the request's traceparent and
+  // rewrites the header to name this request's span, so handlers pass it
+  // on to the calls they make.
+  void Start(RequestImpl &request,
+             std::optional<RequestTrace::Clock::time_point> accepted,
+             std::optional<RequestTrace::Clock::time_point> ready);
+  void Finish(RequestImpl &request);
+
+  // Time per route and phase in microseconds, as folded stacks
+  // ("GET /users;handler 1234" lines) for flame graph tools.
+  std::string Breakdown() const;
+
+ private:
+  struct RouteStats {
+    // Keeps the route, whose address is the key, alive.
+    std::shared_ptr<Route> route;
+    uint64_t requests = 0;
+    std::array<RequestTrace::Clock::duration, kTracePhases> phases{};
+  };
+  // Stats of the requests finished on the threads sharing the shard, keyed
+  // by method and route, which is null for unmatched requests. Breakdown
+  // merges the shards.
+  struct alignas(64) Shard {
+    mutable std::mutex mutex;
+    std::map<std::pair<Method, const Route *>, RouteStats> routes;
+  };
+  static constexpr size_t kShards = 16;
+  Shard &ThreadShard();
+
+  const std::chrono::nanoseconds slow_threshold_;
+  mutable std::mutex mutex_;
+  TraceExporter::Ptr exporter_;
+  std::array<Shard, kShards> shards_;
+};
+}  // namespace internal
+}  // namespace hs
+#endif  // !#ifndef HTTP_SERVER_INTERNAL_TRACE_H
@@ -0,0 +1,42 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_INTERNAL_URL_H
+#define HTTP_SERVER_INTERNAL_URL_H
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace hs::internal {
+struct RequestImpl;
+
+// Offset of the first '%', or '+' when plus is set, in input; npos if there
+// is none. Scans a word at a time.
+size_t FindEscape(std::string_view input, bool plus);
+
+// Decodes %XX escapes, and '+' as a space when plus_as_space is set.
+// Returns input itself when there is nothing to decode, otherwise the
+// decoded bytes are written to storage and a view of it is returned.
+// Malformed escapes are kept as they are.
+std::string_view PercentDecode(std::string_view input, std::string &storage,
+                               bool plus_as_space);
+
+// Escapes everything that can't appear in a path as is, for putting a
+// decoded path back in a URL.
+std::string EncodePath(std::string_view path);
+
+// Collapses repeated slashes and resolves "." and ".." segments; ".." never
+// climbs above the root. The result starts with '/' and keeps a trailing
+// slash.
+std::string NormalizePath(std::string_view path);
+
+// Sets request's path, decoded and normalized, and its raw query from a
+// request target. Query parameters are parsed on first use.
+void ParseTarget(std::string_view target, RequestImpl &request);
+
+// Query parameters of request in order, decoded. Parsed on the first call,
+// the views live as long as request.
+const std::vector<std::pair<std::string_view, std::string_view>>
+    &QueryParameters(RequestImpl &request);
+}  // namespace hs::internal
+#endif  // !#ifndef HTTP_SERVER_INTERNAL_URL_H
@@ -0,0 +1,50 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_INTERNAL_WEBSOCKET_FRAME_H
+#define HTTP_SERVER_INTERNAL_WEBSOCKET_FRAME_H
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace hs::internal {
+
+enum class WebSocketOpcode : uint8_t {
+  Continuation = 0x0,
+  Text = 0x1,
+  Binary = 0x2,
+  Close = 0x8,
+  Ping = 0x9,
+  Pong = 0xa,
+};
+
+struct WebSocketFrameHeader {
+  bool fin;
+  bool rsv1;
+  // RSV2 and RSV3 are never negotiated, a frame using them is an error.
+  bool reserved;
+  WebSocketOpcode opcode;
+  bool masked;
+  std::array<uint8_t, 4> mask;
+  uint64_t length;
+  size_t header_size;
+};
+
+// Number of header bytes the frame needs, known from its first two bytes.
+size_t WebSocketHeaderSize(std::string_view data);
+// Parses a frame header in place; nullopt until all header bytes are there.
+std::optional<WebSocketFrameHeader> ParseWebSocketFrameHeader(
+    std::string_view data);
+// Writes an unmasked server frame.
+void AppendWebSocketFrame(bool fin, bool rsv1, WebSocketOpcode opcode,
+                          std::string_view payload, std::string &out);
+// XORs data in place with the masking key, a word or vector at a time.
+void ApplyMask(char *data, size_t size, const std::array<uint8_t, 4> &mask);
+// Whether a peer may send code in a close frame (RFC 6455 §7.4). 1005, 1006
+// and 1015 only stand for a missing code and are never put on the wire.
+bool IsValidCloseCode(uint16_t code);
+// Sec-WebSocket-Accept value for a client's Sec-WebSocket-Key.
+std::string WebSocketAcceptKey(std::string_view key);
+}  // namespace hs::internal
+#endif  // !#ifndef HTTP_SERVER_INTERNAL_WEBSOCKET_FRAME_H
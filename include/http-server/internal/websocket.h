@@ -0,0 +1,120 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_INTERNAL_WEBSOCKET_H
+#define HTTP_SERVER_INTERNAL_WEBSOCKET_H
+#include <asio/ip/tcp.hpp>
+#include <asio/steady_timer.hpp>
+#include <chrono>
+#include <coro/async_generator.hpp>
+#include <coro/single_consumer_event.hpp>
+#include <coro/task.hpp>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "http-server/http-server.h"
+#include "http-server/internal/request-impl.h"
+#include "http-server/internal/websocket-frame.h"
+#include "http-server/websocket.h"
+
+using asio::ip::tcp;
+namespace hs::internal {
+
+class PerMessageDeflate;
+
+bool IsWebSocketUpgrade(const RequestImpl &request);
+// Completes the opening handshake for request and runs handler on the
+// upgraded connection until it closes.
+coro::task<> ServeWebSocket(RequestImpl::Ptr request,
+                            WebSocketHandler::Ptr handler,
+                            const Config &config);
+
+// One upgraded connection. A reader task parses frames as they arrive and
+// answers control frames; complete messages are handed to Receive without
+// copying while a receiver is waiting, and queued otherwise. A handed off
+// message holds up the reader until the receiver asks for the next one;
+// when a pong is due meanwhile, the buffers it points into are set aside
+// so the reader can go on.
+class WebSocketImpl : public std::enable_shared_from_this<WebSocketImpl> {
+ public:
+  typedef std::shared_ptr<WebSocketImpl> Ptr;
+
+  WebSocketImpl(Stream::Ptr socket, const Config &config, bool deflate);
+  ~WebSocketImpl();
+  coro::task<> Run(WebSocketHandler::Ptr handler, RequestImpl::Ptr request);
+
+  coro::async_generator<WebSocketMessage> Receive(Ptr self);
+  coro::task<> Send(std::string_view data, MessageType type);
+  coro::task<> Close(uint16_t code, std::string_view reason);
+  bool IsOpen() const;
+
+ private:
+  struct QueuedMessage {
+    MessageType type;
+    std::string data;
+  };
+  struct ReceiverGuard;
+
+  coro::task<bool> Fill(size_t size);
+  coro::task<std::optional<WebSocketFrameHeader>> ReadFrame(
+      std::string_view &payload);
+  coro::task<bool> HandleFrame(const WebSocketFrameHeader &header,
+                               std::string_view payload);
+  coro::task<bool> Deliver(MessageType type, bool compressed,
+                           std::string_view data);
+  coro::task<> ReadLoop(Ptr self);
+  coro::task<> PingLoop(Ptr self);
+  coro::task<bool> Wait(asio::steady_timer &timer,
+                        std::chrono::steady_clock::duration duration);
+
+  void WriteFrame(WebSocketOpcode opcode, bool rsv1, std::string_view payload);
+  void SendClose(uint16_t code, std::string_view reason);
+  coro::task<> Flush(Ptr self);
+  void Fail(uint16_t code, std::string_view reason);
+  void Shutdown();
+  coro::task<> Drain();
+  void DetachMessage();
+  void WakeReader();
+  void WakeReceiver();
+
+  Stream::Ptr socket_;
+  const Config &config_;
+  std::unique_ptr<PerMessageDeflate> deflate_;
+  asio::steady_timer ping_timer_;
+  asio::steady_timer close_timer_;
+
+  std::string read_buffer_;
+  size_t read_pos_ = 0;
+  std::string message_buffer_;
+  std::string inflate_buffer_;
+  std::string deflate_buffer_;
+  std::optional<MessageType> fragmented_;
+  bool fragmented_compressed_ = false;
+
+  std::string outbox_;
+  bool writing_ = false;
+  std::vector<std::shared_ptr<coro::single_consumer_event>> drained_;
+
+  bool open_ = true;
+  bool close_sent_ = false;
+  bool pong_pending_ = false;
+  // Whether the reader waits for the receiver to be done with a message.
+  bool delivering_ = false;
+  bool reader_done_ = false;
+  std::shared_ptr<coro::single_consumer_event> reader_finished_;
+
+  // Hand-off between the reader and Receive.
+  bool receiver_active_ = false;
+  bool receiver_waiting_ = false;
+  std::optional<WebSocketMessage> current_;
+  std::deque<QueuedMessage> queued_;
+  // Buffers the message held by the receiver points into, once detached.
+  std::vector<std::string> detached_;
+  std::shared_ptr<coro::single_consumer_event> message_ready_;
+  std::shared_ptr<coro::single_consumer_event> reader_resume_;
+};
+}  // namespace hs::internal
+#endif  // !#ifndef HTTP_SERVER_INTERNAL_WEBSOCKET_H
@@ -0,0 +1,54 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_INTERNAL_WORKER_POOL_H
+#define HTTP_SERVER_INTERNAL_WORKER_POOL_H
+#include <asio/any_io_executor.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace hs::internal {
+
+// Work-stealing pool for blocking and CPU heavy work. Every worker owns a
+// queue, runs its own newest task first and steals the oldest task of
+// another worker when it runs dry.
+class WorkerPool {
+ public:
+  explicit WorkerPool(size_t threads);
+  ~WorkerPool();
+  void Submit(std::function<void()> task);
+  size_t Size() const;
+
+  // Process wide pool, started on first use with one worker per core.
+  static WorkerPool &Default();
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+  bool TryPop(size_t index, std::function<void()> &task);
+  bool TrySteal(size_t index, std::function<void()> &task);
+  void Run(std::stop_token stop, size_t index);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::atomic<size_t> next_ = 0;
+  std::atomic<size_t> pending_ = 0;
+  std::mutex idle_mutex_;
+  std::condition_variable_any idle_;
+  std::vector<std::jthread> threads_;
+};
+
+// The io thread's executor, recorded whenever the server starts handling a
+// request so work handed to the pool knows where to come back to.
+void SetIoExecutor(asio::any_io_executor executor);
+std::optional<asio::any_io_executor> CurrentIoExecutor();
+}  // namespace hs::internal
+#endif  // !#ifndef HTTP_SERVER_INTERNAL_WORKER_POOL_H
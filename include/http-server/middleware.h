@@ -0,0 +1,102 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_MIDDLEWARE_H
+#define HTTP_SERVER_MIDDLEWARE_H
+#include <coro/async_generator.hpp>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "http-server/request.h"
+#include "http-server/route.h"
+namespace hs {
+
+typedef std::function<coro::async_generator<Response>(Request)> Next;
+
+// Runtime middleware, registered with HttpServer::Use and run around every
+// route's handler in registration order. Handle may answer on its own
+// without calling next, pass next a request with changed headers, and
+// rewrite whatever next yields.
+struct Middleware {
+  typedef std::shared_ptr<Middleware> Ptr;
+
+  virtual coro::async_generator<Response> Handle(Request req, Next next) = 0;
+  virtual ~Middleware();
+};
+
+// Runs handler behind middlewares, the first one outermost.
+Handler::Ptr Chain(std::shared_ptr<const std::vector<Middleware::Ptr>> chain,
+                   Handler::Ptr handler);
+
+// Middleware chain composed at compile time. Each middleware type provides
+//   template <typename Next>
+//   coro::async_generator<Response> Handle(Request req, Next next);
+// where next(req) starts the rest of the chain. Layers call each other
+// directly, without virtual calls or std::function. GCC 12 rejects co_await
+// in a for-increment inside templates, so advance next's iterator in the
+// loop body.
+template <typename... Middlewares>
+class MiddlewareHandler : public Handler {
+ public:
+  MiddlewareHandler(Handler::Ptr handler, Middlewares... middlewares)
+      : handler_(std::move(handler)),
+        middlewares_(std::move(middlewares)...) {}
+
+  coro::async_generator<Response> Handle(const Request req) override {
+    return Call<0>(req);
+  }
+  void SetDone() override {
+    Handler::SetDone();
+    handler_->SetDone();
+  }
+
+ private:
+  template <size_t I>
+  coro::async_generator<Response> Call(Request req) {
+    if constexpr (I == sizeof...(Middlewares)) {
+      return handler_->Handle(std::move(req));
+    } else {
+      auto next = [this](Request r) { return Call<I + 1>(std::move(r)); };
+      return std::get<I>(middlewares_).Handle(std::move(req), next);
+    }
+  }
+
+  Handler::Ptr handler_;
+  std::tuple<Middlewares...> middlewares_;
+};
+
+// route with its handler behind a compile-time middleware chain.
+template <typename... Middlewares>
+class MiddlewareRoute : public Route {
+ public:
+  MiddlewareRoute(Route::Ptr route, Middlewares... middlewares)
+      : route_(std::move(route)), middlewares_(std::move(middlewares)...) {}
+
+  Method GetMethod() const override { return route_->GetMethod(); }
+  std::string GetPath() const override { return route_->GetPath(); }
+  Handler::Ptr GetHandler() const override {
+    return std::apply(
+        [this](const Middlewares &...middlewares) {
+          return std::make_shared<MiddlewareHandler<Middlewares...>>(
+              route_->GetHandler(), middlewares...);
+        },
+        middlewares_);
+  }
+  size_t MaxConcurrency() const override { return route_->MaxConcurrency(); }
+  bool Unmetered() const override { return route_->Unmetered(); }
+
+ private:
+  Route::Ptr route_;
+  std::tuple<Middlewares...> middlewares_;
+};
+
+template <typename... Middlewares>
+Route::Ptr WithMiddleware(Route::Ptr route, Middlewares... middlewares) {
+  return std::make_shared<MiddlewareRoute<Middlewares...>>(
+      std::move(route), std::move(middlewares)...);
+}
+}  // namespace hs
+#endif  // !#ifndef HTTP_SERVER_MIDDLEWARE_H
@@ -0,0 +1,74 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_OFFLOAD_H
+#define HTTP_SERVER_OFFLOAD_H
+#include <chrono>
+#include <coro/task.hpp>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace hs {
+namespace internal {
+// Resumes handle on the worker pool, remembering the io thread it left.
+void ResumeOnWorker(std::coroutine_handle<> handle);
+// Posts handle back to the io thread the current worker task came from.
+// Returns false when there is none, the caller then continues inline.
+bool ResumeOnIo(std::coroutine_handle<> handle);
+
+struct WorkerPoolAwaiter {
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> handle) {
+    ResumeOnWorker(handle);
+  }
+  void await_resume() const noexcept {}
+};
+
+struct IoThreadAwaiter {
+  bool await_ready() const noexcept { return false; }
+  bool await_suspend(std::coroutine_handle<> handle) {
+    return ResumeOnIo(handle);
+  }
+  void await_resume() const noexcept {}
+};
+}  // namespace internal
+
+// Moves the calling coroutine onto the shared worker pool. Pair it with
+// on_io_thread() before touching the request or yielding a response again.
+inline internal::WorkerPoolAwaiter on_worker_pool() { return {}; }
+// Moves a coroutine that went to the worker pool back to its io thread.
+inline internal::IoThreadAwaiter on_io_thread() { return {}; }
+
+// Runs fn on the worker pool and resumes the caller on its io thread with
+// fn's result, or rethrows what fn threw.
+template <typename Fn>
+coro::task<std::invoke_result_t<Fn>> offload(Fn fn) {
+  typedef std::invoke_result_t<Fn> Result;
+  co_await on_worker_pool();
+  std::exception_ptr error;
+  if constexpr (std::is_void_v<Result>) {
+    try {
+      fn();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    co_await on_io_thread();
+    if (error) std::rethrow_exception(error);
+  } else {
+    std::optional<Result> result;
+    try {
+      result.emplace(fn());
+    } catch (...) {
+      error = std::current_exception();
+    }
+    co_await on_io_thread();
+    if (error) std::rethrow_exception(error);
+    co_return std::move(*result);
+  }
+}
+
+// Suspends the calling coroutine for duration without blocking its thread.
+coro::task<> sleep_for(std::chrono::steady_clock::duration duration);
+}  // namespace hs
+#endif  // !#ifndef HTTP_SERVER_OFFLOAD_H
@@ -0,0 +1,84 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_PROXY_H
+#define HTTP_SERVER_PROXY_H
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "http-server/enum.h"
+#include "http-server/route.h"
+namespace hs {
+
+namespace internal {
+class UpstreamGroup;
+}  // namespace internal
+
+enum class ProxyBalance {
+  RoundRobin,
+  // The upstream with the fewest requests in flight, round robin on ties.
+  LeastOutstanding,
+};
+
+struct ProxyOptions {
+  // HTTP/1.1 servers as "host:port", "[v6 address]:port" or "host" for
+  // port 80.
+  std::vector<std::string> upstreams;
+  ProxyBalance balance = ProxyBalance::LeastOutstanding;
+  // Bounds resolving and connecting to an upstream.
+  std::chrono::milliseconds connect_timeout{1000};
+  // Bounds every read of the response and write of the request.
+  std::chrono::milliseconds read_timeout{30000};
+  // Keep-alive connections kept per upstream on each io thread, and how
+  // long one may sit unused before it is dropped instead of reused.
+  size_t max_idle_connections = 32;
+  std::chrono::seconds idle_timeout{30};
+  // With health_check_path, every upstream is sent a GET for it each
+  // health_check_interval and takes requests while it answers with a 2xx
+  // or 3xx. Without it, an upstream that can't be connected to sits out
+  // one interval. Checks are started by the requests being proxied.
+  std::string health_check_path;
+  std::chrono::milliseconds health_check_interval{5000};
+  // Forward only the path below the route's, e.g. "/api/users" on a route
+  // at "/api" goes upstream as "/users".
+  bool strip_prefix = false;
+};
+
+// A set of upstream servers with their health and load, shared by the
+// ProxyRoutes forwarding to them.
+class Upstreams {
+ public:
+  typedef std::shared_ptr<Upstreams> Ptr;
+
+  Upstreams(ProxyOptions options);
+  ~Upstreams();
+  size_t Size() const;
+  // Whether the upstream at index in ProxyOptions::upstreams takes
+  // requests.
+  bool Healthy(size_t index) const;
+
+ private:
+  friend class ProxyRoute;
+  std::shared_ptr<internal::UpstreamGroup> pimpl_;
+};
+
+// Forwards requests to one of upstreams over pooled keep-alive connections.
+// Request and response bodies are streamed through without being buffered
+// whole. Hop-by-hop headers are dropped; the path goes upstream
+// percent-encoded, so escaped slashes arrive as plain ones. Failing to reach
+// an upstream gives 502, or 504 on a timeout.
+class ProxyRoute : public Route {
+ public:
+  ProxyRoute(Method method, const std::string &path, Upstreams::Ptr upstreams);
+  Method GetMethod() const override;
+  std::string GetPath() const override;
+  Handler::Ptr GetHandler() const override;
+
+ private:
+  Method method_;
+  std::string path_;
+  Upstreams::Ptr upstreams_;
+};
+}  // namespace hs
+#endif  // !#ifndef HTTP_SERVER_PROXY_H
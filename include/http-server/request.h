@@ -2,9 +2,14 @@
 #ifndef HTTP_SERVER_REQUEST_H
 #define HTTP_SERVER_REQUEST_H
 
+#include <coro/async_generator.hpp>
 #include <coro/task.hpp>
+#include <cstddef>
 #include <memory>
 #include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #include "http-server/enum.h"
@@ -21,12 +26,28 @@ class Request {
 
   Method GetMethod() const;
   Version GetVersion() const;
+  // Percent-decoded, with "." and ".." segments and repeated slashes
+  // resolved.
   std::string_view Path() const;
+  // The raw query string, without the leading '?'.
+  std::string_view Query() const;
   std::optional<std::string_view> Header(std::string_view key) const;
+  // Every header, named as the client sent it.
+  const std::unordered_map<std::string, std::string> &AllHeaders() const;
+  // Adds or replaces a header, e.g. from middleware before the handler runs.
+  void SetHeader(std::string key, std::string value) const;
+  // Query parameters, percent-decoded and parsed on first use. A parameter
+  // without '=' such as "?flag" has an empty value. QueryParam returns the
+  // first value of a repeated key, QueryParams all of them in order.
   std::optional<std::string_view> QueryParam(std::string_view key) const;
+  std::vector<std::string_view> QueryParams(std::string_view key) const;
   std::vector<std::string>& Params() const;
   std::optional<size_t> ContentLength() const;
   coro::task<std::string> Body() const;
+  // Streams the body up to Content-Length as it arrives, in chunks of at
+  // most chunk_size bytes. A chunk is valid until the next is requested.
+  coro::async_generator<std::string_view> BodyChunks(
+      size_t chunk_size = 64 * 1024) const;
 
  private:
   std::shared_ptr<internal::RequestImpl> pimpl_;
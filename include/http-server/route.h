@@ -6,8 +6,11 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <variant>
+#include <vector>
 
 #include "http-server/enum.h"
 #include "http-server/request.h"
@@ -17,6 +20,8 @@ concept Writable = requires(T t) {
   { t.data() } -> std::convertible_to<const void *>;
   { t.size() } -> std::convertible_to<std::size_t>;
 };
+// A header sent more than once, such as Set-Cookie, holds its values
+// separated by '\n'; each is written as a field of its own.
 typedef std::unordered_map<std::string, std::string> Headers;
 struct ResponseBody {
   virtual size_t GetSize() const = 0;
@@ -26,10 +31,12 @@ struct ResponseBody {
 };
 typedef std::variant<StatusCode, Headers, ResponseBody::Ptr> Response;
 
+// T may be a view such as std::string_view or std::span over static
+// storage, which is then written without being copied.
 template <Writable T>
 class WritableResponseBody : public ResponseBody {
  public:
-  WritableResponseBody(T t) : data_(t) {}
+  WritableResponseBody(T t) : data_(std::move(t)) {}
   size_t GetSize() const override { return data_.size(); }
   const void *GetData() const override { return data_.data(); }
 
@@ -42,7 +49,8 @@ struct Handler {
 
   virtual coro::async_generator<Response> Handle(const Request req) = 0;
   virtual ~Handler();
-  void SetDone();
+  // Handlers wrapping another handler forward this to it.
+  virtual void SetDone();
   bool IsDone();
 
  private:
@@ -54,8 +62,24 @@ struct Route {
   virtual Method GetMethod() const = 0;
   virtual std::string GetPath() const = 0;
   virtual Handler::Ptr GetHandler() const = 0;
+  // Requests of this route allowed to run at once, zero for no limit.
+  virtual size_t MaxConcurrency() const;
+  // Long-lived routes such as event streams don't count towards the
+  // server-wide in-flight limits.
+  virtual bool Unmetered() const;
   virtual ~Route();
 };
+// Routes matched before the router's tree is searched, such as a
+// CompiledRoutes table.
+struct RouteTable {
+  typedef std::shared_ptr<RouteTable> Ptr;
+
+  // The route for method and path, null when there is none. params gets
+  // the values of the route's parameters, as the request's Params().
+  virtual Route::Ptr Match(Method method, std::string_view path,
+                           std::vector<std::string> &params) const = 0;
+  virtual ~RouteTable();
+};
 }  // namespace hs
 #define ROUTE(name, method, path, handler)                             \
   class name : public hs::Route {                                      \
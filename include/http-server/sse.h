@@ -0,0 +1,70 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_SSE_H
+#define HTTP_SERVER_SSE_H
+#include <asio/io_context.hpp>
+#include <chrono>
+#include <coro/async_generator.hpp>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "http-server/request.h"
+#include "http-server/route.h"
+namespace hs {
+
+namespace internal {
+class BroadcasterImpl;
+}  // namespace internal
+
+struct SseEvent {
+  std::string data;
+  std::string event;
+  std::string id;
+  std::optional<std::chrono::milliseconds> retry;
+};
+
+// Wire form of an event; every line of data becomes its own data field.
+std::string FormatSseEvent(const SseEvent &event);
+ResponseBody::Ptr SseBody(const SseEvent &event);
+// Headers that start an event stream. The connection closes when the
+// stream ends.
+Headers SseHeaders();
+
+// What a Broadcaster does with a subscriber whose queue is full.
+enum class SlowConsumerPolicy { DropOldest, Disconnect };
+
+// Fans events out to every subscribed SseHandler. Each event is serialized
+// once and the same buffer is queued for all subscribers.
+class Broadcaster {
+ public:
+  typedef std::shared_ptr<Broadcaster> Ptr;
+
+  Broadcaster(asio::io_context &io_context, size_t queue_size = 256,
+              SlowConsumerPolicy policy = SlowConsumerPolicy::DropOldest);
+  ~Broadcaster();
+
+  // Safe to call from any thread; fan-out happens on io_context and each
+  // subscriber resumes on its connection's io thread.
+  void Publish(const SseEvent &event) const;
+  // Ends every subscriber's stream once its queue drains.
+  void Close() const;
+  size_t Subscribers() const;
+
+ private:
+  friend class SseHandler;
+  std::shared_ptr<internal::BroadcasterImpl> pimpl_;
+};
+
+// Streams a Broadcaster's events to one client until the client goes away,
+// the broadcaster closes, or the client falls behind under Disconnect.
+class SseHandler : public Handler {
+ public:
+  SseHandler(Broadcaster::Ptr broadcaster);
+  coro::async_generator<Response> Handle(const Request req) override;
+
+ private:
+  Broadcaster::Ptr broadcaster_;
+};
+}  // namespace hs
+#endif  // !#ifndef HTTP_SERVER_SSE_H
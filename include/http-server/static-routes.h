@@ -1,14 +1,38 @@
 // Copyright 2023 Vinay Varma; Subject to the MIT License.
 #ifndef HTTP_SERVER_STATIC_ROUTES_H
 #define HTTP_SERVER_STATIC_ROUTES_H
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "http-server/enum.h"
 #include "http-server/route.h"
 
 namespace hs {
+namespace internal {
+class StaticIndex;
+}  // namespace internal
+
+struct StaticOptions {
+  // Scan the mounted tree into memory when the route is created and answer
+  // from there, without a stat call per request. On Linux inotify keeps it
+  // current; elsewhere it stays as scanned. Symlinked directories are left
+  // out.
+  bool index = false;
+  // Served for a directory, the first of them it has.
+  std::vector<std::string> index_files = {"index.html"};
+  // Answer directories without an index file with a listing, in HTML or,
+  // when Accept asks for application/json, JSON. With index the listings
+  // are cached until the directory changes.
+  bool list_directories = false;
+};
 
+// Serves the files under dir below path. Directories are redirected to
+// their path with a trailing slash, so relative links resolve inside them.
 class StaticRoute : public Route {
  public:
-  StaticRoute(const std::string& path, const std::string& dir);
+  StaticRoute(const std::string& path, const std::string& dir,
+              StaticOptions options = {});
   Method GetMethod() const override;
   std::string GetPath() const override;
   Handler::Ptr GetHandler() const override;
@@ -16,6 +40,8 @@ class StaticRoute : public Route {
  private:
   std::string path_;
   std::string dir_;
+  StaticOptions options_;
+  std::shared_ptr<internal::StaticIndex> index_;
 };
 }  // namespace hs
 #endif
@@ -0,0 +1,60 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_SYNC_ROUTE_H
+#define HTTP_SERVER_SYNC_ROUTE_H
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "http-server/enum.h"
+#include "http-server/request.h"
+#include "http-server/route.h"
+namespace hs {
+
+// Body of a SimpleResponse: a view of storage that outlives the response,
+// such as a string literal, or an owned string.
+class SimpleBody {
+ public:
+  SimpleBody() = default;
+  SimpleBody(const char *data) : data_(std::string_view(data)) {}
+  SimpleBody(std::string_view data) : data_(data) {}
+  SimpleBody(std::string data) : data_(std::move(data)) {}
+
+  std::string_view View() const;
+  // The body for handlers that stream it, copying nothing.
+  ResponseBody::Ptr Release() &&;
+
+ private:
+  std::variant<std::string_view, std::string> data_;
+};
+
+struct SimpleResponse {
+  StatusCode status = StatusCode::Ok;
+  // Content-Length and Connection are added by the server.
+  std::vector<std::pair<std::string_view, std::string>> headers;
+  SimpleBody body;
+};
+
+// Route answered by a plain function call. Over HTTP/1.1 the response is
+// written with a single gathered write, without a handler coroutine or
+// per-part allocations. Responding can't read the request body, so
+// connections whose request has one are closed afterwards.
+class SyncRoute : public Route {
+ public:
+  virtual SimpleResponse Respond(const Request &req) const = 0;
+  // Used where a streaming handler is needed: HTTP/2, middleware and
+  // wrapping routes. It refers to this route, which must outlive it.
+  Handler::Ptr GetHandler() const override;
+};
+}  // namespace hs
+#define SYNC_ROUTE(name, method, path, respond)                          \
+  class name : public hs::SyncRoute {                                    \
+   public:                                                               \
+    hs::Method GetMethod() const override { return method; }             \
+    std::string GetPath() const override { return path; }                \
+    hs::SimpleResponse Respond(const hs::Request &req) const override {  \
+      return respond(req);                                               \
+    }                                                                    \
+  }
+#endif  // !#ifndef HTTP_SERVER_SYNC_ROUTE_H
@@ -0,0 +1,60 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_TRACE_H
+#define HTTP_SERVER_TRACE_H
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "http-server/enum.h"
+namespace hs {
+
+// Stages of serving an HTTP/1.x request. Accept (the TLS handshake) and
+// Read (waiting for the request head) are only counted for the first
+// request of a connection; later requests start once their head is in.
+enum class TracePhase { Accept, Read, Parse, Route, Handler, Write };
+constexpr size_t kTracePhases = 6;
+std::string_view TracePhaseName(TracePhase phase);
+
+// One traced request, identified W3C Trace Context style.
+struct TraceSpan {
+  // 32 and 16 lowercase hex digits.
+  std::string trace_id;
+  std::string span_id;
+  // The caller's span from an incoming traceparent, empty without one.
+  std::string parent_span_id;
+  Method method;
+  std::string path;
+  // Path of the matched route, empty when none matched.
+  std::string route;
+  StatusCode status;
+  std::chrono::system_clock::time_point start;
+  std::chrono::nanoseconds duration;
+  std::array<std::chrono::nanoseconds, kTracePhases> phases;
+};
+
+// Receives the spans tail sampling keeps. Export runs on the io thread
+// that served the request, keep it short.
+struct TraceExporter {
+  typedef std::shared_ptr<TraceExporter> Ptr;
+
+  virtual void Export(const TraceSpan &span) = 0;
+  virtual ~TraceExporter();
+};
+
+// Appends each span to a file as one line of JSON.
+class FileTraceExporter : public TraceExporter {
+ public:
+  FileTraceExporter(const std::string &path);
+  void Export(const TraceSpan &span) override;
+
+ private:
+  std::mutex mutex_;
+  std::ofstream out_;
+};
+}  // namespace hs
+#endif  // !#ifndef HTTP_SERVER_TRACE_H
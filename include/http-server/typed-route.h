@@ -0,0 +1,338 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_TYPED_ROUTE_H
+#define HTTP_SERVER_TYPED_ROUTE_H
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <coro/async_generator.hpp>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "http-server/enum.h"
+#include "http-server/http-server.h"
+#include "http-server/request.h"
+#include "http-server/route.h"
+#include "http-server/sync-route.h"
+namespace hs {
+
+// A string literal usable as a template argument.
+template <size_t N>
+struct FixedString {
+  char data[N]{};
+  constexpr FixedString(const char (&s)[N]) { std::copy_n(s, N, data); }
+  constexpr std::string_view View() const { return {data, N - 1}; }
+};
+
+namespace internal {
+enum class ParamType { String, Int };
+
+struct PathSegment {
+  bool param = false;
+  ParamType type = ParamType::String;
+  // Literal text, or the parameter's name.
+  std::string_view text;
+};
+
+// Not constexpr: reaching it while parsing a pattern at compile time fails
+// the build with message in the diagnostic.
+inline void PatternError(const char *message) {
+  throw std::invalid_argument(message);
+}
+
+constexpr bool IsNameChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+// Number of segments in pattern, which is checked along the way: it starts
+// with '/', has no empty segments and no trailing slash (except "/"), and
+// each segment is either literal or a whole "{name}" or "{name:type}" with
+// type int or str.
+constexpr size_t CountSegments(std::string_view pattern) {
+  if (!pattern.starts_with('/')) PatternError("route must start with '/'");
+  if (pattern == "/") return 0;
+  if (pattern.ends_with('/')) PatternError("route has a trailing '/'");
+  size_t count = 0;
+  auto rest = pattern.substr(1);
+  for (;;) {
+    auto end = rest.find('/');
+    auto segment = rest.substr(0, end);
+    if (segment.empty()) PatternError("route has an empty segment");
+    if (segment.starts_with('{')) {
+      if (!segment.ends_with('}')) PatternError("unclosed '{' in route");
+      auto inner = segment.substr(1, segment.size() - 2);
+      auto colon = inner.find(':');
+      auto name = inner.substr(0, colon);
+      if (name.empty() || !std::all_of(name.begin(), name.end(), IsNameChar)) {
+        PatternError("bad parameter name in route");
+      }
+      if (colon != std::string_view::npos) {
+        auto type = inner.substr(colon + 1);
+        if (type != "int" && type != "str") {
+          PatternError("parameter type must be int or str");
+        }
+      }
+    } else if (segment.find_first_of("{}") != std::string_view::npos) {
+      PatternError("'{' or '}' inside a literal route segment");
+    }
+    ++count;
+    if (end == std::string_view::npos) break;
+    rest = rest.substr(end + 1);
+  }
+  return count;
+}
+
+template <size_t N>
+constexpr std::array<PathSegment, N> ParseSegments(std::string_view pattern) {
+  std::array<PathSegment, N> segments{};
+  auto rest = pattern.substr(1);
+  for (size_t i = 0; i < N; ++i) {
+    auto end = rest.find('/');
+    auto segment = rest.substr(0, end);
+    if (segment.starts_with('{')) {
+      auto inner = segment.substr(1, segment.size() - 2);
+      auto colon = inner.find(':');
+      segments[i].param = true;
+      segments[i].text = inner.substr(0, colon);
+      if (colon != std::string_view::npos && inner.substr(colon + 1) == "int") {
+        segments[i].type = ParamType::Int;
+      }
+      for (size_t j = 0; j < i; ++j) {
+        if (segments[j].param && segments[j].text == segments[i].text) {
+          PatternError("duplicate parameter name in route");
+        }
+      }
+    } else {
+      segments[i].text = segment;
+    }
+    rest = rest.substr(end + 1);
+  }
+  return segments;
+}
+
+template <ParamType T>
+using ParamValue =
+    std::conditional_t<T == ParamType::Int, int, std::string_view>;
+
+// A route pattern such as "/users/{id:int}/posts/{slug}", parsed at compile
+// time. Match parses a request path against it without allocating.
+template <FixedString Pattern>
+struct TypedPath {
+  static constexpr size_t kSegments = CountSegments(Pattern.View());
+  static constexpr std::array<PathSegment, kSegments> kParsed =
+      ParseSegments<kSegments>(Pattern.View());
+  static constexpr size_t kParams =
+      std::count_if(kParsed.begin(), kParsed.end(),
+                    [](const PathSegment &segment) { return segment.param; });
+  // Segment index of each parameter.
+  static constexpr std::array<size_t, kParams> kParamSegments = []() {
+    std::array<size_t, kParams> indexes{};
+    size_t param = 0;
+    for (size_t i = 0; i < kSegments; ++i) {
+      if (kParsed[i].param) indexes[param++] = i;
+    }
+    return indexes;
+  }();
+
+  template <size_t... I>
+  static auto MakeParams(std::index_sequence<I...>)
+      -> std::tuple<ParamValue<kParsed[kParamSegments[I]].type>...>;
+  // Values of the parameters in order, e.g. std::tuple<int, string_view>.
+  typedef decltype(MakeParams(std::make_index_sequence<kParams>{})) Params;
+
+  // Segments of path holding the parameters, in order, nullopt when a
+  // segment count or literal differs. Views point into path.
+  static std::optional<std::array<std::string_view, kParams>> Values(
+      std::string_view path) {
+    if (!path.starts_with('/')) return std::nullopt;
+    path.remove_prefix(1);
+    if (path.ends_with('/')) path.remove_suffix(1);
+    std::array<std::string_view, kSegments> segments;
+    size_t count = 0;
+    while (!path.empty()) {
+      if (count == kSegments) return std::nullopt;
+      auto end = path.find('/');
+      segments[count++] = path.substr(0, end);
+      path = end == std::string_view::npos ? std::string_view()
+                                           : path.substr(end + 1);
+    }
+    if (count != kSegments) return std::nullopt;
+    for (size_t i = 0; i < kSegments; ++i) {
+      if (!kParsed[i].param && segments[i] != kParsed[i].text) {
+        return std::nullopt;
+      }
+    }
+    std::array<std::string_view, kParams> values;
+    for (size_t i = 0; i < kParams; ++i) {
+      values[i] = segments[kParamSegments[i]];
+    }
+    return values;
+  }
+  // Parameters from the values of their segments, nullopt when one is empty
+  // or an int one doesn't parse. Views point into values.
+  template <typename Strings>
+  static std::optional<Params> Convert(const Strings &values) {
+    Params params;
+    bool ok = Convert(values, params, std::make_index_sequence<kParams>{});
+    if (!ok) return std::nullopt;
+    return params;
+  }
+  // Parameters of path, nullopt when it doesn't match: a segment count,
+  // literal or int parameter that differs. Views point into path.
+  static std::optional<Params> Match(std::string_view path) {
+    auto values = Values(path);
+    if (!values) return std::nullopt;
+    return Convert(*values);
+  }
+
+ private:
+  template <typename Strings, size_t... I>
+  static bool Convert(const Strings &values, Params &params,
+                      std::index_sequence<I...>) {
+    return (Parse(values[I], std::get<I>(params)) && ...);
+  }
+  static bool Parse(std::string_view segment, std::string_view &value) {
+    value = segment;
+    return !segment.empty();
+  }
+  static bool Parse(std::string_view segment, int &value) {
+    auto end = segment.data() + segment.size();
+    auto [ptr, ec] = std::from_chars(segment.data(), end, value);
+    return ec == std::errc() && ptr == end && !segment.empty();
+  }
+};
+
+template <typename Path, auto Fn, typename Params = typename Path::Params>
+struct TypedCall;
+template <typename Path, auto Fn, typename... Args>
+struct TypedCall<Path, Fn, std::tuple<Args...>> {
+  static constexpr bool kSync =
+      std::is_invocable_r_v<SimpleResponse, decltype(Fn), const Request &,
+                            Args...>;
+  static_assert(kSync || std::is_invocable_r_v<coro::async_generator<Response>,
+                                               decltype(Fn), const Request,
+                                               Args...>,
+                "A typed route's function takes the request and the route's "
+                "parameters and returns a SimpleResponse or a "
+                "coro::async_generator<Response>");
+
+  static auto Call(const Request &req) {
+    // A CompiledRoutes table leaves the values in the request's params; a
+    // route called some other way parses the path.
+    auto &values = req.Params();
+    auto params = values.size() == Path::kParams ? Path::Convert(values)
+                                                 : Path::Match(req.Path());
+    if (!params) throw Exception(StatusCode::NotFound, "route not matched");
+    return std::apply([&req](Args... args) { return Fn(req, args...); },
+                      *params);
+  }
+};
+
+template <typename Call>
+struct TypedHandler : public Handler {
+  // A coroutine itself, so req lives as long as the generator of a function
+  // taking it by reference.
+  coro::async_generator<Response> Handle(const Request req) override {
+    auto gen = Call::Call(req);
+    for (auto iter = co_await gen.begin(); iter != gen.end(); co_await ++iter) {
+      co_yield *iter;
+    }
+  }
+};
+
+template <typename Call, bool Sync = Call::kSync>
+class TypedRouteBase;
+template <typename Call>
+class TypedRouteBase<Call, true> : public SyncRoute {
+ public:
+  SimpleResponse Respond(const Request &req) const override {
+    return Call::Call(req);
+  }
+};
+template <typename Call>
+class TypedRouteBase<Call, false> : public Route {
+ public:
+  Handler::Ptr GetHandler() const override {
+    return std::make_shared<TypedHandler<Call>>();
+  }
+};
+}  // namespace internal
+
+// A route whose pattern is parsed at compile time: a malformed one fails the
+// build. Parameters are declared as "{name}" or "{name:str}", passed as a
+// std::string_view, or "{name:int}", passed as an int; paths whose int
+// segments don't parse don't match. Fn is called with the request and the
+// parameters in order, e.g. for "/users/{id:int}/posts/{slug}"
+//   SimpleResponse Post(const Request &req, int id, std::string_view slug);
+// Returning a SimpleResponse makes it a SyncRoute; a function returning
+// coro::async_generator<Response> streams its response instead. Typed
+// routes are matched through a CompiledRoutes table.
+template <Method M, FixedString Pattern, auto Fn>
+class TypedRoute final : public internal::TypedRouteBase<internal::TypedCall<
+                             internal::TypedPath<Pattern>, Fn>> {
+ public:
+  typedef internal::TypedPath<Pattern> Path;
+  static constexpr Method kMethod = M;
+  static constexpr std::string_view kPattern = Pattern.View();
+
+  Method GetMethod() const override { return M; }
+  std::string GetPath() const override { return std::string(kPattern); }
+};
+
+// A fixed table of typed routes, checked in order; only a match allocates,
+// for its params. Two routes with the same method and pattern fail the
+// build. Register it with
+// HttpServer::UseRouteTable; requests it doesn't match go to the routes
+// added at run time.
+template <typename... Routes>
+class CompiledRoutes : public RouteTable {
+  static constexpr bool Unique() {
+    std::array<std::pair<Method, std::string_view>, sizeof...(Routes)> keys{
+        std::pair(Routes::kMethod, Routes::kPattern)...};
+    for (size_t i = 0; i < keys.size(); ++i) {
+      for (size_t j = 0; j < i; ++j) {
+        if (keys[i] == keys[j]) return false;
+      }
+    }
+    return true;
+  }
+  static_assert(Unique(), "route declared twice");
+
+ public:
+  CompiledRoutes() : routes_{std::make_shared<Routes>()...} {}
+
+  Route::Ptr Match(Method method, std::string_view path,
+                   std::vector<std::string> &params) const override {
+    Route::Ptr matched;
+    std::apply(
+        [&](const auto &...route) {
+          ((Matches(*route, method, path, params) && (matched = route, true)) ||
+           ...);
+        },
+        routes_);
+    return matched;
+  }
+
+ private:
+  template <typename R>
+  static bool Matches(const R &, Method method, std::string_view path,
+                      std::vector<std::string> &params) {
+    if (R::kMethod != method) return false;
+    auto values = R::Path::Values(path);
+    if (!values || !R::Path::Convert(*values)) return false;
+    params.assign(values->begin(), values->end());
+    return true;
+  }
+
+  std::tuple<std::shared_ptr<Routes>...> routes_;
+};
+}  // namespace hs
+#endif  // !#ifndef HTTP_SERVER_TYPED_ROUTE_H
@@ -0,0 +1,69 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#ifndef HTTP_SERVER_WEBSOCKET_H
+#define HTTP_SERVER_WEBSOCKET_H
+#include <coro/async_generator.hpp>
+#include <coro/task.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "http-server/enum.h"
+#include "http-server/request.h"
+#include "http-server/route.h"
+namespace hs {
+
+namespace internal {
+class WebSocketImpl;
+}  // namespace internal
+
+enum class MessageType { Text, Binary };
+
+struct WebSocketMessage {
+  MessageType type;
+  // Points into the connection's read buffer and stays valid until the next
+  // message is requested.
+  std::string_view data;
+};
+
+class WebSocket {
+ public:
+  WebSocket(std::shared_ptr<internal::WebSocketImpl> pimpl);
+  ~WebSocket();
+
+  // Yields messages until the peer closes the connection.
+  coro::async_generator<WebSocketMessage> Receive() const;
+  coro::task<> Send(std::string_view data,
+                    MessageType type = MessageType::Text) const;
+  coro::task<> Close(uint16_t code = 1000, std::string_view reason = {}) const;
+  bool IsOpen() const;
+
+ private:
+  std::shared_ptr<internal::WebSocketImpl> pimpl_;
+};
+
+struct WebSocketHandler {
+  typedef std::shared_ptr<WebSocketHandler> Ptr;
+
+  // The connection is closed once Handle returns.
+  virtual coro::task<> Handle(const Request req, WebSocket ws) = 0;
+  virtual ~WebSocketHandler();
+};
+
+// A GET route that upgrades to a WebSocket. Requests without the upgrade
+// headers get 426 Upgrade Required.
+struct WebSocketRoute : public Route {
+  Method GetMethod() const override;
+  Handler::Ptr GetHandler() const override;
+  virtual WebSocketHandler::Ptr GetWebSocketHandler() const = 0;
+};
+}  // namespace hs
+#define WEBSOCKET_ROUTE(name, path, handler)                         \
+  class name : public hs::WebSocketRoute {                           \
+   public:                                                           \
+    std::string GetPath() const override { return path; }            \
+    hs::WebSocketHandler::Ptr GetWebSocketHandler() const override { \
+      return handler();                                              \
+    }                                                                \
+  }
+#endif  // !#ifndef HTTP_SERVER_WEBSOCKET_H
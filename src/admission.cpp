@@ -0,0 +1,127 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include "http-server/internal/admission.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+namespace hs::internal {
+namespace {
+// Ceiling for the adaptive limit when max_in_flight leaves it open.
+constexpr double kDefaultMaxLimit = 1000;
+// Multiplicative decrease applied when a request misses the latency target.
+constexpr double kBackoff = 0.9;
+}  // namespace
+
+AdmissionController::Permit::Permit(AdmissionController *controller,
+                                    const Route *route, bool metered)
+    : controller_(controller),
+      route_(route),
+      metered_(metered),
+      start_(std::chrono::steady_clock::now()) {}
+
+AdmissionController::Permit::Permit(Permit &&other)
+    : controller_(std::exchange(other.controller_, nullptr)),
+      route_(other.route_),
+      metered_(other.metered_),
+      start_(other.start_) {}
+
+AdmissionController::Permit::~Permit() {
+  if (!controller_) return;
+  controller_->Release(route_, metered_);
+  if (metered_) {
+    controller_->RecordLatency(std::chrono::steady_clock::now() - start_);
+  }
+}
+
+AdmissionController::AdmissionController(const Config &config)
+    : max_in_flight_(config.max_in_flight),
+      adaptive_(config.adaptive_concurrency),
+      latency_target_(config.adaptive_latency_target),
+      min_limit_(std::max<double>(config.adaptive_min_limit, 1)),
+      max_limit_(config.max_in_flight > 0
+                     ? std::max<double>(config.max_in_flight, min_limit_)
+                     : std::max(kDefaultMaxLimit, min_limit_)),
+      limit_(max_limit_) {
+  for (auto &rate_limit : config.rate_limits) {
+    rate_limiters_.push_back(std::make_unique<RateLimiter>(rate_limit));
+  }
+}
+
+std::optional<AdmissionController::Permit> AdmissionController::Admit(
+    const Route &route) {
+  size_t route_limit = route.MaxConcurrency();
+  bool metered = !route.Unmetered();
+  std::lock_guard lock(mutex_);
+  if (route_limit > 0) {
+    auto it = route_in_flight_.find(&route);
+    if (it != route_in_flight_.end() && it->second >= route_limit) {
+      spdlog::debug("Rejecting request over the route's limit {}",
+                    route_limit);
+      return std::nullopt;
+    }
+  }
+  if (metered) {
+    if ((max_in_flight_ > 0 && in_flight_ >= max_in_flight_) ||
+        (adaptive_ && in_flight_ >= static_cast<size_t>(limit_))) {
+      spdlog::debug("Rejecting request with {} in flight", in_flight_);
+      return std::nullopt;
+    }
+    ++in_flight_;
+  }
+  if (route_limit > 0) ++route_in_flight_[&route];
+  return Permit(this, route_limit > 0 ? &route : nullptr, metered);
+}
+
+std::optional<Headers> AdmissionController::RateLimited(
+    const Route &route, const RequestImpl &request) {
+  std::string storage;
+  for (auto &limiter : rate_limiters_) {
+    if (!limiter->Applies(route)) continue;
+    auto key = limiter->Key(request, storage);
+    if (!key) continue;
+    auto decision = limiter->Check(*key);
+    if (!decision.allowed) {
+      spdlog::debug("Rejecting request over the rate limit of {}/s",
+                    limiter->Options().rate);
+      return limiter->RefusedHeaders(decision);
+    }
+  }
+  return std::nullopt;
+}
+
+void AdmissionController::RecordLatency(
+    std::chrono::steady_clock::duration latency) {
+  if (!adaptive_) return;
+  std::lock_guard lock(mutex_);
+  if (latency <= latency_target_) {
+    // Additive increase, about one slot per limit's worth of requests.
+    limit_ = std::min(max_limit_, limit_ + 1 / limit_);
+  } else {
+    limit_ = std::max(min_limit_, limit_ * kBackoff);
+  }
+}
+
+size_t AdmissionController::InFlight() const {
+  std::lock_guard lock(mutex_);
+  return in_flight_;
+}
+
+size_t AdmissionController::Limit() const {
+  std::lock_guard lock(mutex_);
+  if (adaptive_) return static_cast<size_t>(limit_);
+  return max_in_flight_;
+}
+
+void AdmissionController::Release(const Route *route, bool metered) {
+  std::lock_guard lock(mutex_);
+  if (metered) --in_flight_;
+  if (!route) return;
+  auto it = route_in_flight_.find(route);
+  if (it != route_in_flight_.end() && --it->second == 0) {
+    route_in_flight_.erase(it);
+  }
+}
+}  // namespace hs::internal
@@ -0,0 +1,291 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include "http-server/cache.h"
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <asio/post.hpp>
+#include <cctype>
+#include <coro/async_generator.hpp>
+#include <string_view>
+#include <utility>
+#include <variant>
+
+#include "http-server/internal/cache.h"
+#include "http-server/internal/worker-pool.h"
+
+namespace hs {
+namespace internal {
+namespace {
+
+std::string Lower(std::string_view value) {
+  std::string lower(value);
+  std::transform(lower.begin(), lower.end(), lower.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return lower;
+}
+
+// Records a handler's response while it is forwarded to the client.
+struct Capture {
+  size_t limit;
+  StatusCode status = StatusCode::Ok;
+  Headers headers;
+  std::string body;
+  bool cacheable = true;
+
+  void operator()(StatusCode code) {
+    status = code;
+    if (code != StatusCode::Ok) cacheable = false;
+  }
+  void operator()(const Headers &more) {
+    for (auto &[name, value] : more) {
+      auto lower = Lower(name);
+      if (lower == "set-cookie" ||
+          (lower == "cache-control" &&
+           (value.find("no-store") != std::string::npos ||
+            value.find("private") != std::string::npos))) {
+        cacheable = false;
+      }
+      headers[name] = value;
+    }
+  }
+  void operator()(const ResponseBody::Ptr &part) {
+    if (!cacheable) return;
+    if (body.size() + part->GetSize() > limit) {
+      cacheable = false;
+      std::string().swap(body);
+      return;
+    }
+    body.append(static_cast<const char *>(part->GetData()), part->GetSize());
+  }
+};
+
+// Hands the key back when its filling request ends without a response to
+// cache, so waiters don't hang.
+struct FillGuard {
+  std::shared_ptr<ResponseCacheImpl> cache;
+  std::string key;
+  bool pending;
+
+  void Complete(CacheEntry::Ptr entry) {
+    pending = false;
+    cache->Complete(key, std::move(entry));
+  }
+  ~FillGuard() {
+    if (pending) cache->Complete(key, nullptr);
+  }
+};
+
+class CachingHandler : public Handler {
+ public:
+  CachingHandler(Handler::Ptr handler, std::shared_ptr<ResponseCacheImpl> cache)
+      : handler_(std::move(handler)), cache_(std::move(cache)) {}
+
+  coro::async_generator<Response> Handle(const Request req) override {
+    auto use = cache_->Use(req);
+    std::string key;
+    bool leader = false;
+    CacheEntry::Ptr entry;
+    if (use != CacheUse::Bypass) {
+      key = cache_->Key(req);
+      if (use == CacheUse::Normal) entry = cache_->Lookup(key);
+      if (!entry) {
+        // A fill already in flight is as fresh as one of our own.
+        if (auto waiter = cache_->Join(key)) {
+          co_await waiter->event;
+          entry = cache_->Lookup(key);
+        } else {
+          leader = true;
+        }
+      }
+    }
+    if (entry) {
+      // Replayed as parts like any response, so the session and middleware
+      // see the status and headers.
+      co_yield entry->status;
+      auto headers = entry->headers;
+      co_yield headers;
+      co_yield entry->body;
+      co_return;
+    }
+
+    // A miss, a bypass, or the response we waited for could not be cached.
+    FillGuard guard{cache_, key, leader};
+    Capture capture{cache_->Options().max_entry_bytes};
+    auto gen = handler_->Handle(req);
+    for (auto iter = co_await gen.begin(); iter != gen.end(); co_await ++iter) {
+      if (leader) std::visit(capture, *iter);
+      co_yield *iter;
+      if (IsDone()) handler_->SetDone();
+    }
+    if (leader && capture.cacheable && !IsDone()) {
+      guard.Complete(BuildCacheEntry(
+          capture.status, std::move(capture.headers), std::move(capture.body),
+          std::chrono::steady_clock::now() + cache_->Options().ttl));
+    }
+  }
+
+ private:
+  Handler::Ptr handler_;
+  std::shared_ptr<ResponseCacheImpl> cache_;
+};
+}  // namespace
+
+CacheEntry::Ptr BuildCacheEntry(StatusCode status, Headers headers,
+                                std::string body,
+                                std::chrono::steady_clock::time_point expires) {
+  std::erase_if(headers, [](const auto &header) {
+    auto name = Lower(header.first);
+    return name == "connection" || name == "content-length" ||
+           name == "transfer-encoding";
+  });
+  headers["Content-Length"] = fmt::format("{}", body.size());
+
+  auto entry = std::make_shared<CacheEntry>();
+  entry->status = status;
+  entry->bytes = body.size();
+  for (auto &[name, value] : headers) {
+    entry->bytes += name.size() + value.size();
+  }
+  entry->headers = std::move(headers);
+  entry->body =
+      std::make_shared<WritableResponseBody<std::string>>(std::move(body));
+  entry->expires = expires;
+  return entry;
+}
+
+ResponseCacheImpl::ResponseCacheImpl(CacheOptions options)
+    : options_(std::move(options)) {}
+
+const CacheOptions &ResponseCacheImpl::Options() const { return options_; }
+
+std::string ResponseCacheImpl::Key(const Request &request) const {
+  std::string key(request.Path());
+  key += '?';
+  key += request.Query();
+  for (auto &name : options_.vary) {
+    key += '\n';
+    key += name;
+    key += ':';
+    if (auto value = request.Header(name)) key += *value;
+  }
+  return key;
+}
+
+CacheUse ResponseCacheImpl::Use(const Request &request) const {
+  // A shared cache must not hand one client's credentialed response to
+  // another, unless the credentials are part of the key.
+  for (std::string_view name : {"Authorization", "Cookie"}) {
+    if (!request.Header(name)) continue;
+    if (std::none_of(options_.vary.begin(), options_.vary.end(),
+                     [&](auto &vary) { return Lower(vary) == Lower(name); })) {
+      return CacheUse::Bypass;
+    }
+  }
+  auto control = request.Header("Cache-Control");
+  if (!control) return CacheUse::Normal;
+  auto directives = Lower(*control);
+  if (directives.find("no-store") != std::string::npos) {
+    return CacheUse::Bypass;
+  }
+  if (directives.find("no-cache") != std::string::npos) {
+    return CacheUse::Refresh;
+  }
+  return CacheUse::Normal;
+}
+
+CacheEntry::Ptr ResponseCacheImpl::Lookup(const std::string &key) {
+  std::lock_guard lock(mutex_);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) return nullptr;
+  if (std::chrono::steady_clock::now() >= it->second.entry->expires) {
+    Erase(it);
+    return nullptr;
+  }
+  lru_.splice(lru_.begin(), lru_, it->second.lru);
+  return it->second.entry;
+}
+
+CacheWaiter::Ptr ResponseCacheImpl::Join(const std::string &key) {
+  std::lock_guard lock(mutex_);
+  auto [it, inserted] = in_flight_.try_emplace(key);
+  if (inserted) return nullptr;
+  auto waiter = std::make_shared<CacheWaiter>();
+  waiter->executor = CurrentIoExecutor();
+  it->second.push_back(waiter);
+  return waiter;
+}
+
+void ResponseCacheImpl::Complete(const std::string &key,
+                                 CacheEntry::Ptr entry) {
+  std::vector<CacheWaiter::Ptr> waiters;
+  {
+    std::lock_guard lock(mutex_);
+    if (entry && entry->bytes <= options_.max_bytes) {
+      if (auto it = entries_.find(key); it != entries_.end()) Erase(it);
+      lru_.push_front(key);
+      bytes_ += entry->bytes;
+      entries_[key] = Slot{std::move(entry), lru_.begin()};
+      while (bytes_ > options_.max_bytes) Erase(entries_.find(lru_.back()));
+    }
+    if (auto it = in_flight_.find(key); it != in_flight_.end()) {
+      waiters = std::move(it->second);
+      in_flight_.erase(it);
+    }
+  }
+  // Waiters resume on their own io thread.
+  for (auto &waiter : waiters) {
+    if (waiter->executor) {
+      asio::post(*waiter->executor, [waiter]() { waiter->event.set(); });
+    } else {
+      waiter->event.set();
+    }
+  }
+}
+
+size_t ResponseCacheImpl::Size() const {
+  std::lock_guard lock(mutex_);
+  return entries_.size();
+}
+
+size_t ResponseCacheImpl::Bytes() const {
+  std::lock_guard lock(mutex_);
+  return bytes_;
+}
+
+void ResponseCacheImpl::Clear() {
+  std::lock_guard lock(mutex_);
+  entries_.clear();
+  lru_.clear();
+  bytes_ = 0;
+}
+
+void ResponseCacheImpl::Erase(
+    std::unordered_map<std::string, Slot>::iterator it) {
+  bytes_ -= it->second.entry->bytes;
+  lru_.erase(it->second.lru);
+  entries_.erase(it);
+}
+}  // namespace internal
+
+ResponseCache::ResponseCache(CacheOptions options)
+    : pimpl_(std::make_shared<internal::ResponseCacheImpl>(
+          std::move(options))) {}
+ResponseCache::~ResponseCache() {}
+size_t ResponseCache::Size() const { return pimpl_->Size(); }
+size_t ResponseCache::Bytes() const { return pimpl_->Bytes(); }
+void ResponseCache::Clear() const { pimpl_->Clear(); }
+
+CachedRoute::CachedRoute(Route::Ptr route, ResponseCache::Ptr cache)
+    : route_(std::move(route)), cache_(std::move(cache)) {}
+Method CachedRoute::GetMethod() const { return route_->GetMethod(); }
+std::string CachedRoute::GetPath() const { return route_->GetPath(); }
+Handler::Ptr CachedRoute::GetHandler() const {
+  if (route_->GetMethod() != Method::GET) return route_->GetHandler();
+  return std::make_shared<internal::CachingHandler>(route_->GetHandler(),
+                                                    cache_->pimpl_);
+}
+size_t CachedRoute::MaxConcurrency() const { return route_->MaxConcurrency(); }
+bool CachedRoute::Unmetered() const { return route_->Unmetered(); }
+}  // namespace hs
@@ -0,0 +1,389 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include "http-server/form.h"
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cctype>
+#include <exception>
+#include <fstream>
+#include <random>
+#include <system_error>
+
+#include "http-server/http-server.h"
+#include "http-server/internal/form.h"
+#include "http-server/internal/url.h"
+#include "http-server/offload.h"
+
+namespace hs {
+namespace internal {
+namespace {
+std::string_view Trim(std::string_view s) {
+  size_t start = s.find_first_not_of(" \t");
+  if (start == std::string_view::npos) return {};
+  size_t end = s.find_last_not_of(" \t");
+  return s.substr(start, end - start + 1);
+}
+
+bool EqualsIgnoreCase(std::string_view a, std::string_view b) {
+  return a.size() == b.size() &&
+         std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+           return std::tolower(static_cast<unsigned char>(x)) ==
+                  std::tolower(static_cast<unsigned char>(y));
+         });
+}
+
+bool IsMediaType(std::string_view content_type, std::string_view type) {
+  return EqualsIgnoreCase(Trim(content_type.substr(0, content_type.find(';'))),
+                          type);
+}
+
+// Decodes one urlencoded name=value pair into name and value.
+std::pair<std::string_view, std::string_view> DecodePair(
+    std::string_view pair, std::string &name, std::string &value) {
+  size_t eq = pair.find('=');
+  auto raw_value =
+      eq == std::string_view::npos ? std::string_view() : pair.substr(eq + 1);
+  return {PercentDecode(pair.substr(0, eq), name, true),
+          PercentDecode(raw_value, value, true)};
+}
+
+std::string UploadName() {
+  thread_local std::mt19937_64 random(std::random_device{}());
+  return fmt::format("upload-{:016x}", random());
+}
+}  // namespace
+
+std::optional<std::string_view> HeaderParam(std::string_view header,
+                                            std::string_view name) {
+  size_t pos = header.find(';');
+  while (pos != std::string_view::npos) {
+    header.remove_prefix(pos + 1);
+    size_t eq = header.find('=');
+    if (eq == std::string_view::npos) return std::nullopt;
+    auto key = Trim(header.substr(0, eq));
+    header = header.substr(eq + 1);
+    header.remove_prefix(std::min(header.find_first_not_of(" \t"),
+                                  header.size()));
+    std::string_view value;
+    if (header.starts_with('"')) {
+      size_t close = header.find('"', 1);
+      if (close == std::string_view::npos) return std::nullopt;
+      value = header.substr(1, close - 1);
+      header.remove_prefix(close + 1);
+      pos = header.find(';');
+    } else {
+      pos = header.find(';');
+      value = Trim(header.substr(0, pos));
+    }
+    if (EqualsIgnoreCase(key, name)) return value;
+  }
+  return std::nullopt;
+}
+
+MultipartParser::MultipartParser(std::string_view boundary,
+                                 const FormLimits &limits)
+    : limits_(limits),
+      delimiter_(fmt::format("\r\n--{}", boundary)),
+      searcher_(delimiter_.begin(), delimiter_.end()),
+      // The first delimiter may open the body without a line break.
+      buffer_("\r\n") {}
+
+void MultipartParser::Feed(std::string_view input) {
+  buffer_.erase(0, pos_);
+  pos_ = 0;
+  buffer_.append(input);
+}
+
+size_t MultipartParser::Find(std::string_view input) const {
+  auto found = searcher_(input.begin(), input.end()).first;
+  return found == input.end() ? std::string_view::npos
+                              : found - input.begin();
+}
+
+MultipartParser::Event MultipartParser::Next(std::string_view &data) {
+  while (true) {
+    auto input = std::string_view(buffer_).substr(pos_);
+    // Bytes that may hold the start of a delimiter split across reads.
+    size_t keep = delimiter_.size() - 1;
+    switch (state_) {
+      case State::Preamble: {
+        size_t found = Find(input);
+        if (found == std::string_view::npos) {
+          if (input.size() > keep) pos_ += input.size() - keep;
+          return Event::NeedMore;
+        }
+        pos_ += found + delimiter_.size();
+        state_ = State::Delimiter;
+        break;
+      }
+      case State::Delimiter: {
+        if (input.size() < 2) return Event::NeedMore;
+        if (input.starts_with("--")) {
+          // The epilogue is ignored.
+          state_ = State::Done;
+          break;
+        }
+        size_t eol = input.find("\r\n");
+        if (eol == std::string_view::npos) {
+          if (input.size() > limits_.max_header_size) {
+            throw Exception(StatusCode::BadRequest, "Malformed multipart body");
+          }
+          return Event::NeedMore;
+        }
+        if (!Trim(input.substr(0, eol)).empty()) {
+          throw Exception(StatusCode::BadRequest, "Malformed multipart body");
+        }
+        if (++parts_ > limits_.max_parts) {
+          throw Exception(StatusCode::PayloadTooLarge, "Too many form parts");
+        }
+        pos_ += eol + 2;
+        state_ = State::Headers;
+        break;
+      }
+      case State::Headers: {
+        size_t end = input.starts_with("\r\n") ? 0 : input.find("\r\n\r\n");
+        if (end == std::string_view::npos
+                ? input.size() > limits_.max_header_size
+                : end > limits_.max_header_size) {
+          throw Exception(StatusCode::PayloadTooLarge,
+                          "Form part headers too large");
+        }
+        if (end == std::string_view::npos) return Event::NeedMore;
+        header_block_.assign(input.substr(0, end));
+        ParseHeaders(header_block_);
+        pos_ += end == 0 ? 2 : end + 4;
+        part_size_ = 0;
+        state_ = State::Body;
+        return Event::PartBegin;
+      }
+      case State::Body: {
+        size_t found = Find(input);
+        size_t size = found != std::string_view::npos ? found
+                      : input.size() > keep           ? input.size() - keep
+                                                      : 0;
+        if (size > 0) {
+          part_size_ += size;
+          if (part_size_ > limits_.max_part_size) {
+            throw Exception(StatusCode::PayloadTooLarge, "Form part too large");
+          }
+          data = input.substr(0, size);
+          pos_ += size;
+          return Event::Data;
+        }
+        if (found == std::string_view::npos) return Event::NeedMore;
+        pos_ += delimiter_.size();
+        state_ = State::Delimiter;
+        return Event::PartEnd;
+      }
+      case State::Done:
+        pos_ = buffer_.size();
+        return Event::Done;
+    }
+  }
+}
+
+void MultipartParser::ParseHeaders(std::string_view block) {
+  part_.headers.clear();
+  while (!block.empty()) {
+    size_t eol = block.find("\r\n");
+    auto line = block.substr(0, eol);
+    block.remove_prefix(eol == std::string_view::npos ? block.size()
+                                                      : eol + 2);
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos || colon == 0) {
+      throw Exception(StatusCode::BadRequest, "Malformed form part header");
+    }
+    part_.headers.emplace_back(line.substr(0, colon),
+                               Trim(line.substr(colon + 1)));
+  }
+}
+}  // namespace internal
+
+std::optional<std::string_view> FormPart::Header(std::string_view name) const {
+  for (auto &[key, value] : headers) {
+    if (internal::EqualsIgnoreCase(key, name)) return value;
+  }
+  return std::nullopt;
+}
+
+std::string_view FormPart::Name() const {
+  auto disposition = Header("Content-Disposition");
+  if (!disposition) return {};
+  return internal::HeaderParam(*disposition, "name").value_or("");
+}
+
+std::optional<std::string_view> FormPart::Filename() const {
+  auto disposition = Header("Content-Disposition");
+  if (!disposition) return std::nullopt;
+  return internal::HeaderParam(*disposition, "filename");
+}
+
+std::string_view FormPart::ContentType() const {
+  return Header("Content-Type").value_or("text/plain");
+}
+
+coro::async_generator<FormChunk> ParseMultipart(Request req,
+                                                FormLimits limits) {
+  auto content_type = req.Header("Content-Type").value_or("");
+  std::optional<std::string_view> boundary;
+  if (internal::IsMediaType(content_type, "multipart/form-data")) {
+    boundary = internal::HeaderParam(content_type, "boundary");
+  }
+  // RFC 2046 caps boundaries at 70 characters.
+  if (!boundary || boundary->empty() || boundary->size() > 70) {
+    throw Exception(StatusCode::BadRequest, "Missing multipart boundary");
+  }
+  typedef internal::MultipartParser::Event Event;
+  internal::MultipartParser parser(*boundary, limits);
+  auto body = req.BodyChunks();
+  auto it = co_await body.begin();
+  while (true) {
+    std::string_view data;
+    auto event = parser.Next(data);
+    if (event == Event::NeedMore) {
+      if (it == body.end()) {
+        throw Exception(StatusCode::BadRequest, "Truncated multipart body");
+      }
+      parser.Feed(*it);
+      co_await ++it;
+    } else if (event == Event::Data || event == Event::PartEnd) {
+      FormChunk chunk{&parser.Part(), data, event == Event::PartEnd};
+      co_yield chunk;
+    } else if (event == Event::Done) {
+      break;
+    }
+  }
+  // Drain the epilogue so the connection can be reused.
+  while (it != body.end()) co_await ++it;
+}
+
+coro::async_generator<std::pair<std::string_view, std::string_view>>
+ParseUrlEncoded(Request req, FormLimits limits) {
+  // A pair split across chunks is gathered here.
+  std::string pending;
+  std::string name, value;
+  size_t fields = 0;
+  auto next_field = [&](std::string_view pair) {
+    if (pair.size() > limits.max_field_size) {
+      throw Exception(StatusCode::PayloadTooLarge, "Form field too large");
+    }
+    if (++fields > limits.max_parts) {
+      throw Exception(StatusCode::PayloadTooLarge, "Too many form fields");
+    }
+    return internal::DecodePair(pair, name, value);
+  };
+  auto body = req.BodyChunks();
+  for (auto it = co_await body.begin(); it != body.end();) {
+    std::string_view chunk = *it;
+    for (size_t amp = chunk.find('&'); amp != std::string_view::npos;
+         amp = chunk.find('&')) {
+      auto pair = chunk.substr(0, amp);
+      chunk.remove_prefix(amp + 1);
+      if (!pending.empty()) pair = pending.append(pair);
+      if (!pair.empty()) {
+        auto field = next_field(pair);
+        co_yield field;
+      }
+      pending.clear();
+    }
+    pending.append(chunk);
+    if (pending.size() > limits.max_field_size) {
+      throw Exception(StatusCode::PayloadTooLarge, "Form field too large");
+    }
+    co_await ++it;
+  }
+  if (!pending.empty()) {
+    auto field = next_field(pending);
+    co_yield field;
+  }
+}
+
+coro::task<std::vector<FormField>> ReadForm(Request req,
+                                            std::filesystem::path upload_dir,
+                                            FormLimits limits) {
+  std::vector<FormField> fields;
+  auto content_type = req.Header("Content-Type").value_or("");
+  if (internal::IsMediaType(content_type,
+                            "application/x-www-form-urlencoded")) {
+    auto pairs = ParseUrlEncoded(req, limits);
+    for (auto it = co_await pairs.begin(); it != pairs.end();) {
+      auto [name, value] = *it;
+      FormField field{.name = std::string(name),
+                      .value = std::string(value),
+                      .content_type = "text/plain",
+                      .size = value.size()};
+      fields.push_back(std::move(field));
+      co_await ++it;
+    }
+    co_return fields;
+  }
+  if (!internal::IsMediaType(content_type, "multipart/form-data")) {
+    throw Exception(StatusCode::UnsupportedMediaType,
+                    "Expected a multipart or urlencoded form");
+  }
+
+  std::exception_ptr error;
+  std::optional<std::ofstream> file;
+  try {
+    bool in_part = false;
+    auto chunks = ParseMultipart(req, limits);
+    for (auto it = co_await chunks.begin(); it != chunks.end();) {
+      auto chunk = *it;
+      if (!in_part) {
+        in_part = true;
+        FormField field{.name = std::string(chunk.part->Name()),
+                        .content_type = std::string(chunk.part->ContentType())};
+        if (auto filename = chunk.part->Filename()) {
+          field.filename = std::string(*filename);
+          field.path = upload_dir / internal::UploadName();
+          file.emplace(field.path, std::ios::binary);
+          if (!*file) {
+            throw Exception(StatusCode::InternalServerError,
+                            "Could not store upload");
+          }
+        }
+        fields.push_back(std::move(field));
+      }
+      auto &field = fields.back();
+      field.size += chunk.data.size();
+      if (!file) {
+        if (field.size > limits.max_field_size) {
+          throw Exception(StatusCode::PayloadTooLarge, "Form field too large");
+        }
+        field.value.append(chunk.data);
+      } else if (!chunk.data.empty()) {
+        // File writes block, keep them off the io thread.
+        co_await offload([&file, data = chunk.data]() {
+          file->write(data.data(), data.size());
+        });
+      }
+      if (chunk.end) {
+        in_part = false;
+        if (file) {
+          co_await offload([&file]() { file->close(); });
+          bool failed = file->fail();
+          file.reset();
+          if (failed) {
+            throw Exception(StatusCode::InternalServerError,
+                            "Could not store upload");
+          }
+        }
+      }
+      co_await ++it;
+    }
+  } catch (...) {
+    error = std::current_exception();
+  }
+  if (error) {
+    file.reset();
+    for (auto &field : fields) {
+      std::error_code ec;
+      if (!field.path.empty()) std::filesystem::remove(field.path, ec);
+    }
+    std::rethrow_exception(error);
+  }
+  co_return fields;
+}
+}  // namespace hs
@@ -0,0 +1,362 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include "http-server/internal/hpack.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace hs::internal {
+namespace {
+
+constexpr size_t kEntryOverhead = 32;
+
+struct StaticEntry {
+  std::string_view name;
+  std::string_view value;
+};
+
+// RFC 7541 Appendix A, index 1 is at position 0.
+constexpr std::array<StaticEntry, 61> kStaticTable{{
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+}};
+
+struct HuffmanCode {
+  uint32_t code;
+  uint8_t bits;
+};
+
+// RFC 7541 Appendix B, indexed by symbol; 256 is EOS.
+constexpr std::array<HuffmanCode, 257> kHuffmanTable{{
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12}, {0x1ff9, 13}, {0x15, 6},
+    {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6}, {0x0, 5}, {0x1, 5}, {0x2, 5},
+    {0x19, 6}, {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6},
+    {0x5c, 7}, {0xfb, 8}, {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7},
+    {0x61, 7}, {0x62, 7}, {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7},
+    {0x68, 7}, {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7}, {0xfd, 8},
+    {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5}, {0x25, 6},
+    {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7}, {0x28, 6}, {0x29, 6},
+    {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5}, {0x9, 5},
+    {0x2d, 6}, {0x77, 7}, {0x78, 7}, {0x79, 7}, {0x7a, 7}, {0x7b, 7},
+    {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20}, {0x3fffd3, 22},
+    {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22},
+    {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23},
+    {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23}, {0xffffec, 24},
+    {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24},
+    {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23},
+    {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23}, {0x3fffd9, 22},
+    {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22},
+    {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22},
+    {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21}, {0x7fffea, 23},
+    {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21},
+    {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21},
+    {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21}, {0x7fffed, 23},
+    {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20},
+    {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23},
+    {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23}, {0x3ffffe0, 26},
+    {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22},
+    {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26},
+    {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27}, {0x7ffffdf, 27},
+    {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19},
+    {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27},
+    {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24}, {0x1fffe4, 21},
+    {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28},
+    {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20},
+    {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21}, {0x3fffe9, 22},
+    {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22},
+    {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24},
+    {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23}, {0x3ffffeb, 26},
+    {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27},
+    {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27},
+    {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27}, {0x7ffffee, 27},
+    {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30}
+}};
+
+// The HPACK code is canonical: within a code length, codes are consecutive
+// and ordered by symbol. That lets the decoder walk one bit at a time and
+// check a single range per length instead of searching the whole table.
+struct HuffmanDecodeTable {
+  std::array<uint32_t, 31> first_code{};
+  std::array<uint16_t, 31> first_index{};
+  std::array<uint16_t, 31> count{};
+  std::array<uint16_t, 257> symbols{};
+
+  HuffmanDecodeTable() {
+    for (uint16_t i = 0; i < symbols.size(); ++i) symbols[i] = i;
+    std::sort(symbols.begin(), symbols.end(), [](uint16_t a, uint16_t b) {
+      if (kHuffmanTable[a].bits != kHuffmanTable[b].bits)
+        return kHuffmanTable[a].bits < kHuffmanTable[b].bits;
+      return a < b;
+    });
+    for (uint16_t i = 0; i < symbols.size(); ++i) {
+      auto &entry = kHuffmanTable[symbols[i]];
+      if (count[entry.bits]++ == 0) {
+        first_code[entry.bits] = entry.code;
+        first_index[entry.bits] = i;
+      }
+    }
+  }
+};
+
+const HuffmanDecodeTable &GetHuffmanDecodeTable() {
+  static const HuffmanDecodeTable table;
+  return table;
+}
+
+size_t EntrySize(const HeaderField &field) {
+  return field.first.size() + field.second.size() + kEntryOverhead;
+}
+}  // namespace
+
+bool DecodeInteger(std::string_view &in, uint8_t prefix_bits,
+                   uint64_t &value) {
+  if (in.empty()) return false;
+  const uint8_t max_prefix = (1 << prefix_bits) - 1;
+  value = static_cast<uint8_t>(in[0]) & max_prefix;
+  in.remove_prefix(1);
+  if (value < max_prefix) return true;
+  for (unsigned shift = 0; !in.empty() && shift <= 56; shift += 7) {
+    uint8_t byte = static_cast<uint8_t>(in[0]);
+    in.remove_prefix(1);
+    value += static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) return true;
+  }
+  return false;
+}
+
+void EncodeInteger(uint64_t value, uint8_t prefix_bits, uint8_t flags,
+                   std::string &out) {
+  const uint8_t max_prefix = (1 << prefix_bits) - 1;
+  if (value < max_prefix) {
+    out.push_back(static_cast<char>(flags | value));
+    return;
+  }
+  out.push_back(static_cast<char>(flags | max_prefix));
+  value -= max_prefix;
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+bool HuffmanDecode(std::string_view in, std::string &out) {
+  auto &table = GetHuffmanDecodeTable();
+  uint32_t code = 0;
+  uint8_t bits = 0;
+  for (unsigned char byte : in) {
+    for (int i = 7; i >= 0; --i) {
+      code = (code << 1) | ((byte >> i) & 1);
+      ++bits;
+      if (bits >= table.count.size()) return false;
+      uint32_t offset = code - table.first_code[bits];
+      if (table.count[bits] == 0 || code < table.first_code[bits] ||
+          offset >= table.count[bits]) {
+        continue;
+      }
+      uint16_t symbol = table.symbols[table.first_index[bits] + offset];
+      if (symbol == 256) return false;
+      out.push_back(static_cast<char>(symbol));
+      code = 0;
+      bits = 0;
+    }
+  }
+  // Padding must be a prefix of EOS, i.e. fewer than 8 one bits.
+  return bits < 8 && code == (1u << bits) - 1;
+}
+
+HpackDecoder::HpackDecoder(size_t max_table_size)
+    : max_table_size_(max_table_size), settings_table_size_(max_table_size) {}
+
+size_t HpackDecoder::TableSize() const { return table_size_; }
+
+bool HpackDecoder::Lookup(uint64_t index, HeaderField &field) const {
+  if (index == 0) return false;
+  if (index <= kStaticTable.size()) {
+    auto &entry = kStaticTable[index - 1];
+    field = {std::string(entry.name), std::string(entry.value)};
+    return true;
+  }
+  index -= kStaticTable.size() + 1;
+  if (index >= dynamic_table_.size()) return false;
+  field = dynamic_table_[index];
+  return true;
+}
+
+bool HpackDecoder::ReadString(std::string_view &in, std::string &out) const {
+  if (in.empty()) return false;
+  bool huffman = static_cast<uint8_t>(in[0]) & 0x80;
+  uint64_t length;
+  if (!DecodeInteger(in, 7, length) || length > in.size()) return false;
+  auto data = in.substr(0, length);
+  in.remove_prefix(length);
+  if (!huffman) {
+    out.assign(data);
+    return true;
+  }
+  out.clear();
+  return HuffmanDecode(data, out);
+}
+
+void HpackDecoder::Evict(size_t max_size) {
+  while (table_size_ > max_size && !dynamic_table_.empty()) {
+    table_size_ -= EntrySize(dynamic_table_.back());
+    dynamic_table_.pop_back();
+  }
+}
+
+void HpackDecoder::Insert(HeaderField field) {
+  size_t size = EntrySize(field);
+  if (size > max_table_size_) {
+    Evict(0);
+    return;
+  }
+  Evict(max_table_size_ - size);
+  table_size_ += size;
+  dynamic_table_.push_front(std::move(field));
+}
+
+std::optional<HeaderList> HpackDecoder::Decode(std::string_view block) {
+  HeaderList headers;
+  bool allow_size_update = true;
+  while (!block.empty()) {
+    uint8_t first = static_cast<uint8_t>(block[0]);
+    uint64_t index;
+    if (first & 0x80) {
+      // Indexed header field.
+      HeaderField field;
+      if (!DecodeInteger(block, 7, index) || !Lookup(index, field)) {
+        return std::nullopt;
+      }
+      headers.push_back(std::move(field));
+      allow_size_update = false;
+      continue;
+    }
+    if ((first & 0xe0) == 0x20) {
+      // Dynamic table size update, only valid at the start of a block.
+      if (!allow_size_update || !DecodeInteger(block, 5, index) ||
+          index > settings_table_size_) {
+        return std::nullopt;
+      }
+      max_table_size_ = index;
+      Evict(max_table_size_);
+      continue;
+    }
+    allow_size_update = false;
+    // Literal header field; with incremental indexing it has a 6 bit prefix,
+    // without or never indexed a 4 bit one.
+    bool indexed = (first & 0xc0) == 0x40;
+    if (!DecodeInteger(block, indexed ? 6 : 4, index)) return std::nullopt;
+    HeaderField field;
+    if (index == 0) {
+      if (!ReadString(block, field.first)) return std::nullopt;
+    } else if (!Lookup(index, field)) {
+      return std::nullopt;
+    }
+    if (!ReadString(block, field.second)) return std::nullopt;
+    if (indexed) Insert(field);
+    headers.push_back(std::move(field));
+  }
+  return headers;
+}
+
+void HpackEncoder::EncodeStatus(StatusCode code, std::string &out) const {
+  auto status = fmt::format("{:d}", code);
+  for (size_t i = 0; i < kStaticTable.size(); ++i) {
+    if (kStaticTable[i].name == ":status" && kStaticTable[i].value == status) {
+      EncodeInteger(i + 1, 7, 0x80, out);
+      return;
+    }
+  }
+  Encode(":status", status, out);
+}
+
+void HpackEncoder::Encode(std::string_view name, std::string_view value,
+                          std::string &out) const {
+  auto it = std::find_if(kStaticTable.begin(), kStaticTable.end(),
+                         [&](auto &entry) { return entry.name == name; });
+  if (it != kStaticTable.end()) {
+    EncodeInteger(it - kStaticTable.begin() + 1, 4, 0x00, out);
+  } else {
+    out.push_back(0x00);
+    EncodeInteger(name.size(), 7, 0x00, out);
+    out.append(name);
+  }
+  EncodeInteger(value.size(), 7, 0x00, out);
+  out.append(value);
+}
+}  // namespace hs::internal
@@ -4,12 +4,14 @@
 #include <fmt/format.h>
 #include <spdlog/spdlog.h>
 
+#include <array>
 #include <asio/buffer.hpp>
 #include <asio/error.hpp>
 #include <asio/io_context.hpp>
-#include <asio/ip/address_v4.hpp>
+#include <asio/post.hpp>
 #include <asio/ip/tcp.hpp>
 #include <asio/read_until.hpp>
+#include <asio/write.hpp>
 #include <coro/single_consumer_event.hpp>
 #include <coro/task.hpp>
 #include <coro/when_all.hpp>
@@ -25,9 +27,21 @@
 #include <unordered_set>
 
 #include "http-server/enum.h"
+#include "http-server/internal/admission.h"
+#include "http-server/internal/http2.h"
+#include "http-server/internal/io-threads.h"
 #include "http-server/internal/request-impl.h"
 #include "http-server/internal/route.h"
+#include "http-server/internal/socket-options.h"
+#include "http-server/internal/spawn.h"
+#include "http-server/internal/stream.h"
+#include "http-server/internal/sync-route.h"
+#include "http-server/internal/trace.h"
+#include "http-server/internal/websocket.h"
+#include "http-server/internal/worker-pool.h"
 #include "http-server/route.h"
+#include "http-server/sync-route.h"
+#include "http-server/websocket.h"
 
 using asio::ip::tcp;
 
@@ -46,10 +60,11 @@ class Session : public std::enable_shared_from_this<Session> {
   coro::task<> WriteSome(asio::const_buffer buffer) {
     asio::error_code ec;
     coro::single_consumer_event event;
-    request_->socket->async_write_some(buffer, [&](auto ec, auto n) {
+    // Long-lived streams write bodies larger than one write_some takes.
+    asio::async_write(*request_->socket, buffer, [&](auto ec, auto n) {
       spdlog::trace("Wrote {} bytes to socket; ec:{}", n, ec.message());
-      if (ec == asio::error::broken_pipe) {
-        spdlog::trace("Got a broken pipe on write");
+      if (ec) {
+        spdlog::trace("Write failed, stopping the handler: {}", ec.message());
         handler_->SetDone();
       }
       event.set();
@@ -57,6 +72,8 @@ class Session : public std::enable_shared_from_this<Session> {
     co_await event;
   }
   coro::task<> operator()(StatusCode statusCode) {
+    request_->trace.status = statusCode;
+    started_ = true;
     co_await WriteSome(asio::buffer(fmt::format(
         "{} {:d} {:s}\r\n", request_->version, statusCode, statusCode)));
   }
@@ -72,8 +89,13 @@ class Session : public std::enable_shared_from_this<Session> {
     }
     std::stringstream ss;
     for (auto &header : headers) {
-      auto headerLine = fmt::format("{}: {}\r\n", header.first, header.second);
-      ss << headerLine;
+      std::string_view values = header.second;
+      for (;;) {
+        auto end = values.find('\n');
+        ss << fmt::format("{}: {}\r\n", header.first, values.substr(0, end));
+        if (end == std::string_view::npos) break;
+        values.remove_prefix(end + 1);
+      }
     }
     ss << "\r\n";
     std::string resp = ss.str();
@@ -84,23 +106,35 @@ class Session : public std::enable_shared_from_this<Session> {
   }
 
   coro::task<bool> ProcessRequest() {
+    auto &trace = request_->trace;
     auto gen = handler_->Handle(Request(request_));
     for (auto iter = co_await gen.begin(); iter != gen.end(); co_await ++iter) {
+      trace.Mark(TracePhase::Handler);
       co_await std::visit(*this, *iter);
+      trace.Mark(TracePhase::Write);
     }
+    trace.Mark(TracePhase::Handler);
     spdlog::info("Finished processing request");
     co_return keep_alive;
   }
+  // Whether the handler got as far as writing a status line.
+  bool Started() const { return started_; }
 
  private:
   Handler::Ptr handler_;
   RequestImpl::Ptr request_;
   bool keep_alive = true;
+  bool started_ = false;
 };
 
-coro::task<> WriteOnFail(RequestImpl::Ptr req, StatusCode statusCode) {
-  std::string response = fmt::format("{} {:d} {:s}\r\nContent-Length:0\r\n\r\n",
+coro::task<> WriteOnFail(RequestImpl::Ptr req, StatusCode statusCode,
+                         Headers headers = {}) {
+  std::string response = fmt::format("{} {:d} {:s}\r\nContent-Length:0\r\n",
                                      req->version, statusCode, statusCode);
+  for (auto &header : headers) {
+    response += fmt::format("{}: {}\r\n", header.first, header.second);
+  }
+  response += "\r\n";
   coro::single_consumer_event event;
 
   req->socket->async_write_some(
@@ -109,24 +143,65 @@ coro::task<> WriteOnFail(RequestImpl::Ptr req, StatusCode statusCode) {
         event.set();
       });
   co_await event;
+  req->trace.status = statusCode;
+  req->trace.Mark(TracePhase::Write);
 }
 
+// Reports a request's trace once HandleRequest is done with it.
+struct FinishTrace {
+  Tracer &tracer;
+  RequestImpl &request;
+  ~FinishTrace() { tracer.Finish(request); }
+};
+
 class HttpServerImpl {
  public:
-  HttpServerImpl(const Config &config) : config_(config) {}
+  HttpServerImpl(const Config &config)
+      : config_(config), admission_(config_), tracer_(config_) {}
   coro::task<bool> HandleRequest(RequestImpl::Ptr request) {
+    SetIoExecutor(request->socket->get_executor());
+    FinishTrace finish_trace{tracer_, *request};
     StatusCode statusCode = StatusCode::Ok;
     bool keep_alive = true;
+    std::shared_ptr<Session> session;
     try {
       auto route_match = router_.Match(request);
 
       if (route_match) {
         auto [route, params] = route_match.value();
         request->path_params = std::move(params);
-        keep_alive =
-            co_await std::make_shared<Session>(route->GetHandler(), request)
-                ->ProcessRequest();
+        if (request->trace.enabled) request->trace.route = route;
+        if (auto limited = admission_.RateLimited(*route, *request)) {
+          request->trace.Mark(TracePhase::Route);
+          co_return co_await Reject(request, StatusCode::TooManyRequests,
+                                    std::move(*limited));
+        }
+        auto websocket = std::dynamic_pointer_cast<WebSocketRoute>(route);
+        if (websocket && IsWebSocketUpgrade(*request)) {
+          // A WebSocket session is not a request to time.
+          request->trace.enabled = false;
+          co_await ServeWebSocket(request, websocket->GetWebSocketHandler(),
+                                  config_);
+          co_return false;
+        }
+        auto permit = admission_.Admit(*route);
+        request->trace.Mark(TracePhase::Route);
+        if (!permit) {
+          Headers headers{
+              {"Retry-After", fmt::format("{}", config_.retry_after.count())},
+          };
+          co_return co_await Reject(request, StatusCode::ServiceUnavailable,
+                                    std::move(headers));
+        }
+        auto sync = dynamic_cast<const SyncRoute *>(route.get());
+        if (sync && !router_.HasMiddleware()) {
+          co_return co_await Respond(request, *sync);
+        }
+        session =
+            std::make_shared<Session>(router_.GetHandler(*route), request);
+        keep_alive = co_await session->ProcessRequest();
       } else {
+        request->trace.Mark(TracePhase::Route);
         co_await WriteOnFail(request, StatusCode::NotFound);
       }
       co_return keep_alive;
@@ -137,14 +212,138 @@ class HttpServerImpl {
       spdlog::error("Handling std exception {}", e.what());
       statusCode = StatusCode::InternalServerError;
     }
+    request->trace.Mark(TracePhase::Handler);
+    if (session && session->Started()) {
+      // Part of the response is out; closing the connection is the only
+      // way left to tell the client it was cut short.
+      co_return false;
+    }
     co_await WriteOnFail(request, statusCode);
     co_return keep_alive;
   }
-  coro::task<> HandleConnection(std::shared_ptr<tcp::socket> socket) {
+  // A request body left unread would be parsed as the next request.
+  static bool HasBody(const RequestImpl &request) {
+    auto length = request.headers.find("Content-Length");
+    return request.headers.contains("Transfer-Encoding") ||
+           (length != request.headers.end() && length->second != "0");
+  }
+  // Answers a request turned away by admission control or a rate limit
+  // without running its handler, closing connections with an unread body.
+  coro::task<bool> Reject(RequestImpl::Ptr request, StatusCode statusCode,
+                          Headers headers) {
+    bool keep_alive = !HasBody(*request);
+    if (!keep_alive) headers["Connection"] = "close";
+    co_await WriteOnFail(request, statusCode, std::move(headers));
+    co_return keep_alive;
+  }
+  // Writes a SyncRoute's response, head and body in one gathered write.
+  coro::task<bool> Respond(RequestImpl::Ptr request, const SyncRoute &route) {
+    auto response = route.Respond(Request(request));
+    request->trace.status = response.status;
+    request->trace.Mark(TracePhase::Handler);
+    auto connection = request->headers.find("Connection");
+    bool keep_alive =
+        !HasBody(*request) && (connection == request->headers.end() ||
+                               connection->second != "close");
+    auto head = SerializeHead(request->version, response, keep_alive);
+    auto body = response.body.View();
+    std::array<asio::const_buffer, 2> buffers{
+        asio::buffer(head), asio::buffer(body.data(), body.size())};
+    asio::error_code error;
+    coro::single_consumer_event event;
+    asio::async_write(*request->socket, buffers, [&](auto ec, auto n) {
+      spdlog::trace("Wrote {} bytes to socket; ec:{}", n, ec.message());
+      error = ec;
+      event.set();
+    });
+    co_await event;
+    request->trace.Mark(TracePhase::Write);
+    co_return keep_alive && !error;
+  }
+  bool IsHttp2Upgrade(const RequestImpl &request) const {
+    // h2c is cleartext only; TLS connections negotiate h2 through ALPN.
+    if (!config_.http2 || request.version != Version::HTTP_1_1 ||
+        request.socket->IsTls()) {
+      return false;
+    }
+    auto upgrade = request.headers.find("Upgrade");
+    if (upgrade == request.headers.end() ||
+        upgrade->second.find("h2c") == std::string::npos ||
+        !request.headers.contains("HTTP2-Settings")) {
+      return false;
+    }
+    // Requests with a body are answered over HTTP/1.1 instead.
+    auto length = request.headers.find("Content-Length");
+    return length == request.headers.end() || length->second == "0";
+  }
+  coro::task<> UpgradeToHttp2(Stream::Ptr socket, RequestImpl::Ptr request) {
+    std::string response = fmt::format(
+        "{} {:d} {:s}\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n",
+        request->version, StatusCode::SwitchingProtocols,
+        StatusCode::SwitchingProtocols);
+    asio::error_code error;
+    coro::single_consumer_event event;
+    asio::async_write(*socket, asio::buffer(response), [&](auto ec, auto n) {
+      spdlog::trace("Wrote {} bytes to socket; ec:{}", n, ec.message());
+      error = ec;
+      event.set();
+    });
+    co_await event;
+    if (error) co_return;
+    auto preread = std::move(request->body_part);
+    co_await std::make_shared<Http2Connection>(socket, router_, config_,
+                                               admission_)
+        ->Serve(std::move(preread), request);
+  }
+  coro::task<bool> Handshake(Stream::Ptr socket) {
+    asio::error_code error;
+    coro::single_consumer_event event;
+    socket->AsyncHandshake(tls_, [&](asio::error_code ec) {
+      error = ec;
+      event.set();
+    });
+    co_await event;
+    if (error) {
+      spdlog::debug("TLS handshake failed: {}", error.message());
+      co_return false;
+    }
+    co_return true;
+  }
+  coro::task<> HandleConnection(Stream::Ptr socket) {
+    // Kept for timing the connection's first request.
+    std::optional<RequestTrace::Clock::time_point> accepted, ready;
+    if (config_.tracing) accepted = RequestTrace::Clock::now();
+    if (tls_) {
+      if (!co_await Handshake(socket)) co_return;
+      if (socket->Alpn() == "h2") {
+        co_await std::make_shared<Http2Connection>(socket, router_, config_,
+                                                   admission_)
+            ->Serve("");
+        co_return;
+      }
+    }
+    if (accepted) ready = RequestTrace::Clock::now();
     for (;;) {
-      auto req = co_await ParseRequestLine(socket);
+      auto req = co_await ParseRequestLine(socket, config_.tracing);
       if (!req) break;
       auto version = req.value()->version;
+      if (version == Version::HTTP_2) {
+        if (config_.http2) {
+          co_await std::make_shared<Http2Connection>(socket, router_, config_,
+                                                     admission_)
+              ->Serve(std::move(req.value()->body_part));
+        }
+        break;
+      }
+      if (IsHttp2Upgrade(*req.value())) {
+        co_await UpgradeToHttp2(socket, std::move(req.value()));
+        break;
+      }
+      if (config_.tracing) {
+        tracer_.Start(*req.value(), accepted, ready);
+        accepted.reset();
+        ready.reset();
+      }
       auto keep_alive = co_await HandleRequest(std::move(req.value()));
       if (version == Version::HTTP_1_0 || !keep_alive) {
         break;
@@ -152,11 +351,12 @@ class HttpServerImpl {
     }
   }
 
-  coro::task<std::shared_ptr<tcp::socket>> Accept(tcp::acceptor &acceptor) {
-    auto socket = std::make_shared<tcp::socket>(acceptor.get_executor());
+  template <typename Acceptor>
+  coro::task<Stream::Ptr> Accept(Acceptor &acceptor) {
+    typename Acceptor::protocol_type::socket socket(acceptor.get_executor());
     coro::single_consumer_event event;
     spdlog::info("Waiting for connection");
-    acceptor.async_accept(*socket, [&](asio::error_code ec) {
+    acceptor.async_accept(socket, [&](asio::error_code ec) {
       spdlog::info("Accepted connection");
       if (ec) {
         spdlog::error("Error accepting connection: {}", ec.message());
@@ -165,27 +365,72 @@ class HttpServerImpl {
       event.set();
     });
     co_await event;
-    co_return socket;
+    ConfigureConnection(socket, config_.socket_options);
+    if (io_threads_) {
+      co_return std::make_shared<Stream>(io_threads_->Adopt(socket));
+    }
+    co_return std::make_shared<Stream>(std::move(socket));
   }
 
-  coro::task<> Listen(tcp::acceptor &acceptor) {
+  template <typename Acceptor>
+  coro::task<> Listen(Acceptor &acceptor) {
+    if (io_threads_) {
+      // This thread only accepts; connections run on their io thread.
+      for (;;) {
+        auto socket = co_await Accept(acceptor);
+        asio::post(socket->get_executor(), [this, socket]() {
+          Spawn(HandleConnection(socket));
+        });
+      }
+    }
     auto socket = co_await Accept(acceptor);
     co_await coro::when_all(Listen(acceptor), HandleConnection(socket));
   }
 
   coro::task<> Serve(asio::io_context &io_context) {
-    auto address = asio::ip::make_address_v4("0.0.0.0");
-    spdlog::info("binding to {}:{}", config_.bind_address, config_.port);
-    tcp::acceptor acceptor(io_context, {address, config_.port});
-    spdlog::info("starting server at {}:{}", config_.bind_address,
-                 config_.port);
-    co_await Listen(acceptor);
+    if (!config_.tls_certificate_chain.empty()) {
+#ifdef HS_TLS
+      tls_ = std::make_shared<TlsContext>(config_);
+#else
+      throw std::runtime_error(
+          "TLS is configured but the server was built without ENABLE_TLS");
+#endif
+    }
+    if (config_.io_threads > 0) {
+      io_threads_ = std::make_unique<IoThreads>(config_);
+    }
+    if (!config_.unix_socket_path.empty()) {
+      auto acceptor = OpenUnixAcceptor(io_context, config_);
+      co_await Listen(acceptor);
+    } else {
+      auto acceptor = OpenTcpAcceptor(io_context, config_);
+      co_await Listen(acceptor);
+    }
   }
   void AddRoute(const Route::Ptr &route) { router_.AddRoute(route); }
+  bool RemoveRoute(Method method, const std::string &path) {
+    return router_.RemoveRoute(method, path);
+  }
+  void ReplaceRoutes(const std::vector<Route::Ptr> &routes) {
+    router_.ReplaceRoutes(routes);
+  }
+  void Use(const Middleware::Ptr &middleware) { router_.Use(middleware); }
+  void UseRouteTable(RouteTable::Ptr table) {
+    router_.SetTable(std::move(table));
+  }
+  void SetTraceExporter(TraceExporter::Ptr exporter) {
+    tracer_.SetExporter(std::move(exporter));
+  }
+  std::string TraceBreakdown() const { return tracer_.Breakdown(); }
 
  private:
   Router router_;
   Config config_;
+  AdmissionController admission_;
+  Tracer tracer_;
+  // Set when serving HTTPS.
+  std::shared_ptr<TlsContext> tls_;
+  std::unique_ptr<IoThreads> io_threads_;
   std::jthread asio_thread_;
 };
 }  // namespace internal
@@ -204,6 +449,24 @@ coro::task<void> HttpServer::ServeAsync(asio::io_context &io_context) {
 HttpServer::~HttpServer() {}
 
 void HttpServer::AddRoute(const Route::Ptr &route) { pimpl_->AddRoute(route); }
+bool HttpServer::RemoveRoute(Method method, const std::string &path) {
+  return pimpl_->RemoveRoute(method, path);
+}
+void HttpServer::ReplaceRoutes(const std::vector<Route::Ptr> &routes) {
+  pimpl_->ReplaceRoutes(routes);
+}
+void HttpServer::Use(const Middleware::Ptr &middleware) {
+  pimpl_->Use(middleware);
+}
+void HttpServer::UseRouteTable(RouteTable::Ptr table) {
+  pimpl_->UseRouteTable(std::move(table));
+}
+void HttpServer::SetTraceExporter(TraceExporter::Ptr exporter) {
+  pimpl_->SetTraceExporter(std::move(exporter));
+}
+std::string HttpServer::TraceBreakdown() const {
+  return pimpl_->TraceBreakdown();
+}
 
 Exception::Exception(StatusCode statusCode, std::string message)
     : code_(statusCode), message_(message) {}
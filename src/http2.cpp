@@ -0,0 +1,848 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include "http-server/internal/http2.h"
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <asio/buffer.hpp>
+#include <asio/error_code.hpp>
+#include <asio/write.hpp>
+#include <cctype>
+#include <coro/async_generator.hpp>
+#include <coro/single_consumer_event.hpp>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "http-server/enum.h"
+#include "http-server/internal/spawn.h"
+#include "http-server/internal/url.h"
+#include "http-server/internal/worker-pool.h"
+#include "http-server/request.h"
+
+namespace hs::internal {
+namespace {
+
+constexpr size_t kReadChunk = 16384;
+constexpr uint32_t kMaxFrameSize = 16384;
+constexpr size_t kMaxHeaderBlockSize = 65536;
+constexpr int64_t kMaxWindow = 0x7fffffff;
+// Every window's size until SETTINGS change it.
+constexpr int64_t kDefaultWindow = 65535;
+
+// A request RFC 9113 calls malformed, answered with a stream error.
+struct MalformedRequest : public std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+uint32_t ReadUint32(std::string_view data) {
+  return (static_cast<uint32_t>(static_cast<uint8_t>(data[0])) << 24) |
+         (static_cast<uint32_t>(static_cast<uint8_t>(data[1])) << 16) |
+         (static_cast<uint32_t>(static_cast<uint8_t>(data[2])) << 8) |
+         static_cast<uint32_t>(static_cast<uint8_t>(data[3]));
+}
+
+uint16_t ReadUint16(std::string_view data) {
+  return (static_cast<uint16_t>(static_cast<uint8_t>(data[0])) << 8) |
+         static_cast<uint16_t>(static_cast<uint8_t>(data[1]));
+}
+
+void AppendUint32(uint32_t value, std::string &out) {
+  out.push_back(static_cast<char>(value >> 24));
+  out.push_back(static_cast<char>(value >> 16));
+  out.push_back(static_cast<char>(value >> 8));
+  out.push_back(static_cast<char>(value));
+}
+
+void AppendSetting(Http2Setting setting, uint32_t value, std::string &out) {
+  out.push_back(static_cast<char>(static_cast<uint16_t>(setting) >> 8));
+  out.push_back(static_cast<char>(static_cast<uint16_t>(setting)));
+  AppendUint32(value, out);
+}
+
+// Removes the pad length byte and trailing padding of a PADDED frame.
+bool StripPadding(const FrameHeader &header, std::string_view &payload) {
+  if ((header.flags & PaddedFlag) == 0) return true;
+  if (payload.empty()) return false;
+  size_t padding = static_cast<uint8_t>(payload[0]);
+  payload.remove_prefix(1);
+  if (padding > payload.size()) return false;
+  payload.remove_suffix(padding);
+  return true;
+}
+
+// HTTP2-Settings carries a SETTINGS payload in base64url without padding.
+std::optional<std::string> DecodeBase64Url(std::string_view in) {
+  std::string out;
+  uint32_t buffer = 0;
+  int bits = 0;
+  for (char c : in) {
+    int value;
+    if (c >= 'A' && c <= 'Z') {
+      value = c - 'A';
+    } else if (c >= 'a' && c <= 'z') {
+      value = c - 'a' + 26;
+    } else if (c >= '0' && c <= '9') {
+      value = c - '0' + 52;
+    } else if (c == '-' || c == '+') {
+      value = 62;
+    } else if (c == '_' || c == '/') {
+      value = 63;
+    } else if (c == '=') {
+      break;
+    } else {
+      return std::nullopt;
+    }
+    buffer = (buffer << 6) | value;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      out.push_back(static_cast<char>((buffer >> bits) & 0xff));
+    }
+  }
+  return out;
+}
+
+// HTTP/2 header names are lower case; handlers look them up the way HTTP/1
+// clients usually send them, e.g. "Content-Length".
+std::string CanonicalHeaderName(std::string_view name) {
+  std::string canonical(name);
+  bool upper = true;
+  for (auto &c : canonical) {
+    if (upper) c = static_cast<char>(std::toupper(c));
+    upper = c == '-';
+  }
+  return canonical;
+}
+
+bool IsConnectionSpecific(std::string_view name) {
+  return name == "connection" || name == "keep-alive" ||
+         name == "proxy-connection" || name == "transfer-encoding" ||
+         name == "upgrade";
+}
+}  // namespace
+
+FrameHeader ParseFrameHeader(std::string_view data) {
+  FrameHeader header;
+  header.length = (static_cast<uint32_t>(static_cast<uint8_t>(data[0])) << 16) |
+                  (static_cast<uint32_t>(static_cast<uint8_t>(data[1])) << 8) |
+                  static_cast<uint32_t>(static_cast<uint8_t>(data[2]));
+  header.type = static_cast<FrameType>(data[3]);
+  header.flags = static_cast<uint8_t>(data[4]);
+  header.stream_id = ReadUint32(data.substr(5)) & 0x7fffffff;
+  return header;
+}
+
+void AppendFrameHeader(const FrameHeader &header, std::string &out) {
+  out.push_back(static_cast<char>(header.length >> 16));
+  out.push_back(static_cast<char>(header.length >> 8));
+  out.push_back(static_cast<char>(header.length));
+  out.push_back(static_cast<char>(header.type));
+  out.push_back(static_cast<char>(header.flags));
+  AppendUint32(header.stream_id & 0x7fffffff, out);
+}
+
+// Maps the Response variants a handler yields onto HEADERS and DATA frames.
+// The status is held back until the headers arrive so both go out in a single
+// HEADERS frame.
+class Http2Session {
+ public:
+  Http2Session(Http2Connection::Ptr connection, Http2Stream::Ptr stream)
+      : connection_(connection), stream_(stream) {}
+
+  coro::task<> operator()(StatusCode statusCode) {
+    status_ = statusCode;
+    co_return;
+  }
+  coro::task<> operator()(Headers headers) {
+    if (headers_sent_) {
+      spdlog::warn("Dropping headers yielded after the body on stream {}",
+                   stream_->id);
+      co_return;
+    }
+    SendHeaders(headers, false);
+  }
+  coro::task<> operator()(ResponseBody::Ptr resp) {
+    if (!headers_sent_) SendHeaders({}, false);
+    co_await connection_->SendData(
+        stream_,
+        std::string_view(static_cast<const char *>(resp->GetData()),
+                         resp->GetSize()),
+        false);
+  }
+
+  coro::task<> Finish() {
+    if (!headers_sent_) {
+      SendHeaders({}, true);
+      co_return;
+    }
+    co_await connection_->SendData(stream_, {}, true);
+  }
+  void Fail(StatusCode statusCode) {
+    status_ = statusCode;
+    SendHeaders({{"Content-Length", "0"}}, true);
+  }
+  bool HeadersSent() const { return headers_sent_; }
+
+ private:
+  void SendHeaders(const Headers &headers, bool end_stream) {
+    connection_->SendHeaders(stream_, status_, headers, end_stream);
+    headers_sent_ = true;
+  }
+
+  Http2Connection::Ptr connection_;
+  Http2Stream::Ptr stream_;
+  StatusCode status_ = StatusCode::Ok;
+  bool headers_sent_ = false;
+};
+
+Http2Connection::Http2Connection(Stream::Ptr socket, Router &router,
+                                 const Config &config,
+                                 AdmissionController &admission)
+    : socket_(socket),
+      router_(router),
+      config_(config),
+      admission_(admission) {}
+
+coro::task<> Http2Connection::Serve(std::string preread,
+                                    RequestImpl::Ptr upgrade) {
+  auto self = shared_from_this();
+  read_buffer_ = std::move(preread);
+  if (upgrade) {
+    // The 101 response acknowledges these settings, no SETTINGS ack is sent.
+    auto settings = upgrade->headers.find("HTTP2-Settings");
+    if (settings != upgrade->headers.end()) {
+      auto payload = DecodeBase64Url(settings->second);
+      if (!payload || !ApplySettings(*payload)) co_return;
+    }
+  }
+  SendSettings();
+  if (upgrade) {
+    auto stream = std::make_shared<Http2Stream>();
+    stream->id = 1;
+    stream->request = upgrade;
+    stream->request->version = Version::HTTP_2;
+    stream->send_window = peer_initial_window_;
+    stream->recv_window = RecvInitialWindow();
+    stream->end_stream = true;
+    streams_[stream->id] = stream;
+    last_stream_id_ = stream->id;
+    Dispatch(stream);
+  }
+
+  if (!co_await Fill(kHttp2Preface.size()) ||
+      std::string_view(read_buffer_).substr(0, kHttp2Preface.size()) !=
+          kHttp2Preface) {
+    spdlog::debug("Missing HTTP/2 client preface");
+    GoAway(Http2Error::ProtocolError);
+  } else {
+    read_pos_ = kHttp2Preface.size();
+    std::string payload;
+    while (!closed_) {
+      auto header = co_await ReadFrame(payload);
+      if (!header || !HandleFrame(*header, payload)) break;
+    }
+  }
+  Close();
+  while (active_streams_ > 0) {
+    idle_ = std::make_unique<coro::single_consumer_event>();
+    co_await *idle_;
+  }
+  spdlog::debug("HTTP/2 connection finished after stream {}", last_stream_id_);
+}
+
+coro::task<bool> Http2Connection::Fill(size_t size) {
+  while (read_buffer_.size() - read_pos_ < size) {
+    if (read_pos_ > 0) {
+      read_buffer_.erase(0, read_pos_);
+      read_pos_ = 0;
+    }
+    size_t offset = read_buffer_.size();
+    read_buffer_.resize(offset + kReadChunk);
+    asio::error_code error;
+    size_t read = 0;
+    coro::single_consumer_event event;
+    socket_->async_read_some(
+        asio::buffer(read_buffer_.data() + offset, kReadChunk),
+        [&](auto ec, auto n) {
+          error = ec;
+          read = n;
+          event.set();
+        });
+    co_await event;
+    read_buffer_.resize(offset + read);
+    if (error) {
+      spdlog::debug("HTTP/2 read failed: {}", error.message());
+      closed_ = true;
+      co_return false;
+    }
+  }
+  co_return true;
+}
+
+coro::task<std::optional<FrameHeader>> Http2Connection::ReadFrame(
+    std::string &payload) {
+  if (!co_await Fill(kFrameHeaderSize)) co_return std::nullopt;
+  auto header =
+      ParseFrameHeader(std::string_view(read_buffer_).substr(read_pos_));
+  if (header.length > kMaxFrameSize) {
+    GoAway(Http2Error::FrameSizeError);
+    co_return std::nullopt;
+  }
+  if (!co_await Fill(kFrameHeaderSize + header.length)) co_return std::nullopt;
+  payload.assign(read_buffer_, read_pos_ + kFrameHeaderSize, header.length);
+  read_pos_ += kFrameHeaderSize + header.length;
+  co_return header;
+}
+
+bool Http2Connection::HandleFrame(const FrameHeader &header,
+                                  std::string_view payload) {
+  if (continuation_stream_ != 0 &&
+      (header.type != FrameType::Continuation ||
+       header.stream_id != continuation_stream_)) {
+    GoAway(Http2Error::ProtocolError);
+    return false;
+  }
+  switch (header.type) {
+    case FrameType::Data:
+      return HandleData(header, payload);
+    case FrameType::Headers:
+      return HandleHeaders(header, payload);
+    case FrameType::Continuation:
+      if (continuation_stream_ == 0) {
+        GoAway(Http2Error::ProtocolError);
+        return false;
+      }
+      header_block_.append(payload);
+      if (header_block_.size() > kMaxHeaderBlockSize) {
+        GoAway(Http2Error::ProtocolError);
+        return false;
+      }
+      if (header.flags & EndHeadersFlag) {
+        return HandleHeaderBlock(continuation_stream_,
+                                 continuation_end_stream_);
+      }
+      return true;
+    case FrameType::Priority:
+      return true;
+    case FrameType::RstStream: {
+      if (header.stream_id == 0 || payload.size() != 4) {
+        GoAway(Http2Error::ProtocolError);
+        return false;
+      }
+      auto it = streams_.find(header.stream_id);
+      if (it != streams_.end()) {
+        auto stream = it->second;
+        stream->reset = true;
+        if (stream->handler) stream->handler->SetDone();
+        WakeWriters();
+        // Dispatched streams are retired by RunStream.
+        if (!stream->end_stream) streams_.erase(it);
+      }
+      return true;
+    }
+    case FrameType::Settings:
+      if (header.stream_id != 0) {
+        GoAway(Http2Error::ProtocolError);
+        return false;
+      }
+      if (header.flags & AckFlag) {
+        // Our initial window size applies to the streams from now on.
+        if (!settings_acked_) {
+          int64_t before = RecvInitialWindow();
+          settings_acked_ = true;
+          int64_t delta = RecvInitialWindow() - before;
+          for (auto &[id, stream] : streams_) stream->recv_window += delta;
+        }
+        return true;
+      }
+      if (!ApplySettings(payload)) return false;
+      WriteFrame(FrameType::Settings, AckFlag, 0, {});
+      return true;
+    case FrameType::PushPromise:
+      GoAway(Http2Error::ProtocolError);
+      return false;
+    case FrameType::Ping:
+      if (header.stream_id != 0 || payload.size() != 8) {
+        GoAway(Http2Error::FrameSizeError);
+        return false;
+      }
+      if ((header.flags & AckFlag) == 0) {
+        WriteFrame(FrameType::Ping, AckFlag, 0, payload);
+      }
+      return true;
+    case FrameType::GoAway:
+      // Streams already started finish, no new ones are accepted.
+      goaway_received_ = true;
+      return true;
+    case FrameType::WindowUpdate:
+      return HandleWindowUpdate(header, payload);
+  }
+  // Unknown frame types must be ignored.
+  return true;
+}
+
+bool Http2Connection::HandleHeaders(const FrameHeader &header,
+                                    std::string_view payload) {
+  if (header.stream_id == 0 || header.stream_id % 2 == 0 ||
+      !StripPadding(header, payload)) {
+    GoAway(Http2Error::ProtocolError);
+    return false;
+  }
+  if (header.flags & PriorityFlag) {
+    if (payload.size() < 5) {
+      GoAway(Http2Error::FrameSizeError);
+      return false;
+    }
+    payload.remove_prefix(5);
+  }
+  header_block_.assign(payload);
+  continuation_end_stream_ = header.flags & EndStreamFlag;
+  if ((header.flags & EndHeadersFlag) == 0) {
+    continuation_stream_ = header.stream_id;
+    return true;
+  }
+  return HandleHeaderBlock(header.stream_id, continuation_end_stream_);
+}
+
+bool Http2Connection::HandleHeaderBlock(uint32_t stream_id, bool end_stream) {
+  continuation_stream_ = 0;
+  // Every block is decoded, even for refused streams, to keep the HPACK
+  // dynamic table in sync with the peer.
+  auto headers = decoder_.Decode(header_block_);
+  header_block_.clear();
+  if (!headers) {
+    GoAway(Http2Error::CompressionError);
+    return false;
+  }
+  auto it = streams_.find(stream_id);
+  if (it != streams_.end()) {
+    // Trailers; their fields are dropped.
+    auto stream = it->second;
+    if (stream->end_stream || !end_stream) {
+      ResetStream(stream, Http2Error::ProtocolError);
+      return true;
+    }
+    stream->end_stream = true;
+    Dispatch(stream);
+    return true;
+  }
+  if (stream_id <= last_stream_id_) {
+    GoAway(Http2Error::StreamClosed);
+    return false;
+  }
+  last_stream_id_ = stream_id;
+  auto stream = std::make_shared<Http2Stream>();
+  stream->id = stream_id;
+  stream->headers = std::move(*headers);
+  stream->send_window = peer_initial_window_;
+  stream->recv_window = RecvInitialWindow();
+  stream->end_stream = end_stream;
+  if (goaway_received_ ||
+      streams_.size() >= config_.http2_max_concurrent_streams) {
+    ResetStream(stream, Http2Error::RefusedStream);
+    return true;
+  }
+  streams_[stream_id] = stream;
+  if (end_stream) Dispatch(stream);
+  return true;
+}
+
+bool Http2Connection::HandleData(const FrameHeader &header,
+                                 std::string_view payload) {
+  if (header.stream_id == 0) {
+    GoAway(Http2Error::ProtocolError);
+    return false;
+  }
+  // Flow control covers the whole payload, padding included, which must fit
+  // the windows advertised. Data is handed to the stream right away, so the
+  // connection window is replenished as it arrives and stays as it is.
+  int64_t flow_controlled = payload.size();
+  if (flow_controlled > connection_recv_window_) {
+    GoAway(Http2Error::FlowControlError);
+    return false;
+  }
+  if (flow_controlled > 0) SendWindowUpdate(0, flow_controlled);
+  if (!StripPadding(header, payload)) {
+    GoAway(Http2Error::ProtocolError);
+    return false;
+  }
+  auto it = streams_.find(header.stream_id);
+  if (it == streams_.end() || it->second->end_stream) {
+    if (header.stream_id > last_stream_id_) {
+      GoAway(Http2Error::ProtocolError);
+      return false;
+    }
+    std::string error;
+    AppendUint32(static_cast<uint32_t>(Http2Error::StreamClosed), error);
+    WriteFrame(FrameType::RstStream, 0, header.stream_id, error);
+    return true;
+  }
+  auto stream = it->second;
+  if (flow_controlled > stream->recv_window) {
+    ResetStream(stream, Http2Error::FlowControlError);
+    return true;
+  }
+  stream->recv_window -= flow_controlled;
+  if (stream->body.size() + payload.size() > config_.http2_max_body_size) {
+    spdlog::debug("HTTP/2 request body over {} bytes",
+                  config_.http2_max_body_size);
+    SendHeaders(stream, StatusCode::PayloadTooLarge, {}, true);
+    ResetStream(stream, Http2Error::Cancel);
+    return true;
+  }
+  stream->body.append(payload);
+  if (header.flags & EndStreamFlag) {
+    stream->end_stream = true;
+    Dispatch(stream);
+  } else if (flow_controlled > 0) {
+    stream->recv_window += flow_controlled;
+    SendWindowUpdate(stream->id, flow_controlled);
+  }
+  return true;
+}
+
+bool Http2Connection::ApplySettings(std::string_view payload) {
+  if (payload.size() % 6 != 0) {
+    GoAway(Http2Error::FrameSizeError);
+    return false;
+  }
+  for (size_t i = 0; i < payload.size(); i += 6) {
+    auto setting = static_cast<Http2Setting>(ReadUint16(payload.substr(i)));
+    uint32_t value = ReadUint32(payload.substr(i + 2));
+    switch (setting) {
+      case Http2Setting::EnablePush:
+        if (value > 1) {
+          GoAway(Http2Error::ProtocolError);
+          return false;
+        }
+        break;
+      case Http2Setting::InitialWindowSize: {
+        if (value > kMaxWindow) {
+          GoAway(Http2Error::FlowControlError);
+          return false;
+        }
+        int64_t delta = static_cast<int64_t>(value) - peer_initial_window_;
+        for (auto &[id, stream] : streams_) {
+          stream->send_window += delta;
+          if (stream->send_window > kMaxWindow) {
+            GoAway(Http2Error::FlowControlError);
+            return false;
+          }
+        }
+        peer_initial_window_ = value;
+        break;
+      }
+      case Http2Setting::MaxFrameSize:
+        if (value < 16384 || value > 16777215) {
+          GoAway(Http2Error::ProtocolError);
+          return false;
+        }
+        peer_max_frame_size_ = value;
+        break;
+      default:
+        // The encoder never indexes, so the peer's table size is irrelevant.
+        break;
+    }
+  }
+  WakeWriters();
+  return true;
+}
+
+bool Http2Connection::HandleWindowUpdate(const FrameHeader &header,
+                                         std::string_view payload) {
+  if (payload.size() != 4) {
+    GoAway(Http2Error::FrameSizeError);
+    return false;
+  }
+  uint32_t increment = ReadUint32(payload) & 0x7fffffff;
+  if (header.stream_id == 0) {
+    connection_send_window_ += increment;
+    if (increment == 0 || connection_send_window_ > kMaxWindow) {
+      GoAway(increment == 0 ? Http2Error::ProtocolError
+                            : Http2Error::FlowControlError);
+      return false;
+    }
+  } else {
+    auto it = streams_.find(header.stream_id);
+    if (it == streams_.end()) return true;
+    auto stream = it->second;
+    stream->send_window += increment;
+    if (increment == 0 || stream->send_window > kMaxWindow) {
+      ResetStream(stream, increment == 0 ? Http2Error::ProtocolError
+                                         : Http2Error::FlowControlError);
+      return true;
+    }
+  }
+  WakeWriters();
+  return true;
+}
+
+void Http2Connection::Dispatch(const Http2Stream::Ptr &stream) {
+  ++active_streams_;
+  Spawn(RunStream(shared_from_this(), stream));
+}
+
+RequestImpl::Ptr Http2Connection::BuildRequest(Http2Stream &stream) {
+  auto request = std::make_shared<RequestImpl>();
+  request->socket = socket_;
+  request->version = Version::HTTP_2;
+  std::optional<std::string> method, path;
+  for (auto &[name, value] : stream.headers) {
+    if (name == ":method") {
+      method = value;
+    } else if (name == ":path") {
+      path = value;
+    } else if (name == ":authority") {
+      request->headers["Host"] = value;
+    } else if (!name.starts_with(":")) {
+      auto [it, inserted] =
+          request->headers.try_emplace(CanonicalHeaderName(name), value);
+      if (!inserted) it->second += (name == "cookie" ? "; " : ", ") + value;
+    }
+  }
+  if (!method || !path) {
+    throw Exception(StatusCode::BadRequest, "Missing pseudo header");
+  }
+  request->method = ParseMethod(*method);
+  ParseTarget(*path, *request);
+  // Request::Body reads the buffered DATA frames through Content-Length;
+  // one promising more would read the rest off the shared connection.
+  auto length = request->headers.find("Content-Length");
+  auto size = fmt::format("{}", stream.body.size());
+  if (length != request->headers.end() && length->second != size) {
+    throw MalformedRequest("Content-Length differs from the DATA received");
+  }
+  if (!stream.body.empty()) request->headers["Content-Length"] = size;
+  request->body_part = std::move(stream.body);
+  return request;
+}
+
+coro::task<> Http2Connection::RunStream(Ptr self, Http2Stream::Ptr stream) {
+  SetIoExecutor(socket_->get_executor());
+  Http2Session session(self, stream);
+  StatusCode statusCode = StatusCode::Ok;
+  bool failed = false;
+  bool malformed = false;
+  try {
+    auto request = stream->request ? stream->request : BuildRequest(*stream);
+    auto route_match = router_.Match(request);
+    if (route_match) {
+      auto [route, params] = route_match.value();
+      request->path_params = std::move(params);
+      auto limited = admission_.RateLimited(*route, *request);
+      auto permit = limited ? std::nullopt : admission_.Admit(*route);
+      if (limited) {
+        SendHeaders(stream, StatusCode::TooManyRequests, *limited, true);
+      } else if (!permit) {
+        SendHeaders(stream, StatusCode::ServiceUnavailable,
+                    {{"Retry-After",
+                      fmt::format("{}", config_.retry_after.count())}},
+                    true);
+      } else {
+        stream->handler = router_.GetHandler(*route);
+        auto gen = stream->handler->Handle(Request(request));
+        for (auto iter = co_await gen.begin(); iter != gen.end();
+             co_await ++iter) {
+          co_await std::visit(session, *iter);
+          if (stream->reset) break;
+        }
+        co_await session.Finish();
+      }
+    } else {
+      failed = true;
+      statusCode = StatusCode::NotFound;
+    }
+  } catch (const MalformedRequest &e) {
+    spdlog::debug("Malformed HTTP/2 request: {}", e.what());
+    malformed = true;
+  } catch (const Exception &e) {
+    spdlog::error("Handling exception {}", e.what());
+    failed = true;
+    statusCode = e.Code();
+  } catch (const std::exception &e) {
+    spdlog::error("Handling std exception {}", e.what());
+    failed = true;
+    statusCode = StatusCode::InternalServerError;
+  }
+  if (malformed) {
+    ResetStream(stream, Http2Error::ProtocolError);
+  } else if (failed) {
+    if (session.HeadersSent()) {
+      ResetStream(stream, Http2Error::InternalError);
+    } else {
+      session.Fail(statusCode);
+    }
+  }
+  streams_.erase(stream->id);
+  if (--active_streams_ == 0 && idle_) {
+    auto idle = std::move(idle_);
+    idle->set();
+  }
+}
+
+void Http2Connection::SendHeaders(const Http2Stream::Ptr &stream,
+                                  StatusCode status, const Headers &headers,
+                                  bool end_stream) {
+  if (stream->reset || closed_) return;
+  std::string block;
+  encoder_.EncodeStatus(status, block);
+  for (auto &[name, value] : headers) {
+    std::string lower(name);
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    if (IsConnectionSpecific(lower)) continue;
+    std::string_view values = value;
+    for (;;) {
+      auto end = values.find('\n');
+      encoder_.Encode(lower, values.substr(0, end), block);
+      if (end == std::string_view::npos) break;
+      values.remove_prefix(end + 1);
+    }
+  }
+  std::string_view rest = block;
+  FrameType type = FrameType::Headers;
+  uint8_t flags = end_stream ? EndStreamFlag : 0;
+  do {
+    auto fragment = rest.substr(0, peer_max_frame_size_);
+    rest.remove_prefix(fragment.size());
+    if (rest.empty()) flags |= EndHeadersFlag;
+    WriteFrame(type, flags, stream->id, fragment);
+    type = FrameType::Continuation;
+    flags = 0;
+  } while (!rest.empty());
+}
+
+coro::task<> Http2Connection::SendData(Http2Stream::Ptr stream,
+                                       std::string_view data,
+                                       bool end_stream) {
+  if (data.empty() && !end_stream) co_return;
+  do {
+    if (stream->reset || closed_) co_return;
+    int64_t window = std::min(connection_send_window_, stream->send_window);
+    if (window <= 0 && !data.empty()) {
+      stream->window_event = std::make_unique<coro::single_consumer_event>();
+      co_await *stream->window_event;
+      continue;
+    }
+    size_t size = std::min<size_t>(
+        {data.size(), static_cast<size_t>(std::max<int64_t>(window, 0)),
+         peer_max_frame_size_});
+    bool last = size == data.size();
+    WriteFrame(FrameType::Data, last && end_stream ? EndStreamFlag : 0,
+               stream->id, data.substr(0, size));
+    connection_send_window_ -= size;
+    stream->send_window -= size;
+    data.remove_prefix(size);
+  } while (!data.empty());
+}
+
+void Http2Connection::WriteFrame(FrameType type, uint8_t flags,
+                                 uint32_t stream_id, std::string_view payload) {
+  AppendFrameHeader({static_cast<uint32_t>(payload.size()), type, flags,
+                     stream_id},
+                    outbox_);
+  outbox_.append(payload);
+  if (!writing_) {
+    writing_ = true;
+    Spawn(Flush(shared_from_this()));
+  }
+}
+
+coro::task<> Http2Connection::Flush(Ptr self) {
+  std::string chunk;
+  while (!outbox_.empty()) {
+    chunk.clear();
+    chunk.swap(outbox_);
+    asio::error_code error;
+    coro::single_consumer_event event;
+    asio::async_write(*socket_, asio::buffer(chunk), [&](auto ec, auto n) {
+      spdlog::trace("Wrote {} bytes to socket; ec:{}", n, ec.message());
+      error = ec;
+      event.set();
+    });
+    co_await event;
+    if (error) {
+      outbox_.clear();
+      Close();
+      break;
+    }
+  }
+  writing_ = false;
+}
+
+void Http2Connection::SendSettings() {
+  std::string payload;
+  AppendSetting(Http2Setting::MaxConcurrentStreams,
+                config_.http2_max_concurrent_streams, payload);
+  AppendSetting(Http2Setting::InitialWindowSize,
+                config_.http2_initial_window_size, payload);
+  WriteFrame(FrameType::Settings, 0, 0, payload);
+  // The connection window can only be raised with a WINDOW_UPDATE.
+  if (config_.http2_initial_window_size > kDefaultWindow) {
+    SendWindowUpdate(0, config_.http2_initial_window_size - kDefaultWindow);
+    connection_recv_window_ = config_.http2_initial_window_size;
+  }
+}
+
+int64_t Http2Connection::RecvInitialWindow() const {
+  // Until the peer acknowledges our SETTINGS it may go by the default.
+  int64_t window = config_.http2_initial_window_size;
+  return settings_acked_ ? window : std::max(window, kDefaultWindow);
+}
+
+void Http2Connection::SendWindowUpdate(uint32_t stream_id,
+                                       uint32_t increment) {
+  std::string payload;
+  AppendUint32(increment & 0x7fffffff, payload);
+  WriteFrame(FrameType::WindowUpdate, 0, stream_id, payload);
+}
+
+void Http2Connection::ResetStream(const Http2Stream::Ptr &stream,
+                                  Http2Error error) {
+  std::string payload;
+  AppendUint32(static_cast<uint32_t>(error), payload);
+  WriteFrame(FrameType::RstStream, 0, stream->id, payload);
+  stream->reset = true;
+  if (stream->handler) stream->handler->SetDone();
+  WakeWriters();
+  // A stream reset before it was dispatched has no RunStream to retire it.
+  if (!stream->end_stream) streams_.erase(stream->id);
+}
+
+void Http2Connection::GoAway(Http2Error error) {
+  spdlog::debug("HTTP/2 GOAWAY with error {}", static_cast<uint32_t>(error));
+  std::string payload;
+  AppendUint32(last_stream_id_, payload);
+  AppendUint32(static_cast<uint32_t>(error), payload);
+  WriteFrame(FrameType::GoAway, 0, 0, payload);
+  closed_ = true;
+}
+
+void Http2Connection::Close() {
+  closed_ = true;
+  for (auto &[id, stream] : streams_) {
+    stream->reset = true;
+    if (stream->handler) stream->handler->SetDone();
+  }
+  WakeWriters();
+}
+
+void Http2Connection::WakeWriters() {
+  // Waking a writer resumes it inline and it may remove itself from streams_.
+  std::vector<Http2Stream::Ptr> waiting;
+  for (auto &[id, stream] : streams_) {
+    if (stream->window_event) waiting.push_back(stream);
+  }
+  for (auto &stream : waiting) {
+    auto event = std::move(stream->window_event);
+    if (event) event->set();
+  }
+}
+}  // namespace hs::internal
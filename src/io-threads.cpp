@@ -0,0 +1,162 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include "http-server/internal/io-threads.h"
+
+#include <spdlog/spdlog.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <utility>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace hs::internal {
+
+std::vector<int> AvailableCpus() {
+  std::vector<int> cpus;
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+  }
+#endif
+  if (cpus.empty()) {
+    for (unsigned cpu = 0; cpu < std::thread::hardware_concurrency(); ++cpu) {
+      cpus.push_back(static_cast<int>(cpu));
+    }
+  }
+  std::vector<std::pair<int, int>> by_node;
+  for (int cpu : cpus) by_node.emplace_back(CpuNode(cpu), cpu);
+  std::sort(by_node.begin(), by_node.end());
+  for (size_t i = 0; i < cpus.size(); ++i) cpus[i] = by_node[i].second;
+  return cpus;
+}
+
+int CpuNode(int cpu) {
+#ifdef __linux__
+  // The cpu directory links to its node as nodeN.
+  std::error_code error;
+  std::filesystem::directory_iterator it(
+      "/sys/devices/system/cpu/cpu" + std::to_string(cpu), error);
+  for (; !error && it != std::filesystem::directory_iterator();
+       it.increment(error)) {
+    auto name = it->path().filename().string();
+    if (name.starts_with("node") && name.size() > 4 &&
+        std::all_of(name.begin() + 4, name.end(), ::isdigit)) {
+      return std::stoi(name.substr(4));
+    }
+  }
+#endif
+  return 0;
+}
+
+bool PinCurrentThread(int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (error == 0) return true;
+  spdlog::warn("Could not pin io thread to CPU {}: {}", cpu,
+               std::strerror(error));
+#else
+  spdlog::warn("Pinning io threads is not supported on this platform");
+#endif
+  return false;
+}
+
+std::optional<int> IncomingCpu(int socket) {
+#ifdef SO_INCOMING_CPU
+  int cpu = -1;
+  socklen_t size = sizeof(cpu);
+  if (getsockopt(socket, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &size) == 0 &&
+      cpu >= 0) {
+    return cpu;
+  }
+#endif
+  return std::nullopt;
+}
+
+IoThreads::IoThreads(const Config &config)
+    : steer_(config.steer_connections) {
+  std::vector<int> cpus;
+  if (config.pin_io_threads) {
+    cpus = config.io_cpus.empty() ? AvailableCpus() : config.io_cpus;
+  }
+  size_t count = std::max<size_t>(config.io_threads, 1);
+  for (size_t i = 0; i < count; ++i) {
+    auto thread = std::make_unique<Thread>();
+    if (!cpus.empty()) {
+      thread->cpu = cpus[i % cpus.size()];
+      thread->node = CpuNode(thread->cpu);
+      if (by_cpu_.size() <= static_cast<size_t>(thread->cpu)) {
+        by_cpu_.resize(thread->cpu + 1);
+      }
+      if (!by_cpu_[thread->cpu]) by_cpu_[thread->cpu] = i;
+    }
+    if (by_node_.size() <= static_cast<size_t>(thread->node)) {
+      by_node_.resize(thread->node + 1);
+    }
+    by_node_[thread->node].push_back(i);
+    threads_.push_back(std::move(thread));
+  }
+  if (steer_) {
+    for (int cpu : AvailableCpus()) {
+      if (node_of_cpu_.size() <= static_cast<size_t>(cpu)) {
+        node_of_cpu_.resize(cpu + 1, -1);
+      }
+      node_of_cpu_[cpu] = CpuNode(cpu);
+    }
+  }
+  // Threads pin themselves before running anything, so the buffers their
+  // connections allocate are first touched, and placed, on their own node.
+  for (auto &thread : threads_) {
+    thread->thread = std::jthread([thread = thread.get()]() {
+      if (thread->cpu >= 0) PinCurrentThread(thread->cpu);
+      thread->context.run();
+    });
+  }
+  spdlog::info("Started {} io threads", threads_.size());
+}
+
+IoThreads::~IoThreads() {
+  for (auto &thread : threads_) {
+    thread->work.reset();
+    thread->context.stop();
+  }
+  for (auto &thread : threads_) {
+    if (thread->thread.joinable()) thread->thread.join();
+  }
+}
+
+size_t IoThreads::Size() const { return threads_.size(); }
+
+asio::io_context &IoThreads::Pick(int socket) {
+  if (steer_) {
+    if (auto cpu = IncomingCpu(socket)) {
+      size_t index = static_cast<size_t>(*cpu);
+      if (index < by_cpu_.size() && by_cpu_[index]) {
+        return threads_[*by_cpu_[index]]->context;
+      }
+      // No thread on that CPU; stay on its node.
+      if (index < node_of_cpu_.size() && node_of_cpu_[index] >= 0 &&
+          static_cast<size_t>(node_of_cpu_[index]) < by_node_.size()) {
+        auto &local = by_node_[node_of_cpu_[index]];
+        if (!local.empty()) {
+          return threads_[local[next_++ % local.size()]]->context;
+        }
+      }
+    }
+  }
+  return threads_[next_++ % threads_.size()]->context;
+}
+}  // namespace hs::internal
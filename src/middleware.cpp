@@ -0,0 +1,45 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include "http-server/middleware.h"
+
+#include <utility>
+
+namespace hs {
+namespace internal {
+namespace {
+
+class ChainHandler : public Handler {
+ public:
+  ChainHandler(std::shared_ptr<const std::vector<Middleware::Ptr>> chain,
+               Handler::Ptr handler)
+      : chain_(std::move(chain)), handler_(std::move(handler)) {}
+
+  coro::async_generator<Response> Handle(const Request req) override {
+    return Call(0, req);
+  }
+  void SetDone() override {
+    Handler::SetDone();
+    handler_->SetDone();
+  }
+
+ private:
+  coro::async_generator<Response> Call(size_t index, Request req) {
+    if (index == chain_->size()) return handler_->Handle(std::move(req));
+    return (*chain_)[index]->Handle(std::move(req), [this, index](Request r) {
+      return Call(index + 1, std::move(r));
+    });
+  }
+
+  std::shared_ptr<const std::vector<Middleware::Ptr>> chain_;
+  Handler::Ptr handler_;
+};
+}  // namespace
+}  // namespace internal
+
+Middleware::~Middleware() {}
+
+Handler::Ptr Chain(std::shared_ptr<const std::vector<Middleware::Ptr>> chain,
+                   Handler::Ptr handler) {
+  return std::make_shared<internal::ChainHandler>(std::move(chain),
+                                                  std::move(handler));
+}
+}  // namespace hs
@@ -0,0 +1,819 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include "http-server/proxy.h"
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <asio/connect.hpp>
+#include <asio/error.hpp>
+#include <asio/execution/context.hpp>
+#include <asio/query.hpp>
+#include <asio/write.hpp>
+#include <charconv>
+#include <coro/async_generator.hpp>
+#include <coro/single_consumer_event.hpp>
+#include <cstring>
+#include <stdexcept>
+
+#include "http-server/http-server.h"
+#include "http-server/internal/proxy.h"
+#include "http-server/internal/spawn.h"
+#include "http-server/internal/url.h"
+#include "http-server/internal/worker-pool.h"
+
+namespace hs {
+namespace internal {
+namespace {
+constexpr size_t kBufferSize = 64 * 1024;
+// Longest chunk size or trailer line accepted.
+constexpr size_t kMaxLine = 4096;
+std::atomic<uint64_t> next_group_id{1};
+
+bool EqualsIgnoreCase(std::string_view a, std::string_view b) {
+  return a.size() == b.size() &&
+         std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+           return std::tolower(static_cast<unsigned char>(x)) ==
+                  std::tolower(static_cast<unsigned char>(y));
+         });
+}
+
+std::string_view Trim(std::string_view s) {
+  auto begin = s.find_first_not_of(" \t");
+  if (begin == std::string_view::npos) return {};
+  auto end = s.find_last_not_of(" \t");
+  return s.substr(begin, end - begin + 1);
+}
+
+// Whether the comma separated list has token, e.g. "close" in a Connection
+// header.
+bool HasToken(std::string_view list, std::string_view token) {
+  while (!list.empty()) {
+    auto comma = list.find(',');
+    if (EqualsIgnoreCase(Trim(list.substr(0, comma)), token)) return true;
+    if (comma == std::string_view::npos) break;
+    list = list.substr(comma + 1);
+  }
+  return false;
+}
+
+// Headers describing one connection rather than the message, which a proxy
+// must not forward: the fixed set and those the Connection header names.
+bool IsHopByHop(std::string_view name, std::string_view connection) {
+  static constexpr std::string_view kHopByHop[] = {
+      "Connection",          "Keep-Alive", "Proxy-Connection",
+      "Proxy-Authenticate",  "TE",         "Trailer",
+      "Transfer-Encoding",   "Upgrade",    "Proxy-Authorization",
+  };
+  for (auto hop : kHopByHop) {
+    if (EqualsIgnoreCase(name, hop)) return true;
+  }
+  return HasToken(connection, name);
+}
+
+std::string_view FindHeader(
+    const std::unordered_map<std::string, std::string> &headers,
+    std::string_view name) {
+  for (auto &[key, value] : headers) {
+    if (EqualsIgnoreCase(key, name)) return value;
+  }
+  return {};
+}
+
+std::pair<std::string, std::string> SplitHostPort(std::string_view address) {
+  std::string_view host, port = "80";
+  if (address.starts_with('[')) {
+    auto close = address.find(']');
+    if (close == std::string_view::npos) {
+      throw std::runtime_error(fmt::format("Bad upstream {}", address));
+    }
+    host = address.substr(1, close - 1);
+    auto rest = address.substr(close + 1);
+    if (!rest.empty()) {
+      if (rest[0] != ':') {
+        throw std::runtime_error(fmt::format("Bad upstream {}", address));
+      }
+      port = rest.substr(1);
+    }
+  } else {
+    auto colon = address.rfind(':');
+    host = address.substr(0, colon);
+    if (colon != std::string_view::npos) port = address.substr(colon + 1);
+  }
+  if (host.empty() || port.empty()) {
+    throw std::runtime_error(fmt::format("Bad upstream {}", address));
+  }
+  return {std::string(host), std::string(port)};
+}
+
+std::string HostHeader(const UpstreamGroup::Upstream &upstream) {
+  if (upstream.host.find(':') != std::string::npos) {
+    return fmt::format("[{}]:{}", upstream.host, upstream.port);
+  }
+  return fmt::format("{}:{}", upstream.host, upstream.port);
+}
+
+StatusCode FailureStatus(asio::error_code error) {
+  return error == asio::error::timed_out ? StatusCode::GatewayTimeout
+                                         : StatusCode::BadGateway;
+}
+
+// Methods a client may repeat without changing the result (RFC 9110
+// section 9.2.2), so a request the upstream may have acted on can be resent.
+bool IsIdempotent(Method method) {
+  return method == Method::GET || method == Method::HEAD ||
+         method == Method::PUT || method == Method::DELETE;
+}
+
+ResponseBody::Ptr Body(std::string_view data) {
+  return std::make_shared<WritableResponseBody<std::string_view>>(data);
+}
+
+// Response bytes read from an upstream and not yet handled.
+struct Reader {
+  std::string buffer = std::string(kBufferSize, '\0');
+  size_t begin = 0;
+  size_t end = 0;
+
+  std::string_view Pending() const {
+    return std::string_view(buffer).substr(begin, end - begin);
+  }
+  // Views of the consumed bytes stay valid until the next Fill.
+  void Consume(size_t size) {
+    begin += size;
+    if (begin == end) begin = end = 0;
+  }
+  // Reads more after the pending bytes, failing with message_size when they
+  // fill the buffer.
+  coro::task<asio::error_code> Fill(UpstreamConnection &connection,
+                                    std::chrono::milliseconds timeout) {
+    if (begin > 0) {
+      std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+      end -= begin;
+      begin = 0;
+    }
+    if (end == buffer.size()) co_return asio::error::message_size;
+    auto [error, size] = co_await connection.ReadSome(
+        asio::buffer(buffer.data() + end, buffer.size() - end), timeout);
+    end += size;
+    co_return error;
+  }
+};
+
+// Reads up to the final response head, skipping interim 1xx responses.
+coro::task<asio::error_code> ReadHead(UpstreamConnection &connection,
+                                      Reader &reader,
+                                      std::chrono::milliseconds timeout,
+                                      ResponseHead &head) {
+  for (;;) {
+    auto pending = reader.Pending();
+    auto end = pending.find("\r\n\r\n");
+    if (end == std::string_view::npos) {
+      auto error = co_await reader.Fill(connection, timeout);
+      if (error == asio::error::message_size) {
+        throw Exception(StatusCode::BadGateway,
+                        "Upstream response head too large");
+      }
+      if (error) co_return error;
+      continue;
+    }
+    auto parsed = ParseResponseHead(pending.substr(0, end + 4));
+    if (!parsed) {
+      throw Exception(StatusCode::BadGateway, "Malformed upstream response");
+    }
+    reader.Consume(end + 4);
+    if (parsed->status < 200 && parsed->status != 101) continue;
+    head = std::move(*parsed);
+    co_return asio::error_code();
+  }
+}
+
+struct Outstanding {
+  UpstreamGroup &group;
+  size_t index;
+  ~Outstanding() { group.Done(index); }
+};
+
+class ProxyHandler : public Handler {
+ public:
+  ProxyHandler(std::shared_ptr<UpstreamGroup> group)
+      : group_(std::move(group)) {}
+
+  coro::async_generator<Response> Handle(const Request req) override {
+    auto executor = CurrentIoExecutor();
+    if (!executor) {
+      throw Exception(StatusCode::InternalServerError,
+                      "Proxying outside an io thread");
+    }
+    auto &options = group_->Options();
+    group_->CheckHealth(*executor);
+    auto length = req.ContentLength();
+    if (!length && req.Header("Transfer-Encoding")) {
+      throw Exception(StatusCode::BadRequest, "Missing Content-Length header");
+    }
+    bool has_body = length && *length > 0;
+    auto picked = group_->Pick();
+    if (!picked) {
+      throw Exception(StatusCode::BadGateway, "No healthy upstream");
+    }
+    size_t index = *picked;
+    Outstanding outstanding{*group_, index};
+    auto &upstream = group_->At(index);
+    auto head = RequestHead(req, upstream, has_body ? *length : 0);
+
+    auto &pool = IdleConnections::Of(*executor);
+    UpstreamConnection::Ptr connection;
+    Reader reader;
+    ResponseHead response;
+    for (int attempt = 0;; ++attempt) {
+      connection = pool.Take(group_->Id(), index, options.idle_timeout);
+      bool reused = connection != nullptr;
+      if (!reused) {
+        connection = std::make_unique<UpstreamConnection>(*executor);
+        auto error = co_await connection->Connect(
+            upstream.host, upstream.port, options.connect_timeout);
+        if (error) {
+          group_->MarkDown(index);
+          throw Exception(FailureStatus(error),
+                          fmt::format("Connecting to {} failed: {}",
+                                      HostHeader(upstream), error.message()));
+        }
+      }
+      auto error = co_await Send(*connection, head, req, has_body);
+      if (!error) {
+        error = co_await ReadHead(*connection, reader, options.read_timeout,
+                                  response);
+      }
+      if (!error) break;
+      // The upstream may close an idle connection just as it is taken. It
+      // may also have acted on the request before closing, so only
+      // idempotent requests without a body are sent once more on a new one.
+      if (reused && attempt == 0 && !has_body &&
+          IsIdempotent(req.GetMethod()) && reader.Pending().empty() &&
+          error != asio::error::timed_out) {
+        spdlog::debug("Pooled connection to {} failed: {}",
+                      HostHeader(upstream), error.message());
+        continue;
+      }
+      throw Exception(FailureStatus(error),
+                      fmt::format("Upstream {} failed: {}",
+                                  HostHeader(upstream), error.message()));
+    }
+
+    auto status = static_cast<StatusCode>(response.status);
+    co_yield status;
+    auto headers = ResponseHeaders(response);
+    auto version = req.GetVersion();
+    if (req.GetMethod() == Method::HEAD || response.status == 204 ||
+        response.status == 304 || response.status < 200) {
+      if (response.content_length) {
+        headers["Content-Length"] =
+            fmt::format("{}", *response.content_length);
+      }
+      co_yield headers;
+      Release(pool, index, std::move(connection), response.keep_alive);
+      co_return;
+    }
+
+    if (response.content_length) {
+      headers["Content-Length"] = fmt::format("{}", *response.content_length);
+      co_yield headers;
+      size_t remaining = *response.content_length;
+      while (remaining > 0) {
+        // The client has gone. The connection, with the rest of the body
+        // unread, is dropped rather than pooled.
+        if (IsDone()) co_return;
+        if (reader.Pending().empty()) {
+          auto error = co_await reader.Fill(*connection, options.read_timeout);
+          if (reader.Pending().empty()) {
+            throw Exception(FailureStatus(error),
+                            fmt::format("Upstream {} body cut short: {}",
+                                        HostHeader(upstream), error.message()));
+          }
+        }
+        auto data = reader.Pending().substr(0, remaining);
+        remaining -= data.size();
+        reader.Consume(data.size());
+        co_yield Body(data);
+      }
+      Release(pool, index, std::move(connection),
+              response.keep_alive && reader.Pending().empty());
+      co_return;
+    }
+
+    if (response.chunked) {
+      // HTTP/1.1 clients get the upstream's chunks, trailers included, as
+      // they are. Others get the data and learn of its end from the
+      // connection (HTTP/1.0) or stream (HTTP/2) ending.
+      bool raw = version == Version::HTTP_1_1;
+      if (raw) {
+        headers["Transfer-Encoding"] = "chunked";
+      } else if (version == Version::HTTP_1_0) {
+        headers["Connection"] = "Close";
+      }
+      co_yield headers;
+      ChunkedDecoder decoder;
+      // Pending bytes decoded but not yet passed on, in raw mode.
+      size_t decoded = 0;
+      for (;;) {
+        if (IsDone()) co_return;
+        std::string_view data;
+        size_t used = decoder.Decode(reader.Pending().substr(decoded), data);
+        if (raw) {
+          decoded += used;
+          if (used > 0 && !decoder.Done()) continue;
+          if (decoded > 0) {
+            auto out = reader.Pending().substr(0, decoded);
+            reader.Consume(decoded);
+            decoded = 0;
+            co_yield Body(out);
+          }
+        } else {
+          reader.Consume(used);
+          if (!data.empty()) co_yield Body(data);
+          if (used > 0 && !decoder.Done()) continue;
+        }
+        if (decoder.Done()) break;
+        auto error = co_await reader.Fill(*connection, options.read_timeout);
+        if (error == asio::error::message_size) {
+          throw Exception(StatusCode::BadGateway, "Upstream chunk too large");
+        }
+        if (error) {
+          throw Exception(FailureStatus(error),
+                          fmt::format("Upstream {} body cut short: {}",
+                                      HostHeader(upstream), error.message()));
+        }
+      }
+      Release(pool, index, std::move(connection),
+              response.keep_alive && reader.Pending().empty());
+      co_return;
+    }
+
+    // The body runs until the upstream closes the connection, and so does
+    // the response to HTTP/1.x clients.
+    if (version != Version::HTTP_2) headers["Connection"] = "Close";
+    co_yield headers;
+    for (;;) {
+      if (IsDone()) co_return;
+      if (reader.Pending().empty()) {
+        auto error = co_await reader.Fill(*connection, options.read_timeout);
+        if (error == asio::error::eof) break;
+        if (error) {
+          throw Exception(FailureStatus(error),
+                          fmt::format("Upstream {} body cut short: {}",
+                                      HostHeader(upstream), error.message()));
+        }
+      }
+      auto data = reader.Pending();
+      reader.Consume(data.size());
+      co_yield Body(data);
+    }
+  }
+
+ private:
+  std::string RequestHead(const Request &req,
+                          const UpstreamGroup::Upstream &upstream,
+                          size_t length) const {
+    std::string path;
+    if (group_->Options().strip_prefix) {
+      for (auto &param : req.Params()) path += "/" + param;
+      if (path.empty()) path = "/";
+    } else {
+      path = req.Path();
+    }
+    auto query = req.Query();
+    auto head = fmt::format("{} {}{}{} HTTP/1.1\r\n", req.GetMethod(),
+                            EncodePath(path), query.empty() ? "" : "?", query);
+    auto &headers = req.AllHeaders();
+    auto connection = FindHeader(headers, "Connection");
+    bool host = false;
+    for (auto &[name, value] : headers) {
+      // Framing is redone here and the upstream connection is the proxy's.
+      if (name.starts_with(':') || IsHopByHop(name, connection) ||
+          EqualsIgnoreCase(name, "Content-Length") ||
+          EqualsIgnoreCase(name, "Expect") ||
+          EqualsIgnoreCase(name, "HTTP2-Settings")) {
+        continue;
+      }
+      host = host || EqualsIgnoreCase(name, "Host");
+      head += fmt::format("{}: {}\r\n", name, value);
+    }
+    if (!host) head += fmt::format("Host: {}\r\n", HostHeader(upstream));
+    if (length > 0) head += fmt::format("Content-Length: {}\r\n", length);
+    head += "\r\n";
+    return head;
+  }
+
+  coro::task<asio::error_code> Send(UpstreamConnection &connection,
+                                    const std::string &head,
+                                    const Request &req, bool has_body) {
+    auto timeout = group_->Options().read_timeout;
+    auto error = co_await connection.Write(head, timeout);
+    if (error || !has_body) co_return error;
+    auto body = req.BodyChunks();
+    for (auto chunk = co_await body.begin(); chunk != body.end();
+         co_await ++chunk) {
+      error = co_await connection.Write(*chunk, timeout);
+      if (error) co_return error;
+    }
+    co_return error;
+  }
+
+  // Joins repeated headers into one, since Headers holds a single value per
+  // name. Set-Cookie values may hold commas, so they are kept apart.
+  static Headers ResponseHeaders(const ResponseHead &response) {
+    std::string_view connection;
+    for (auto &[name, value] : response.headers) {
+      if (EqualsIgnoreCase(name, "Connection")) connection = value;
+    }
+    Headers headers;
+    for (auto &[name, value] : response.headers) {
+      if (IsHopByHop(name, connection) ||
+          EqualsIgnoreCase(name, "Content-Length")) {
+        continue;
+      }
+      auto [it, inserted] = headers.emplace(name, value);
+      if (!inserted) {
+        it->second += EqualsIgnoreCase(name, "Set-Cookie") ? "\n" : ", ";
+        it->second += value;
+      }
+    }
+    return headers;
+  }
+
+  void Release(IdleConnections &pool, size_t index,
+               UpstreamConnection::Ptr connection, bool reusable) {
+    if (!reusable) return;
+    connection->idle_since = UpstreamConnection::Clock::now();
+    pool.Put(group_->Id(), index, std::move(connection),
+             group_->Options().max_idle_connections);
+  }
+
+  std::shared_ptr<UpstreamGroup> group_;
+};
+}  // namespace
+
+std::optional<ResponseHead> ParseResponseHead(std::string_view head) {
+  auto line_end = head.find("\r\n");
+  if (line_end == std::string_view::npos) return std::nullopt;
+  auto line = head.substr(0, line_end);
+  // HTTP-version SP 3DIGIT SP reason-phrase
+  if (line.size() < 12 || !line.starts_with("HTTP/1.") ||
+      (line[7] != '0' && line[7] != '1') || line[8] != ' ' ||
+      (line.size() > 12 && line[12] != ' ')) {
+    return std::nullopt;
+  }
+  ResponseHead response;
+  auto [ptr, ec] =
+      std::from_chars(line.data() + 9, line.data() + 12, response.status);
+  if (ec != std::errc() || ptr != line.data() + 12 || response.status < 100) {
+    return std::nullopt;
+  }
+  response.keep_alive = line[7] == '1';
+  bool transfer_encoding = false;
+  size_t pos = line_end + 2;
+  for (;;) {
+    auto end = head.find("\r\n", pos);
+    if (end == std::string_view::npos) return std::nullopt;
+    auto field = head.substr(pos, end - pos);
+    pos = end + 2;
+    if (field.empty()) break;
+    auto colon = field.find(':');
+    if (colon == 0 || colon == std::string_view::npos) return std::nullopt;
+    auto name = field.substr(0, colon);
+    // Whitespace before the colon, or a folded line, is not allowed.
+    if (name.find_first_of(" \t") != std::string_view::npos) {
+      return std::nullopt;
+    }
+    auto value = Trim(field.substr(colon + 1));
+    if (EqualsIgnoreCase(name, "Content-Length")) {
+      size_t length;
+      auto [ptr, ec] =
+          std::from_chars(value.data(), value.data() + value.size(), length);
+      if (ec != std::errc() || ptr != value.data() + value.size() ||
+          value.empty() ||
+          (response.content_length && *response.content_length != length)) {
+        return std::nullopt;
+      }
+      response.content_length = length;
+    } else if (EqualsIgnoreCase(name, "Transfer-Encoding")) {
+      transfer_encoding = true;
+      // Only a final chunked coding delimits the body.
+      auto comma = value.rfind(',');
+      response.chunked = EqualsIgnoreCase(
+          Trim(comma == std::string_view::npos ? value
+                                               : value.substr(comma + 1)),
+          "chunked");
+    } else if (EqualsIgnoreCase(name, "Connection")) {
+      if (HasToken(value, "close")) {
+        response.keep_alive = false;
+      } else if (HasToken(value, "keep-alive")) {
+        response.keep_alive = true;
+      }
+    }
+    response.headers.emplace_back(name, value);
+  }
+  // Transfer-Encoding overrides Content-Length; without chunked last the
+  // body runs until the connection closes.
+  if (transfer_encoding) response.content_length.reset();
+  return response;
+}
+
+size_t ChunkedDecoder::Decode(std::string_view input, std::string_view &data) {
+  data = {};
+  switch (state_) {
+    case State::Size: {
+      auto end = input.find("\r\n");
+      if (end == std::string_view::npos) {
+        if (input.size() >= kMaxLine) {
+          throw Exception(StatusCode::BadGateway, "Chunk size line too long");
+        }
+        return 0;
+      }
+      // Chunk extensions are ignored.
+      auto size = Trim(input.substr(0, std::min(end, input.find(';'))));
+      auto [ptr, ec] =
+          std::from_chars(size.data(), size.data() + size.size(), remaining_,
+                          16);
+      if (size.empty() || ec != std::errc() ||
+          ptr != size.data() + size.size()) {
+        throw Exception(StatusCode::BadGateway, "Malformed chunk size");
+      }
+      state_ = remaining_ > 0 ? State::Data : State::Trailer;
+      return end + 2;
+    }
+    case State::Data: {
+      size_t size = std::min(remaining_, input.size());
+      data = input.substr(0, size);
+      remaining_ -= size;
+      if (remaining_ == 0) state_ = State::DataEnd;
+      return size;
+    }
+    case State::DataEnd:
+      if (input.size() < 2) return 0;
+      if (!input.starts_with("\r\n")) {
+        throw Exception(StatusCode::BadGateway, "Malformed chunk");
+      }
+      state_ = State::Size;
+      return 2;
+    case State::Trailer: {
+      auto end = input.find("\r\n");
+      if (end == std::string_view::npos) {
+        if (input.size() >= kMaxLine) {
+          throw Exception(StatusCode::BadGateway, "Trailer line too long");
+        }
+        return 0;
+      }
+      if (end == 0) state_ = State::Done;
+      return end + 2;
+    }
+    case State::Done:
+    default:
+      return 0;
+  }
+}
+
+UpstreamConnection::UpstreamConnection(asio::any_io_executor executor)
+    : socket_(executor), resolver_(executor), timer_(executor) {}
+
+coro::task<std::pair<asio::error_code, size_t>> UpstreamConnection::Timed(
+    std::chrono::milliseconds timeout, std::function<void(Completion)> start) {
+  asio::error_code error;
+  size_t size = 0;
+  bool expired = false;
+  // Waits for the timer's handler as well, so none outlives the call.
+  int pending = 2;
+  coro::single_consumer_event event;
+  timer_.expires_after(timeout);
+  timer_.async_wait([&](asio::error_code ec) {
+    if (!ec) {
+      expired = true;
+      resolver_.cancel();
+      asio::error_code ignored;
+      socket_.cancel(ignored);
+    }
+    if (--pending == 0) event.set();
+  });
+  start([&](asio::error_code ec, size_t n) {
+    error = ec;
+    size = n;
+    timer_.cancel();
+    if (--pending == 0) event.set();
+  });
+  co_await event;
+  if (expired && error == asio::error::operation_aborted) {
+    error = asio::error::timed_out;
+  }
+  co_return std::make_pair(error, size);
+}
+
+coro::task<asio::error_code> UpstreamConnection::Connect(
+    const std::string &host, const std::string &port,
+    std::chrono::milliseconds timeout) {
+  auto [error, size] = co_await Timed(timeout, [&](Completion done) {
+    resolver_.async_resolve(
+        host, port,
+        [this, done](asio::error_code ec,
+                     asio::ip::tcp::resolver::results_type results) {
+          if (ec) return done(ec, 0);
+          asio::async_connect(socket_, results,
+                              [done](asio::error_code ec,
+                                     const asio::ip::tcp::endpoint &) {
+                                done(ec, 0);
+                              });
+        });
+  });
+  if (!error) {
+    asio::error_code ignored;
+    socket_.set_option(asio::ip::tcp::no_delay(true), ignored);
+  }
+  co_return error;
+}
+
+coro::task<asio::error_code> UpstreamConnection::Write(
+    std::string_view data, std::chrono::milliseconds timeout) {
+  auto [error, size] = co_await Timed(timeout, [&](Completion done) {
+    asio::async_write(socket_, asio::buffer(data.data(), data.size()),
+                      std::move(done));
+  });
+  co_return error;
+}
+
+coro::task<std::pair<asio::error_code, size_t>> UpstreamConnection::ReadSome(
+    asio::mutable_buffer buffer, std::chrono::milliseconds timeout) {
+  co_return co_await Timed(timeout, [&](Completion done) {
+    socket_.async_read_some(buffer, std::move(done));
+  });
+}
+
+asio::execution_context::id IdleConnections::id;
+
+IdleConnections::IdleConnections(asio::execution_context &context)
+    : asio::execution_context::service(context) {}
+
+IdleConnections &IdleConnections::Of(const asio::any_io_executor &executor) {
+  return asio::use_service<IdleConnections>(
+      asio::query(executor, asio::execution::context));
+}
+
+UpstreamConnection::Ptr IdleConnections::Take(
+    uint64_t group, size_t upstream, std::chrono::seconds idle_timeout) {
+  std::lock_guard lock(mutex_);
+  auto it = idle_.find({group, upstream});
+  if (it == idle_.end()) return nullptr;
+  auto &connections = it->second;
+  // Oldest first, so the expired ones are at the front.
+  auto cutoff = UpstreamConnection::Clock::now() - idle_timeout;
+  while (!connections.empty() && connections.front()->idle_since < cutoff) {
+    connections.pop_front();
+  }
+  if (connections.empty()) return nullptr;
+  auto connection = std::move(connections.back());
+  connections.pop_back();
+  return connection;
+}
+
+void IdleConnections::Put(uint64_t group, size_t upstream,
+                          UpstreamConnection::Ptr connection,
+                          size_t max_idle) {
+  std::lock_guard lock(mutex_);
+  auto &connections = idle_[{group, upstream}];
+  connections.push_back(std::move(connection));
+  while (connections.size() > max_idle) connections.pop_front();
+}
+
+size_t IdleConnections::Size() const {
+  std::lock_guard lock(mutex_);
+  size_t size = 0;
+  for (auto &[key, connections] : idle_) size += connections.size();
+  return size;
+}
+
+void IdleConnections::shutdown() {
+  std::lock_guard lock(mutex_);
+  idle_.clear();
+}
+
+UpstreamGroup::UpstreamGroup(ProxyOptions options)
+    : options_(std::move(options)),
+      id_(next_group_id++),
+      upstreams_(options_.upstreams.size()) {
+  if (upstreams_.empty()) {
+    throw std::runtime_error("A proxy needs at least one upstream");
+  }
+  for (size_t i = 0; i < upstreams_.size(); ++i) {
+    std::tie(upstreams_[i].host, upstreams_[i].port) =
+        SplitHostPort(options_.upstreams[i]);
+  }
+}
+
+bool UpstreamGroup::Available(Upstream &upstream, Clock::rep now) {
+  if (upstream.healthy) return true;
+  if (!options_.health_check_path.empty() || now < upstream.next_check) {
+    return false;
+  }
+  // Without health checks an upstream is tried again after its interval.
+  upstream.healthy = true;
+  return true;
+}
+
+std::optional<size_t> UpstreamGroup::Pick() {
+  auto now = Clock::now().time_since_epoch().count();
+  size_t start = next_++;
+  std::optional<size_t> picked;
+  for (size_t i = 0; i < upstreams_.size(); ++i) {
+    size_t index = (start + i) % upstreams_.size();
+    auto &upstream = upstreams_[index];
+    if (!Available(upstream, now)) continue;
+    if (options_.balance == ProxyBalance::RoundRobin) {
+      picked = index;
+      break;
+    }
+    if (!picked || upstream.outstanding < upstreams_[*picked].outstanding) {
+      picked = index;
+    }
+  }
+  if (picked) ++upstreams_[*picked].outstanding;
+  return picked;
+}
+
+void UpstreamGroup::Done(size_t index) { --upstreams_[index].outstanding; }
+
+void UpstreamGroup::MarkDown(size_t index) {
+  auto &upstream = upstreams_[index];
+  if (upstream.healthy.exchange(false)) {
+    spdlog::warn("Upstream {} is down", HostHeader(upstream));
+  }
+  upstream.next_check = std::chrono::duration_cast<Clock::duration>(
+                            Clock::now().time_since_epoch() +
+                            options_.health_check_interval)
+                            .count();
+}
+
+void UpstreamGroup::CheckHealth(const asio::any_io_executor &executor) {
+  if (options_.health_check_path.empty()) return;
+  auto now = Clock::now().time_since_epoch();
+  for (size_t i = 0; i < upstreams_.size(); ++i) {
+    auto &upstream = upstreams_[i];
+    if (now.count() < upstream.next_check || upstream.checking.exchange(true)) {
+      continue;
+    }
+    upstream.next_check = std::chrono::duration_cast<Clock::duration>(
+                              now + options_.health_check_interval)
+                              .count();
+    Spawn(Probe(i, executor));
+  }
+}
+
+coro::task<> UpstreamGroup::Probe(size_t index,
+                                  asio::any_io_executor executor) {
+  // Keeps the group alive until the check is done.
+  auto self = shared_from_this();
+  auto &upstream = upstreams_[index];
+  UpstreamConnection connection(executor);
+  auto error = co_await connection.Connect(upstream.host, upstream.port,
+                                           options_.connect_timeout);
+  if (!error) {
+    error = co_await connection.Write(
+        fmt::format("GET {} HTTP/1.1\r\nHost: {}\r\nConnection: close\r\n\r\n",
+                    options_.health_check_path, HostHeader(upstream)),
+        options_.read_timeout);
+  }
+  std::string head(kMaxLine, '\0');
+  size_t read = 0;
+  while (!error && read < head.size() &&
+         std::string_view(head.data(), read).find("\r\n\r\n") ==
+             std::string_view::npos) {
+    size_t size;
+    std::tie(error, size) = co_await connection.ReadSome(
+        asio::buffer(head.data() + read, head.size() - read),
+        options_.read_timeout);
+    read += size;
+  }
+  auto response = ParseResponseHead(std::string_view(head.data(), read));
+  bool healthy = response && response->status >= 200 && response->status < 400;
+  if (upstream.healthy.exchange(healthy) != healthy) {
+    spdlog::warn("Upstream {} is {}", HostHeader(upstream),
+                 healthy ? "up" : "down");
+  }
+  upstream.checking = false;
+}
+}  // namespace internal
+
+Upstreams::Upstreams(ProxyOptions options)
+    : pimpl_(std::make_shared<internal::UpstreamGroup>(std::move(options))) {}
+Upstreams::~Upstreams() {}
+size_t Upstreams::Size() const { return pimpl_->Size(); }
+bool Upstreams::Healthy(size_t index) const {
+  return pimpl_->At(index).healthy;
+}
+
+ProxyRoute::ProxyRoute(Method method, const std::string &path,
+                       Upstreams::Ptr upstreams)
+    : method_(method), path_(path), upstreams_(std::move(upstreams)) {}
+Method ProxyRoute::GetMethod() const { return method_; }
+std::string ProxyRoute::GetPath() const { return path_; }
+Handler::Ptr ProxyRoute::GetHandler() const {
+  return std::make_shared<internal::ProxyHandler>(upstreams_->pimpl_);
+}
+}  // namespace hs
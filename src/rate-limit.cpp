@@ -0,0 +1,167 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include "http-server/internal/rate-limit.h"
+
+#include <fmt/format.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+
+namespace hs::internal {
+namespace {
+int64_t Interval(const RateLimit &options) {
+  if (!(options.rate > 0) || options.burst == 0) {
+    throw std::runtime_error("Rate limit needs a positive rate and burst");
+  }
+  if (options.key == RateLimitKey::Header && options.header.empty()) {
+    throw std::runtime_error("Rate limit by header needs a header name");
+  }
+  return std::max<int64_t>(1, static_cast<int64_t>(1e9 / options.rate));
+}
+
+// Rounds up to whole seconds, as the headers count them.
+int64_t Seconds(RateLimiter::Clock::duration duration) {
+  return std::chrono::ceil<std::chrono::seconds>(duration).count();
+}
+}  // namespace
+
+RateLimiter::RateLimiter(const RateLimit &options)
+    : options_(options),
+      interval_(Interval(options)),
+      tolerance_(interval_ * static_cast<int64_t>(options.burst)),
+      epoch_(Clock::now()),
+      bucket_mask_(std::bit_ceil(std::max<size_t>(
+                       1, (options.max_keys + 3) / 4)) -
+                   1),
+      buckets_(std::make_unique<Bucket[]>(bucket_mask_ + 1)) {}
+
+bool RateLimiter::Applies(const Route &route) const {
+  if (options_.routes.empty()) return true;
+  return std::find(options_.routes.begin(), options_.routes.end(),
+                   route.GetPath()) != options_.routes.end();
+}
+
+std::optional<std::string_view> RateLimiter::Key(const RequestImpl &request,
+                                                 std::string &storage) const {
+  switch (options_.key) {
+    case RateLimitKey::RemoteAddress: {
+      if (!request.socket) return std::nullopt;
+      asio::error_code ec;
+      auto endpoint = request.socket->Socket().remote_endpoint(ec);
+      if (ec) return std::nullopt;
+      // The address alone: every connection comes from its own port.
+      auto address = endpoint.data();
+      if (address->sa_family == AF_INET) {
+        auto in = reinterpret_cast<const sockaddr_in *>(address);
+        storage.assign(reinterpret_cast<const char *>(&in->sin_addr),
+                       sizeof(in->sin_addr));
+      } else if (address->sa_family == AF_INET6) {
+        auto in6 = reinterpret_cast<const sockaddr_in6 *>(address);
+        storage.assign(reinterpret_cast<const char *>(&in6->sin6_addr),
+                       sizeof(in6->sin6_addr));
+      } else {
+        storage.clear();
+      }
+      return storage;
+    }
+    case RateLimitKey::Header: {
+      auto value = FindHeader(request, options_.header);
+      if (!value) return std::nullopt;
+      return *value;
+    }
+    case RateLimitKey::PathParam:
+      if (options_.path_param >= request.path_params.size()) {
+        return std::nullopt;
+      }
+      return request.path_params[options_.path_param];
+  }
+  return std::nullopt;
+}
+
+RateLimiter::Slot &RateLimiter::Find(uint64_t hash, int64_t now) {
+  auto &slots = buckets_[hash & bucket_mask_].slots;
+  for (auto &slot : slots) {
+    if (slot.key.load(std::memory_order_acquire) == hash) return slot;
+  }
+  Slot *oldest = &slots[0];
+  int64_t oldest_tat = std::numeric_limits<int64_t>::max();
+  for (auto &slot : slots) {
+    uint64_t key = slot.key.load(std::memory_order_acquire);
+    int64_t tat = slot.tat.load(std::memory_order_relaxed);
+    if (key == 0 || tat <= now) {
+      // Taken over as it stands: an arrival time in the past counts as
+      // now.
+      if (slot.key.compare_exchange_strong(key, hash,
+                                           std::memory_order_acq_rel) ||
+          key == hash) {
+        return slot;
+      }
+      continue;
+    }
+    if (tat < oldest_tat) {
+      oldest = &slot;
+      oldest_tat = tat;
+    }
+  }
+  // Full of keys still refilling: forget the one closest to done.
+  oldest->key.store(hash, std::memory_order_release);
+  oldest->tat.store(now, std::memory_order_relaxed);
+  return *oldest;
+}
+
+RateLimiter::Decision RateLimiter::Check(std::string_view key,
+                                         Clock::time_point now) {
+  // Zero marks an unused slot.
+  uint64_t hash = std::max<uint64_t>(std::hash<std::string_view>()(key), 1);
+  int64_t at = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   now - epoch_)
+                   .count();
+  auto &slot = Find(hash, at);
+  int64_t tat = slot.tat.load(std::memory_order_relaxed);
+  for (;;) {
+    int64_t next = std::max(tat, at) + interval_;
+    if (next - at > tolerance_) {
+      return {.allowed = false,
+              .remaining = 0,
+              .reset = std::chrono::nanoseconds(std::max<int64_t>(tat - at, 0)),
+              .retry_after = std::chrono::nanoseconds(next - at - tolerance_)};
+    }
+    if (slot.tat.compare_exchange_weak(tat, next, std::memory_order_relaxed)) {
+      return {.allowed = true,
+              .remaining = static_cast<size_t>((tolerance_ - (next - at)) /
+                                               interval_),
+              .reset = std::chrono::nanoseconds(next - at),
+              .retry_after = Clock::duration::zero()};
+    }
+  }
+}
+
+size_t RateLimiter::Tracked(Clock::time_point now) const {
+  int64_t at = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   now - epoch_)
+                   .count();
+  size_t tracked = 0;
+  for (size_t i = 0; i <= bucket_mask_; ++i) {
+    for (auto &slot : buckets_[i].slots) {
+      if (slot.key.load(std::memory_order_relaxed) != 0 &&
+          slot.tat.load(std::memory_order_relaxed) > at) {
+        ++tracked;
+      }
+    }
+  }
+  return tracked;
+}
+
+Headers RateLimiter::RefusedHeaders(const Decision &decision) const {
+  return {
+      {"RateLimit-Limit", fmt::format("{}", options_.burst)},
+      {"RateLimit-Remaining", fmt::format("{}", decision.remaining)},
+      {"RateLimit-Reset", fmt::format("{}", Seconds(decision.reset))},
+      {"Retry-After", fmt::format("{}", Seconds(decision.retry_after))},
+  };
+}
+}  // namespace hs::internal
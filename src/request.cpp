@@ -2,12 +2,14 @@
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <asio/buffer.hpp>
 #include <asio/completion_condition.hpp>
 #include <asio/error_code.hpp>
 #include <asio/read.hpp>
 #include <asio/read_until.hpp>
 #include <asio/streambuf.hpp>
+#include <cctype>
 #include <cstddef>
 #include <optional>
 #include <string>
@@ -17,6 +19,7 @@
 #include "http-server/enum.h"
 #include "http-server/http-server.h"
 #include "http-server/internal/request-impl.h"
+#include "http-server/internal/url.h"
 
 // Helper function to remove trailing '\r' and leading/trailing whitespace from
 // a string
@@ -30,31 +33,30 @@ std::string cleanString(const std::string &str) {
 }
 namespace hs {
 namespace internal {
-auto ParseUrl(const std::string &url) {
-  size_t npos = url.find('?', 0);
-  std::unordered_map<std::string, std::string> params;
+Method ParseMethod(std::string_view method) {
+  if (method == "GET") return Method::GET;
+  if (method == "POST") return Method::POST;
+  throw Exception(StatusCode::InternalServerError, "Unsupported method");
+}
 
-  if (npos == std::string::npos) {
-    return std::make_pair(url, params);
-  }
-  std::string path = url.substr(0, npos);
-  while (size_t qpos = url.find('&', npos + 1)) {
-    auto query = url.substr(npos + 1, qpos - npos - 1);
-    size_t spos = query.find('=');
-    if (spos == std::string::npos) {
-      throw Exception(StatusCode::BadRequest, "Malformed query");
+const std::string *FindHeader(const RequestImpl &request,
+                              std::string_view name) {
+  auto it = request.headers.find(std::string(name));
+  if (it != request.headers.end()) return &it->second;
+  for (auto &[key, value] : request.headers) {
+    if (key.size() == name.size() &&
+        std::equal(key.begin(), key.end(), name.begin(), [](char a, char b) {
+          return std::tolower(static_cast<unsigned char>(a)) ==
+                 std::tolower(static_cast<unsigned char>(b));
+        })) {
+      return &value;
     }
-    params[query.substr(0, spos)] = query.substr(spos + 1);
-    if (qpos == std::string::npos) {
-      break;
-    }
-    npos = qpos;
   }
-  return std::make_pair(path, params);
+  return nullptr;
 }
 
 coro::task<std::optional<RequestImpl::Ptr>> ParseRequestLine(
-    std::shared_ptr<tcp::socket> socket) {
+    Stream::Ptr socket, bool trace) {
   bool has_request = true;
   asio::streambuf buffer;
   coro::single_consumer_event event;
@@ -74,6 +76,7 @@ coro::task<std::optional<RequestImpl::Ptr>> ParseRequestLine(
 
   auto req = std::make_shared<RequestImpl>();
   req->socket = socket;
+  if (trace) req->trace.received = RequestTrace::Clock::now();
   // Read and parse request line
   std::string requestLine;
   std::getline(input, requestLine);
@@ -84,17 +87,15 @@ coro::task<std::optional<RequestImpl::Ptr>> ParseRequestLine(
   std::string methodStr, url, versionStr;
   lineStream >> methodStr >> url >> versionStr;
 
-  if (methodStr == "GET") {
-    req->method = Method::GET;
-  } else if (methodStr == "POST") {
-    req->method = Method::POST;
-  } else {
-    throw Exception(StatusCode::InternalServerError, "Unsupported method");
+  if (methodStr == "PRI" && url == "*" && versionStr == "HTTP/2.0") {
+    req->version = Version::HTTP_2;
+    req->body_part = fmt::format("{}\r\n", requestLine) +
+                     std::string(std::istreambuf_iterator<char>(input), {});
+    co_return req;
   }
+  req->method = ParseMethod(methodStr);
 
-  const auto [path, params] = ParseUrl(url);
-  req->query_params = params;
-  req->path = path;
+  ParseTarget(url, *req);
 
   if (versionStr == "HTTP/1.0") {
     req->version = Version::HTTP_1_0;
@@ -121,6 +122,7 @@ coro::task<std::optional<RequestImpl::Ptr>> ParseRequestLine(
     }
   }
   req->body_part = std::string(std::istreambuf_iterator<char>(input), {});
+  if (trace) req->trace.parsed = RequestTrace::Clock::now();
 
   co_return req;
 }
@@ -132,22 +134,34 @@ Request::~Request() {}
 Method Request::GetMethod() const { return pimpl_->method; }
 Version Request::GetVersion() const { return pimpl_->version; }
 std::string_view Request::Path() const { return pimpl_->path; }
+std::string_view Request::Query() const { return pimpl_->query; }
 std::optional<std::string_view> Request::Header(std::string_view name) const {
-  auto it = pimpl_->headers.find(std::string(name));
-  if (it != pimpl_->headers.end()) {
-    return it->second;
-  }
+  if (auto value = internal::FindHeader(*pimpl_, name)) return *value;
   return std::nullopt;
 }
+const std::unordered_map<std::string, std::string> &Request::AllHeaders()
+    const {
+  return pimpl_->headers;
+}
+void Request::SetHeader(std::string name, std::string value) const {
+  pimpl_->headers[std::move(name)] = std::move(value);
+}
 
 std::optional<std::string_view> Request::QueryParam(
     std::string_view name) const {
-  auto it = pimpl_->query_params.find(std::string(name));
-  if (it != pimpl_->query_params.end()) {
-    return it->second;
+  for (auto &[key, value] : internal::QueryParameters(*pimpl_)) {
+    if (key == name) return value;
   }
   return std::nullopt;
 }
+std::vector<std::string_view> Request::QueryParams(
+    std::string_view name) const {
+  std::vector<std::string_view> values;
+  for (auto &[key, value] : internal::QueryParameters(*pimpl_)) {
+    if (key == name) values.push_back(value);
+  }
+  return values;
+}
 std::vector<std::string> &Request::Params() const {
   return pimpl_->path_params;
 }
@@ -179,4 +193,35 @@ coro::task<std::string> Request::Body() const {
       std::string(std::istreambuf_iterator<char>(input), {});
   ;
 }
+
+coro::async_generator<std::string_view> Request::BodyChunks(
+    size_t chunk_size) const {
+  auto cl = ContentLength();
+  if (!cl) {
+    throw Exception(StatusCode::BadRequest, "Missing Content-Length header");
+  }
+  auto buffered = std::string_view(pimpl_->body_part).substr(0, *cl);
+  size_t remaining = *cl - buffered.size();
+  if (!buffered.empty()) co_yield buffered;
+  std::string buffer(std::min(chunk_size, remaining), '\0');
+  while (remaining > 0) {
+    asio::error_code error;
+    size_t read = 0;
+    coro::single_consumer_event event;
+    pimpl_->socket->async_read_some(
+        asio::buffer(buffer.data(), std::min(buffer.size(), remaining)),
+        [&](auto ec, auto n) {
+          error = ec;
+          read = n;
+          event.set();
+        });
+    co_await event;
+    if (error) {
+      throw Exception(StatusCode::BadRequest, "Incomplete request body");
+    }
+    remaining -= read;
+    std::string_view chunk(buffer.data(), read);
+    co_yield chunk;
+  }
+}
 }  // namespace hs
@@ -2,14 +2,20 @@
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <mutex>
+
 #include "http-server/internal/route.h"
 
 namespace hs {
+size_t Route::MaxConcurrency() const { return 0; }
+bool Route::Unmetered() const { return false; }
 Route::~Route() { spdlog::debug("destroying route"); }
 void Handler::SetDone() { done = true; }
 bool Handler::IsDone() { return done; }
 Handler::~Handler() { spdlog::debug("destroying handler"); }
 ResponseBody::~ResponseBody() { spdlog::debug("destroying response body"); }
+RouteTable::~RouteTable() {}
 namespace internal {
 
 Node::Node(std::string_view path) : path_part(path) {}
@@ -61,7 +67,16 @@ void Node::Add(const Route::Ptr &route, std::string_view path) {
   std::string_view base, rest;
   if (pos == std::string_view::npos) {
     if (path.empty()) {
-      routes.push_back(route);
+      auto method = route->GetMethod();
+      auto it = std::find_if(routes.begin(), routes.end(),
+                             [method](const Route::Ptr &existing) {
+                               return existing->GetMethod() == method;
+                             });
+      if (it != routes.end()) {
+        *it = route;
+      } else {
+        routes.push_back(route);
+      }
       return;
     }
     base = path;
@@ -80,12 +95,72 @@ void Node::Add(const Route::Ptr &route, std::string_view path) {
   children.push_back(child);
 }
 
-Router::Router() noexcept : root_("") {}
+bool Node::Remove(const Method method, std::string_view path) {
+  if (path.starts_with("/")) {
+    path = path.substr(1);
+  }
+  if (path.ends_with("/")) {
+    path = path.substr(0, path.size() - 1);
+  }
+  if (path.empty()) {
+    return std::erase_if(routes, [method](const Route::Ptr &route) {
+             return route->GetMethod() == method;
+           }) > 0;
+  }
+  size_t pos = path.find("/");
+  auto base = path.substr(0, pos);
+  auto rest = pos == std::string_view::npos ? "" : path.substr(pos + 1);
+  for (auto it = children.begin(); it != children.end(); ++it) {
+    if (it->path_part != base) continue;
+    if (!it->Remove(method, rest)) return false;
+    if (it->routes.empty() && it->children.empty()) children.erase(it);
+    return true;
+  }
+  return false;
+}
+
+Router::Router() : root_(std::make_shared<const Node>("")) {}
 void Router::AddRoute(const Route::Ptr &route) {
-  root_.Add(route, route->GetPath());
+  std::lock_guard lock(update_mutex_);
+  auto root = std::make_shared<Node>(*root_.load());
+  root->Add(route, route->GetPath());
+  root_.store(std::move(root));
+}
+bool Router::RemoveRoute(Method method, std::string_view path) {
+  std::lock_guard lock(update_mutex_);
+  auto root = std::make_shared<Node>(*root_.load());
+  if (!root->Remove(method, path)) return false;
+  root_.store(std::move(root));
+  return true;
+}
+void Router::ReplaceRoutes(const std::vector<Route::Ptr> &routes) {
+  auto root = std::make_shared<Node>("");
+  for (auto &route : routes) root->Add(route, route->GetPath());
+  std::lock_guard lock(update_mutex_);
+  root_.store(std::move(root));
+}
+RouteMatch Router::Match(const RequestImpl::Ptr &request) const {
+  if (table_) {
+    std::vector<std::string> params;
+    if (auto route = table_->Match(request->method, request->path, params)) {
+      return std::make_pair(std::move(route), std::move(params));
+    }
+  }
+  return root_.load()->Match(request->method, request->path);
+}
+void Router::SetTable(RouteTable::Ptr table) { table_ = std::move(table); }
+void Router::Use(const Middleware::Ptr &middleware) {
+  auto middlewares = middlewares_
+                         ? std::make_shared<std::vector<Middleware::Ptr>>(
+                               *middlewares_)
+                         : std::make_shared<std::vector<Middleware::Ptr>>();
+  middlewares->push_back(middleware);
+  middlewares_ = std::move(middlewares);
 }
-RouteMatch Router::Match(const RequestImpl::Ptr &request) {
-  return root_.Match(request->method, request->path);
+bool Router::HasMiddleware() const { return middlewares_ != nullptr; }
+Handler::Ptr Router::GetHandler(const Route &route) const {
+  if (!middlewares_) return route.GetHandler();
+  return Chain(middlewares_, route.GetHandler());
 }
 }  // namespace internal
 }  // namespace hs
@@ -0,0 +1,168 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include "http-server/internal/socket-options.h"
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <spdlog/spdlog.h>
+#include <sys/socket.h>
+
+#include <asio/ip/address.hpp>
+#include <asio/socket_base.hpp>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace hs::internal {
+namespace {
+
+using asio::ip::tcp;
+using asio::local::stream_protocol;
+
+// An int valued option asio has no type for.
+template <int Level, int Name>
+class IntOption {
+ public:
+  explicit IntOption(int value) : value_(value) {}
+  template <typename Protocol>
+  int level(const Protocol &) const {
+    return Level;
+  }
+  template <typename Protocol>
+  int name(const Protocol &) const {
+    return Name;
+  }
+  template <typename Protocol>
+  const int *data(const Protocol &) const {
+    return &value_;
+  }
+  template <typename Protocol>
+  size_t size(const Protocol &) const {
+    return sizeof(value_);
+  }
+
+ private:
+  int value_;
+};
+
+template <typename Socket, typename Option>
+void Set(Socket &socket, const Option &option, std::string_view name) {
+  asio::error_code error;
+  socket.set_option(option, error);
+  if (error) spdlog::warn("Could not set {}: {}", name, error.message());
+}
+
+// Set on the listener too, since the receive buffer must be sized before
+// listen for TCP window scaling.
+template <typename Socket>
+void SetBufferSizes(Socket &socket, const SocketOptions &options) {
+  if (options.send_buffer_size > 0) {
+    Set(socket, asio::socket_base::send_buffer_size(options.send_buffer_size),
+        "SO_SNDBUF");
+  }
+  if (options.receive_buffer_size > 0) {
+    Set(socket,
+        asio::socket_base::receive_buffer_size(options.receive_buffer_size),
+        "SO_RCVBUF");
+  }
+}
+
+template <typename Socket>
+void SetBusyPoll(Socket &socket, const SocketOptions &options) {
+  if (options.busy_poll.count() <= 0) return;
+#ifdef SO_BUSY_POLL
+  Set(socket,
+      IntOption<SOL_SOCKET, SO_BUSY_POLL>(
+          static_cast<int>(options.busy_poll.count())),
+      "SO_BUSY_POLL");
+#else
+  spdlog::warn("SO_BUSY_POLL is not supported on this platform");
+#endif
+}
+
+tcp::endpoint Resolve(asio::io_context &io_context, const Config &config) {
+  auto &host = config.bind_address;
+  if (host.empty() || host == "*") {
+    return config.socket_options.dual_stack
+               ? tcp::endpoint(tcp::v6(), config.port)
+               : tcp::endpoint(tcp::v4(), config.port);
+  }
+  asio::error_code error;
+  auto address = asio::ip::make_address(host, error);
+  if (!error) return {address, config.port};
+  tcp::resolver resolver(io_context);
+  auto results = resolver.resolve(host, std::to_string(config.port),
+                                  tcp::resolver::passive);
+  return results.begin()->endpoint();
+}
+}  // namespace
+
+tcp::acceptor OpenTcpAcceptor(asio::io_context &io_context,
+                              const Config &config) {
+  auto &options = config.socket_options;
+  auto endpoint = Resolve(io_context, config);
+  tcp::acceptor acceptor(io_context, endpoint.protocol());
+  if (options.reuse_address) {
+    Set(acceptor, asio::socket_base::reuse_address(true), "SO_REUSEADDR");
+  }
+  if (endpoint.address().is_v6()) {
+    Set(acceptor, asio::ip::v6_only(!options.dual_stack), "IPV6_V6ONLY");
+  }
+  SetBufferSizes(acceptor, options);
+  SetBusyPoll(acceptor, options);
+  if (options.defer_accept.count() > 0) {
+#ifdef TCP_DEFER_ACCEPT
+    Set(acceptor,
+        IntOption<IPPROTO_TCP, TCP_DEFER_ACCEPT>(
+            static_cast<int>(options.defer_accept.count())),
+        "TCP_DEFER_ACCEPT");
+#else
+    spdlog::warn("TCP_DEFER_ACCEPT is not supported on this platform");
+#endif
+  }
+  if (options.fast_open_queue > 0) {
+#ifdef TCP_FASTOPEN
+    Set(acceptor,
+        IntOption<IPPROTO_TCP, TCP_FASTOPEN>(options.fast_open_queue),
+        "TCP_FASTOPEN");
+#else
+    spdlog::warn("TCP_FASTOPEN is not supported on this platform");
+#endif
+  }
+  acceptor.bind(endpoint);
+  acceptor.listen(options.backlog > 0
+                      ? options.backlog
+                      : asio::socket_base::max_listen_connections);
+  spdlog::info("listening on {}:{}", endpoint.address().to_string(),
+               acceptor.local_endpoint().port());
+  return acceptor;
+}
+
+stream_protocol::acceptor OpenUnixAcceptor(asio::io_context &io_context,
+                                           const Config &config) {
+  auto &options = config.socket_options;
+  // A socket file left by an earlier run would fail the bind.
+  std::error_code ignored;
+  std::filesystem::remove(config.unix_socket_path, ignored);
+  stream_protocol::acceptor acceptor(io_context, stream_protocol());
+  SetBufferSizes(acceptor, options);
+  acceptor.bind(stream_protocol::endpoint(config.unix_socket_path));
+  acceptor.listen(options.backlog > 0
+                      ? options.backlog
+                      : asio::socket_base::max_listen_connections);
+  spdlog::info("listening on {}", config.unix_socket_path);
+  return acceptor;
+}
+
+void ConfigureConnection(tcp::socket &socket, const SocketOptions &options) {
+  if (options.tcp_nodelay) {
+    Set(socket, tcp::no_delay(true), "TCP_NODELAY");
+  }
+  SetBufferSizes(socket, options);
+  SetBusyPoll(socket, options);
+}
+
+void ConfigureConnection(stream_protocol::socket &socket,
+                         const SocketOptions &options) {
+  SetBufferSizes(socket, options);
+}
+}  // namespace hs::internal
@@ -0,0 +1,33 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include "http-server/internal/spawn.h"
+
+#include <spdlog/spdlog.h>
+
+#include <coroutine>
+#include <exception>
+
+namespace hs::internal {
+namespace {
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept {
+      spdlog::error("Unhandled exception in detached task");
+    }
+  };
+};
+
+Detached RunDetached(coro::task<> task) {
+  try {
+    co_await std::move(task);
+  } catch (const std::exception &e) {
+    spdlog::error("Detached task failed: {}", e.what());
+  }
+}
+}  // namespace
+
+void Spawn(coro::task<> task) { RunDetached(std::move(task)); }
+}  // namespace hs::internal
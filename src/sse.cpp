@@ -0,0 +1,204 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include "http-server/sse.h"
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <asio/post.hpp>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "http-server/internal/sse.h"
+#include "http-server/internal/worker-pool.h"
+
+namespace hs {
+namespace internal {
+
+BroadcasterImpl::BroadcasterImpl(asio::io_context &io_context,
+                                 size_t queue_size, SlowConsumerPolicy policy)
+    : io_context_(io_context), queue_size_(queue_size), policy_(policy) {}
+
+void BroadcasterImpl::Post(ResponseBody::Ptr body) {
+  asio::post(io_context_,
+             [self = shared_from_this(), body = std::move(body)]() {
+               self->Fanout(body);
+             });
+}
+
+void BroadcasterImpl::PostClose() {
+  asio::post(io_context_, [self = shared_from_this()]() { self->CloseAll(); });
+}
+
+SseSubscriber::Ptr BroadcasterImpl::Subscribe() {
+  auto subscriber = std::make_shared<SseSubscriber>();
+  subscriber->executor = CurrentIoExecutor();
+  std::lock_guard lock(mutex_);
+  subscriber->closed = closed_;
+  subscribers_.insert(subscriber);
+  count_ = subscribers_.size();
+  return subscriber;
+}
+
+void BroadcasterImpl::Unsubscribe(const SseSubscriber::Ptr &subscriber) {
+  std::lock_guard lock(mutex_);
+  subscribers_.erase(subscriber);
+  count_ = subscribers_.size();
+}
+
+void BroadcasterImpl::Fanout(const ResponseBody::Ptr &body) {
+  Wakeups ready;
+  {
+    std::lock_guard lock(mutex_);
+    for (auto &subscriber : subscribers_) {
+      std::lock_guard subscriber_lock(subscriber->mutex);
+      if (subscriber->closed) continue;
+      if (subscriber->queue.size() >= queue_size_) {
+        if (policy_ == SlowConsumerPolicy::Disconnect) {
+          spdlog::debug("Disconnecting a slow event stream subscriber");
+          subscriber->closed = true;
+          subscriber->queue.clear();
+        } else {
+          subscriber->queue.pop_front();
+          ++subscriber->dropped;
+          subscriber->queue.push_back(body);
+        }
+      } else {
+        subscriber->queue.push_back(body);
+      }
+      if (subscriber->ready) {
+        ready.emplace_back(subscriber, std::move(subscriber->ready));
+      }
+    }
+  }
+  Wake(ready);
+}
+
+void BroadcasterImpl::CloseAll() {
+  Wakeups ready;
+  {
+    std::lock_guard lock(mutex_);
+    closed_ = true;
+    for (auto &subscriber : subscribers_) {
+      std::lock_guard subscriber_lock(subscriber->mutex);
+      subscriber->closed = true;
+      if (subscriber->ready) {
+        ready.emplace_back(subscriber, std::move(subscriber->ready));
+      }
+    }
+  }
+  Wake(ready);
+}
+
+size_t BroadcasterImpl::SubscriberCount() const { return count_; }
+
+void BroadcasterImpl::Wake(Wakeups &ready) {
+  // Subscribers resumed inline may unsubscribe, so this runs after the locks
+  // are released.
+  for (auto &[subscriber, event] : ready) {
+    if (subscriber->executor) {
+      asio::post(*subscriber->executor, [event]() { event->set(); });
+    } else {
+      event->set();
+    }
+  }
+}
+}  // namespace internal
+
+std::string FormatSseEvent(const SseEvent &event) {
+  std::string out;
+  if (!event.event.empty()) out += fmt::format("event: {}\n", event.event);
+  if (!event.id.empty()) out += fmt::format("id: {}\n", event.id);
+  if (event.retry) out += fmt::format("retry: {}\n", event.retry->count());
+  std::string_view data = event.data;
+  do {
+    auto newline = data.find('\n');
+    auto line = data.substr(0, newline);
+    if (line.ends_with('\r')) line.remove_suffix(1);
+    out += fmt::format("data: {}\n", line);
+    data = newline == std::string_view::npos ? std::string_view()
+                                             : data.substr(newline + 1);
+  } while (!data.empty());
+  out += "\n";
+  return out;
+}
+
+ResponseBody::Ptr SseBody(const SseEvent &event) {
+  return std::make_shared<WritableResponseBody<std::string>>(
+      FormatSseEvent(event));
+}
+
+Headers SseHeaders() {
+  return Headers{
+      {"Content-Type", "text/event-stream"},
+      {"Cache-Control", "no-cache"},
+      // The body has no length or chunked framing; over HTTP/1.x the
+      // client learns the stream ended when the connection closes.
+      {"Connection", "Close"},
+  };
+}
+
+Broadcaster::Broadcaster(asio::io_context &io_context, size_t queue_size,
+                         SlowConsumerPolicy policy)
+    : pimpl_(std::make_shared<internal::BroadcasterImpl>(io_context, queue_size,
+                                                         policy)) {}
+Broadcaster::~Broadcaster() {}
+
+void Broadcaster::Publish(const SseEvent &event) const {
+  pimpl_->Post(SseBody(event));
+}
+void Broadcaster::Close() const { pimpl_->PostClose(); }
+size_t Broadcaster::Subscribers() const { return pimpl_->SubscriberCount(); }
+
+namespace {
+struct SubscriptionGuard {
+  internal::BroadcasterImpl::Ptr broadcaster;
+  internal::SseSubscriber::Ptr subscriber;
+  ~SubscriptionGuard() { broadcaster->Unsubscribe(subscriber); }
+};
+}  // namespace
+
+SseHandler::SseHandler(Broadcaster::Ptr broadcaster)
+    : broadcaster_(std::move(broadcaster)) {}
+
+coro::async_generator<Response> SseHandler::Handle(const Request req) {
+  auto broadcaster = broadcaster_->pimpl_;
+  SubscriptionGuard guard{broadcaster, broadcaster->Subscribe()};
+  auto &subscriber = *guard.subscriber;
+  co_yield StatusCode::Ok;
+  auto headers = SseHeaders();
+  co_yield headers;
+  while (!IsDone()) {
+    ResponseBody::Ptr body;
+    std::shared_ptr<coro::single_consumer_event> ready;
+    {
+      std::lock_guard lock(subscriber.mutex);
+      if (!subscriber.queue.empty()) {
+        body = std::move(subscriber.queue.front());
+        subscriber.queue.pop_front();
+      } else if (subscriber.closed) {
+        break;
+      } else {
+        ready = std::make_shared<coro::single_consumer_event>();
+        subscriber.ready = ready;
+      }
+    }
+    if (ready) {
+      co_await *ready;
+      continue;
+    }
+    co_yield body;
+  }
+  size_t dropped;
+  {
+    std::lock_guard lock(subscriber.mutex);
+    dropped = subscriber.dropped;
+  }
+  if (dropped > 0) {
+    spdlog::info("Event stream subscriber missed {} events", dropped);
+  }
+}
+}  // namespace hs
@@ -0,0 +1,427 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include "http-server/internal/static-index.h"
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "http-server/internal/url.h"
+
+namespace hs::internal {
+namespace {
+#ifdef __linux__
+constexpr uint32_t kWatchMask = IN_CREATE | IN_DELETE | IN_MODIFY |
+                                IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM |
+                                IN_MOVED_TO | IN_ONLYDIR;
+#endif
+
+std::string Join(std::string_view directory, std::string_view name) {
+  if (directory.empty()) return std::string(name);
+  return fmt::format("{}/{}", directory, name);
+}
+
+std::string_view Parent(std::string_view path) {
+  auto slash = path.rfind('/');
+  return slash == std::string_view::npos ? std::string_view()
+                                         : path.substr(0, slash);
+}
+
+std::string_view Name(std::string_view path) {
+  return path.substr(path.rfind('/') + 1);
+}
+
+// Whether path is under directory, or directory itself.
+bool Within(std::string_view path, std::string_view directory) {
+  if (directory.empty()) return true;
+  return path.starts_with(directory) &&
+         (path.size() == directory.size() || path[directory.size()] == '/');
+}
+
+std::string EscapeHtml(std::string_view text) {
+  std::string escaped;
+  for (char c : text) {
+    switch (c) {
+      case '&':
+        escaped += "&amp;";
+        break;
+      case '<':
+        escaped += "&lt;";
+        break;
+      case '>':
+        escaped += "&gt;";
+        break;
+      case '"':
+        escaped += "&quot;";
+        break;
+      case '\'':
+        escaped += "&#39;";
+        break;
+      default:
+        escaped += c;
+    }
+  }
+  return escaped;
+}
+
+std::string EscapeJson(std::string_view text) {
+  std::string escaped;
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      escaped += fmt::format("\\u{:04x}", static_cast<int>(c));
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+}  // namespace
+
+std::string_view ContentType(std::string_view filename) {
+  static const std::unordered_map<std::string, std::string_view> kTypes{
+      {"html", "text/html"},
+      {"htm", "text/html"},
+      {"css", "text/css"},
+      {"js", "application/javascript"},
+      {"mjs", "application/javascript"},
+      {"json", "application/json"},
+      {"map", "application/json"},
+      {"xml", "application/xml"},
+      {"txt", "text/plain"},
+      {"csv", "text/csv"},
+      {"md", "text/markdown"},
+      {"png", "image/png"},
+      {"jpg", "image/jpeg"},
+      {"jpeg", "image/jpeg"},
+      {"gif", "image/gif"},
+      {"svg", "image/svg+xml"},
+      {"ico", "image/x-icon"},
+      {"webp", "image/webp"},
+      {"avif", "image/avif"},
+      {"woff", "font/woff"},
+      {"woff2", "font/woff2"},
+      {"ttf", "font/ttf"},
+      {"otf", "font/otf"},
+      {"wasm", "application/wasm"},
+      {"pdf", "application/pdf"},
+      {"zip", "application/zip"},
+      {"gz", "application/gzip"},
+      {"mp3", "audio/mpeg"},
+      {"ogg", "audio/ogg"},
+      {"wav", "audio/wav"},
+      {"mp4", "video/mp4"},
+      {"webm", "video/webm"},
+  };
+  auto name = Name(filename);
+  auto dot = name.rfind('.');
+  if (dot == std::string_view::npos) return "text/plain";
+  std::string extension(name.substr(dot + 1));
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  auto it = kTypes.find(extension);
+  return it == kTypes.end() ? "text/plain" : it->second;
+}
+
+std::string RenderListing(
+    std::vector<std::pair<std::string, StaticFile>> entries, bool json) {
+  std::sort(entries.begin(), entries.end(),
+            [](auto &a, auto &b) { return a.first < b.first; });
+  std::string out;
+  if (json) {
+    out += '[';
+    for (auto &[name, file] : entries) {
+      if (out.size() > 1) out += ',';
+      out += fmt::format(R"({{"name":"{}","type":"{}","size":{}}})",
+                         EscapeJson(name),
+                         file.directory ? "directory" : "file", file.size);
+    }
+    out += ']';
+    return out;
+  }
+  out +=
+      "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"></head><body>\n"
+      "<ul>\n";
+  for (auto &[name, file] : entries) {
+    // "./" keeps a name with a colon from reading as a URL scheme.
+    auto suffix = file.directory ? "/" : "";
+    out += fmt::format("<li><a href=\"./{}{}\">{}{}</a></li>\n",
+                       EscapeHtml(EncodePath(name)), suffix, EscapeHtml(name),
+                       suffix);
+  }
+  out += "</ul>\n</body></html>\n";
+  return out;
+}
+
+StaticIndex::StaticIndex(std::filesystem::path root) : root_(std::move(root)) {
+  std::error_code error;
+  if (!std::filesystem::is_directory(root_, error)) {
+    throw std::runtime_error(
+        fmt::format("{} is not a directory", root_.string()));
+  }
+#ifdef __linux__
+  inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  stop_ = eventfd(0, EFD_CLOEXEC);
+  if (inotify_ < 0 || stop_ < 0) {
+    spdlog::warn("Not watching {} for changes: {}", root_.string(),
+                 std::strerror(errno));
+    if (inotify_ >= 0) close(inotify_);
+    if (stop_ >= 0) close(stop_);
+    inotify_ = stop_ = -1;
+  }
+#endif
+  Scanned scanned;
+  Scan("", scanned);
+  Insert(std::move(scanned));
+  spdlog::debug("Indexed {} entries under {}", files_.size(), root_.string());
+  if (inotify_ >= 0) watcher_ = std::thread([this]() { Run(); });
+}
+
+StaticIndex::~StaticIndex() {
+#ifdef __linux__
+  if (watcher_.joinable()) {
+    uint64_t one = 1;
+    if (write(stop_, &one, sizeof(one)) < 0) {
+      spdlog::error("Could not stop the watcher: {}", std::strerror(errno));
+    }
+    watcher_.join();
+  }
+  if (inotify_ >= 0) close(inotify_);
+  if (stop_ >= 0) close(stop_);
+#endif
+}
+
+std::optional<StaticFile> StaticIndex::Find(std::string_view path) const {
+  std::shared_lock lock(mutex_);
+  auto it = files_.find(path);
+  if (it == files_.end()) return std::nullopt;
+  return it->second;
+}
+
+std::shared_ptr<const std::string> StaticIndex::Listing(std::string_view path,
+                                                        bool json) {
+  {
+    std::shared_lock lock(mutex_);
+    auto it = listings_.find(path);
+    if (it != listings_.end()) {
+      auto &listing = json ? it->second.json : it->second.html;
+      if (listing) return listing;
+    }
+  }
+  std::unique_lock lock(mutex_);
+  auto directory = files_.find(path);
+  if (directory == files_.end() || !directory->second.directory) {
+    return nullptr;
+  }
+  Scanned entries;
+  auto children = children_.find(path);
+  if (children != children_.end()) {
+    for (auto &name : children->second) {
+      auto child = files_.find(Join(path, name));
+      if (child != files_.end()) entries.emplace_back(name, child->second);
+    }
+  }
+  auto listing = std::make_shared<const std::string>(
+      RenderListing(std::move(entries), json));
+  auto &cached = listings_[std::string(path)];
+  (json ? cached.json : cached.html) = listing;
+  return listing;
+}
+
+size_t StaticIndex::Size() const {
+  std::shared_lock lock(mutex_);
+  return files_.size();
+}
+
+void StaticIndex::Scan(const std::string &path, Scanned &scanned) {
+  Watch(path);
+  scanned.emplace_back(path, StaticFile{.directory = true});
+  std::error_code error;
+  std::filesystem::directory_iterator it(path.empty() ? root_ : root_ / path,
+                                         error);
+  for (; !error && it != std::filesystem::directory_iterator();
+       it.increment(error)) {
+    auto name = it->path().filename().string();
+    auto child = Join(path, name);
+    std::error_code status_error;
+    if (it->is_directory(status_error)) {
+      // Following links to directories could loop.
+      if (!it->is_symlink(status_error)) Scan(child, scanned);
+    } else if (it->is_regular_file(status_error)) {
+      auto size = it->file_size(status_error);
+      if (status_error) continue;
+      scanned.emplace_back(
+          child, StaticFile{.size = size, .content_type = ContentType(name)});
+    }
+  }
+  if (error) {
+    spdlog::warn("Could not read {}: {}", (root_ / path).string(),
+                 error.message());
+  }
+}
+
+void StaticIndex::Watch(const std::string &path) {
+#ifdef __linux__
+  if (inotify_ < 0) return;
+  auto directory = path.empty() ? root_ : root_ / path;
+  int watch = inotify_add_watch(inotify_, directory.c_str(), kWatchMask);
+  if (watch < 0) {
+    spdlog::warn("Could not watch {}: {}", directory.string(),
+                 std::strerror(errno));
+    return;
+  }
+  watches_[watch] = path;
+#endif
+}
+
+void StaticIndex::Insert(Scanned scanned) {
+  for (auto &[path, file] : scanned) {
+    if (file.directory) {
+      children_.try_emplace(path);
+      listings_.erase(path);
+    }
+    if (!path.empty()) {
+      auto parent = Parent(path);
+      auto children = children_.find(parent);
+      if (children == children_.end()) {
+        children = children_.try_emplace(std::string(parent)).first;
+      }
+      children->second.emplace(Name(path));
+      auto listing = listings_.find(parent);
+      if (listing != listings_.end()) listings_.erase(listing);
+    }
+    files_[std::move(path)] = file;
+  }
+}
+
+void StaticIndex::Remove(const std::string &path) {
+  auto it = files_.find(path);
+  if (it == files_.end()) return;
+  if (it->second.directory) {
+    std::erase_if(files_,
+                  [&](auto &entry) { return Within(entry.first, path); });
+    std::erase_if(children_,
+                  [&](auto &entry) { return Within(entry.first, path); });
+    std::erase_if(listings_,
+                  [&](auto &entry) { return Within(entry.first, path); });
+#ifdef __linux__
+    std::erase_if(watches_, [&](auto &watch) {
+      if (!Within(watch.second, path)) return false;
+      inotify_rm_watch(inotify_, watch.first);
+      return true;
+    });
+#endif
+  } else {
+    files_.erase(it);
+  }
+  if (path.empty()) return;
+  auto parent = Parent(path);
+  auto children = children_.find(parent);
+  if (children != children_.end()) {
+    children->second.erase(std::string(Name(path)));
+  }
+  auto listing = listings_.find(parent);
+  if (listing != listings_.end()) listings_.erase(listing);
+}
+
+void StaticIndex::Refresh(const std::string &path) {
+  // Read outside the lock; lookups go on meanwhile.
+  Scanned scanned;
+  std::error_code error;
+  auto full = root_ / path;
+  auto status = std::filesystem::status(full, error);
+  if (std::filesystem::is_directory(status)) {
+    auto link = std::filesystem::symlink_status(full, error);
+    if (!std::filesystem::is_symlink(link)) Scan(path, scanned);
+  } else if (std::filesystem::is_regular_file(status)) {
+    auto size = std::filesystem::file_size(full, error);
+    if (!error) {
+      scanned.emplace_back(
+          path, StaticFile{.size = size, .content_type = ContentType(path)});
+    }
+  }
+  std::unique_lock lock(mutex_);
+  auto it = files_.find(path);
+  // A directory already indexed only needs its own events.
+  if (it != files_.end() && it->second.directory && !scanned.empty() &&
+      scanned.front().second.directory) {
+    Insert(std::move(scanned));
+    return;
+  }
+  Remove(path);
+  Insert(std::move(scanned));
+}
+
+void StaticIndex::Rescan() {
+  spdlog::warn("Lost changes under {}, reading it again", root_.string());
+  Scanned scanned;
+  Scan("", scanned);
+  std::unique_lock lock(mutex_);
+  files_.clear();
+  children_.clear();
+  listings_.clear();
+  Insert(std::move(scanned));
+}
+
+void StaticIndex::Run() {
+#ifdef __linux__
+  pollfd fds[2] = {{.fd = inotify_, .events = POLLIN},
+                   {.fd = stop_, .events = POLLIN}};
+  alignas(inotify_event) char buffer[64 * 1024];
+  for (;;) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) continue;
+      spdlog::error("Stopped watching {}: {}", root_.string(),
+                    std::strerror(errno));
+      return;
+    }
+    if (fds[1].revents) return;
+    ssize_t size;
+    while ((size = read(inotify_, buffer, sizeof(buffer))) > 0) {
+      if (!Apply(buffer, size)) Rescan();
+    }
+  }
+#endif
+}
+
+bool StaticIndex::Apply(const char *buffer, size_t size) {
+#ifdef __linux__
+  for (size_t offset = 0; offset < size;) {
+    auto event = reinterpret_cast<const inotify_event *>(buffer + offset);
+    offset += sizeof(inotify_event) + event->len;
+    if (event->mask & IN_Q_OVERFLOW) return false;
+    auto watch = watches_.find(event->wd);
+    if (watch == watches_.end()) continue;
+    if (event->mask & IN_IGNORED) {
+      watches_.erase(watch);
+      continue;
+    }
+    // Events on the watched directory itself come without a name.
+    if (event->len == 0) continue;
+    auto path = Join(watch->second, event->name);
+    if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+      std::unique_lock lock(mutex_);
+      Remove(path);
+    } else if (!(event->mask & IN_ISDIR) ||
+               (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+      Refresh(path);
+    }
+  }
+#endif
+  return true;
+}
+}  // namespace hs::internal
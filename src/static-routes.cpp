@@ -4,72 +4,189 @@
 
 #include <filesystem>
 #include <fstream>
+#include <memory>
+#include <optional>
 #include <sstream>
+#include <string>
 #include <string_view>
 #include <system_error>
-#include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "coro/async_generator.hpp"
 #include "http-server/enum.h"
 #include "http-server/http-server.h"
+#include "http-server/internal/static-index.h"
+#include "http-server/internal/url.h"
+#include "http-server/offload.h"
 #include "http-server/route.h"
 namespace hs {
 
-std::string_view GetContentType(std::string_view filename) {
-  if (filename.ends_with(".html")) return "text/html";
-  if (filename.ends_with(".css")) return "text/css";
-  if (filename.ends_with(".js")) return "application/javascript";
-  if (filename.ends_with(".png")) return "image/png";
-  return "text/plain";
+namespace {
+// Lookup for routes without an index.
+std::optional<internal::StaticFile> Stat(const std::string& filename) {
+  std::error_code error;
+  auto status = std::filesystem::status(filename, error);
+  if (status.type() == std::filesystem::file_type::directory) {
+    return internal::StaticFile{.directory = true};
+  }
+  if (status.type() == std::filesystem::file_type::regular) {
+    return internal::StaticFile{.content_type =
+                                    internal::ContentType(filename)};
+  }
+  return std::nullopt;
+}
+
+std::string ListDirectory(const std::string& directory, bool json) {
+  std::vector<std::pair<std::string, internal::StaticFile>> entries;
+  std::error_code error;
+  std::filesystem::directory_iterator it(directory, error);
+  for (; !error && it != std::filesystem::directory_iterator();
+       it.increment(error)) {
+    std::error_code status_error;
+    auto name = it->path().filename().string();
+    if (it->is_directory(status_error)) {
+      entries.emplace_back(name, internal::StaticFile{.directory = true});
+    } else if (it->is_regular_file(status_error)) {
+      entries.emplace_back(
+          name, internal::StaticFile{.size = it->file_size(status_error)});
+    }
+  }
+  if (error) throw Exception(StatusCode::NotFound, "directory not found");
+  return internal::RenderListing(std::move(entries), json);
 }
 
+// Holds a listing shared with the index's cache.
+struct SharedText {
+  std::shared_ptr<const std::string> text;
+  const char* data() const { return text->data(); }
+  size_t size() const { return text->size(); }
+};
+}  // namespace
+
 class StaticRouteHandler : public Handler {
  public:
-  StaticRouteHandler(const std::string& dir) : dir_(dir) {}
+  StaticRouteHandler(const std::string& dir, const StaticOptions& options,
+                     std::shared_ptr<internal::StaticIndex> index)
+      : dir_(dir), options_(options), index_(std::move(index)) {}
+  // The path below dir_ that params name, empty for dir_ itself.
   std::string CheckFile(const std::vector<std::string>& params) {
-    if (params.empty()) {
-      throw Exception(StatusCode::BadRequest, "no resource requested");
+    // Request paths arrive normalized, but params may also come from a
+    // rewritten request; refuse anything that could leave dir_.
+    std::string relative;
+    static constexpr std::string_view kSeparators("/\\\0", 3);
+    for (auto& p : params) {
+      if (p.empty() || p == "." || p == ".." ||
+          p.find_first_of(kSeparators) != std::string::npos) {
+        throw Exception(StatusCode::NotFound, "resource not found");
+      }
+      if (!relative.empty()) relative += '/';
+      relative += p;
     }
-    std::stringstream ss;
-    ss << dir_;
-    for (auto& p : params) ss << "/" << p;
-    auto filename = ss.str();
-    auto status = std::filesystem::status(filename);
-    if (status.type() != std::filesystem::file_type::regular) {
-      throw Exception(StatusCode::NotFound,
-                      fmt::format("{} not found", filename));
-    }
-    return filename;
+    return relative;
+  }
+  std::optional<internal::StaticFile> Find(const std::string& relative) {
+    if (index_) return index_->Find(relative);
+    return Stat(FullPath(relative));
+  }
+  std::string FullPath(const std::string& relative) {
+    return relative.empty() ? dir_ : dir_ + "/" + relative;
   }
   coro::async_generator<Response> Handle(const Request req) override {
-    auto filename = CheckFile(req.Params());
-    auto size = std::filesystem::file_size(filename);
+    auto relative = CheckFile(req.Params());
+    auto file = Find(relative);
+    if (!file) {
+      throw Exception(StatusCode::NotFound,
+                      fmt::format("{} not found", FullPath(relative)));
+    }
+    if (file->directory) {
+      auto path = req.Path();
+      if (!path.ends_with('/')) {
+        // Relative links in the directory's page resolve inside it.
+        co_yield StatusCode::MovedPermanently;
+        hs::Headers headers{
+            {"Location", internal::EncodePath(path) + "/"},
+            {"Content-Length", "0"},
+        };
+        co_yield headers;
+        co_return;
+      }
+      for (auto& name : options_.index_files) {
+        auto candidate = relative.empty() ? name : relative + "/" + name;
+        auto index_file = Find(candidate);
+        if (index_file && !index_file->directory) {
+          relative = std::move(candidate);
+          file = index_file;
+          break;
+        }
+      }
+    }
+    if (file->directory) {
+      if (!options_.list_directories) {
+        throw Exception(StatusCode::NotFound, "directory listing is off");
+      }
+      auto accept = req.Header("Accept");
+      bool json =
+          accept && accept->find("application/json") != std::string_view::npos;
+      std::shared_ptr<const std::string> listing;
+      if (index_) {
+        listing = index_->Listing(relative, json);
+        if (!listing) throw Exception(StatusCode::NotFound, "not a directory");
+      } else {
+        auto directory = FullPath(relative);
+        listing = std::make_shared<const std::string>(co_await offload(
+            [&directory, json]() { return ListDirectory(directory, json); }));
+      }
+      co_yield StatusCode::Ok;
+      hs::Headers headers{
+          {"Content-Type", json ? "application/json" : "text/html"},
+          {"Content-Length", fmt::format("{}", listing->size())},
+      };
+      co_yield headers;
+      co_yield std::make_shared<WritableResponseBody<SharedText>>(
+          SharedText{std::move(listing)});
+      co_return;
+    }
+    auto filename = FullPath(relative);
+    // File reads block, keep them off the io thread.
+    std::string ret = co_await offload([&filename]() {
+      std::ifstream ifs(filename, std::ios::binary);
+      if (!ifs) {
+        throw Exception(StatusCode::NotFound,
+                        fmt::format("{} not found", filename));
+      }
+      std::stringstream ss;
+      ss << ifs.rdbuf();
+      return ss.str();
+    });
     co_yield StatusCode::Ok;
     hs::Headers headers{
-        {"Content-Type", std::string(GetContentType(filename))},
-        {"Content-Length", fmt::format("{}", size)},
+        {"Content-Type", std::string(file->content_type)},
+        {"Content-Length", fmt::format("{}", ret.size())},
     };
     co_yield headers;
-    std::ifstream ifs(filename);
-    std::stringstream ss;
-    ss<<ifs.rdbuf();
-    std::string ret = ss.str();
     co_yield std::make_shared<WritableResponseBody<std::string>>(
         std::move(ret));
   }
 
  private:
   std::string dir_;
+  StaticOptions options_;
+  std::shared_ptr<internal::StaticIndex> index_;
 };
 
-StaticRoute::StaticRoute(const std::string& path, const std::string& dir)
-    : path_(path), dir_(dir) {}
+StaticRoute::StaticRoute(const std::string& path, const std::string& dir,
+                         StaticOptions options)
+    : path_(path),
+      dir_(dir),
+      options_(std::move(options)),
+      index_(options_.index ? std::make_shared<internal::StaticIndex>(dir_)
+                            : nullptr) {}
 
 Method StaticRoute::GetMethod() const { return Method::GET; }
 std::string StaticRoute::GetPath() const { return path_; }
 Handler::Ptr StaticRoute::GetHandler() const {
-  return std::make_shared<StaticRouteHandler>(dir_);
+  return std::make_shared<StaticRouteHandler>(dir_, options_, index_);
 }
 
 }  // namespace hs
@@ -0,0 +1,212 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include "http-server/internal/stream.h"
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <cerrno>
+#include <stdexcept>
+
+#include "http-server/http-server.h"
+
+namespace hs::internal {
+#ifdef HS_TLS
+namespace {
+
+// Server preference order, in ALPN wire format.
+constexpr unsigned char kAlpn[] = "\x02h2\x08http/1.1";
+constexpr unsigned int kAlpnHttp11Offset = 3;
+constexpr unsigned char kSessionContext[] = "http-server";
+
+int SelectAlpn(SSL *, const unsigned char **out, unsigned char *out_length,
+               const unsigned char *in, unsigned int in_length, void *arg) {
+  bool http2 = *static_cast<const bool *>(arg);
+  const unsigned char *server = http2 ? kAlpn : kAlpn + kAlpnHttp11Offset;
+  unsigned int server_length = sizeof(kAlpn) - 1 - (server - kAlpn);
+  unsigned char *selected;
+  if (SSL_select_next_proto(&selected, out_length, server, server_length, in,
+                            in_length) != OPENSSL_NPN_NEGOTIATED) {
+    return SSL_TLSEXT_ERR_NOACK;
+  }
+  *out = selected;
+  return SSL_TLSEXT_ERR_OK;
+}
+
+std::string LastError() {
+  char reason[256];
+  ERR_error_string_n(ERR_get_error(), reason, sizeof(reason));
+  return reason;
+}
+}  // namespace
+
+TlsContext::TlsContext(const Config &config)
+    : ctx_(SSL_CTX_new(TLS_server_method())), http2_(config.http2) {
+  if (!ctx_) {
+    throw std::runtime_error(
+        fmt::format("Failed to create TLS context: {}", LastError()));
+  }
+  SSL_CTX_set_min_proto_version(ctx_, TLS1_2_VERSION);
+  // Treat a peer closing without close_notify as a plain end of stream.
+  uint64_t options = SSL_OP_IGNORE_UNEXPECTED_EOF | SSL_OP_NO_RENEGOTIATION;
+  if (!config.tls_session_tickets) options |= SSL_OP_NO_TICKET;
+#ifdef SSL_OP_ENABLE_KTLS
+  if (config.tls_ktls) options |= SSL_OP_ENABLE_KTLS;
+#endif
+  SSL_CTX_set_options(ctx_, options);
+
+  if (SSL_CTX_use_certificate_chain_file(
+          ctx_, config.tls_certificate_chain.c_str()) != 1 ||
+      SSL_CTX_use_PrivateKey_file(ctx_, config.tls_private_key.c_str(),
+                                  SSL_FILETYPE_PEM) != 1 ||
+      SSL_CTX_check_private_key(ctx_) != 1) {
+    auto error = LastError();
+    SSL_CTX_free(ctx_);
+    throw std::runtime_error(
+        fmt::format("Failed to load TLS certificate: {}", error));
+  }
+
+  // Resumption: stateless tickets, plus a server side cache for clients
+  // that resume by session id.
+  SSL_CTX_set_session_id_context(ctx_, kSessionContext,
+                                 sizeof(kSessionContext) - 1);
+  if (config.tls_session_cache_size > 0) {
+    SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx_, config.tls_session_cache_size);
+  } else {
+    SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_OFF);
+  }
+  SSL_CTX_set_timeout(ctx_, config.tls_session_timeout.count());
+  SSL_CTX_set_alpn_select_cb(ctx_, SelectAlpn, &http2_);
+}
+
+TlsContext::~TlsContext() { SSL_CTX_free(ctx_); }
+
+SSL_CTX *TlsContext::Get() const { return ctx_; }
+
+bool Stream::Failed(int result, asio::error_code &error, bool &want_write) {
+  switch (SSL_get_error(ssl_, result)) {
+    case SSL_ERROR_WANT_READ:
+      return false;
+    case SSL_ERROR_WANT_WRITE:
+      want_write = true;
+      return false;
+    case SSL_ERROR_ZERO_RETURN:
+      error = asio::error::eof;
+      break;
+    case SSL_ERROR_SYSCALL:
+      error = errno ? asio::error_code(errno,
+                                       asio::error::get_system_category())
+                    : asio::error::eof;
+      break;
+    default:
+      error = asio::error_code(static_cast<int>(ERR_get_error()),
+                               asio::error::get_ssl_category());
+  }
+  return true;
+}
+
+void Stream::Handshake(std::function<void(asio::error_code)> handler) {
+  ERR_clear_error();
+  int result = SSL_do_handshake(ssl_);
+  asio::error_code error;
+  bool want_write = false;
+  if (result != 1 && !Failed(result, error, want_write)) {
+    socket_.async_wait(
+        want_write ? asio::socket_base::wait_write
+                   : asio::socket_base::wait_read,
+        [this, handler = std::move(handler)](asio::error_code error) mutable {
+          if (error) return handler(error);
+          Handshake(std::move(handler));
+        });
+    return;
+  }
+  if (!error) {
+    spdlog::debug("TLS handshake done; resumed:{} alpn:{} ktls:{}",
+                  SSL_session_reused(ssl_) == 1, Alpn(), KernelTls());
+  }
+  asio::post(get_executor(), [handler = std::move(handler), error]() {
+    handler(error);
+  });
+}
+#endif
+
+Stream::Stream(socket_type socket) : socket_(std::move(socket)) {}
+
+Stream::~Stream() {
+#ifdef HS_TLS
+  if (!ssl_) return;
+  // OpenSSL drops the session of a connection that ends without
+  // close_notify from its cache, so send one if nobody did.
+  if (!(SSL_get_shutdown(ssl_) & SSL_SENT_SHUTDOWN) &&
+      SSL_is_init_finished(ssl_)) {
+    ERR_clear_error();
+    SSL_shutdown(ssl_);
+  }
+  SSL_free(ssl_);
+#endif
+}
+
+bool Stream::IsTls() const {
+#ifdef HS_TLS
+  return ssl_ != nullptr;
+#else
+  return false;
+#endif
+}
+
+void Stream::AsyncHandshake(const std::shared_ptr<TlsContext> &context,
+                            std::function<void(asio::error_code)> handler) {
+#ifdef HS_TLS
+  asio::error_code error;
+  socket_.non_blocking(true, error);
+  if (!error) {
+    ssl_ = SSL_new(context->Get());
+    if (!ssl_ || SSL_set_fd(ssl_, socket_.native_handle()) != 1) {
+      error = asio::error::no_memory;
+    }
+  }
+  if (!error) {
+    SSL_set_accept_state(ssl_);
+    return Handshake(std::move(handler));
+  }
+#else
+  auto error = asio::error::operation_not_supported;
+#endif
+  asio::post(get_executor(), [handler = std::move(handler), error]() {
+    handler(error);
+  });
+}
+
+std::string_view Stream::Alpn() const {
+#ifdef HS_TLS
+  const unsigned char *data = nullptr;
+  unsigned int length = 0;
+  if (ssl_) SSL_get0_alpn_selected(ssl_, &data, &length);
+  if (data) return {reinterpret_cast<const char *>(data), length};
+#endif
+  return {};
+}
+
+bool Stream::KernelTls() const {
+#if defined(HS_TLS) && defined(BIO_get_ktls_send)
+  return ssl_ && BIO_get_ktls_send(SSL_get_wbio(ssl_));
+#else
+  return false;
+#endif
+}
+
+void Stream::shutdown(asio::socket_base::shutdown_type what,
+                      asio::error_code &error) {
+#ifdef HS_TLS
+  if (ssl_) {
+    ERR_clear_error();
+    SSL_shutdown(ssl_);
+  }
+#endif
+  socket_.shutdown(what, error);
+}
+
+void Stream::close() { socket_.close(); }
+
+void Stream::close(asio::error_code &error) { socket_.close(error); }
+}  // namespace hs::internal
@@ -0,0 +1,68 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include "http-server/sync-route.h"
+
+#include <fmt/format.h>
+
+#include <coro/async_generator.hpp>
+#include <memory>
+
+#include "http-server/internal/sync-route.h"
+
+namespace hs {
+namespace internal {
+namespace {
+
+class SyncHandler : public Handler {
+ public:
+  SyncHandler(const SyncRoute *route) : route_(route) {}
+
+  coro::async_generator<Response> Handle(const Request req) override {
+    auto response = route_->Respond(req);
+    co_yield response.status;
+    Headers headers;
+    for (auto &[name, value] : response.headers) {
+      headers[std::string(name)] = std::move(value);
+    }
+    headers["Content-Length"] = fmt::format("{}", response.body.View().size());
+    co_yield headers;
+    co_yield std::move(response.body).Release();
+  }
+
+ private:
+  const SyncRoute *route_;
+};
+}  // namespace
+
+std::string SerializeHead(Version version, const SimpleResponse &response,
+                          bool keep_alive) {
+  auto head = fmt::format("{} {:d} {:s}\r\n", version, response.status,
+                          response.status);
+  for (auto &[name, value] : response.headers) {
+    head += name;
+    head += ": ";
+    head += value;
+    head += "\r\n";
+  }
+  head += fmt::format("Content-Length: {}\r\nConnection: {}\r\n\r\n",
+                      response.body.View().size(),
+                      keep_alive ? "Keep-Alive" : "Close");
+  return head;
+}
+}  // namespace internal
+
+std::string_view SimpleBody::View() const {
+  return std::visit([](auto &data) { return std::string_view(data); }, data_);
+}
+
+ResponseBody::Ptr SimpleBody::Release() && {
+  if (auto view = std::get_if<std::string_view>(&data_)) {
+    return std::make_shared<WritableResponseBody<std::string_view>>(*view);
+  }
+  return std::make_shared<WritableResponseBody<std::string>>(
+      std::move(std::get<std::string>(data_)));
+}
+
+Handler::Ptr SyncRoute::GetHandler() const {
+  return std::make_shared<internal::SyncHandler>(this);
+}
+}  // namespace hs
@@ -0,0 +1,266 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include "http-server/trace.h"
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <stdexcept>
+
+#include "http-server/http-server.h"
+#include "http-server/internal/request-impl.h"
+#include "http-server/internal/trace.h"
+#include "http-server/route.h"
+
+namespace hs {
+namespace internal {
+namespace {
+bool IsLowerHex(std::string_view s) {
+  return std::all_of(s.begin(), s.end(), [](char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+  });
+}
+
+bool IsZero(std::string_view s) {
+  return s.find_first_not_of('0') == std::string_view::npos;
+}
+
+std::string RandomId(size_t words) {
+  thread_local std::mt19937_64 random(std::random_device{}());
+  std::string id;
+  for (size_t i = 0; i < words; ++i) {
+    uint64_t word;
+    // All zero ids are invalid.
+    while ((word = random()) == 0) {
+    }
+    id += fmt::format("{:016x}", word);
+  }
+  return id;
+}
+
+std::string JsonEscape(std::string_view s) {
+  std::string escaped;
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      escaped += fmt::format("\\u{:04x}", static_cast<int>(c));
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+int64_t Micros(std::chrono::nanoseconds duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+      .count();
+}
+}  // namespace
+
+std::optional<TraceParent> ParseTraceParent(std::string_view header) {
+  // version "-" trace-id "-" parent-id "-" flags, version 00 being exactly
+  // that long and later versions possibly longer.
+  if (header.size() < 55 || header[2] != '-' || header[35] != '-' ||
+      header[52] != '-' || (header.size() > 55 && header[55] != '-')) {
+    return std::nullopt;
+  }
+  auto version = header.substr(0, 2);
+  auto trace_id = header.substr(3, 32);
+  auto parent_id = header.substr(36, 16);
+  auto flags = header.substr(53, 2);
+  if (!IsLowerHex(version) || version == "ff" ||
+      (version == "00" && header.size() != 55) || !IsLowerHex(trace_id) ||
+      IsZero(trace_id) || !IsLowerHex(parent_id) || IsZero(parent_id) ||
+      !IsLowerHex(flags)) {
+    return std::nullopt;
+  }
+  return TraceParent{std::string(trace_id), std::string(parent_id),
+                     static_cast<uint8_t>(std::stoi(std::string(flags),
+                                                    nullptr, 16))};
+}
+
+Tracer::Tracer(const Config &config)
+    : slow_threshold_(config.trace_slow_threshold) {}
+
+void Tracer::SetExporter(TraceExporter::Ptr exporter) {
+  std::lock_guard lock(mutex_);
+  exporter_ = std::move(exporter);
+}
+
+void Tracer::Start(RequestImpl &request,
+                   std::optional<RequestTrace::Clock::time_point> accepted,
+                   std::optional<RequestTrace::Clock::time_point> ready) {
+  auto &trace = request.trace;
+  trace.enabled = true;
+  trace.phases = {};
+  if (accepted && ready) {
+    trace.phases[static_cast<size_t>(TracePhase::Accept)] = *ready - *accepted;
+    trace.phases[static_cast<size_t>(TracePhase::Read)] =
+        trace.received - *ready;
+  }
+  trace.phases[static_cast<size_t>(TracePhase::Parse)] =
+      trace.parsed - trace.received;
+  trace.mark = trace.parsed;
+
+  uint8_t flags = 0;
+  auto header = request.headers.find("traceparent");
+  if (header == request.headers.end()) {
+    header = request.headers.find("Traceparent");
+  }
+  std::optional<TraceParent> parent;
+  if (header != request.headers.end()) {
+    parent = ParseTraceParent(header->second);
+  }
+  if (parent) {
+    trace.trace_id = std::move(parent->trace_id);
+    trace.parent_span_id = std::move(parent->parent_id);
+    flags = parent->flags;
+  } else {
+    trace.trace_id = RandomId(2);
+    trace.parent_span_id.clear();
+  }
+  trace.span_id = RandomId(1);
+  auto value =
+      fmt::format("00-{}-{}-{:02x}", trace.trace_id, trace.span_id, flags);
+  if (header != request.headers.end()) {
+    header->second = std::move(value);
+  } else {
+    request.headers["traceparent"] = std::move(value);
+  }
+}
+
+void Tracer::Finish(RequestImpl &request) {
+  auto &trace = request.trace;
+  if (!trace.enabled) return;
+  trace.enabled = false;
+  std::chrono::nanoseconds duration{0};
+  for (auto phase : trace.phases) duration += phase;
+
+  {
+    auto &shard = ThreadShard();
+    std::lock_guard lock(shard.mutex);
+    auto &stats = shard.routes[{request.method, trace.route.get()}];
+    if (!stats.route) stats.route = trace.route;
+    ++stats.requests;
+    for (size_t i = 0; i < kTracePhases; ++i) {
+      stats.phases[i] += trace.phases[i];
+    }
+  }
+  // Tail sampling: the decision is made once the outcome is known.
+  if (duration < slow_threshold_ &&
+      trace.status < StatusCode::InternalServerError) {
+    return;
+  }
+  TraceExporter::Ptr exporter;
+  {
+    std::lock_guard lock(mutex_);
+    exporter = exporter_;
+  }
+  if (!exporter) return;
+  TraceSpan span{
+      .trace_id = trace.trace_id,
+      .span_id = trace.span_id,
+      .parent_span_id = trace.parent_span_id,
+      .method = request.method,
+      .path = request.path,
+      .route = trace.route ? trace.route->GetPath() : std::string(),
+      .status = trace.status,
+      .start = std::chrono::system_clock::now() -
+               std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                   duration),
+      .duration = duration,
+  };
+  for (size_t i = 0; i < kTracePhases; ++i) span.phases[i] = trace.phases[i];
+  try {
+    exporter->Export(span);
+  } catch (const std::exception &e) {
+    spdlog::warn("Trace export failed: {}", e.what());
+  }
+}
+
+Tracer::Shard &Tracer::ThreadShard() {
+  // Threads take shards in turn, so io threads rarely share one.
+  static std::atomic<size_t> next{0};
+  thread_local size_t index = next++ % kShards;
+  return shards_[index];
+}
+
+std::string Tracer::Breakdown() const {
+  std::map<std::string, RouteStats> routes;
+  for (auto &shard : shards_) {
+    std::lock_guard lock(shard.mutex);
+    for (auto &[key, stats] : shard.routes) {
+      auto &merged = routes[fmt::format(
+          "{} {}", key.first,
+          stats.route ? stats.route->GetPath() : "<unmatched>")];
+      merged.requests += stats.requests;
+      for (size_t i = 0; i < kTracePhases; ++i) {
+        merged.phases[i] += stats.phases[i];
+      }
+    }
+  }
+  std::string out;
+  for (auto &[route, stats] : routes) {
+    for (size_t i = 0; i < kTracePhases; ++i) {
+      auto micros = Micros(stats.phases[i]);
+      if (micros == 0) continue;
+      out += fmt::format("{};{} {}\n", route,
+                         TracePhaseName(static_cast<TracePhase>(i)), micros);
+    }
+  }
+  return out;
+}
+}  // namespace internal
+
+std::string_view TracePhaseName(TracePhase phase) {
+  switch (phase) {
+    case TracePhase::Accept:
+      return "accept";
+    case TracePhase::Read:
+      return "read";
+    case TracePhase::Parse:
+      return "parse";
+    case TracePhase::Route:
+      return "route";
+    case TracePhase::Handler:
+      return "handler";
+    case TracePhase::Write:
+    default:
+      return "write";
+  }
+}
+
+TraceExporter::~TraceExporter() {}
+
+FileTraceExporter::FileTraceExporter(const std::string &path)
+    : out_(path, std::ios::app) {
+  if (!out_) {
+    throw std::runtime_error(fmt::format("Could not open {}", path));
+  }
+}
+
+void FileTraceExporter::Export(const TraceSpan &span) {
+  std::string phases;
+  for (size_t i = 0; i < kTracePhases; ++i) {
+    phases += fmt::format("{}\"{}\":{}", i ? "," : "",
+                          TracePhaseName(static_cast<TracePhase>(i)),
+                          internal::Micros(span.phases[i]));
+  }
+  auto line = fmt::format(
+      "{{\"trace_id\":\"{}\",\"span_id\":\"{}\",\"parent_span_id\":\"{}\","
+      "\"method\":\"{}\",\"path\":\"{}\",\"route\":\"{}\",\"status\":{:d},"
+      "\"start_us\":{},\"duration_us\":{},\"phases_us\":{{{}}}}}\n",
+      span.trace_id, span.span_id, span.parent_span_id, span.method,
+      internal::JsonEscape(span.path), internal::JsonEscape(span.route),
+      span.status,
+      internal::Micros(span.start.time_since_epoch()),
+      internal::Micros(span.duration), phases);
+  std::lock_guard lock(mutex_);
+  out_ << line;
+  out_.flush();
+}
+}  // namespace hs
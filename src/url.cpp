@@ -0,0 +1,162 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include "http-server/internal/url.h"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "http-server/enum.h"
+#include "http-server/http-server.h"
+#include "http-server/internal/request-impl.h"
+
+namespace hs::internal {
+namespace {
+constexpr uint64_t kOnes = 0x0101010101010101ULL;
+constexpr uint64_t kHighBits = 0x8080808080808080ULL;
+
+// Non-zero when some byte of word equals c.
+uint64_t HasByte(uint64_t word, unsigned char c) {
+  uint64_t x = word ^ (kOnes * c);
+  return (x - kOnes) & ~x & kHighBits;
+}
+
+int HexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+}  // namespace
+
+size_t FindEscape(std::string_view input, bool plus) {
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= input.size(); i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, input.data() + i, sizeof(word));
+    if (HasByte(word, '%') || (plus && HasByte(word, '+'))) break;
+  }
+  for (; i < input.size(); ++i) {
+    if (input[i] == '%' || (plus && input[i] == '+')) return i;
+  }
+  return std::string_view::npos;
+}
+
+std::string_view PercentDecode(std::string_view input, std::string &storage,
+                               bool plus_as_space) {
+  size_t pos = FindEscape(input, plus_as_space);
+  if (pos == std::string_view::npos) return input;
+  storage.clear();
+  storage.reserve(input.size());
+  while (pos != std::string_view::npos) {
+    storage.append(input.data(), pos);
+    input.remove_prefix(pos);
+    if (input[0] == '+') {
+      storage.push_back(' ');
+      input.remove_prefix(1);
+    } else if (int hi, lo; input.size() >= 3 &&
+                           (hi = HexValue(input[1])) >= 0 &&
+                           (lo = HexValue(input[2])) >= 0) {
+      storage.push_back(static_cast<char>(hi << 4 | lo));
+      input.remove_prefix(3);
+    } else {
+      storage.push_back('%');
+      input.remove_prefix(1);
+    }
+    pos = FindEscape(input, plus_as_space);
+  }
+  storage.append(input);
+  return storage;
+}
+
+std::string EncodePath(std::string_view path) {
+  static constexpr std::string_view kAllowed = "-._~!$&'()*+,;=:@/";
+  std::string encoded;
+  encoded.reserve(path.size());
+  for (char c : path) {
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        (c >= '0' && c <= '9') || kAllowed.find(c) != std::string_view::npos) {
+      encoded += c;
+    } else {
+      encoded += fmt::format("%{:02X}", static_cast<unsigned char>(c));
+    }
+  }
+  return encoded;
+}
+
+std::string NormalizePath(std::string_view path) {
+  std::string normalized;
+  normalized.reserve(path.size() + 1);
+  bool trailing_slash = false;
+  while (!path.empty()) {
+    size_t end = path.find('/');
+    auto segment = path.substr(0, end);
+    path.remove_prefix(end == std::string_view::npos ? path.size() : end + 1);
+    trailing_slash = true;
+    if (segment.empty() || segment == ".") continue;
+    if (segment == "..") {
+      // normalized is empty or starts with '/'.
+      normalized.resize(std::min(normalized.rfind('/'), normalized.size()));
+      continue;
+    }
+    normalized.push_back('/');
+    normalized.append(segment);
+    trailing_slash = end != std::string_view::npos;
+  }
+  if (normalized.empty() || trailing_slash) normalized.push_back('/');
+  return normalized;
+}
+
+void ParseTarget(std::string_view target, RequestImpl &request) {
+  size_t query = target.find('?');
+  auto path = target.substr(0, query);
+  // Absolute-form, as sent to proxies: drop the scheme and authority.
+  if (size_t scheme = path.find("://");
+      scheme != std::string_view::npos && path.find('/') > scheme) {
+    size_t start = path.find('/', scheme + 3);
+    path = start == std::string_view::npos ? "/" : path.substr(start);
+  }
+  if (path.empty() || path[0] != '/') {
+    throw Exception(StatusCode::BadRequest, "Malformed request target");
+  }
+  std::string storage;
+  auto decoded = PercentDecode(path, storage, false);
+  if (decoded.find('\0') != std::string_view::npos) {
+    throw Exception(StatusCode::BadRequest, "Malformed request target");
+  }
+  request.path = NormalizePath(decoded);
+  request.query = query == std::string_view::npos
+                      ? std::string()
+                      : std::string(target.substr(query + 1));
+  request.query_params.reset();
+  request.decoded_query.clear();
+}
+
+const std::vector<std::pair<std::string_view, std::string_view>>
+    &QueryParameters(RequestImpl &request) {
+  if (request.query_params) return *request.query_params;
+  auto &params = request.query_params.emplace();
+  std::string_view query = request.query;
+  auto decode = [&request](std::string_view input) {
+    std::string storage;
+    auto decoded = PercentDecode(input, storage, true);
+    if (decoded.data() == input.data()) return decoded;
+    return std::string_view(request.decoded_query.emplace_back(
+        std::move(storage)));
+  };
+  while (!query.empty()) {
+    size_t end = query.find('&');
+    auto param = query.substr(0, end);
+    query.remove_prefix(end == std::string_view::npos ? query.size()
+                                                      : end + 1);
+    if (param.empty()) continue;
+    size_t eq = param.find('=');
+    auto key = param.substr(0, eq);
+    auto value = eq == std::string_view::npos ? std::string_view()
+                                              : param.substr(eq + 1);
+    params.emplace_back(decode(key), decode(value));
+  }
+  return params;
+}
+}  // namespace hs::internal
@@ -0,0 +1,203 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include "http-server/internal/websocket-frame.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace hs::internal {
+namespace {
+
+constexpr std::string_view kWebSocketGuid =
+    "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+uint32_t RotateLeft(uint32_t value, int bits) {
+  return (value << bits) | (value >> (32 - bits));
+}
+
+// Handshake keys are short and hashed once per connection, a plain SHA-1
+// avoids pulling in a crypto library for it.
+std::array<uint8_t, 20> Sha1(std::string_view input) {
+  std::array<uint32_t, 5> h{0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476,
+                            0xc3d2e1f0};
+  std::string message(input);
+  uint64_t bit_length = static_cast<uint64_t>(input.size()) * 8;
+  message.push_back(static_cast<char>(0x80));
+  while (message.size() % 64 != 56) message.push_back(0);
+  for (int i = 7; i >= 0; --i) {
+    message.push_back(static_cast<char>(bit_length >> (i * 8)));
+  }
+  for (size_t chunk = 0; chunk < message.size(); chunk += 64) {
+    std::array<uint32_t, 80> w;
+    for (int i = 0; i < 16; ++i) {
+      auto *p =
+          reinterpret_cast<const uint8_t *>(message.data() + chunk + i * 4);
+      w[i] = (static_cast<uint32_t>(p[0]) << 24) |
+             (static_cast<uint32_t>(p[1]) << 16) |
+             (static_cast<uint32_t>(p[2]) << 8) | p[3];
+    }
+    for (int i = 16; i < 80; ++i) {
+      w[i] = RotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; ++i) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5a827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ed9eba1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8f1bbcdc;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xca62c1d6;
+      }
+      uint32_t temp = RotateLeft(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = RotateLeft(b, 30);
+      b = a;
+      a = temp;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+  std::array<uint8_t, 20> digest;
+  for (int i = 0; i < 20; ++i) {
+    digest[i] = static_cast<uint8_t>(h[i / 4] >> (24 - (i % 4) * 8));
+  }
+  return digest;
+}
+
+std::string Base64Encode(const uint8_t *data, size_t size) {
+  constexpr std::string_view kAlphabet =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  for (size_t i = 0; i < size; i += 3) {
+    uint32_t chunk = static_cast<uint32_t>(data[i]) << 16;
+    if (i + 1 < size) chunk |= static_cast<uint32_t>(data[i + 1]) << 8;
+    if (i + 2 < size) chunk |= data[i + 2];
+    out.push_back(kAlphabet[(chunk >> 18) & 0x3f]);
+    out.push_back(kAlphabet[(chunk >> 12) & 0x3f]);
+    out.push_back(i + 1 < size ? kAlphabet[(chunk >> 6) & 0x3f] : '=');
+    out.push_back(i + 2 < size ? kAlphabet[chunk & 0x3f] : '=');
+  }
+  return out;
+}
+}  // namespace
+
+size_t WebSocketHeaderSize(std::string_view data) {
+  if (data.size() < 2) return 2;
+  uint8_t second = static_cast<uint8_t>(data[1]);
+  size_t size = 2 + ((second & 0x80) ? 4 : 0);
+  switch (second & 0x7f) {
+    case 126:
+      return size + 2;
+    case 127:
+      return size + 8;
+    default:
+      return size;
+  }
+}
+
+std::optional<WebSocketFrameHeader> ParseWebSocketFrameHeader(
+    std::string_view data) {
+  size_t header_size = WebSocketHeaderSize(data);
+  if (data.size() < header_size) return std::nullopt;
+  auto *bytes = reinterpret_cast<const uint8_t *>(data.data());
+  WebSocketFrameHeader header;
+  header.fin = bytes[0] & 0x80;
+  header.rsv1 = bytes[0] & 0x40;
+  header.reserved = bytes[0] & 0x30;
+  header.opcode = static_cast<WebSocketOpcode>(bytes[0] & 0x0f);
+  header.masked = bytes[1] & 0x80;
+  header.header_size = header_size;
+  size_t pos = 2;
+  header.length = bytes[1] & 0x7f;
+  if (header.length == 126) {
+    header.length = (static_cast<uint64_t>(bytes[2]) << 8) | bytes[3];
+    pos = 4;
+  } else if (header.length == 127) {
+    header.length = 0;
+    for (; pos < 10; ++pos) header.length = (header.length << 8) | bytes[pos];
+  }
+  header.mask = {0, 0, 0, 0};
+  if (header.masked) std::memcpy(header.mask.data(), bytes + pos, 4);
+  return header;
+}
+
+void AppendWebSocketFrame(bool fin, bool rsv1, WebSocketOpcode opcode,
+                          std::string_view payload, std::string &out) {
+  out.push_back(static_cast<char>((fin ? 0x80 : 0) | (rsv1 ? 0x40 : 0) |
+                                  static_cast<uint8_t>(opcode)));
+  uint64_t length = payload.size();
+  if (length < 126) {
+    out.push_back(static_cast<char>(length));
+  } else if (length <= 0xffff) {
+    out.push_back(static_cast<char>(126));
+    out.push_back(static_cast<char>(length >> 8));
+    out.push_back(static_cast<char>(length));
+  } else {
+    out.push_back(static_cast<char>(127));
+    for (int i = 7; i >= 0; --i) {
+      out.push_back(static_cast<char>(length >> (i * 8)));
+    }
+  }
+  out.append(payload);
+}
+
+void ApplyMask(char *data, size_t size, const std::array<uint8_t, 4> &mask) {
+  // Every wide step is a multiple of four bytes, so the key stays aligned to
+  // the payload offset and can be broadcast as is.
+  uint32_t key;
+  std::memcpy(&key, mask.data(), sizeof(key));
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256i wide_key = _mm256_set1_epi32(static_cast<int>(key));
+  for (; i + 32 <= size; i += 32) {
+    auto *p = reinterpret_cast<__m256i *>(data + i);
+    _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), wide_key));
+  }
+#endif
+#if defined(__SSE2__)
+  const __m128i vector_key = _mm_set1_epi32(static_cast<int>(key));
+  for (; i + 16 <= size; i += 16) {
+    auto *p = reinterpret_cast<__m128i *>(data + i);
+    _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), vector_key));
+  }
+#endif
+  const uint64_t word_key = (static_cast<uint64_t>(key) << 32) | key;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, data + i, sizeof(word));
+    word ^= word_key;
+    std::memcpy(data + i, &word, sizeof(word));
+  }
+  for (; i < size; ++i) data[i] ^= static_cast<char>(mask[i % 4]);
+}
+
+bool IsValidCloseCode(uint16_t code) {
+  if (code >= 3000) return code <= 4999;
+  return code >= 1000 && code <= 1014 && code != 1004 && code != 1005 &&
+         code != 1006;
+}
+
+std::string WebSocketAcceptKey(std::string_view key) {
+  std::string input(key);
+  input.append(kWebSocketGuid);
+  auto digest = Sha1(input);
+  return Base64Encode(digest.data(), digest.size());
+}
+}  // namespace hs::internal
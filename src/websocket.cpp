@@ -0,0 +1,670 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include "http-server/websocket.h"
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <asio/buffer.hpp>
+#include <asio/error_code.hpp>
+#include <asio/write.hpp>
+#include <cctype>
+#include <coro/single_consumer_event.hpp>
+#include <exception>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifdef HS_PERMESSAGE_DEFLATE
+#include <zlib.h>
+#endif
+
+#include "http-server/http-server.h"
+#include "http-server/internal/spawn.h"
+#include "http-server/internal/websocket.h"
+
+namespace hs {
+namespace internal {
+namespace {
+
+constexpr size_t kReadChunk = 16384;
+// Send waits for the socket once this much is queued.
+constexpr size_t kHighWatermark = 1 << 20;
+// Messages kept for a handler that is not receiving; the oldest is dropped.
+constexpr size_t kMaxQueuedMessages = 64;
+constexpr size_t kMaxControlPayload = 125;
+// Smaller messages are not worth compressing.
+constexpr size_t kMinDeflateSize = 64;
+
+// An empty buffer whose bytes live on the heap, where moving the string
+// leaves them in place.
+std::string HeapBuffer() {
+  std::string buffer;
+  buffer.reserve(kReadChunk);
+  return buffer;
+}
+
+#ifdef HS_PERMESSAGE_DEFLATE
+constexpr bool kPerMessageDeflate = true;
+#else
+constexpr bool kPerMessageDeflate = false;
+#endif
+
+bool EqualsIgnoreCase(std::string_view a, std::string_view b) {
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (std::tolower(static_cast<unsigned char>(a[i])) !=
+        std::tolower(static_cast<unsigned char>(b[i]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string_view Trim(std::string_view value) {
+  while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+    value.remove_prefix(1);
+  }
+  while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+    value.remove_suffix(1);
+  }
+  return value;
+}
+
+// Whether a comma separated header value lists token, ignoring parameters.
+bool ContainsToken(std::string_view value, std::string_view token) {
+  while (!value.empty()) {
+    auto comma = value.find(',');
+    auto item = value.substr(0, comma);
+    value = comma == std::string_view::npos ? std::string_view()
+                                            : value.substr(comma + 1);
+    if (EqualsIgnoreCase(Trim(item.substr(0, item.find(';'))), token)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+class UpgradeRequiredHandler : public Handler {
+ public:
+  coro::async_generator<Response> Handle(const Request req) override {
+    co_yield StatusCode::UpgradeRequired;
+    Headers headers{
+        {"Sec-WebSocket-Version", "13"},
+        {"Upgrade", "websocket"},
+        {"Content-Length", "0"},
+    };
+    co_yield headers;
+  }
+};
+}  // namespace
+
+// permessage-deflate (RFC 7692) with no context takeover in either direction,
+// so every message is compressed and inflated on its own.
+class PerMessageDeflate {
+ public:
+#ifdef HS_PERMESSAGE_DEFLATE
+  PerMessageDeflate() {
+    inflateInit2(&inflate_, -MAX_WBITS);
+    deflateInit2(&deflate_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+                 Z_DEFAULT_STRATEGY);
+  }
+  ~PerMessageDeflate() {
+    inflateEnd(&inflate_);
+    deflateEnd(&deflate_);
+  }
+
+  bool Inflate(std::string_view in, size_t max_size, std::string &out) {
+    inflateReset(&inflate_);
+    out.clear();
+    for (auto input : {in, std::string_view(kTail, sizeof(kTail))}) {
+      inflate_.next_in =
+          reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+      inflate_.avail_in = input.size();
+      do {
+        size_t offset = out.size();
+        out.resize(offset + kReadChunk);
+        inflate_.next_out = reinterpret_cast<Bytef *>(out.data() + offset);
+        inflate_.avail_out = kReadChunk;
+        int ret = inflate(&inflate_, Z_SYNC_FLUSH);
+        out.resize(offset + kReadChunk - inflate_.avail_out);
+        if (ret == Z_STREAM_END) break;
+        if (ret != Z_OK && ret != Z_BUF_ERROR) return false;
+        if (out.size() > max_size) return false;
+        if (ret == Z_BUF_ERROR && inflate_.avail_out > 0) break;
+      } while (inflate_.avail_in > 0 || inflate_.avail_out == 0);
+    }
+    return true;
+  }
+
+  bool Deflate(std::string_view in, std::string &out) {
+    deflateReset(&deflate_);
+    out.clear();
+    deflate_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+    deflate_.avail_in = in.size();
+    do {
+      size_t offset = out.size();
+      out.resize(offset + kReadChunk);
+      deflate_.next_out = reinterpret_cast<Bytef *>(out.data() + offset);
+      deflate_.avail_out = kReadChunk;
+      if (deflate(&deflate_, Z_SYNC_FLUSH) == Z_STREAM_ERROR) return false;
+      out.resize(offset + kReadChunk - deflate_.avail_out);
+    } while (deflate_.avail_out == 0);
+    // The empty block Z_SYNC_FLUSH ends with is implied on the wire.
+    if (std::string_view(out).ends_with(
+            std::string_view(kTail, sizeof(kTail)))) {
+      out.resize(out.size() - sizeof(kTail));
+    }
+    return true;
+  }
+
+ private:
+  static constexpr char kTail[] = {'\x00', '\x00', '\xff', '\xff'};
+  z_stream inflate_{};
+  z_stream deflate_{};
+#else
+  bool Inflate(std::string_view, size_t, std::string &) { return false; }
+  bool Deflate(std::string_view, std::string &) { return false; }
+#endif
+};
+
+bool IsWebSocketUpgrade(const RequestImpl &request) {
+  if (request.method != Method::GET || request.version != Version::HTTP_1_1) {
+    return false;
+  }
+  auto upgrade = request.headers.find("Upgrade");
+  return upgrade != request.headers.end() &&
+         ContainsToken(upgrade->second, "websocket");
+}
+
+coro::task<> ServeWebSocket(RequestImpl::Ptr request,
+                            WebSocketHandler::Ptr handler,
+                            const Config &config) {
+  auto key = request->headers.find("Sec-WebSocket-Key");
+  if (key == request->headers.end()) {
+    throw Exception(StatusCode::BadRequest, "Missing Sec-WebSocket-Key");
+  }
+  auto version = request->headers.find("Sec-WebSocket-Version");
+  if (version == request->headers.end() || Trim(version->second) != "13") {
+    throw Exception(StatusCode::UpgradeRequired,
+                    "Unsupported WebSocket version");
+  }
+  auto extensions = request->headers.find("Sec-WebSocket-Extensions");
+  bool deflate = kPerMessageDeflate && config.websocket_deflate &&
+                 extensions != request->headers.end() &&
+                 ContainsToken(extensions->second, "permessage-deflate");
+
+  std::string response = fmt::format(
+      "{} {:d} {:s}\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+      "Sec-WebSocket-Accept: {}\r\n",
+      request->version, StatusCode::SwitchingProtocols,
+      StatusCode::SwitchingProtocols, WebSocketAcceptKey(Trim(key->second)));
+  if (deflate) {
+    response +=
+        "Sec-WebSocket-Extensions: permessage-deflate; "
+        "server_no_context_takeover; client_no_context_takeover\r\n";
+  }
+  response += "\r\n";
+  asio::error_code error;
+  coro::single_consumer_event event;
+  asio::async_write(*request->socket, asio::buffer(response),
+                    [&](auto ec, auto n) {
+                      spdlog::trace("Wrote {} bytes to socket; ec:{}", n,
+                                    ec.message());
+                      error = ec;
+                      event.set();
+                    });
+  co_await event;
+  if (error) co_return;
+  co_await std::make_shared<WebSocketImpl>(request->socket, config, deflate)
+      ->Run(handler, request);
+}
+
+struct WebSocketImpl::ReceiverGuard {
+  WebSocketImpl &impl;
+  ReceiverGuard(WebSocketImpl &impl) : impl(impl) {
+    impl.receiver_active_ = true;
+  }
+  ~ReceiverGuard() {
+    impl.receiver_active_ = false;
+    impl.receiver_waiting_ = false;
+    impl.current_.reset();
+    impl.message_ready_.reset();
+    impl.detached_.clear();
+    impl.WakeReader();
+  }
+};
+
+WebSocketImpl::WebSocketImpl(Stream::Ptr socket, const Config &config,
+                             bool deflate)
+    : socket_(socket),
+      config_(config),
+      deflate_(deflate ? std::make_unique<PerMessageDeflate>() : nullptr),
+      ping_timer_(socket->get_executor()),
+      close_timer_(socket->get_executor()),
+      read_buffer_(HeapBuffer()),
+      message_buffer_(HeapBuffer()),
+      inflate_buffer_(HeapBuffer()) {}
+
+WebSocketImpl::~WebSocketImpl() {}
+
+coro::task<> WebSocketImpl::Run(WebSocketHandler::Ptr handler,
+                                RequestImpl::Ptr request) {
+  auto self = shared_from_this();
+  // Frames the client sent right behind its handshake.
+  read_buffer_.append(request->body_part);
+  Spawn(ReadLoop(self));
+  if (config_.websocket_ping_interval.count() > 0) Spawn(PingLoop(self));
+
+  uint16_t code = 1000;
+  try {
+    co_await handler->Handle(Request(request), WebSocket(self));
+  } catch (const std::exception &e) {
+    spdlog::error("WebSocket handler failed: {}", e.what());
+    code = 1011;
+  }
+  SendClose(code, {});
+
+  // Wait for the peer's close and for the outbox to drain, but no longer than
+  // the pong timeout.
+  close_timer_.expires_after(config_.websocket_pong_timeout);
+  close_timer_.async_wait([self](auto ec) {
+    if (!ec) self->Shutdown();
+  });
+  if (!reader_done_) {
+    auto finished = std::make_shared<coro::single_consumer_event>();
+    reader_finished_ = finished;
+    co_await *finished;
+  }
+  co_await Drain();
+  Shutdown();
+}
+
+coro::async_generator<WebSocketMessage> WebSocketImpl::Receive(Ptr self) {
+  ReceiverGuard guard(*this);
+  QueuedMessage pending;
+  for (;;) {
+    // The previous message, if it was detached, is no longer in use.
+    detached_.clear();
+    if (!queued_.empty()) {
+      pending = std::move(queued_.front());
+      queued_.pop_front();
+      co_yield WebSocketMessage{pending.type, pending.data};
+      continue;
+    }
+    if (!open_) co_return;
+    current_.reset();
+    auto ready = std::make_shared<coro::single_consumer_event>();
+    message_ready_ = ready;
+    receiver_waiting_ = true;
+    WakeReader();
+    co_await *ready;
+    if (!current_) continue;
+    auto message = *current_;
+    co_yield message;
+  }
+}
+
+coro::task<> WebSocketImpl::Send(std::string_view data, MessageType type) {
+  if (!IsOpen()) {
+    spdlog::debug("Dropping message for a closed WebSocket");
+    co_return;
+  }
+  auto opcode = type == MessageType::Text ? WebSocketOpcode::Text
+                                          : WebSocketOpcode::Binary;
+  if (deflate_ && data.size() >= kMinDeflateSize &&
+      deflate_->Deflate(data, deflate_buffer_)) {
+    WriteFrame(opcode, true, deflate_buffer_);
+  } else {
+    WriteFrame(opcode, false, data);
+  }
+  while (outbox_.size() > kHighWatermark && open_) {
+    auto drained = std::make_shared<coro::single_consumer_event>();
+    drained_.push_back(drained);
+    co_await *drained;
+  }
+}
+
+coro::task<> WebSocketImpl::Close(uint16_t code, std::string_view reason) {
+  SendClose(code, reason);
+  co_return;
+}
+
+bool WebSocketImpl::IsOpen() const { return open_ && !close_sent_; }
+
+coro::task<bool> WebSocketImpl::Fill(size_t size) {
+  while (read_buffer_.size() - read_pos_ < size) {
+    if (read_pos_ > 0) {
+      read_buffer_.erase(0, read_pos_);
+      read_pos_ = 0;
+    }
+    size_t offset = read_buffer_.size();
+    read_buffer_.resize(offset + kReadChunk);
+    asio::error_code error;
+    size_t read = 0;
+    coro::single_consumer_event event;
+    socket_->async_read_some(
+        asio::buffer(read_buffer_.data() + offset, kReadChunk),
+        [&](auto ec, auto n) {
+          error = ec;
+          read = n;
+          event.set();
+        });
+    co_await event;
+    read_buffer_.resize(offset + read);
+    if (error) {
+      spdlog::debug("WebSocket read failed: {}", error.message());
+      co_return false;
+    }
+  }
+  co_return true;
+}
+
+coro::task<std::optional<WebSocketFrameHeader>> WebSocketImpl::ReadFrame(
+    std::string_view &payload) {
+  if (!co_await Fill(2)) co_return std::nullopt;
+  auto size =
+      WebSocketHeaderSize(std::string_view(read_buffer_).substr(read_pos_));
+  if (!co_await Fill(size)) co_return std::nullopt;
+  auto header = ParseWebSocketFrameHeader(
+      std::string_view(read_buffer_).substr(read_pos_));
+  if (!header->masked || header->reserved || (header->rsv1 && !deflate_)) {
+    Fail(1002, "Protocol error");
+    co_return std::nullopt;
+  }
+  if (header->length > config_.websocket_max_message_size) {
+    Fail(1009, "Message too big");
+    co_return std::nullopt;
+  }
+  if (!co_await Fill(header->header_size + header->length)) {
+    co_return std::nullopt;
+  }
+  // Unmasked in place; the view stays valid until the next ReadFrame.
+  char *data = read_buffer_.data() + read_pos_ + header->header_size;
+  ApplyMask(data, header->length, header->mask);
+  payload = std::string_view(data, header->length);
+  read_pos_ += header->header_size + header->length;
+  co_return header;
+}
+
+coro::task<bool> WebSocketImpl::HandleFrame(const WebSocketFrameHeader &header,
+                                            std::string_view payload) {
+  switch (header.opcode) {
+    case WebSocketOpcode::Text:
+    case WebSocketOpcode::Binary: {
+      auto type = header.opcode == WebSocketOpcode::Text ? MessageType::Text
+                                                         : MessageType::Binary;
+      if (fragmented_) {
+        Fail(1002, "Expected a continuation frame");
+        co_return false;
+      }
+      if (header.fin) co_return co_await Deliver(type, header.rsv1, payload);
+      fragmented_ = type;
+      fragmented_compressed_ = header.rsv1;
+      message_buffer_.assign(payload);
+      co_return true;
+    }
+    case WebSocketOpcode::Continuation: {
+      if (!fragmented_ || header.rsv1) {
+        Fail(1002, "Unexpected continuation frame");
+        co_return false;
+      }
+      if (message_buffer_.size() + payload.size() >
+          config_.websocket_max_message_size) {
+        Fail(1009, "Message too big");
+        co_return false;
+      }
+      message_buffer_.append(payload);
+      if (!header.fin) co_return true;
+      auto type = *fragmented_;
+      fragmented_.reset();
+      co_return co_await Deliver(type, fragmented_compressed_, message_buffer_);
+    }
+    default:
+      break;
+  }
+
+  if (!header.fin || header.rsv1 || payload.size() > kMaxControlPayload) {
+    Fail(1002, "Invalid control frame");
+    co_return false;
+  }
+  switch (header.opcode) {
+    case WebSocketOpcode::Close: {
+      if (payload.size() == 1) {
+        Fail(1002, "Invalid close frame");
+        co_return false;
+      }
+      uint16_t code = 1000;
+      if (payload.size() >= 2) {
+        code = static_cast<uint16_t>(static_cast<uint8_t>(payload[0]) << 8 |
+                                     static_cast<uint8_t>(payload[1]));
+        if (!IsValidCloseCode(code)) {
+          Fail(1002, "Invalid close code");
+          co_return false;
+        }
+      }
+      spdlog::debug("WebSocket closed by peer with {}", code);
+      SendClose(code, {});
+      co_return false;
+    }
+    case WebSocketOpcode::Ping:
+      WriteFrame(WebSocketOpcode::Pong, false, payload);
+      co_return true;
+    case WebSocketOpcode::Pong:
+      pong_pending_ = false;
+      co_return true;
+    default:
+      Fail(1002, "Unknown opcode");
+      co_return false;
+  }
+}
+
+coro::task<bool> WebSocketImpl::Deliver(MessageType type, bool compressed,
+                                        std::string_view data) {
+  if (compressed) {
+    if (!deflate_->Inflate(data, config_.websocket_max_message_size,
+                           inflate_buffer_)) {
+      Fail(1007, "Invalid compressed message");
+      co_return false;
+    }
+    data = inflate_buffer_;
+  }
+  if (receiver_waiting_) {
+    delivering_ = true;
+    current_ = WebSocketMessage{type, data};
+    receiver_waiting_ = false;
+    WakeReceiver();
+    // data is only valid until the receiver asks for the next message, or
+    // until it is detached because a pong must be read.
+    if (pong_pending_) DetachMessage();
+    while (delivering_ && receiver_active_ && !receiver_waiting_ && open_) {
+      auto resume = std::make_shared<coro::single_consumer_event>();
+      reader_resume_ = resume;
+      co_await *resume;
+    }
+    delivering_ = false;
+    co_return true;
+  }
+  if (queued_.size() >= kMaxQueuedMessages) {
+    spdlog::warn("WebSocket receive queue full, dropping a message");
+    queued_.pop_front();
+  }
+  queued_.push_back({type, std::string(data)});
+  co_return true;
+}
+
+void WebSocketImpl::DetachMessage() {
+  // The receiver's view stays valid in the set-aside buffers; the reader
+  // carries on with fresh ones holding the bytes not parsed yet.
+  auto unread = std::string_view(read_buffer_).substr(read_pos_);
+  auto read_buffer = HeapBuffer();
+  read_buffer.append(unread);
+  detached_.push_back(std::move(read_buffer_));
+  detached_.push_back(std::move(message_buffer_));
+  detached_.push_back(std::move(inflate_buffer_));
+  read_buffer_ = std::move(read_buffer);
+  read_pos_ = 0;
+  message_buffer_ = HeapBuffer();
+  inflate_buffer_ = HeapBuffer();
+  delivering_ = false;
+  WakeReader();
+}
+
+coro::task<> WebSocketImpl::ReadLoop(Ptr self) {
+  std::string_view payload;
+  for (;;) {
+    auto header = co_await ReadFrame(payload);
+    if (!header || !co_await HandleFrame(*header, payload)) break;
+  }
+  open_ = false;
+  reader_done_ = true;
+  ping_timer_.cancel();
+  WakeReceiver();
+  if (reader_finished_) {
+    auto finished = std::move(reader_finished_);
+    finished->set();
+  }
+}
+
+coro::task<> WebSocketImpl::PingLoop(Ptr self) {
+  while (open_) {
+    if (!co_await Wait(ping_timer_, config_.websocket_ping_interval) ||
+        !open_) {
+      break;
+    }
+    pong_pending_ = true;
+    WriteFrame(WebSocketOpcode::Ping, false, {});
+    // A reader held up by a slow receiver couldn't read the pong.
+    if (delivering_) DetachMessage();
+    if (!co_await Wait(ping_timer_, config_.websocket_pong_timeout) ||
+        !open_) {
+      break;
+    }
+    if (pong_pending_) {
+      spdlog::info("WebSocket peer missed a pong, closing");
+      Shutdown();
+      break;
+    }
+  }
+}
+
+coro::task<bool> WebSocketImpl::Wait(
+    asio::steady_timer &timer, std::chrono::steady_clock::duration duration) {
+  timer.expires_after(duration);
+  asio::error_code error;
+  coro::single_consumer_event event;
+  timer.async_wait([&](auto ec) {
+    error = ec;
+    event.set();
+  });
+  co_await event;
+  co_return !error;
+}
+
+void WebSocketImpl::WriteFrame(WebSocketOpcode opcode, bool rsv1,
+                               std::string_view payload) {
+  AppendWebSocketFrame(true, rsv1, opcode, payload, outbox_);
+  if (!writing_) {
+    writing_ = true;
+    Spawn(Flush(shared_from_this()));
+  }
+}
+
+void WebSocketImpl::SendClose(uint16_t code, std::string_view reason) {
+  if (close_sent_) return;
+  close_sent_ = true;
+  std::string payload;
+  payload.push_back(static_cast<char>(code >> 8));
+  payload.push_back(static_cast<char>(code & 0xff));
+  payload.append(reason.substr(0, kMaxControlPayload - 2));
+  WriteFrame(WebSocketOpcode::Close, false, payload);
+}
+
+coro::task<> WebSocketImpl::Flush(Ptr self) {
+  std::string chunk;
+  while (!outbox_.empty()) {
+    chunk.clear();
+    chunk.swap(outbox_);
+    asio::error_code error;
+    coro::single_consumer_event event;
+    asio::async_write(*socket_, asio::buffer(chunk), [&](auto ec, auto n) {
+      spdlog::trace("Wrote {} bytes to socket; ec:{}", n, ec.message());
+      error = ec;
+      event.set();
+    });
+    co_await event;
+    if (error) {
+      outbox_.clear();
+      Shutdown();
+      break;
+    }
+    auto drained = std::move(drained_);
+    for (auto &waiter : drained) waiter->set();
+  }
+  writing_ = false;
+  auto drained = std::move(drained_);
+  for (auto &waiter : drained) waiter->set();
+}
+
+coro::task<> WebSocketImpl::Drain() {
+  while (writing_) {
+    auto drained = std::make_shared<coro::single_consumer_event>();
+    drained_.push_back(drained);
+    co_await *drained;
+  }
+}
+
+void WebSocketImpl::Fail(uint16_t code, std::string_view reason) {
+  spdlog::debug("WebSocket failed: {}", reason);
+  SendClose(code, reason);
+}
+
+void WebSocketImpl::Shutdown() {
+  open_ = false;
+  asio::error_code error;
+  socket_->shutdown(tcp::socket::shutdown_both, error);
+  socket_->close(error);
+  ping_timer_.cancel();
+  close_timer_.cancel();
+  WakeReader();
+  WakeReceiver();
+}
+
+void WebSocketImpl::WakeReader() {
+  if (reader_resume_) {
+    auto resume = std::move(reader_resume_);
+    resume->set();
+  }
+}
+
+void WebSocketImpl::WakeReceiver() {
+  if (message_ready_) {
+    auto ready = std::move(message_ready_);
+    ready->set();
+  }
+}
+}  // namespace internal
+
+WebSocket::WebSocket(std::shared_ptr<internal::WebSocketImpl> pimpl)
+    : pimpl_(std::move(pimpl)) {}
+WebSocket::~WebSocket() {}
+
+coro::async_generator<WebSocketMessage> WebSocket::Receive() const {
+  return pimpl_->Receive(pimpl_);
+}
+coro::task<> WebSocket::Send(std::string_view data, MessageType type) const {
+  return pimpl_->Send(data, type);
+}
+coro::task<> WebSocket::Close(uint16_t code, std::string_view reason) const {
+  return pimpl_->Close(code, reason);
+}
+bool WebSocket::IsOpen() const { return pimpl_->IsOpen(); }
+
+WebSocketHandler::~WebSocketHandler() {}
+
+Method WebSocketRoute::GetMethod() const { return Method::GET; }
+Handler::Ptr WebSocketRoute::GetHandler() const {
+  return std::make_shared<internal::UpgradeRequiredHandler>();
+}
+}  // namespace hs
@@ -0,0 +1,139 @@
+// Copyright 2023 Vinay Varma; Subject to the MIT License.
+#include "http-server/internal/worker-pool.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <asio/error_code.hpp>
+#include <asio/post.hpp>
+#include <asio/steady_timer.hpp>
+#include <coro/single_consumer_event.hpp>
+#include <exception>
+#include <utility>
+
+#include "http-server/offload.h"
+
+namespace hs {
+namespace internal {
+namespace {
+// Which pool and queue the current thread works for, if any.
+thread_local WorkerPool *current_pool = nullptr;
+thread_local size_t current_index = 0;
+// On io threads, their own executor; on workers, the io thread the running
+// task came from.
+thread_local std::optional<asio::any_io_executor> io_executor;
+}  // namespace
+
+WorkerPool::WorkerPool(size_t threads) {
+  threads = std::max<size_t>(threads, 1);
+  for (size_t i = 0; i < threads; ++i) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    threads_.emplace_back(
+        [this, i](std::stop_token stop) { Run(std::move(stop), i); });
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  for (auto &thread : threads_) thread.request_stop();
+  threads_.clear();
+}
+
+void WorkerPool::Submit(std::function<void()> task) {
+  // Work submitted from a worker stays on its queue, the rest is spread.
+  size_t index = current_pool == this ? current_index
+                                      : next_++ % queues_.size();
+  // Counted before it can be popped, so the count never drops below zero.
+  ++pending_;
+  {
+    std::lock_guard lock(queues_[index]->mutex);
+    queues_[index]->tasks.push_back(std::move(task));
+  }
+  std::lock_guard lock(idle_mutex_);
+  idle_.notify_one();
+}
+
+size_t WorkerPool::Size() const { return queues_.size(); }
+
+WorkerPool &WorkerPool::Default() {
+  static WorkerPool pool(
+      std::max<size_t>(std::thread::hardware_concurrency(), 2));
+  return pool;
+}
+
+bool WorkerPool::TryPop(size_t index, std::function<void()> &task) {
+  auto &queue = *queues_[index];
+  std::lock_guard lock(queue.mutex);
+  if (queue.tasks.empty()) return false;
+  task = std::move(queue.tasks.back());
+  queue.tasks.pop_back();
+  return true;
+}
+
+bool WorkerPool::TrySteal(size_t index, std::function<void()> &task) {
+  for (size_t i = 1; i < queues_.size(); ++i) {
+    auto &queue = *queues_[(index + i) % queues_.size()];
+    std::lock_guard lock(queue.mutex);
+    if (queue.tasks.empty()) continue;
+    task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    return true;
+  }
+  return false;
+}
+
+void WorkerPool::Run(std::stop_token stop, size_t index) {
+  current_pool = this;
+  current_index = index;
+  std::function<void()> task;
+  while (!stop.stop_requested()) {
+    if (TryPop(index, task) || TrySteal(index, task)) {
+      --pending_;
+      try {
+        task();
+      } catch (const std::exception &e) {
+        spdlog::error("Worker task failed: {}", e.what());
+      }
+      task = nullptr;
+      continue;
+    }
+    std::unique_lock lock(idle_mutex_);
+    idle_.wait(lock, stop, [this]() { return pending_ > 0; });
+  }
+}
+
+void SetIoExecutor(asio::any_io_executor executor) {
+  io_executor = std::move(executor);
+}
+
+std::optional<asio::any_io_executor> CurrentIoExecutor() { return io_executor; }
+
+void ResumeOnWorker(std::coroutine_handle<> handle) {
+  WorkerPool::Default().Submit([handle, executor = io_executor]() {
+    io_executor = executor;
+    handle.resume();
+  });
+}
+
+bool ResumeOnIo(std::coroutine_handle<> handle) {
+  if (!io_executor || current_pool == nullptr) return false;
+  asio::post(*io_executor, [handle]() { handle.resume(); });
+  return true;
+}
+}  // namespace internal
+
+coro::task<> sleep_for(std::chrono::steady_clock::duration duration) {
+  auto executor = internal::CurrentIoExecutor();
+  if (!executor) {
+    spdlog::warn("sleep_for outside an io thread blocks the caller");
+    std::this_thread::sleep_for(duration);
+    co_return;
+  }
+  asio::steady_timer timer(*executor);
+  timer.expires_after(duration);
+  coro::single_consumer_event event;
+  timer.async_wait([&](asio::error_code) { event.set(); });
+  co_await event;
+}
+}  // namespace hs
@@ -0,0 +1,81 @@
+#include "http-server/internal/admission.h"
+
+#include <doctest/doctest.h>
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace {
+struct TestRoute : public hs::Route {
+  TestRoute(size_t limit = 0, bool unmetered = false)
+      : limit(limit), unmetered(unmetered) {}
+  hs::Method GetMethod() const override { return hs::Method::GET; }
+  std::string GetPath() const override { return "/"; }
+  hs::Handler::Ptr GetHandler() const override { return nullptr; }
+  size_t MaxConcurrency() const override { return limit; }
+  bool Unmetered() const override { return unmetered; }
+  size_t limit;
+  bool unmetered;
+};
+}  // namespace
+
+TEST_SUITE_BEGIN("admission");
+TEST_CASE("global in-flight cap") {
+  hs::Config config("test", "localhost", 0);
+  config.max_in_flight = 2;
+  hs::internal::AdmissionController admission(config);
+  TestRoute route;
+  auto first = admission.Admit(route);
+  auto second = admission.Admit(route);
+  REQUIRE(first);
+  REQUIRE(second);
+  CHECK_FALSE(admission.Admit(route));
+  CHECK(admission.InFlight() == 2);
+  first.reset();
+  CHECK(admission.InFlight() == 1);
+  CHECK(admission.Admit(route));
+
+  TestRoute stream(0, true);
+  auto unmetered = admission.Admit(stream);
+  CHECK(unmetered);
+  CHECK(admission.InFlight() == 1);
+}
+TEST_CASE("per route limit") {
+  hs::Config config("test", "localhost", 0);
+  hs::internal::AdmissionController admission(config);
+  TestRoute limited(1);
+  TestRoute other;
+  auto permit = admission.Admit(limited);
+  REQUIRE(permit);
+  CHECK_FALSE(admission.Admit(limited));
+  CHECK(admission.Admit(other));
+  permit.reset();
+  CHECK(admission.Admit(limited));
+}
+TEST_CASE("adaptive limit") {
+  hs::Config config("test", "localhost", 0);
+  config.max_in_flight = 100;
+  config.adaptive_concurrency = true;
+  config.adaptive_latency_target = std::chrono::milliseconds(10);
+  config.adaptive_min_limit = 4;
+  hs::internal::AdmissionController admission(config);
+  CHECK(admission.Limit() == 100);
+  for (int i = 0; i < 100; ++i) {
+    admission.RecordLatency(std::chrono::milliseconds(50));
+  }
+  CHECK(admission.Limit() == 4);
+
+  TestRoute route;
+  std::vector<hs::internal::AdmissionController::Permit> permits;
+  for (int i = 0; i < 4; ++i) permits.push_back(*admission.Admit(route));
+  CHECK_FALSE(admission.Admit(route));
+  permits.clear();
+
+  for (int i = 0; i < 100; ++i) {
+    admission.RecordLatency(std::chrono::milliseconds(1));
+  }
+  CHECK(admission.Limit() > 4);
+}
+TEST_SUITE_END();
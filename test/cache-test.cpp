@@ -0,0 +1,105 @@
+#include "http-server/internal/cache.h"
+
+#include <doctest/doctest.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "http-server/internal/request-impl.h"
+
+namespace {
+hs::internal::CacheEntry::Ptr Entry(std::string body,
+                                    std::chrono::seconds ttl = {}) {
+  return hs::internal::BuildCacheEntry(
+      hs::StatusCode::Ok, {{"Content-Type", "text/plain"}}, std::move(body),
+      std::chrono::steady_clock::now() + ttl);
+}
+std::string_view View(const hs::ResponseBody::Ptr &body) {
+  return {static_cast<const char *>(body->GetData()), body->GetSize()};
+}
+}  // namespace
+
+TEST_SUITE_BEGIN("cache");
+TEST_CASE("entry") {
+  auto entry = hs::internal::BuildCacheEntry(
+      hs::StatusCode::Ok,
+      {{"Content-Type", "text/plain"}, {"Connection", "close"}}, "hello",
+      std::chrono::steady_clock::now());
+  CHECK(entry->status == hs::StatusCode::Ok);
+  CHECK(View(entry->body) == "hello");
+  CHECK(entry->headers.at("Content-Length") == "5");
+  // The session that replays it decides the connection's fate.
+  CHECK(!entry->headers.contains("Connection"));
+}
+TEST_CASE("key") {
+  hs::internal::ResponseCacheImpl cache({.vary = {"Accept-Encoding"}});
+  auto impl = std::make_shared<hs::internal::RequestImpl>();
+  impl->path = "/items";
+  impl->query = "page=2";
+  impl->headers["Accept-Encoding"] = "gzip";
+  CHECK(cache.Key(hs::Request(impl)) == "/items?page=2\nAccept-Encoding:gzip");
+}
+TEST_CASE("request use") {
+  using hs::internal::CacheUse;
+  hs::internal::ResponseCacheImpl cache({.vary = {"Cookie"}});
+  auto use = [&](std::string name, std::string value) {
+    auto impl = std::make_shared<hs::internal::RequestImpl>();
+    impl->path = "/";
+    if (!name.empty()) impl->headers[name] = value;
+    return cache.Use(hs::Request(impl));
+  };
+  CHECK(use("", "") == CacheUse::Normal);
+  CHECK(use("Authorization", "Bearer a") == CacheUse::Bypass);
+  // Part of the key, so one client's entry isn't served to another.
+  CHECK(use("Cookie", "session=a") == CacheUse::Normal);
+  CHECK(use("Cache-Control", "No-Store") == CacheUse::Bypass);
+  CHECK(use("Cache-Control", "max-age=0, no-cache") == CacheUse::Refresh);
+  CHECK(use("Cache-Control", "max-age=60") == CacheUse::Normal);
+}
+TEST_CASE("lookup and eviction") {
+  auto ttl = std::chrono::seconds(60);
+  SUBCASE("hit") {
+    hs::internal::ResponseCacheImpl cache({});
+    CHECK_FALSE(cache.Lookup("/a?"));
+    CHECK_FALSE(cache.Join("/a?"));
+    cache.Complete("/a?", Entry("a", ttl));
+    auto entry = cache.Lookup("/a?");
+    REQUIRE(entry);
+    CHECK(View(entry->body) == "a");
+    CHECK(cache.Size() == 1);
+  }
+  SUBCASE("expired") {
+    hs::internal::ResponseCacheImpl cache({});
+    cache.Complete("/a?", Entry("a"));
+    CHECK_FALSE(cache.Lookup("/a?"));
+    CHECK(cache.Size() == 0);
+    CHECK(cache.Bytes() == 0);
+  }
+  SUBCASE("least recently used goes first") {
+    auto size = Entry("a", ttl)->bytes;
+    hs::internal::ResponseCacheImpl cache({.max_bytes = 2 * size});
+    cache.Complete("/a?", Entry("a", ttl));
+    cache.Complete("/b?", Entry("b", ttl));
+    CHECK(cache.Lookup("/a?"));
+    cache.Complete("/c?", Entry("c", ttl));
+    CHECK(cache.Lookup("/a?"));
+    CHECK_FALSE(cache.Lookup("/b?"));
+    CHECK(cache.Lookup("/c?"));
+    CHECK(cache.Bytes() == 2 * size);
+  }
+}
+TEST_CASE("single flight") {
+  hs::internal::ResponseCacheImpl cache({});
+  CHECK_FALSE(cache.Join("/a?"));
+  auto first = cache.Join("/a?");
+  auto second = cache.Join("/a?");
+  REQUIRE(first);
+  REQUIRE(second);
+  // An uncacheable response still releases the key.
+  cache.Complete("/a?", nullptr);
+  CHECK_FALSE(cache.Lookup("/a?"));
+  CHECK_FALSE(cache.Join("/a?"));
+}
+TEST_SUITE_END();
@@ -0,0 +1,90 @@
+#include "http-server/form.h"
+
+#include <doctest/doctest.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "http-server/http-server.h"
+#include "http-server/internal/form.h"
+
+namespace {
+constexpr std::string_view kBody =
+    "preamble\r\n"
+    "--XyZ\r\n"
+    "Content-Disposition: form-data; name=\"title\"\r\n"
+    "\r\n"
+    "hello\r\n--X\r\n"
+    "--XyZ\r\n"
+    "content-disposition: form-data; name=\"file\"; filename=\"a;b.txt\"\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "\r\n"
+    "\r\n--XyY\r\n"
+    "--XyZ--\r\n"
+    "epilogue";
+
+struct Part {
+  std::string name;
+  std::string filename;
+  std::string content_type;
+  std::string data;
+};
+
+// Feeds kBody in pieces of size bytes and collects the parts.
+std::vector<Part> Parse(size_t size, const hs::FormLimits &limits = {}) {
+  typedef hs::internal::MultipartParser::Event Event;
+  hs::internal::MultipartParser parser("XyZ", limits);
+  std::vector<Part> parts;
+  std::string_view input = kBody;
+  while (true) {
+    std::string_view data;
+    auto event = parser.Next(data);
+    if (event == Event::Done) break;
+    if (event == Event::NeedMore) {
+      REQUIRE(!input.empty());
+      parser.Feed(input.substr(0, size));
+      input.remove_prefix(std::min(size, input.size()));
+    } else if (event == Event::PartBegin) {
+      auto &part = parser.Part();
+      parts.push_back({std::string(part.Name()),
+                       std::string(part.Filename().value_or("")),
+                       std::string(part.ContentType()), ""});
+    } else if (event == Event::Data) {
+      parts.back().data.append(data);
+    }
+  }
+  return parts;
+}
+}  // namespace
+
+TEST_SUITE_BEGIN("form");
+TEST_CASE("header params") {
+  using hs::internal::HeaderParam;
+  std::string_view type = "multipart/form-data; Boundary=\"a b\" ; x=1";
+  CHECK(HeaderParam(type, "boundary") == "a b");
+  CHECK(HeaderParam(type, "x") == "1");
+  CHECK(!HeaderParam(type, "y"));
+  CHECK(HeaderParam("form-data; name=\"f\"; filename=\"x.txt\"", "name") ==
+        "f");
+}
+TEST_CASE("multipart") {
+  for (size_t size : {size_t(1), size_t(3), size_t(7), kBody.size()}) {
+    auto parts = Parse(size);
+    REQUIRE(parts.size() == 2);
+    CHECK(parts[0].name == "title");
+    CHECK(parts[0].filename.empty());
+    CHECK(parts[0].content_type == "text/plain");
+    CHECK(parts[0].data == "hello\r\n--X");
+    CHECK(parts[1].name == "file");
+    CHECK(parts[1].filename == "a;b.txt");
+    CHECK(parts[1].content_type == "application/octet-stream");
+    CHECK(parts[1].data == "\r\n--XyY");
+  }
+}
+TEST_CASE("multipart limits") {
+  CHECK_THROWS_AS(Parse(16, {.max_parts = 1}), hs::Exception);
+  CHECK_THROWS_AS(Parse(16, {.max_part_size = 8}), hs::Exception);
+  CHECK_THROWS_AS(Parse(16, {.max_header_size = 16}), hs::Exception);
+}
+TEST_SUITE_END();
@@ -0,0 +1,108 @@
+#include "http-server/internal/hpack.h"
+
+#include <doctest/doctest.h>
+
+#include <string>
+#include <string_view>
+
+namespace {
+std::string FromHex(std::string_view hex) {
+  std::string out;
+  for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+    out.push_back(static_cast<char>(std::stoi(std::string(hex.substr(i, 2)),
+                                              nullptr, 16)));
+  }
+  return out;
+}
+}  // namespace
+
+TEST_SUITE_BEGIN("hpack");
+TEST_CASE("integer representation") {
+  std::string out;
+  hs::internal::EncodeInteger(10, 5, 0, out);
+  CHECK(out == FromHex("0a"));
+  out.clear();
+  hs::internal::EncodeInteger(1337, 5, 0, out);
+  CHECK(out == FromHex("1f9a0a"));
+  out.clear();
+  hs::internal::EncodeInteger(42, 8, 0, out);
+  CHECK(out == FromHex("2a"));
+
+  std::string_view in = "\x1f\x9a\x0a";
+  uint64_t value;
+  REQUIRE(hs::internal::DecodeInteger(in, 5, value));
+  CHECK(value == 1337);
+  CHECK(in.empty());
+}
+TEST_CASE("huffman") {
+  std::string out;
+  REQUIRE(
+      hs::internal::HuffmanDecode(FromHex("f1e3c2e5f23a6ba0ab90f4ff"), out));
+  CHECK(out == "www.example.com");
+  out.clear();
+  REQUIRE(hs::internal::HuffmanDecode(FromHex("a8eb10649cbf"), out));
+  CHECK(out == "no-cache");
+  out.clear();
+  CHECK_FALSE(hs::internal::HuffmanDecode(FromHex("a8eb10649cbfff"), out));
+}
+TEST_CASE("decoder") {
+  hs::internal::HpackDecoder decoder;
+  SUBCASE("requests without huffman") {
+    auto first = decoder.Decode(
+        FromHex("828684410f7777772e6578616d706c652e636f6d"));
+    REQUIRE(first.has_value());
+    REQUIRE(first->size() == 4);
+    CHECK((*first)[0] == hs::internal::HeaderField{":method", "GET"});
+    CHECK((*first)[3] ==
+          hs::internal::HeaderField{":authority", "www.example.com"});
+    CHECK(decoder.TableSize() == 57);
+
+    auto second = decoder.Decode(FromHex("828684be58086e6f2d6361636865"));
+    REQUIRE(second.has_value());
+    REQUIRE(second->size() == 5);
+    CHECK((*second)[3] ==
+          hs::internal::HeaderField{":authority", "www.example.com"});
+    CHECK((*second)[4] ==
+          hs::internal::HeaderField{"cache-control", "no-cache"});
+    CHECK(decoder.TableSize() == 110);
+  }
+  SUBCASE("requests with huffman") {
+    auto first =
+        decoder.Decode(FromHex("828684418cf1e3c2e5f23a6ba0ab90f4ff"));
+    REQUIRE(first.has_value());
+    CHECK((*first)[3] ==
+          hs::internal::HeaderField{":authority", "www.example.com"});
+    auto second = decoder.Decode(FromHex("828684be5886a8eb10649cbf"));
+    REQUIRE(second.has_value());
+    CHECK((*second)[4] ==
+          hs::internal::HeaderField{"cache-control", "no-cache"});
+    auto third = decoder.Decode(FromHex("828785bf408825a849e95ba97d7f8925a8"
+                                        "49e95bb8e8b4bf"));
+    REQUIRE(third.has_value());
+    REQUIRE(third->size() == 5);
+    CHECK((*third)[1] == hs::internal::HeaderField{":scheme", "https"});
+    CHECK((*third)[3] ==
+          hs::internal::HeaderField{":authority", "www.example.com"});
+    CHECK((*third)[4] ==
+          hs::internal::HeaderField{"custom-key", "custom-value"});
+    CHECK(decoder.TableSize() == 164);
+  }
+  SUBCASE("invalid index") { CHECK_FALSE(decoder.Decode(FromHex("ff00"))); }
+}
+TEST_CASE("encoder round trip") {
+  hs::internal::HpackEncoder encoder;
+  hs::internal::HpackDecoder decoder;
+  std::string block;
+  encoder.EncodeStatus(hs::StatusCode::NotFound, block);
+  encoder.Encode("content-type", "text/plain", block);
+  encoder.Encode("x-request-id", "42", block);
+  auto headers = decoder.Decode(block);
+  REQUIRE(headers.has_value());
+  REQUIRE(headers->size() == 3);
+  CHECK((*headers)[0] == hs::internal::HeaderField{":status", "404"});
+  CHECK((*headers)[1] ==
+        hs::internal::HeaderField{"content-type", "text/plain"});
+  CHECK((*headers)[2] == hs::internal::HeaderField{"x-request-id", "42"});
+  CHECK(decoder.TableSize() == 0);
+}
+TEST_SUITE_END();
@@ -0,0 +1,251 @@
+#include "http-server/internal/http2.h"
+
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <asio/io_context.hpp>
+#include <asio/local/connect_pair.hpp>
+#include <asio/local/stream_protocol.hpp>
+#include <asio/read.hpp>
+#include <asio/write.hpp>
+#include <coro/async_generator.hpp>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "http-server/http-server.h"
+#include "http-server/internal/admission.h"
+#include "http-server/internal/hpack.h"
+#include "http-server/internal/route.h"
+#include "http-server/internal/spawn.h"
+#include "http-server/internal/stream.h"
+
+namespace {
+using namespace hs::internal;
+
+struct Echo : public hs::Handler {
+  coro::async_generator<hs::Response> Handle(const hs::Request req) override {
+    auto body = co_await req.Body();
+    co_yield hs::StatusCode::Ok;
+    hs::Headers headers{{"X-Method", "post"}, {"Set-Cookie", "a=1\nb=2"}};
+    co_yield headers;
+    co_yield std::make_shared<hs::WritableResponseBody<std::string>>(body);
+  }
+};
+
+struct EchoRoute : public hs::Route {
+  hs::Method GetMethod() const override { return hs::Method::POST; }
+  std::string GetPath() const override { return "/echo"; }
+  hs::Handler::Ptr GetHandler() const override {
+    return std::make_shared<Echo>();
+  }
+};
+
+std::string Frame(FrameType type, uint8_t flags, uint32_t stream_id,
+                  std::string_view payload) {
+  std::string out;
+  AppendFrameHeader({static_cast<uint32_t>(payload.size()), type, flags,
+                     stream_id},
+                    out);
+  out.append(payload);
+  return out;
+}
+
+std::string Post(uint32_t stream_id, std::string_view content_length) {
+  HpackEncoder encoder;
+  std::string block;
+  encoder.Encode(":method", "POST", block);
+  encoder.Encode(":scheme", "http", block);
+  encoder.Encode(":path", "/echo", block);
+  encoder.Encode(":authority", "localhost", block);
+  encoder.Encode("content-length", content_length, block);
+  return Frame(FrameType::Headers, EndHeadersFlag, stream_id, block);
+}
+
+// What the client saw on one stream.
+struct Received {
+  HeaderList headers;
+  std::string body;
+  bool ended = false;
+  std::optional<Http2Error> reset;
+};
+
+struct Exchange {
+  bool settings = false;
+  bool settings_ack = false;
+  std::optional<Http2Error> goaway;
+  std::map<uint32_t, Received> streams;
+};
+
+// Serves one connection over a socket pair. The peer writes the preface, an
+// empty SETTINGS frame and out, then reads frames until done holds.
+Exchange Run(const hs::Config &config, std::string_view out,
+             std::function<bool(Exchange &)> done) {
+  asio::io_context io_context;
+  asio::local::stream_protocol::socket server(io_context);
+  asio::local::stream_protocol::socket client(io_context);
+  asio::local::connect_pair(server, client);
+
+  Router router;
+  router.AddRoute(std::make_shared<EchoRoute>());
+  AdmissionController admission(config);
+  auto connection = std::make_shared<Http2Connection>(
+      std::make_shared<Stream>(std::move(server)), router, config, admission);
+
+  Exchange exchange;
+  auto &streams = exchange.streams;
+  std::thread peer([&]() {
+    std::string preface(kHttp2Preface);
+    preface += Frame(FrameType::Settings, 0, 0, "");
+    asio::write(client, asio::buffer(preface));
+    asio::write(client, asio::buffer(out));
+
+    HpackDecoder decoder;
+    while (!done(exchange)) {
+      std::string header(kFrameHeaderSize, '\0');
+      asio::read(client, asio::buffer(header));
+      auto frame = ParseFrameHeader(header);
+      std::string payload(frame.length, '\0');
+      asio::read(client, asio::buffer(payload));
+      auto &stream = streams[frame.stream_id];
+      switch (frame.type) {
+        case FrameType::Settings:
+          if (frame.flags & AckFlag) {
+            exchange.settings_ack = true;
+          } else {
+            exchange.settings = true;
+            auto ack = Frame(FrameType::Settings, AckFlag, 0, "");
+            asio::write(client, asio::buffer(ack));
+          }
+          break;
+        case FrameType::Headers:
+          stream.headers = decoder.Decode(payload).value_or(HeaderList{});
+          stream.ended = frame.flags & EndStreamFlag;
+          break;
+        case FrameType::Data:
+          stream.body += payload;
+          stream.ended = frame.flags & EndStreamFlag;
+          break;
+        case FrameType::RstStream:
+          stream.reset = static_cast<Http2Error>(
+              (static_cast<uint8_t>(payload[2]) << 8) |
+              static_cast<uint8_t>(payload[3]));
+          break;
+        case FrameType::GoAway:
+          exchange.goaway = static_cast<Http2Error>(
+              (static_cast<uint8_t>(payload[6]) << 8) |
+              static_cast<uint8_t>(payload[7]));
+          break;
+        default:
+          break;
+      }
+    }
+    client.close();
+  });
+  Spawn(connection->Serve(""));
+  io_context.run();
+  peer.join();
+  return exchange;
+}
+}  // namespace
+
+TEST_SUITE_BEGIN("http2");
+TEST_CASE("loopback framing") {
+  hs::Config config("test", "localhost", 0);
+  config.http2_max_body_size = 8;
+  std::string out;
+  // A well-formed request.
+  out += Post(1, "5");
+  out += Frame(FrameType::Data, EndStreamFlag, 1, "hello");
+  // Fewer bytes than its content-length promised.
+  out += Post(3, "10");
+  out += Frame(FrameType::Data, EndStreamFlag, 3, "abc");
+  // More than http2_max_body_size.
+  out += Post(5, "9");
+  out += Frame(FrameType::Data, 0, 5, "123456789");
+  auto exchange = Run(config, out, [](auto &exchange) {
+    auto &streams = exchange.streams;
+    return streams[1].ended && streams[3].reset && streams[5].reset;
+  });
+
+  CHECK(exchange.settings);
+  CHECK(exchange.settings_ack);
+  auto &streams = exchange.streams;
+  auto &ok = streams[1];
+  REQUIRE(!ok.headers.empty());
+  CHECK(ok.headers[0] == HeaderField(":status", "200"));
+  CHECK(std::find(ok.headers.begin(), ok.headers.end(),
+                  HeaderField("x-method", "post")) != ok.headers.end());
+  // Each cookie goes in a field of its own.
+  CHECK(std::count(ok.headers.begin(), ok.headers.end(),
+                   HeaderField("set-cookie", "a=1")) == 1);
+  CHECK(std::count(ok.headers.begin(), ok.headers.end(),
+                   HeaderField("set-cookie", "b=2")) == 1);
+  CHECK(ok.body == "hello");
+  CHECK(streams[3].headers.empty());
+  CHECK(streams[3].reset == Http2Error::ProtocolError);
+  REQUIRE(!streams[5].headers.empty());
+  CHECK(streams[5].headers[0] == HeaderField(":status", "413"));
+  CHECK(streams[5].reset == Http2Error::Cancel);
+}
+
+TEST_CASE("reset streams free their slot") {
+  hs::Config config("test", "localhost", 0);
+  config.http2_max_concurrent_streams = 2;
+  std::string cancel("\0\0\0\x08", 4);
+  std::string out;
+  // Half-sent uploads the client gives up on, more than the limit.
+  for (uint32_t id = 1; id <= 7; id += 2) {
+    out += Post(id, "5");
+    out += Frame(FrameType::Data, 0, id, "he");
+    out += Frame(FrameType::RstStream, 0, id, cancel);
+  }
+  out += Post(9, "5");
+  out += Frame(FrameType::Data, EndStreamFlag, 9, "hello");
+  auto exchange = Run(config, out, [](auto &exchange) {
+    auto &streams = exchange.streams;
+    return streams[9].ended || streams[9].reset;
+  });
+
+  auto &streams = exchange.streams;
+  CHECK(!streams[9].reset);
+  REQUIRE(!streams[9].headers.empty());
+  CHECK(streams[9].headers[0] == HeaderField(":status", "200"));
+  CHECK(streams[9].body == "hello");
+}
+TEST_CASE("flow control") {
+  hs::Config config("test", "localhost", 0);
+  SUBCASE("data past the receive window") {
+    config.http2_initial_window_size = 8;
+    // Acknowledges the server's SETTINGS up front, so its window applies.
+    std::string out = Frame(FrameType::Settings, AckFlag, 0, "");
+    out += Post(1, "10");
+    out += Frame(FrameType::Data, EndStreamFlag, 1, "0123456789");
+    out += Post(3, "5");
+    out += Frame(FrameType::Data, EndStreamFlag, 3, "hello");
+    auto exchange = Run(config, out, [](auto &exchange) {
+      auto &streams = exchange.streams;
+      return streams[1].reset && streams[3].ended;
+    });
+    auto &streams = exchange.streams;
+    CHECK(streams[1].reset == Http2Error::FlowControlError);
+    CHECK(streams[3].body == "hello");
+  }
+  SUBCASE("initial window raised past the maximum") {
+    // Stream 1's send window goes to 2^31-1, then one more.
+    std::string out = Post(1, "5");
+    out += Frame(FrameType::WindowUpdate, 0, 1, std::string("\x7f\xff\0\0", 4));
+    out += Frame(FrameType::Settings, 0, 0,
+                 std::string("\0\x04\0\x01\0\0", 6));
+    auto exchange = Run(config, out, [](auto &exchange) {
+      return exchange.goaway.has_value();
+    });
+    CHECK(exchange.goaway == Http2Error::FlowControlError);
+  }
+}
+TEST_SUITE_END();
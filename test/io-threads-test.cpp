@@ -0,0 +1,43 @@
+#include "http-server/internal/io-threads.h"
+
+#include <doctest/doctest.h>
+
+#include <asio/post.hpp>
+#include <future>
+#include <thread>
+
+#include "http-server/internal/socket-options.h"
+
+TEST_SUITE_BEGIN("io-threads");
+TEST_CASE("available cpus") {
+  auto cpus = hs::internal::AvailableCpus();
+  REQUIRE(!cpus.empty());
+  for (size_t i = 1; i < cpus.size(); ++i) {
+    CHECK(hs::internal::CpuNode(cpus[i - 1]) <=
+          hs::internal::CpuNode(cpus[i]));
+  }
+}
+TEST_CASE("adopt") {
+  asio::io_context io_context;
+  hs::Config config("test", "127.0.0.1", 0);
+  config.io_threads = 2;
+  config.pin_io_threads = true;
+  config.steer_connections = true;
+  hs::internal::IoThreads threads(config);
+  CHECK(threads.Size() == 2);
+
+  auto acceptor = hs::internal::OpenTcpAcceptor(io_context, config);
+  asio::ip::tcp::socket client(io_context);
+  client.connect(acceptor.local_endpoint());
+  auto accepted = acceptor.accept();
+  auto socket = threads.Adopt(accepted);
+  CHECK(!accepted.is_open());
+  CHECK(socket.is_open());
+
+  // Work on the adopted socket runs on an io thread, not this one.
+  std::promise<std::thread::id> ran_on;
+  asio::post(socket.get_executor(),
+             [&ran_on]() { ran_on.set_value(std::this_thread::get_id()); });
+  CHECK(ran_on.get_future().get() != std::this_thread::get_id());
+}
+TEST_SUITE_END();
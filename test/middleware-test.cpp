@@ -0,0 +1,116 @@
+#include "http-server/middleware.h"
+
+#include <doctest/doctest.h>
+
+#include <coro/sync_wait.hpp>
+#include <coro/task.hpp>
+#include <memory>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "http-server/internal/request-impl.h"
+
+namespace {
+struct Echo : public hs::Handler {
+  coro::async_generator<hs::Response> Handle(const hs::Request req) override {
+    co_yield hs::StatusCode::Ok;
+    hs::Headers headers;
+    if (auto user = req.Header("X-User")) headers["X-User"] = *user;
+    co_yield headers;
+  }
+};
+
+// Rejects requests without a token, otherwise names the caller.
+struct Auth {
+  template <typename Next>
+  coro::async_generator<hs::Response> Handle(hs::Request req, Next next) {
+    if (!req.Header("Authorization")) {
+      co_yield hs::StatusCode::BadRequest;
+      co_return;
+    }
+    req.SetHeader("X-User", "alice");
+    auto gen = next(req);
+    for (auto it = co_await gen.begin(); it != gen.end();) {
+      co_yield *it;
+      co_await ++it;
+    }
+  }
+};
+
+// Tags the headers of the response.
+struct Tag {
+  std::string name;
+  template <typename Next>
+  coro::async_generator<hs::Response> Handle(hs::Request req, Next next) {
+    auto gen = next(req);
+    for (auto it = co_await gen.begin(); it != gen.end();) {
+      auto response = *it;
+      if (auto headers = std::get_if<hs::Headers>(&response)) {
+        (*headers)["X-Tag"] += name;
+      }
+      co_yield response;
+      co_await ++it;
+    }
+  }
+};
+
+template <typename M>
+struct Dynamic : public hs::Middleware {
+  M middleware;
+  Dynamic(M m) : middleware(std::move(m)) {}
+  coro::async_generator<hs::Response> Handle(hs::Request req,
+                                             hs::Next next) override {
+    return middleware.Handle(std::move(req), std::move(next));
+  }
+};
+
+coro::task<> Drain(coro::async_generator<hs::Response> gen,
+                   std::vector<hs::Response> &out) {
+  for (auto it = co_await gen.begin(); it != gen.end(); co_await ++it) {
+    out.push_back(*it);
+  }
+}
+
+std::vector<hs::Response> Run(hs::Handler &handler, bool authorized) {
+  auto impl = std::make_shared<hs::internal::RequestImpl>();
+  impl->path = "/";
+  if (authorized) impl->headers["Authorization"] = "token";
+  std::vector<hs::Response> out;
+  coro::sync_wait(Drain(handler.Handle(hs::Request(impl)), out));
+  return out;
+}
+}  // namespace
+
+TEST_SUITE_BEGIN("middleware");
+TEST_CASE("compile time chain") {
+  hs::MiddlewareHandler<Tag, Auth, Tag> handler(std::make_shared<Echo>(),
+                                                Tag{"a"}, Auth{}, Tag{"b"});
+  SUBCASE("passes through") {
+    auto out = Run(handler, true);
+    REQUIRE(out.size() == 2);
+    CHECK(std::get<hs::StatusCode>(out[0]) == hs::StatusCode::Ok);
+    auto headers = std::get<hs::Headers>(out[1]);
+    CHECK(headers["X-User"] == "alice");
+    // Inner middleware sees the response first.
+    CHECK(headers["X-Tag"] == "ba");
+  }
+  SUBCASE("short circuits") {
+    auto out = Run(handler, false);
+    REQUIRE(out.size() == 1);
+    CHECK(std::get<hs::StatusCode>(out[0]) == hs::StatusCode::BadRequest);
+  }
+}
+TEST_CASE("runtime chain") {
+  auto chain = std::make_shared<std::vector<hs::Middleware::Ptr>>();
+  chain->push_back(std::make_shared<Dynamic<Tag>>(Tag{"a"}));
+  chain->push_back(std::make_shared<Dynamic<Auth>>(Auth{}));
+  auto handler = hs::Chain(chain, std::make_shared<Echo>());
+  auto out = Run(*handler, true);
+  REQUIRE(out.size() == 2);
+  auto headers = std::get<hs::Headers>(out[1]);
+  CHECK(headers["X-User"] == "alice");
+  CHECK(headers["X-Tag"] == "a");
+  CHECK(Run(*handler, false).size() == 1);
+}
+TEST_SUITE_END();
@@ -0,0 +1,375 @@
+#include "http-server/proxy.h"
+
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+
+#include <asio/buffers_iterator.hpp>
+#include <asio/error.hpp>
+#include <asio/io_context.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/read_until.hpp>
+#include <asio/streambuf.hpp>
+#include <asio/write.hpp>
+#include <chrono>
+#include <coro/task.hpp>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include "http-server/http-server.h"
+#include "http-server/internal/proxy.h"
+#include "http-server/internal/request-impl.h"
+#include "http-server/internal/spawn.h"
+#include "http-server/internal/worker-pool.h"
+
+namespace {
+using asio::ip::tcp;
+
+struct Proxied {
+  hs::StatusCode status = hs::StatusCode::Ok;
+  hs::Headers headers;
+  std::string body;
+};
+
+coro::task<> Proxy(hs::Handler::Ptr handler,
+                   std::shared_ptr<hs::internal::RequestImpl> request,
+                   Proxied *out) {
+  try {
+    auto gen = handler->Handle(hs::Request(request));
+    for (auto it = co_await gen.begin(); it != gen.end(); co_await ++it) {
+      if (auto status = std::get_if<hs::StatusCode>(&*it)) {
+        out->status = *status;
+      } else if (auto headers = std::get_if<hs::Headers>(&*it)) {
+        out->headers = *headers;
+      } else {
+        auto &body = std::get<hs::ResponseBody::Ptr>(*it);
+        out->body.append(static_cast<const char *>(body->GetData()),
+                         body->GetSize());
+      }
+    }
+  } catch (const hs::Exception &e) {
+    out->status = e.Code();
+  }
+}
+
+coro::task<> ProxyAll(
+    hs::Handler::Ptr handler,
+    std::vector<std::shared_ptr<hs::internal::RequestImpl>> requests,
+    std::vector<Proxied> *out) {
+  out->resize(requests.size());
+  for (size_t i = 0; i < requests.size(); ++i) {
+    co_await Proxy(handler, requests[i], &(*out)[i]);
+  }
+}
+
+// Takes the first body chunk, then goes away like a client that hung up.
+coro::task<> Abandon(hs::Handler::Ptr handler,
+                     std::shared_ptr<hs::internal::RequestImpl> request,
+                     Proxied *out) {
+  auto gen = handler->Handle(hs::Request(request));
+  for (auto it = co_await gen.begin(); it != gen.end(); co_await ++it) {
+    if (auto body = std::get_if<hs::ResponseBody::Ptr>(&*it)) {
+      out->body.append(static_cast<const char *>((*body)->GetData()),
+                       (*body)->GetSize());
+      handler->SetDone();
+    }
+  }
+}
+
+std::shared_ptr<hs::internal::RequestImpl> Get(std::string path,
+                                               hs::Version version) {
+  auto request = std::make_shared<hs::internal::RequestImpl>();
+  request->method = hs::Method::GET;
+  request->version = version;
+  request->path = std::move(path);
+  return request;
+}
+
+std::string_view Decode(hs::internal::ChunkedDecoder &decoder,
+                        std::string_view input, std::string &body) {
+  std::string_view data;
+  while (size_t used = decoder.Decode(input, data)) {
+    body.append(data);
+    input.remove_prefix(used);
+  }
+  return input;
+}
+}  // namespace
+
+TEST_SUITE_BEGIN("proxy");
+TEST_CASE("response head") {
+  using hs::internal::ParseResponseHead;
+  auto head = ParseResponseHead(
+      "HTTP/1.1 200 OK\r\nContent-Length: 12\r\nSet-Cookie: a=1\r\n"
+      "Connection: close\r\n\r\n");
+  REQUIRE(head);
+  CHECK(head->status == 200);
+  CHECK(head->content_length == 12);
+  CHECK(!head->chunked);
+  CHECK(!head->keep_alive);
+  CHECK(head->headers.size() == 3);
+
+  head = ParseResponseHead(
+      "HTTP/1.1 204 \r\nTransfer-Encoding: gzip, chunked\r\n"
+      "Content-Length: 3\r\n\r\n");
+  REQUIRE(head);
+  CHECK(head->chunked);
+  CHECK(!head->content_length);
+  CHECK(head->keep_alive);
+  // Relayed statuses without an hs::StatusCode keep a matching reason.
+  auto status = static_cast<hs::StatusCode>(head->status);
+  CHECK(fmt::format("{:d} {:s}", status, status) == "204 NoContent");
+  status = static_cast<hs::StatusCode>(599);
+  CHECK(fmt::format("{:s}", status) == "ServerError");
+
+  head = ParseResponseHead("HTTP/1.0 200 OK\r\nConnection: keep-alive\r\n\r\n");
+  REQUIRE(head);
+  CHECK(head->keep_alive);
+
+  CHECK(!ParseResponseHead("HTTP/2 200 OK\r\n\r\n"));
+  CHECK(!ParseResponseHead("HTTP/1.1 20 OK\r\n\r\n"));
+  CHECK(!ParseResponseHead("HTTP/1.1 200 OK\r\nName : value\r\n\r\n"));
+  CHECK(!ParseResponseHead(
+      "HTTP/1.1 200 OK\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n"));
+}
+TEST_CASE("chunked decoder") {
+  std::string body;
+  hs::internal::ChunkedDecoder decoder;
+  // Split mid size line, mid data and mid trailer.
+  auto rest = Decode(decoder, "5;ext=1\r\nhel", body);
+  CHECK(body == "hel");
+  CHECK(rest.empty());
+  rest = Decode(decoder, "lo\r\n1", body);
+  CHECK(rest == "1");
+  rest = Decode(decoder, "1a\r\n0123456789abcdefghijklmnop\r\n0\r\nX-T", body);
+  CHECK(rest == "X-T");
+  CHECK(!decoder.Done());
+  rest = Decode(decoder, "railer: 1\r\n\r\nnext", body);
+  CHECK(decoder.Done());
+  CHECK(rest == "next");
+  CHECK(body == "hello0123456789abcdefghijklmnop");
+
+  hs::internal::ChunkedDecoder bad;
+  std::string_view data;
+  CHECK_THROWS_AS(bad.Decode("zz\r\n", data), hs::Exception);
+}
+TEST_CASE("balancing") {
+  SUBCASE("round robin") {
+    hs::internal::UpstreamGroup group(
+        {.upstreams = {"a:1", "b:2", "[::1]:3"},
+         .balance = hs::ProxyBalance::RoundRobin});
+    CHECK(group.At(2).host == "::1");
+    CHECK(group.Pick() == 0);
+    CHECK(group.Pick() == 1);
+    CHECK(group.Pick() == 2);
+    group.MarkDown(0);
+    CHECK(group.Pick() == 1);
+  }
+  SUBCASE("least outstanding") {
+    hs::internal::UpstreamGroup group({.upstreams = {"a", "b", "c"}});
+    CHECK(group.At(0).port == "80");
+    CHECK(group.Pick() == 0);
+    CHECK(group.Pick() == 1);
+    CHECK(group.Pick() == 2);
+    group.Done(1);
+    CHECK(group.Pick() == 1);
+  }
+  SUBCASE("passive recovery") {
+    hs::internal::UpstreamGroup group(
+        {.upstreams = {"a"},
+         .health_check_interval = std::chrono::milliseconds(0)});
+    group.MarkDown(0);
+    CHECK(!group.At(0).healthy);
+    CHECK(group.Pick() == 0);
+    CHECK(group.At(0).healthy);
+  }
+  CHECK_THROWS(hs::internal::UpstreamGroup(hs::ProxyOptions{}));
+}
+TEST_CASE("loopback upstream") {
+  asio::io_context upstream_context;
+  tcp::acceptor acceptor(upstream_context,
+                         tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+  std::vector<std::string> received;
+  // Serves both requests on one connection: the proxy must reuse it.
+  std::thread upstream([&]() {
+    auto socket = acceptor.accept();
+    asio::streambuf buffer;
+    for (std::string_view response :
+         {"HTTP/1.1 200 OK\r\nContent-Length: 5\r\nX-Upstream: a\r\n"
+          "Set-Cookie: a=1; Expires=Wed, 21 Oct 2026 07:28:00 GMT\r\n"
+          "Set-Cookie: b=2\r\n\r\nhello",
+          "HTTP/1.1 201 Created\r\nTransfer-Encoding: chunked\r\n\r\n"
+          "3\r\nwor\r\n2\r\nld\r\n0\r\n\r\n"}) {
+      auto size = asio::read_until(socket, buffer, "\r\n\r\n");
+      auto begin = asio::buffers_begin(buffer.data());
+      received.emplace_back(begin, begin + size);
+      buffer.consume(size);
+      asio::write(socket, asio::buffer(response));
+    }
+  });
+
+  asio::io_context io_context;
+  hs::internal::SetIoExecutor(io_context.get_executor());
+  auto upstreams = std::make_shared<hs::Upstreams>(hs::ProxyOptions{
+      .upstreams = {fmt::format("127.0.0.1:{}",
+                                acceptor.local_endpoint().port())},
+      .read_timeout = std::chrono::milliseconds(2000)});
+  hs::ProxyRoute route(hs::Method::GET, "/api", upstreams);
+
+  auto first = Get("/api/a b", hs::Version::HTTP_1_1);
+  first->query = "x=1";
+  first->headers["Host"] = "example.com";
+  first->headers["Connection"] = "keep-alive, X-Hop";
+  first->headers["X-Hop"] = "1";
+  first->headers["Accept"] = "*/*";
+  auto second = Get("/api/b", hs::Version::HTTP_1_0);
+  std::vector<Proxied> responses;
+  hs::internal::Spawn(
+      ProxyAll(route.GetHandler(), {first, second}, &responses));
+  io_context.run();
+  upstream.join();
+
+  REQUIRE(received.size() == 2);
+  CHECK(received[0].starts_with("GET /api/a%20b?x=1 HTTP/1.1\r\n"));
+  CHECK(received[0].find("Host: example.com\r\n") != std::string::npos);
+  CHECK(received[0].find("Accept: */*\r\n") != std::string::npos);
+  CHECK(received[0].find("X-Hop") == std::string::npos);
+  CHECK(received[0].find("Connection") == std::string::npos);
+  CHECK(received[1].find("Host: 127.0.0.1:") != std::string::npos);
+
+  REQUIRE(responses.size() == 2);
+  CHECK(responses[0].status == hs::StatusCode::Ok);
+  CHECK(responses[0].headers["Content-Length"] == "5");
+  CHECK(responses[0].headers["X-Upstream"] == "a");
+  // Cookies can't be joined with commas, their dates hold them.
+  CHECK(responses[0].headers["Set-Cookie"] ==
+        "a=1; Expires=Wed, 21 Oct 2026 07:28:00 GMT\nb=2");
+  CHECK(responses[0].body == "hello");
+  // An HTTP/1.0 client gets the chunks decoded.
+  CHECK(responses[1].status == 201);
+  CHECK(responses[1].headers["Connection"] == "Close");
+  CHECK(!responses[1].headers.contains("Transfer-Encoding"));
+  CHECK(responses[1].body == "world");
+  CHECK(hs::internal::IdleConnections::Of(io_context.get_executor()).Size() ==
+        1);
+  CHECK(upstreams->Healthy(0));
+}
+TEST_CASE("retry on a dropped pooled connection") {
+  asio::io_context upstream_context;
+  tcp::acceptor acceptor(upstream_context,
+                         tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+  std::vector<std::string> received;
+  std::thread upstream([&]() {
+    std::string_view ok = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+    auto read = [&](tcp::socket &socket, asio::streambuf &buffer) {
+      auto size = asio::read_until(socket, buffer, "\r\n\r\n");
+      auto begin = asio::buffers_begin(buffer.data());
+      received.emplace_back(begin, begin + size);
+      buffer.consume(size);
+    };
+    // Two connections that each answer one request and drop the next, then
+    // one more for a retry.
+    for (int i = 0; i < 3; ++i) {
+      auto socket = acceptor.accept();
+      asio::streambuf buffer;
+      read(socket, buffer);
+      asio::write(socket, asio::buffer(ok));
+      if (i < 2) read(socket, buffer);
+    }
+  });
+
+  asio::io_context io_context;
+  hs::internal::SetIoExecutor(io_context.get_executor());
+  auto upstreams = std::make_shared<hs::Upstreams>(hs::ProxyOptions{
+      .upstreams = {fmt::format("127.0.0.1:{}",
+                                acceptor.local_endpoint().port())},
+      .read_timeout = std::chrono::milliseconds(2000)});
+  hs::ProxyRoute route(hs::Method::GET, "/", upstreams);
+  auto post = Get("/", hs::Version::HTTP_1_1);
+  post->method = hs::Method::POST;
+  std::vector<Proxied> responses;
+  hs::internal::Spawn(ProxyAll(route.GetHandler(),
+                               {Get("/", hs::Version::HTTP_1_1), post,
+                                Get("/", hs::Version::HTTP_1_1),
+                                Get("/", hs::Version::HTTP_1_1)},
+                               &responses));
+  io_context.run();
+  upstream.join();
+
+  REQUIRE(responses.size() == 4);
+  CHECK(responses[0].status == hs::StatusCode::Ok);
+  // The upstream may have acted on the POST, it is not sent again.
+  CHECK(responses[1].status == hs::StatusCode::BadGateway);
+  CHECK(responses[2].status == hs::StatusCode::Ok);
+  // The GET is.
+  CHECK(responses[3].status == hs::StatusCode::Ok);
+  CHECK(responses[3].body == "ok");
+  REQUIRE(received.size() == 5);
+  CHECK(received[1].starts_with("POST / HTTP/1.1\r\n"));
+  CHECK(received[2].starts_with("GET / HTTP/1.1\r\n"));
+}
+TEST_CASE("client gone mid body") {
+  asio::io_context upstream_context;
+  tcp::acceptor acceptor(upstream_context,
+                         tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+  bool dropped = false;
+  std::thread upstream([&]() {
+    auto socket = acceptor.accept();
+    asio::streambuf buffer;
+    asio::read_until(socket, buffer, "\r\n\r\n");
+    std::string_view response =
+        "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nhello";
+    asio::write(socket, asio::buffer(response));
+    char byte;
+    asio::error_code error;
+    socket.read_some(asio::buffer(&byte, 1), error);
+    dropped = error == asio::error::eof;
+  });
+
+  asio::io_context io_context;
+  hs::internal::SetIoExecutor(io_context.get_executor());
+  auto upstreams = std::make_shared<hs::Upstreams>(hs::ProxyOptions{
+      .upstreams = {fmt::format("127.0.0.1:{}",
+                                acceptor.local_endpoint().port())},
+      .read_timeout = std::chrono::milliseconds(2000)});
+  hs::ProxyRoute route(hs::Method::GET, "/", upstreams);
+  Proxied response;
+  hs::internal::Spawn(
+      Abandon(route.GetHandler(), Get("/", hs::Version::HTTP_1_1), &response));
+  io_context.run();
+  upstream.join();
+
+  CHECK(response.body == "hello");
+  // Half its body unread, the connection is closed rather than pooled.
+  CHECK(dropped);
+  CHECK(hs::internal::IdleConnections::Of(io_context.get_executor()).Size() ==
+        0);
+}
+TEST_CASE("unreachable upstream") {
+  asio::io_context io_context;
+  hs::internal::SetIoExecutor(io_context.get_executor());
+  uint16_t port;
+  {
+    tcp::acceptor closed(io_context,
+                         tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+    port = closed.local_endpoint().port();
+  }
+  auto upstreams = std::make_shared<hs::Upstreams>(
+      hs::ProxyOptions{.upstreams = {fmt::format("127.0.0.1:{}", port)}});
+  hs::ProxyRoute route(hs::Method::GET, "/", upstreams);
+  std::vector<Proxied> responses;
+  hs::internal::Spawn(ProxyAll(route.GetHandler(),
+                               {Get("/", hs::Version::HTTP_1_1),
+                                Get("/", hs::Version::HTTP_1_1)},
+                               &responses));
+  io_context.run();
+  REQUIRE(responses.size() == 2);
+  CHECK(responses[0].status == hs::StatusCode::BadGateway);
+  CHECK(!upstreams->Healthy(0));
+  // Out of rotation until the interval is over.
+  CHECK(responses[1].status == hs::StatusCode::BadGateway);
+}
+TEST_SUITE_END();
@@ -0,0 +1,105 @@
+#include "http-server/internal/rate-limit.h"
+
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "http-server/internal/admission.h"
+
+namespace {
+using namespace std::chrono_literals;
+using Clock = hs::internal::RateLimiter::Clock;
+
+struct TestRoute : public hs::Route {
+  TestRoute(std::string path) : path(std::move(path)) {}
+  hs::Method GetMethod() const override { return hs::Method::GET; }
+  std::string GetPath() const override { return path; }
+  hs::Handler::Ptr GetHandler() const override { return nullptr; }
+  std::string path;
+};
+}  // namespace
+
+TEST_SUITE_BEGIN("rate limit");
+TEST_CASE("burst and refill") {
+  hs::internal::RateLimiter limiter({.rate = 2, .burst = 3});
+  auto now = Clock::now();
+  auto first = limiter.Check("a", now);
+  CHECK(first.allowed);
+  CHECK(first.remaining == 2);
+  CHECK(limiter.Check("a", now).remaining == 1);
+  CHECK(limiter.Check("a", now).remaining == 0);
+  auto refused = limiter.Check("a", now);
+  CHECK_FALSE(refused.allowed);
+  CHECK(refused.retry_after == 500ms);
+  CHECK(refused.reset == 1500ms);
+  // Other keys have their own burst.
+  CHECK(limiter.Check("b", now).allowed);
+  // One request refills every half second.
+  CHECK_FALSE(limiter.Check("a", now + 499ms).allowed);
+  CHECK(limiter.Check("a", now + 500ms).allowed);
+  CHECK_FALSE(limiter.Check("a", now + 500ms).allowed);
+  CHECK(limiter.Tracked(now + 400ms) == 2);
+  CHECK(limiter.Tracked(now + 1s) == 1);
+  CHECK(limiter.Tracked(now + 2s) == 0);
+
+  auto headers = limiter.RefusedHeaders(refused);
+  CHECK(headers["RateLimit-Limit"] == "3");
+  CHECK(headers["RateLimit-Remaining"] == "0");
+  CHECK(headers["RateLimit-Reset"] == "2");
+  CHECK(headers["Retry-After"] == "1");
+
+  CHECK_THROWS(hs::internal::RateLimiter({.rate = 0}));
+  CHECK_THROWS(hs::internal::RateLimiter({.key = hs::RateLimitKey::Header}));
+}
+TEST_CASE("bounded table") {
+  hs::internal::RateLimiter limiter({.rate = 1, .burst = 1, .max_keys = 8});
+  auto now = Clock::now();
+  for (int i = 0; i < 1000; ++i) {
+    CHECK(limiter.Check(fmt::format("client-{}", i), now).allowed);
+  }
+  CHECK(limiter.Tracked(now) == 8);
+  // Refilled keys give their slots to new ones.
+  auto later = now + 1s;
+  CHECK(limiter.Tracked(later) == 0);
+  CHECK(limiter.Check("new", later).allowed);
+  CHECK_FALSE(limiter.Check("new", later).allowed);
+}
+TEST_CASE("keys and routes") {
+  auto request = std::make_shared<hs::internal::RequestImpl>();
+  request->headers["X-Api-Key"] = "secret";
+  request->path_params = {"42"};
+  std::string storage;
+  hs::internal::RateLimiter by_header(
+      {.key = hs::RateLimitKey::Header, .header = "X-Api-Key"});
+  CHECK(by_header.Key(*request, storage) == "secret");
+  // Field names match in any case.
+  hs::internal::RateLimiter by_lowercase(
+      {.key = hs::RateLimitKey::Header, .header = "x-api-key"});
+  CHECK(by_lowercase.Key(*request, storage) == "secret");
+  hs::internal::RateLimiter by_param(
+      {.key = hs::RateLimitKey::PathParam, .path_param = 1});
+  CHECK_FALSE(by_param.Key(*request, storage));
+  hs::internal::RateLimiter by_address({});
+  CHECK_FALSE(by_address.Key(*request, storage));
+
+  hs::Config config("test", "localhost", 0);
+  config.rate_limits = {{.key = hs::RateLimitKey::PathParam,
+                         .rate = 1,
+                         .burst = 1,
+                         .routes = {"/users/:id"}}};
+  hs::internal::AdmissionController admission(config);
+  TestRoute users("/users/:id");
+  TestRoute other("/other/:id");
+  CHECK_FALSE(admission.RateLimited(users, *request));
+  auto headers = admission.RateLimited(users, *request);
+  REQUIRE(headers);
+  CHECK(headers->at("RateLimit-Limit") == "1");
+  CHECK(headers->contains("Retry-After"));
+  CHECK_FALSE(admission.RateLimited(other, *request));
+  request->path_params = {"7"};
+  CHECK_FALSE(admission.RateLimited(users, *request));
+}
+TEST_SUITE_END();
@@ -72,6 +72,33 @@ TEST_CASE("router") {
       CHECK(route->GetPath() == "/api/v1/users/address");
       REQUIRE(params.empty());
     }
+    SUBCASE("replace") {
+      auto replacement = std::make_shared<TestRoute>();
+      router.AddRoute(replacement);
+      auto match = router.Match(request);
+      REQUIRE(match != std::nullopt);
+      CHECK(match->first == replacement);
+    }
+    SUBCASE("remove") {
+      request->path = "/api/v1/users/address";
+      auto before = router.Match(request);
+      CHECK(router.RemoveRoute(hs::Method::GET, "/api/v1/users/address"));
+      CHECK_FALSE(router.RemoveRoute(hs::Method::GET, "/api/v1/users/address"));
+      CHECK_FALSE(router.RemoveRoute(hs::Method::POST, "/api/v1/users"));
+      // Falls back to the parent, with the rest as a param.
+      auto match = router.Match(request);
+      REQUIRE(match != std::nullopt);
+      CHECK(match->first == test_route);
+      // Matches made before the change keep their route.
+      REQUIRE(before != std::nullopt);
+      CHECK(before->first == test_route_child);
+    }
+    SUBCASE("replace all") {
+      router.ReplaceRoutes({test_route_child});
+      CHECK(router.Match(request) == std::nullopt);
+      request->path = "/api/v1/users/address";
+      CHECK(router.Match(request) != std::nullopt);
+    }
   }
 }
 TEST_SUITE_END();
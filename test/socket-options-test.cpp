@@ -0,0 +1,43 @@
+#include "http-server/internal/socket-options.h"
+
+#include <doctest/doctest.h>
+
+#include <asio/connect.hpp>
+#include <asio/io_context.hpp>
+#include <filesystem>
+
+TEST_SUITE_BEGIN("socket-options");
+TEST_CASE("tcp") {
+  asio::io_context io_context;
+  hs::Config config("test", "127.0.0.1", 0);
+  config.socket_options.receive_buffer_size = 64 * 1024;
+  auto acceptor = hs::internal::OpenTcpAcceptor(io_context, config);
+  auto endpoint = acceptor.local_endpoint();
+  CHECK(endpoint.address().is_v4());
+  CHECK(endpoint.port() != 0);
+
+  asio::ip::tcp::socket client(io_context);
+  client.connect(endpoint);
+  auto socket = acceptor.accept();
+  hs::internal::ConfigureConnection(socket, config.socket_options);
+  asio::ip::tcp::no_delay no_delay;
+  socket.get_option(no_delay);
+  CHECK(no_delay.value());
+  asio::socket_base::receive_buffer_size size;
+  socket.get_option(size);
+  CHECK(size.value() >= 64 * 1024);
+}
+TEST_CASE("unix") {
+  asio::io_context io_context;
+  hs::Config config("test", "", 0);
+  config.unix_socket_path =
+      (std::filesystem::temp_directory_path() / "http-server-test.sock")
+          .string();
+  auto acceptor = hs::internal::OpenUnixAcceptor(io_context, config);
+  asio::local::stream_protocol::socket client(io_context);
+  client.connect(config.unix_socket_path);
+  auto socket = acceptor.accept();
+  CHECK(socket.is_open());
+  std::filesystem::remove(config.unix_socket_path);
+}
+TEST_SUITE_END();
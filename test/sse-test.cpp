@@ -0,0 +1,166 @@
+#include "http-server/sse.h"
+
+#include <doctest/doctest.h>
+
+#include <asio/error.hpp>
+#include <asio/io_context.hpp>
+#include <asio/local/stream_protocol.hpp>
+#include <asio/read.hpp>
+#include <asio/read_until.hpp>
+#include <asio/write.hpp>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "http-server/http-server.h"
+#include "http-server/internal/spawn.h"
+#include "http-server/internal/sse.h"
+
+namespace {
+struct EventsRoute : public hs::Route {
+  EventsRoute(hs::Broadcaster::Ptr broadcaster)
+      : broadcaster(std::move(broadcaster)) {}
+  hs::Method GetMethod() const override { return hs::Method::GET; }
+  std::string GetPath() const override { return "/events"; }
+  hs::Handler::Ptr GetHandler() const override {
+    return std::make_shared<hs::SseHandler>(broadcaster);
+  }
+  bool Unmetered() const override { return true; }
+  hs::Broadcaster::Ptr broadcaster;
+};
+
+// Serves the event stream on a Unix socket with two io threads; the
+// broadcaster delivers on the acceptor's io_context, run by thread.
+struct EventServer {
+  EventServer() {
+    config.unix_socket_path =
+        (std::filesystem::temp_directory_path() / "http-server-sse-test.sock")
+            .string();
+    config.io_threads = 2;
+    server = std::make_shared<hs::HttpServer>(config);
+    server->AddRoute(std::make_shared<EventsRoute>(broadcaster));
+    hs::internal::Spawn(server->ServeAsync(io_context));
+    thread = std::thread([this]() { io_context.run(); });
+  }
+  ~EventServer() {
+    io_context.stop();
+    thread.join();
+    std::filesystem::remove(config.unix_socket_path);
+  }
+  // Connects a client and reads the response head of its event stream.
+  asio::local::stream_protocol::socket Subscribe(std::string &received) {
+    asio::local::stream_protocol::socket client(client_context);
+    client.connect(config.unix_socket_path);
+    std::string request = "GET /events HTTP/1.1\r\nHost: test\r\n\r\n";
+    asio::write(client, asio::buffer(request));
+    asio::read_until(client, asio::dynamic_buffer(received), "\r\n\r\n");
+    return client;
+  }
+  void WaitForSubscribers(size_t count) {
+    while (broadcaster->Subscribers() < count) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  hs::Config config{"test", "", 0};
+  asio::io_context io_context;
+  asio::io_context client_context;
+  hs::Broadcaster::Ptr broadcaster =
+      std::make_shared<hs::Broadcaster>(io_context);
+  hs::HttpServer::Ptr server;
+  std::thread thread;
+};
+}  // namespace
+
+TEST_SUITE_BEGIN("sse");
+TEST_CASE("event format") {
+  CHECK(hs::FormatSseEvent({.data = "hello"}) == "data: hello\n\n");
+  CHECK(hs::FormatSseEvent({.data = "a\nb\r\nc",
+                            .event = "update",
+                            .id = "7",
+                            .retry = std::chrono::milliseconds(1500)}) ==
+        "event: update\nid: 7\nretry: 1500\ndata: a\ndata: b\ndata: c\n\n");
+  CHECK(hs::FormatSseEvent({}) == "data: \n\n");
+}
+TEST_CASE("fan out") {
+  asio::io_context io_context;
+  auto body = hs::SseBody({.data = "x"});
+  SUBCASE("shares one buffer") {
+    auto broadcaster = std::make_shared<hs::internal::BroadcasterImpl>(
+        io_context, 4, hs::SlowConsumerPolicy::DropOldest);
+    auto first = broadcaster->Subscribe();
+    auto second = broadcaster->Subscribe();
+    CHECK(broadcaster->SubscriberCount() == 2);
+    broadcaster->Fanout(body);
+    REQUIRE(first->queue.size() == 1);
+    REQUIRE(second->queue.size() == 1);
+    CHECK(first->queue.front() == second->queue.front());
+    broadcaster->Unsubscribe(first);
+    CHECK(broadcaster->SubscriberCount() == 1);
+  }
+  SUBCASE("drop oldest") {
+    auto broadcaster = std::make_shared<hs::internal::BroadcasterImpl>(
+        io_context, 2, hs::SlowConsumerPolicy::DropOldest);
+    auto subscriber = broadcaster->Subscribe();
+    auto last = hs::SseBody({.data = "last"});
+    broadcaster->Fanout(body);
+    broadcaster->Fanout(body);
+    broadcaster->Fanout(last);
+    CHECK(subscriber->queue.size() == 2);
+    CHECK(subscriber->queue.back() == last);
+    CHECK(subscriber->dropped == 1);
+    CHECK_FALSE(subscriber->closed);
+  }
+  SUBCASE("disconnect") {
+    auto broadcaster = std::make_shared<hs::internal::BroadcasterImpl>(
+        io_context, 2, hs::SlowConsumerPolicy::Disconnect);
+    auto subscriber = broadcaster->Subscribe();
+    broadcaster->Fanout(body);
+    broadcaster->Fanout(body);
+    broadcaster->Fanout(body);
+    CHECK(subscriber->closed);
+    CHECK(subscriber->queue.empty());
+  }
+  SUBCASE("close") {
+    auto broadcaster = std::make_shared<hs::internal::BroadcasterImpl>(
+        io_context, 2, hs::SlowConsumerPolicy::DropOldest);
+    auto before = broadcaster->Subscribe();
+    broadcaster->CloseAll();
+    CHECK(before->closed);
+    CHECK(broadcaster->Subscribe()->closed);
+  }
+}
+TEST_CASE("subscribers on io threads") {
+  EventServer events;
+  std::vector<std::string> received(4);
+  std::vector<asio::local::stream_protocol::socket> clients;
+  for (auto &r : received) clients.push_back(events.Subscribe(r));
+  events.WaitForSubscribers(clients.size());
+  for (int i = 0; i < 100; ++i) {
+    events.broadcaster->Publish({.data = std::to_string(i)});
+  }
+  for (size_t i = 0; i < clients.size(); ++i) {
+    asio::read_until(clients[i], asio::dynamic_buffer(received[i]),
+                     "data: 99\n\n");
+    CHECK(received[i].find("HTTP/1.1 200") == 0);
+    CHECK(received[i].find("data: 0\n\ndata: 1\n\n") != std::string::npos);
+  }
+  clients.clear();
+}
+TEST_CASE("close ends the stream") {
+  EventServer events;
+  std::string received;
+  auto client = events.Subscribe(received);
+  CHECK(received.find("Connection: Close\r\n") != std::string::npos);
+  events.WaitForSubscribers(1);
+  events.broadcaster->Publish({.data = "last"});
+  events.broadcaster->Close();
+  asio::error_code error;
+  asio::read(client, asio::dynamic_buffer(received), error);
+  CHECK(error == asio::error::eof);
+  CHECK(received.ends_with("data: last\n\n"));
+}
+TEST_SUITE_END();
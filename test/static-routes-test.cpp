@@ -0,0 +1,162 @@
+#include "http-server/static-routes.h"
+
+#include <doctest/doctest.h>
+
+#include <chrono>
+#include <coro/sync_wait.hpp>
+#include <coro/task.hpp>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include "http-server/http-server.h"
+#include "http-server/internal/request-impl.h"
+#include "http-server/internal/static-index.h"
+
+namespace {
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+
+struct Tree {
+  fs::path root;
+  Tree() {
+    root = fs::temp_directory_path() /
+           ("static-test-" + std::to_string(testing_id++));
+    fs::remove_all(root);
+    fs::create_directories(root / "docs" / "img");
+    Write("index.html", "<p>home</p>");
+    Write("docs/a <b>.TXT", "alpha");
+    Write("docs/img/logo.png", "png");
+  }
+  ~Tree() { fs::remove_all(root); }
+  void Write(const std::string &path, const std::string &content) {
+    std::ofstream(root / path) << content;
+  }
+  static inline int testing_id = 0;
+};
+
+// Waits for the watcher thread to catch up.
+template <typename Fn>
+bool Eventually(Fn fn) {
+  for (int i = 0; i < 200 && !fn(); ++i) std::this_thread::sleep_for(10ms);
+  return fn();
+}
+
+struct Response {
+  hs::StatusCode status = hs::StatusCode::Ok;
+  hs::Headers headers;
+  std::string body;
+};
+
+coro::task<> Drain(coro::async_generator<hs::Response> gen, Response &out) {
+  for (auto it = co_await gen.begin(); it != gen.end(); co_await ++it) {
+    if (auto status = std::get_if<hs::StatusCode>(&*it)) {
+      out.status = *status;
+    } else if (auto headers = std::get_if<hs::Headers>(&*it)) {
+      out.headers = *headers;
+    } else {
+      auto &body = std::get<hs::ResponseBody::Ptr>(*it);
+      out.body.append(static_cast<const char *>(body->GetData()),
+                      body->GetSize());
+    }
+  }
+}
+
+Response Get(const hs::StaticRoute &route, std::string path,
+             std::vector<std::string> params, std::string accept = "") {
+  auto request = std::make_shared<hs::internal::RequestImpl>();
+  request->method = hs::Method::GET;
+  request->path = std::move(path);
+  request->path_params = std::move(params);
+  if (!accept.empty()) request->headers["Accept"] = accept;
+  Response out;
+  auto handler = route.GetHandler();
+  coro::sync_wait(Drain(handler->Handle(hs::Request(request)), out));
+  return out;
+}
+}  // namespace
+
+TEST_SUITE_BEGIN("static routes");
+TEST_CASE("content type") {
+  using hs::internal::ContentType;
+  CHECK(ContentType("a/b.CSS") == "text/css");
+  CHECK(ContentType("logo.svg") == "image/svg+xml");
+  CHECK(ContentType("v1.0/README") == "text/plain");
+  CHECK(ContentType("archive.tar.gz") == "application/gzip");
+}
+TEST_CASE("listing") {
+  std::vector<std::pair<std::string, hs::internal::StaticFile>> entries{
+      {"b\"", {.size = 3}}, {"a<dir>", {.directory = true}}};
+  auto json = hs::internal::RenderListing(entries, true);
+  CHECK(json ==
+        R"([{"name":"a<dir>","type":"directory","size":0},)"
+        R"({"name":"b\"","type":"file","size":3}])");
+  auto html = hs::internal::RenderListing(entries, false);
+  CHECK(html.find("<a href=\"./a%3Cdir%3E/\">a&lt;dir&gt;/</a>") !=
+        std::string::npos);
+  CHECK(html.find("b&quot;") < html.size());
+}
+TEST_CASE("index") {
+  Tree tree;
+  hs::internal::StaticIndex index(tree.root);
+  CHECK(index.Size() == 6);
+  CHECK(index.Find("")->directory);
+  auto file = index.Find("docs/a <b>.TXT");
+  REQUIRE(file);
+  CHECK(file->size == 5);
+  CHECK(file->content_type == "text/plain");
+  CHECK(!index.Find("docs/missing"));
+  auto listing = index.Listing("docs", true);
+  REQUIRE(listing);
+  CHECK(*listing ==
+        R"([{"name":"a <b>.TXT","type":"file","size":5},)"
+        R"({"name":"img","type":"directory","size":0}])");
+  CHECK(index.Listing("docs", true) == listing);
+  CHECK(!index.Listing("index.html", true));
+
+#ifdef __linux__
+  // Changes show up through inotify and drop the cached listing.
+  tree.Write("docs/new.css", "body{}");
+  auto found = [&](const char *path) {
+    return [&index, path]() { return index.Find(path).has_value(); };
+  };
+  CHECK(Eventually(found("docs/new.css")));
+  CHECK(Eventually([&]() { return index.Find("docs/new.css")->size == 6; }));
+  CHECK(index.Listing("docs", true)->find("new.css") != std::string::npos);
+  fs::create_directories(tree.root / "more" / "deep");
+  tree.Write("more/deep/x.js", "1");
+  CHECK(Eventually(found("more/deep/x.js")));
+  fs::rename(tree.root / "more", tree.root / "docs" / "moved");
+  CHECK(Eventually(found("docs/moved/deep/x.js")));
+  CHECK(!index.Find("more/deep"));
+  fs::remove_all(tree.root / "docs");
+  CHECK(Eventually([&]() { return !index.Find("docs"); }));
+  CHECK(index.Size() == 2);
+#endif
+}
+TEST_CASE("route") {
+  Tree tree;
+  hs::StaticRoute route("/", tree.root.string(),
+                        {.index = true, .list_directories = true});
+  auto response = Get(route, "/docs", {"docs"});
+  CHECK(response.status == hs::StatusCode::MovedPermanently);
+  CHECK(response.headers["Location"] == "/docs/");
+  response = Get(route, "/docs/", {"docs"}, "application/json");
+  CHECK(response.status == hs::StatusCode::Ok);
+  CHECK(response.headers["Content-Type"] == "application/json");
+  CHECK(response.body.starts_with(R"([{"name":"a <b>.TXT")"));
+  response = Get(route, "/docs/img/", {"docs", "img"});
+  CHECK(response.headers["Content-Type"] == "text/html");
+  CHECK(response.body.find("./logo.png") != std::string::npos);
+  std::vector<std::string> missing{"docs", "x"};
+  CHECK_THROWS_AS(Get(route, "/docs/x", missing), hs::Exception);
+
+  hs::StaticRoute unlisted("/", tree.root.string(), {.index = true});
+  std::vector<std::string> docs{"docs"};
+  CHECK_THROWS_AS(Get(unlisted, "/docs/", docs), hs::Exception);
+}
+TEST_SUITE_END();
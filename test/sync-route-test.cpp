@@ -0,0 +1,41 @@
+#include "http-server/sync-route.h"
+
+#include <doctest/doctest.h>
+
+#include <string>
+#include <string_view>
+
+#include "http-server/internal/sync-route.h"
+
+TEST_SUITE_BEGIN("sync-route");
+TEST_CASE("body") {
+  static constexpr std::string_view kOk = "ok";
+  hs::SimpleBody view(kOk);
+  CHECK(view.View().data() == kOk.data());
+  auto body = std::move(view).Release();
+  CHECK(body->GetData() == kOk.data());
+  CHECK(body->GetSize() == 2);
+
+  hs::SimpleBody owned(std::string("{}"));
+  CHECK(owned.View() == "{}");
+  CHECK(std::move(owned).Release()->GetSize() == 2);
+}
+TEST_CASE("head") {
+  hs::SimpleResponse response{
+      .headers = {{"Content-Type", "application/json"}},
+      .body = "{\"status\":\"up\"}",
+  };
+  CHECK(hs::internal::SerializeHead(hs::Version::HTTP_1_1, response, true) ==
+        "HTTP/1.1 200 Ok\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: 15\r\n"
+        "Connection: Keep-Alive\r\n\r\n");
+  response.status = hs::StatusCode::NotFound;
+  response.headers.clear();
+  response.body = {};
+  CHECK(hs::internal::SerializeHead(hs::Version::HTTP_1_1, response, false) ==
+        "HTTP/1.1 404 NotFound\r\n"
+        "Content-Length: 0\r\n"
+        "Connection: Close\r\n\r\n");
+}
+TEST_SUITE_END();
@@ -0,0 +1,129 @@
+#include "http-server/trace.h"
+
+#include <doctest/doctest.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "http-server/http-server.h"
+#include "http-server/internal/request-impl.h"
+#include "http-server/internal/trace.h"
+#include "http-server/route.h"
+
+namespace {
+struct Collector : hs::TraceExporter {
+  std::vector<hs::TraceSpan> spans;
+  void Export(const hs::TraceSpan &span) override { spans.push_back(span); }
+};
+
+struct UsersRoute : hs::Route {
+  hs::Method GetMethod() const override { return hs::Method::GET; }
+  std::string GetPath() const override { return "/users/{id}"; }
+  hs::Handler::Ptr GetHandler() const override { return nullptr; }
+};
+
+// A request to route that spent duration in its handler.
+hs::internal::RequestImpl Traced(hs::internal::Tracer &tracer,
+                                 std::chrono::milliseconds duration,
+                                 hs::Route::Ptr route) {
+  hs::internal::RequestImpl request;
+  request.method = hs::Method::GET;
+  request.path = "/users/1";
+  request.trace.received = hs::internal::RequestTrace::Clock::now();
+  request.trace.parsed = request.trace.received;
+  tracer.Start(request, std::nullopt, std::nullopt);
+  request.trace.route = std::move(route);
+  request.trace.Mark(hs::TracePhase::Route);
+  request.trace.mark -= duration;
+  request.trace.Mark(hs::TracePhase::Handler);
+  return request;
+}
+}  // namespace
+
+TEST_SUITE_BEGIN("trace");
+TEST_CASE("traceparent") {
+  using hs::internal::ParseTraceParent;
+  auto parent = ParseTraceParent(
+      "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01");
+  REQUIRE(parent);
+  CHECK(parent->trace_id == "4bf92f3577b34da6a3ce929d0e0e4736");
+  CHECK(parent->parent_id == "00f067aa0ba902b7");
+  CHECK(parent->flags == 1);
+  CHECK(ParseTraceParent(
+      "01-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01-later"));
+  CHECK(!ParseTraceParent(
+      "00-00000000000000000000000000000000-00f067aa0ba902b7-01"));
+  CHECK(!ParseTraceParent(
+      "00-4BF92F3577B34DA6A3CE929D0E0E4736-00f067aa0ba902b7-01"));
+  CHECK(!ParseTraceParent(
+      "ff-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01"));
+  CHECK(!ParseTraceParent("00-4bf92f3577b34da6a3ce929d0e0e4736"));
+}
+TEST_CASE("propagation") {
+  hs::Config config("test", "", 0);
+  hs::internal::Tracer tracer(config);
+  hs::internal::RequestImpl request;
+  request.headers["traceparent"] =
+      "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01";
+  tracer.Start(request, std::nullopt, std::nullopt);
+  CHECK(request.trace.trace_id == "4bf92f3577b34da6a3ce929d0e0e4736");
+  CHECK(request.trace.parent_span_id == "00f067aa0ba902b7");
+  CHECK(request.trace.span_id.size() == 16);
+  // Handlers see this request's span as the parent of their calls.
+  CHECK(request.headers["traceparent"] ==
+        "00-4bf92f3577b34da6a3ce929d0e0e4736-" + request.trace.span_id +
+            "-01");
+
+  hs::internal::RequestImpl fresh;
+  tracer.Start(fresh, std::nullopt, std::nullopt);
+  CHECK(fresh.trace.trace_id.size() == 32);
+  CHECK(fresh.trace.parent_span_id.empty());
+  CHECK(fresh.headers.contains("traceparent"));
+}
+TEST_CASE("tail sampling") {
+  hs::Config config("test", "", 0);
+  config.trace_slow_threshold = std::chrono::milliseconds(50);
+  hs::internal::Tracer tracer(config);
+  auto collector = std::make_shared<Collector>();
+  tracer.SetExporter(collector);
+  auto route = std::make_shared<UsersRoute>();
+
+  auto fast = Traced(tracer, std::chrono::milliseconds(1), route);
+  tracer.Finish(fast);
+  CHECK(collector->spans.empty());
+
+  auto slow = Traced(tracer, std::chrono::milliseconds(80), route);
+  tracer.Finish(slow);
+  REQUIRE(collector->spans.size() == 1);
+  auto &span = collector->spans[0];
+  CHECK(span.route == "/users/{id}");
+  CHECK(span.path == "/users/1");
+  CHECK(span.duration >= std::chrono::milliseconds(80));
+  CHECK(span.phases[static_cast<size_t>(hs::TracePhase::Handler)] >=
+        std::chrono::milliseconds(80));
+
+  auto failed = Traced(tracer, std::chrono::milliseconds(1), route);
+  failed.trace.status = hs::StatusCode::InternalServerError;
+  tracer.Finish(failed);
+  CHECK(collector->spans.size() == 2);
+
+  auto unmatched = Traced(tracer, std::chrono::milliseconds(1), nullptr);
+  tracer.Finish(unmatched);
+  // Finished on another thread, into another shard.
+  std::thread([&]() {
+    auto other = Traced(tracer, std::chrono::milliseconds(1), route);
+    tracer.Finish(other);
+  }).join();
+
+  auto breakdown = tracer.Breakdown();
+  auto line = breakdown.find("GET /users/{id};handler ");
+  CHECK(line != std::string::npos);
+  // The shards' stats are merged into one line per route and phase.
+  CHECK(breakdown.find("GET /users/{id};handler ", line + 1) ==
+        std::string::npos);
+  CHECK(breakdown.find("GET <unmatched>;handler ") != std::string::npos);
+}
+TEST_SUITE_END();
@@ -0,0 +1,120 @@
+#include "http-server/typed-route.h"
+
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+
+#include <coro/sync_wait.hpp>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "http-server/internal/request-impl.h"
+#include "http-server/internal/route.h"
+
+namespace {
+hs::SimpleResponse Post(const hs::Request &, int id, std::string_view slug) {
+  return {.body = fmt::format("{}:{}", id, slug)};
+}
+coro::async_generator<hs::Response> File(hs::Request, std::string_view name) {
+  co_yield hs::StatusCode::Ok;
+}
+// Reads the request after its first suspension.
+coro::async_generator<hs::Response> Echo(const hs::Request &req,
+                                         std::string_view) {
+  co_yield hs::StatusCode::Ok;
+  co_yield std::make_shared<hs::WritableResponseBody<std::string>>(
+      std::string(req.Path()));
+}
+
+typedef hs::TypedRoute<hs::Method::GET, "/users/{id:int}/posts/{slug}", Post>
+    PostRoute;
+typedef hs::TypedRoute<hs::Method::GET, "/files/{name:str}", File> FileRoute;
+typedef hs::TypedRoute<hs::Method::GET, "/echo/{name}", Echo> EchoRoute;
+typedef hs::TypedRoute<hs::Method::GET, "/", [](const hs::Request &) {
+  return hs::SimpleResponse{.body = "root"};
+}> RootRoute;
+
+static_assert(std::is_same_v<PostRoute::Path::Params,
+                             std::tuple<int, std::string_view>>);
+static_assert(PostRoute::Path::kSegments == 4);
+static_assert(RootRoute::Path::kParams == 0);
+static_assert(std::is_base_of_v<hs::SyncRoute, PostRoute>);
+static_assert(!std::is_base_of_v<hs::SyncRoute, FileRoute>);
+
+std::shared_ptr<hs::internal::RequestImpl> Get(std::string path) {
+  auto request = std::make_shared<hs::internal::RequestImpl>();
+  request->method = hs::Method::GET;
+  request->path = std::move(path);
+  return request;
+}
+
+coro::task<> Drain(coro::async_generator<hs::Response> gen,
+                   std::vector<hs::Response> &out) {
+  for (auto it = co_await gen.begin(); it != gen.end(); co_await ++it) {
+    out.push_back(*it);
+  }
+}
+}  // namespace
+
+TEST_SUITE_BEGIN("typed routes");
+TEST_CASE("match") {
+  auto params = PostRoute::Path::Match("/users/42/posts/hello/");
+  REQUIRE(params);
+  CHECK(std::get<0>(*params) == 42);
+  CHECK(std::get<1>(*params) == "hello");
+  CHECK(!PostRoute::Path::Match("/users/x/posts/hello"));
+  CHECK(!PostRoute::Path::Match("/users/42/comments/hello"));
+  CHECK(!PostRoute::Path::Match("/users/42/posts"));
+  CHECK(!PostRoute::Path::Match("/users/42/posts/hello/more"));
+  CHECK(!PostRoute::Path::Match("/users/42/posts//"));
+  CHECK(RootRoute::Path::Match("/"));
+  CHECK(!RootRoute::Path::Match("/a"));
+}
+TEST_CASE("respond") {
+  PostRoute route;
+  CHECK(route.GetPath() == "/users/{id:int}/posts/{slug}");
+  auto response = route.Respond(hs::Request(Get("/users/7/posts/intro")));
+  CHECK(response.body.View() == "7:intro");
+}
+TEST_CASE("stream") {
+  EchoRoute route;
+  std::vector<hs::Response> out;
+  // Echo refers to the handler's own copy of the request.
+  coro::sync_wait(
+      Drain(route.GetHandler()->Handle(hs::Request(Get("/echo/a"))), out));
+  REQUIRE(out.size() == 2);
+  auto &body = std::get<hs::ResponseBody::Ptr>(out[1]);
+  CHECK(std::string_view(static_cast<const char *>(body->GetData()),
+                         body->GetSize()) == "/echo/a");
+}
+TEST_CASE("table") {
+  auto table = std::make_shared<hs::CompiledRoutes<PostRoute, FileRoute,
+                                                   RootRoute>>();
+  std::vector<std::string> params;
+  CHECK(table->Match(hs::Method::GET, "/files/a.txt", params)->GetPath() ==
+        "/files/{name:str}");
+  CHECK(params == std::vector<std::string>{"a.txt"});
+  CHECK(table->Match(hs::Method::GET, "/", params)->GetPath() == "/");
+  CHECK(params.empty());
+  CHECK(!table->Match(hs::Method::POST, "/", params));
+  CHECK(!table->Match(hs::Method::GET, "/users/me/posts/a", params));
+
+  // The table goes first; the tree takes what it doesn't match.
+  hs::internal::Router router;
+  router.SetTable(table);
+  auto request = Get("/users/1/posts/a");
+  auto match = router.Match(request);
+  REQUIRE(match);
+  CHECK(match->first->GetPath() == "/users/{id:int}/posts/{slug}");
+  // Params for rate limits keyed on them, and for the route not to parse
+  // the path again.
+  CHECK(match->second == std::vector<std::string>{"1", "a"});
+  request->path_params = std::move(match->second);
+  auto response = PostRoute().Respond(hs::Request(request));
+  CHECK(response.body.View() == "1:a");
+  CHECK(!router.Match(Get("/users/1")));
+}
+TEST_SUITE_END();
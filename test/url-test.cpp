@@ -0,0 +1,67 @@
+#include "http-server/internal/url.h"
+
+#include <doctest/doctest.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "http-server/http-server.h"
+#include "http-server/internal/request-impl.h"
+#include "http-server/request.h"
+
+TEST_SUITE_BEGIN("url");
+TEST_CASE("percent decode") {
+  std::string storage;
+  std::string_view plain = "/a/plain/path/without/escapes";
+  auto decoded = hs::internal::PercentDecode(plain, storage, true);
+  CHECK(decoded.data() == plain.data());
+  CHECK(storage.empty());
+
+  CHECK(hs::internal::PercentDecode("a%20b+c", storage, true) == "a b c");
+  CHECK(hs::internal::PercentDecode("a%20b+c", storage, false) == "a b+c");
+  CHECK(hs::internal::PercentDecode("%e2%9C%93", storage, false) == "✓");
+  CHECK(hs::internal::PercentDecode("100%", storage, false) == "100%");
+  CHECK(hs::internal::PercentDecode("%zz%4", storage, false) == "%zz%4");
+  CHECK(hs::internal::FindEscape("abcdefghijklmnop%", false) == 16);
+  CHECK(hs::internal::FindEscape("abcdefghijklmnop+", false) ==
+        std::string_view::npos);
+}
+TEST_CASE("normalize path") {
+  CHECK(hs::internal::NormalizePath("/") == "/");
+  CHECK(hs::internal::NormalizePath("//a///b") == "/a/b");
+  CHECK(hs::internal::NormalizePath("/a/./b/") == "/a/b/");
+  CHECK(hs::internal::NormalizePath("/a/b/../c") == "/a/c");
+  CHECK(hs::internal::NormalizePath("/../../etc/passwd") == "/etc/passwd");
+  CHECK(hs::internal::NormalizePath("/a/..") == "/");
+}
+TEST_CASE("target") {
+  hs::internal::RequestImpl impl;
+  hs::internal::ParseTarget("/static/%2e%2e/%2E%2E/secret?x=1", impl);
+  CHECK(impl.path == "/secret");
+  CHECK(impl.query == "x=1");
+  hs::internal::ParseTarget("http://example.com/a?b", impl);
+  CHECK(impl.path == "/a");
+  CHECK(impl.query == "b");
+  CHECK_THROWS_AS(hs::internal::ParseTarget("a/b", impl), hs::Exception);
+  CHECK_THROWS_AS(hs::internal::ParseTarget("/a%00b", impl), hs::Exception);
+}
+TEST_CASE("query params") {
+  auto impl = std::make_shared<hs::internal::RequestImpl>();
+  hs::internal::ParseTarget("/search?q=a+b%21&flag&&tag=x&tag=y&e=", *impl);
+  CHECK(!impl->query_params);
+  hs::Request req(impl);
+  CHECK(req.QueryParam("q") == "a b!");
+  CHECK(req.QueryParam("flag") == "");
+  CHECK(req.QueryParam("e") == "");
+  CHECK(req.QueryParam("tag") == "x");
+  CHECK(req.QueryParams("tag") == std::vector<std::string_view>{"x", "y"});
+  CHECK(!req.QueryParam("missing"));
+  CHECK(req.QueryParams("missing").empty());
+  // Values without escapes point into the raw query.
+  auto tag = *req.QueryParam("tag");
+  CHECK(tag.data() >= impl->query.data());
+  CHECK(tag.data() < impl->query.data() + impl->query.size());
+}
+TEST_SUITE_END();
@@ -0,0 +1,214 @@
+#include "http-server/internal/websocket-frame.h"
+
+#include <doctest/doctest.h>
+
+#include <asio/io_context.hpp>
+#include <asio/local/connect_pair.hpp>
+#include <asio/local/stream_protocol.hpp>
+#include <asio/read.hpp>
+#include <asio/write.hpp>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "http-server/http-server.h"
+#include "http-server/internal/request-impl.h"
+#include "http-server/internal/spawn.h"
+#include "http-server/internal/stream.h"
+#include "http-server/internal/websocket.h"
+#include "http-server/internal/worker-pool.h"
+#include "http-server/offload.h"
+
+namespace {
+using namespace hs::internal;
+
+// Takes one message and holds on to it well past the pong timeout.
+struct SlowHandler : public hs::WebSocketHandler {
+  coro::task<> Handle(const hs::Request, hs::WebSocket ws) override {
+    auto messages = ws.Receive();
+    auto it = co_await messages.begin();
+    if (it == messages.end()) co_return;
+    std::string message((*it).data);
+    co_await hs::sleep_for(std::chrono::milliseconds(300));
+    co_await ws.Send(message);
+  }
+};
+
+// A client frame; the zero mask leaves the payload as it is.
+std::string ClientFrame(WebSocketOpcode opcode, std::string_view payload) {
+  std::string frame;
+  frame.push_back(static_cast<char>(0x80 | static_cast<uint8_t>(opcode)));
+  frame.push_back(static_cast<char>(0x80 | payload.size()));
+  frame.append(4, '\0');
+  frame.append(payload);
+  return frame;
+}
+
+// What a client saw of one connection served by SlowHandler.
+struct Peer {
+  int pings = 0;
+  std::optional<std::string> echoed;
+  // The server's close payload, unset when the connection just ended.
+  std::optional<std::string> close;
+};
+
+// Serves a connection with a 20 ms ping interval and 50 ms pong timeout.
+// The client writes frames, then answers the server's pings if
+// answer_pings and its close frame.
+Peer Talk(std::string frames, bool answer_pings) {
+  asio::io_context io_context;
+  SetIoExecutor(io_context.get_executor());
+  asio::local::stream_protocol::socket server(io_context);
+  asio::local::stream_protocol::socket client(io_context);
+  asio::local::connect_pair(server, client);
+
+  hs::Config config("test", "localhost", 0);
+  config.websocket_ping_interval = std::chrono::milliseconds(20);
+  config.websocket_pong_timeout = std::chrono::milliseconds(50);
+  auto websocket = std::make_shared<WebSocketImpl>(
+      std::make_shared<Stream>(std::move(server)), config, false);
+
+  Peer peer;
+  std::thread thread([&]() {
+    asio::write(client, asio::buffer(frames));
+    asio::error_code error;
+    while (!peer.close) {
+      std::string header(2, '\0');
+      asio::read(client, asio::buffer(header), error);
+      if (error) break;
+      header.resize(WebSocketHeaderSize(header));
+      asio::read(client, asio::buffer(header.data() + 2, header.size() - 2),
+                 error);
+      if (error) break;
+      auto frame = ParseWebSocketFrameHeader(header);
+      std::string payload(frame->length, '\0');
+      asio::read(client, asio::buffer(payload), error);
+      if (error) break;
+      std::string reply;
+      switch (frame->opcode) {
+        case WebSocketOpcode::Ping:
+          ++peer.pings;
+          if (answer_pings) reply = ClientFrame(WebSocketOpcode::Pong, payload);
+          break;
+        case WebSocketOpcode::Text:
+          peer.echoed = payload;
+          break;
+        case WebSocketOpcode::Close:
+          peer.close = payload;
+          reply = ClientFrame(WebSocketOpcode::Close, payload);
+          break;
+        default:
+          break;
+      }
+      if (!reply.empty()) asio::write(client, asio::buffer(reply), error);
+    }
+    client.close();
+  });
+  auto request = std::make_shared<RequestImpl>();
+  Spawn(websocket->Run(std::make_shared<SlowHandler>(), request));
+  io_context.run();
+  thread.join();
+  return peer;
+}
+}  // namespace
+
+TEST_SUITE_BEGIN("websocket");
+TEST_CASE("accept key") {
+  CHECK(hs::internal::WebSocketAcceptKey("dGhlIHNhbXBsZSBub25jZQ==") ==
+        "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+}
+TEST_CASE("frame header") {
+  SUBCASE("masked text frame") {
+    std::string frame = "\x81\x85\x37\xfa\x21\x3d\x7f\x9f\x4d\x51\x58";
+    auto header = hs::internal::ParseWebSocketFrameHeader(frame);
+    REQUIRE(header.has_value());
+    CHECK(header->fin);
+    CHECK(header->opcode == hs::internal::WebSocketOpcode::Text);
+    CHECK(header->masked);
+    CHECK(header->length == 5);
+    CHECK(header->header_size == 6);
+    hs::internal::ApplyMask(frame.data() + header->header_size,
+                            header->length, header->mask);
+    CHECK(frame.substr(header->header_size) == "Hello");
+  }
+  SUBCASE("incomplete header") {
+    std::string frame = "\x82\xfe\x01";
+    CHECK(hs::internal::WebSocketHeaderSize(frame) == 8);
+    CHECK_FALSE(hs::internal::ParseWebSocketFrameHeader(frame).has_value());
+  }
+  SUBCASE("round trip extended lengths") {
+    for (size_t size : {125, 126, 65535, 65536}) {
+      std::string frame;
+      hs::internal::AppendWebSocketFrame(
+          true, false, hs::internal::WebSocketOpcode::Binary,
+          std::string(size, 'x'), frame);
+      auto header = hs::internal::ParseWebSocketFrameHeader(frame);
+      REQUIRE(header.has_value());
+      CHECK(header->length == size);
+      CHECK_FALSE(header->masked);
+      CHECK(frame.size() == header->header_size + size);
+    }
+  }
+}
+TEST_CASE("close code") {
+  CHECK(IsValidCloseCode(1000));
+  CHECK(IsValidCloseCode(1011));
+  CHECK(IsValidCloseCode(3000));
+  CHECK(IsValidCloseCode(4999));
+  CHECK(!IsValidCloseCode(999));
+  CHECK(!IsValidCloseCode(1004));
+  CHECK(!IsValidCloseCode(1005));
+  CHECK(!IsValidCloseCode(1006));
+  CHECK(!IsValidCloseCode(1015));
+  CHECK(!IsValidCloseCode(2999));
+  CHECK(!IsValidCloseCode(5000));
+}
+TEST_CASE("mask") {
+  std::array<uint8_t, 4> mask{0x12, 0x34, 0x56, 0x78};
+  for (size_t size : {0, 3, 8, 15, 16, 31, 33, 100}) {
+    std::string data;
+    for (size_t i = 0; i < size; ++i) data.push_back(static_cast<char>(i));
+    std::string masked = data;
+    hs::internal::ApplyMask(masked.data(), masked.size(), mask);
+    for (size_t i = 0; i < size; ++i) {
+      CHECK(masked[i] == static_cast<char>(data[i] ^ mask[i % 4]));
+    }
+    hs::internal::ApplyMask(masked.data(), masked.size(), mask);
+    CHECK(masked == data);
+  }
+}
+TEST_CASE("slow receiver") {
+  SUBCASE("keeps a live peer") {
+    auto peer = Talk(ClientFrame(WebSocketOpcode::Text, "hello"), true);
+    CHECK(peer.pings > 1);
+    CHECK(peer.echoed == "hello");
+    CHECK(peer.close == std::string("\x03\xe8", 2));
+  }
+  SUBCASE("still drops a dead one") {
+    auto peer = Talk(ClientFrame(WebSocketOpcode::Text, "hello"), false);
+    CHECK(peer.pings == 1);
+    CHECK(!peer.echoed);
+    CHECK(!peer.close);
+  }
+}
+TEST_CASE("peer close") {
+  SUBCASE("without a code") {
+    auto peer = Talk(ClientFrame(WebSocketOpcode::Close, ""), true);
+    CHECK(peer.close == std::string("\x03\xe8", 2));
+  }
+  SUBCASE("with a code") {
+    auto peer =
+        Talk(ClientFrame(WebSocketOpcode::Close, std::string("\x0f\xa0", 2)),
+             true);
+    CHECK(peer.close == std::string("\x0f\xa0", 2));
+  }
+  SUBCASE("with a code not for the wire") {
+    auto peer =
+        Talk(ClientFrame(WebSocketOpcode::Close, std::string("\x03\xed", 2)),
+             true);
+    CHECK(peer.close == std::string("\x03\xeaInvalid close code"));
+  }
+}
+TEST_SUITE_END();
@@ -0,0 +1,49 @@
+#include "http-server/internal/worker-pool.h"
+
+#include <doctest/doctest.h>
+
+#include <atomic>
+#include <latch>
+#include <mutex>
+#include <set>
+#include <thread>
+
+TEST_SUITE_BEGIN("worker pool");
+TEST_CASE("runs every task") {
+  hs::internal::WorkerPool pool(4);
+  CHECK(pool.Size() == 4);
+  constexpr int kTasks = 1000;
+  std::atomic<int> count = 0;
+  std::latch done(kTasks);
+  for (int i = 0; i < kTasks; ++i) {
+    pool.Submit([&]() {
+      ++count;
+      done.count_down();
+    });
+  }
+  done.wait();
+  CHECK(count == kTasks);
+}
+TEST_CASE("idle workers steal") {
+  hs::internal::WorkerPool pool(4);
+  constexpr int kTasks = 64;
+  std::mutex mutex;
+  std::set<std::thread::id> threads;
+  std::latch done(kTasks);
+  // All tasks land on the submitting worker's queue.
+  pool.Submit([&]() {
+    for (int i = 0; i < kTasks; ++i) {
+      pool.Submit([&]() {
+        {
+          std::lock_guard lock(mutex);
+          threads.insert(std::this_thread::get_id());
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        done.count_down();
+      });
+    }
+  });
+  done.wait();
+  CHECK(threads.size() > 1);
+}
+TEST_SUITE_END();